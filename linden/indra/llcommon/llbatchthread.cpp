@@ -0,0 +1,90 @@
+/** 
+ * @file llbatchthread.cpp
+ * @brief Runs a batch of independent jobs in parallel and waits for them
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include "llbatchthread.h"
+
+//----------------------------------------------------------------------------
+
+// MAIN THREAD
+LLBatchThread::LLBatchThread(const std::string& name, bool threaded, LLThreadPool* pool)
+	: LLQueuedThread(name, threaded, pool)
+{
+}
+
+// MAIN THREAD
+void LLBatchThread::runJobs(const job_list_t& jobs)
+{
+	update(0); // unpause, so adding each job wakes a thread for it
+
+	std::vector<handle_t> handles;
+	handles.reserve(jobs.size());
+	for (job_list_t::const_iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+	{
+		handle_t handle = generateHandle();
+		if (!addRequest(new JobRequest(handle, PRIORITY_HIGH, *iter)))
+		{
+			llerrs << "request added after LLBatchThread::shutdown()" << llendl;
+		}
+		handles.push_back(handle);
+	}
+
+	// Help out until the queue is empty, then wait for the jobs still
+	// running on other threads.
+	while (processNextRequest() > 0)
+	{
+	}
+	for (std::vector<handle_t>::iterator iter = handles.begin(); iter != handles.end(); ++iter)
+	{
+		waitForResult(*iter);
+	}
+}
+
+//----------------------------------------------------------------------------
+
+LLBatchThread::JobRequest::JobRequest(handle_t handle, U32 priority, Job* job)
+	: LLQueuedThread::QueuedRequest(handle, priority),
+	  mJob(job)
+{
+}
+
+LLBatchThread::JobRequest::~JobRequest()
+{
+}
+
+bool LLBatchThread::JobRequest::processRequest()
+{
+	mJob->run();
+	return true;
+}
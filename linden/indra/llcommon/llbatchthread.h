@@ -0,0 +1,88 @@
+/** 
+ * @file llbatchthread.h
+ * @brief Runs a batch of independent jobs in parallel and waits for them
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#ifndef LL_LLBATCHTHREAD_H
+#define LL_LLBATCHTHREAD_H
+
+#include <string>
+#include <vector>
+
+#include "llqueuedthread.h"
+
+//============================================================================
+// LLBatchThread is a fork/join helper for work that must be finished before
+// the caller can go on, such as culling a frame. runJobs() queues every job,
+// then the calling thread takes jobs off the queue itself while the pool (or
+// our own thread) takes the rest, and returns once they have all run. Because
+// the caller keeps working, a batch still completes when the pool threads are
+// all busy with other queues; it is just not parallel then.
+//
+// Jobs in a batch run concurrently in no particular order, so they must not
+// share anything they write. Callers that need a deterministic result give
+// each job its own output and combine them in job order afterwards.
+
+class LLBatchThread : public LLQueuedThread
+{
+public:
+	class Job
+	{
+	public:
+		virtual ~Job() {}
+		virtual void run() = 0;
+	};
+	typedef std::vector<Job*> job_list_t;
+
+private:
+	class JobRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		virtual ~JobRequest(); // use deleteRequest()
+
+	public:
+		JobRequest(handle_t handle, U32 priority, Job* job);
+
+		/*virtual*/ bool processRequest();
+
+	private:
+		Job* mJob;
+	};
+
+public:
+	LLBatchThread(const std::string& name, bool threaded = true, LLThreadPool* pool = NULL);
+
+	// Runs every job and returns when they have all finished. The jobs are
+	// not deleted.
+	void runJobs(const job_list_t& jobs);
+};
+
+#endif // LL_LLBATCHTHREAD_H
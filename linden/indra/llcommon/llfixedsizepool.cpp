@@ -0,0 +1,117 @@
+/**
+ * @file llfixedsizepool.cpp
+ * @brief Free list allocator for blocks of one size
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include "llfixedsizepool.h"
+
+// Blocks are rounded up to this, enough for any member of the pooled classes.
+static const size_t BLOCK_ALIGNMENT = 16;
+
+LLFixedSizePool::LLFixedSizePool(size_t block_size, S32 blocks_per_slab) :
+	mBlockSize((llmax(block_size, sizeof(FreeBlock)) + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1)),
+	mBlocksPerSlab(llmax(blocks_per_slab, 1)),
+	mFreeList(NULL),
+	mBlocksInUse(0),
+	mAllocations(0)
+{
+}
+
+LLFixedSizePool::~LLFixedSizePool()
+{
+	if (mBlocksInUse)
+	{	//objects made from the pool outlived it, leave their memory be
+		return;
+	}
+
+	for (std::vector<U8*>::iterator iter = mSlabs.begin(); iter != mSlabs.end(); ++iter)
+	{
+		::free(*iter);
+	}
+}
+
+void* LLFixedSizePool::allocate()
+{
+	if (!mFreeList)
+	{
+		addSlab();
+	}
+
+	FreeBlock* block = mFreeList;
+	mFreeList = block->mNext;
+	mBlocksInUse++;
+	mAllocations++;
+	return block;
+}
+
+void LLFixedSizePool::free(void* block)
+{
+	if (!block)
+	{
+		return;
+	}
+
+	llassert(mBlocksInUse > 0);
+	FreeBlock* free_block = (FreeBlock*) block;
+	free_block->mNext = mFreeList;
+	mFreeList = free_block;
+	mBlocksInUse--;
+}
+
+LLFixedSizePool::Stats LLFixedSizePool::getStats() const
+{
+	Stats stats;
+	stats.mSlabs = (S32) mSlabs.size();
+	stats.mBlocksInUse = mBlocksInUse;
+	stats.mAllocations = mAllocations;
+	return stats;
+}
+
+void LLFixedSizePool::addSlab()
+{
+	U8* slab = (U8*) malloc(mBlockSize * mBlocksPerSlab);
+	if (!slab)
+	{
+		llerrs << "Out of memory allocating " << mBlocksPerSlab << " blocks of "
+				<< mBlockSize << " bytes" << llendl;
+	}
+	mSlabs.push_back(slab);
+
+	// thread the slab onto the free list, first block on top
+	for (S32 i = mBlocksPerSlab - 1; i >= 0; i--)
+	{
+		FreeBlock* block = (FreeBlock*) (slab + i * mBlockSize);
+		block->mNext = mFreeList;
+		mFreeList = block;
+	}
+}
@@ -0,0 +1,89 @@
+/**
+ * @file llfixedsizepool.h
+ * @brief Free list allocator for blocks of one size
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#ifndef LL_LLFIXEDSIZEPOOL_H
+#define LL_LLFIXEDSIZEPOOL_H
+
+#include <vector>
+
+//============================================================================
+// LLFixedSizePool hands out blocks of one size carved from slabs of many
+// blocks, and keeps freed blocks on a free list for reuse, so that classes
+// which are created and destroyed constantly (octree nodes, spatial groups)
+// stop going to the heap for each object and sit close together in memory.
+// Slabs are only given back when the pool is destroyed, and then only if
+// every block has been freed.
+//
+// A class uses it from its own operator new and delete.  The pool is not
+// thread safe; it is meant for objects made and destroyed on one thread.
+
+class LLFixedSizePool
+{
+public:
+	LLFixedSizePool(size_t block_size, S32 blocks_per_slab);
+	~LLFixedSizePool();
+
+	void* allocate();
+	void free(void* block);
+
+	size_t getBlockSize() const		{ return mBlockSize; }
+
+	struct Stats
+	{
+		S32 mSlabs;			// heap allocations made by the pool
+		S32 mBlocksInUse;
+		U32 mAllocations;	// blocks handed out, ever
+	};
+	Stats getStats() const;
+
+private:
+	// No copy constructor or copy assignment
+	LLFixedSizePool(const LLFixedSizePool&);
+	LLFixedSizePool& operator=(const LLFixedSizePool&);
+
+	void addSlab();
+
+	struct FreeBlock
+	{
+		FreeBlock* mNext;
+	};
+
+	size_t mBlockSize;
+	S32 mBlocksPerSlab;
+	FreeBlock* mFreeList;
+	std::vector<U8*> mSlabs;
+	S32 mBlocksInUse;
+	U32 mAllocations;
+};
+
+#endif // LL_LLFIXEDSIZEPOOL_H
@@ -31,18 +31,35 @@
 
 #include "linden_common.h"
 #include "llqueuedthread.h"
+#include "llthreadpool.h"
 #include "llstl.h"
 
 //============================================================================
 
 // MAIN THREAD
-LLQueuedThread::LLQueuedThread(const std::string& name, bool threaded) :
+LLQueuedThread::LLQueuedThread(const std::string& name, bool threaded, LLThreadPool* pool) :
 	LLThread(name),
 	mThreaded(threaded),
 	mIdleThread(TRUE),
+	mPool(threaded ? pool : NULL),
+	mPoolUsers(0),
+	mQueueMutex(NULL),
+	mPendingCount(0),
+	mIncomingMutex(NULL),
+	mHashShardMask(REQUEST_HASH_SHARDS-1),
 	mNextHandle(0)
 {
-	if (mThreaded)
+	for (S32 i = 0; i < REQUEST_HASH_SHARDS; i++)
+	{
+		mHashMutexes[i] = new LLMutex(NULL);
+	}
+	if (mPool)
+	{
+		// Our own thread is never started, the pool's threads process the requests
+		mStatus = RUNNING;
+		mPool->addQueue(this);
+	}
+	else if (mThreaded)
 	{
 		start();
 	}
@@ -52,6 +69,11 @@ LLQueuedThread::LLQueuedThread(const std::string& name, bool threaded) :
 LLQueuedThread::~LLQueuedThread()
 {
 	shutdown();
+	for (S32 i = 0; i < REQUEST_HASH_SHARDS; i++)
+	{
+		delete mHashMutexes[i];
+		mHashMutexes[i] = NULL;
+	}
 	// ~LLThread() will be called here
 }
 
@@ -60,7 +82,13 @@ void LLQueuedThread::shutdown()
 	setQuitting();
 
 	unpause(); // MAIN THREAD
-	if (mThreaded)
+	if (mPool)
+	{
+		mPool->removeQueue(this); // waits for pool threads using this queue
+		mPool = NULL;
+		mStatus = STOPPED;
+	}
+	else if (mThreaded)
 	{
 		S32 timeout = 100;
 		for ( ; timeout>0; timeout--)
@@ -82,15 +110,28 @@ void LLQueuedThread::shutdown()
 		mStatus = STOPPED;
 	}
 
+	// Every request is in the hash, so the queue and any pending ops just get dropped
+	mIncomingMutex.lock();
+	mIncomingOps.clear();
+	mIncomingMutex.unlock();
+	mQueueMutex.lock();
+	mRequestQueue.clear();
+	mPendingCount = 0;
+	mQueueMutex.unlock();
+
 	QueuedRequest* req;
 	S32 active_count = 0;
-	while ( (req = (QueuedRequest*)mRequestHash.pop_element()) )
+	for (S32 i = 0; i < REQUEST_HASH_SHARDS; i++)
 	{
-		if (req->getStatus() == STATUS_QUEUED || req->getStatus() == STATUS_INPROGRESS)
+		LLMutexLock lock(mHashMutexes[i]);
+		while ( (req = (QueuedRequest*)mRequestHash[i].pop_element()) )
 		{
-			++active_count;
+			if (req->getStatus() == STATUS_QUEUED || req->getStatus() == STATUS_INPROGRESS)
+			{
+				++active_count;
+			}
+			req->deleteRequest();
 		}
-		req->deleteRequest();
 	}
 	if (active_count)
 	{
@@ -118,6 +159,18 @@ S32 LLQueuedThread::updateQueue(U32 max_time_ms)
 	{
 		pending = getPending();
 		unpause();
+		if (mPool)
+		{
+			// unpause() only signals one thread, but several pool threads
+			// may be waiting in checkPause() on our condition
+			lockData();
+			mRunCondition->broadcast();
+			unlockData();
+			if (pending > 0)
+			{
+				mPool->wake();
+			}
+		}
 	}
 	else
 	{
@@ -136,7 +189,11 @@ void LLQueuedThread::incQueue()
 	// Something has been added to the queue
 	if (!isPaused())
 	{
-		if (mThreaded)
+		if (mPool)
+		{
+			mPool->wake();
+		}
+		else if (mThreaded)
 		{
 			wake(); // Wake the thread up if necessary.
 		}
@@ -147,11 +204,7 @@ void LLQueuedThread::incQueue()
 // May be called from any thread
 S32 LLQueuedThread::getPending()
 {
-	S32 res;
-	lockData();
-	res = mRequestQueue.size();
-	unlockData();
-	return res;
+	return mPendingCount;
 }
 
 // MAIN thread
@@ -161,7 +214,7 @@ void LLQueuedThread::waitOnPending()
 	{
 		update(0);
 
-		if (mIdleThread)
+		if (mPool ? (getPending() == 0 && mPoolUsers == 0) : (bool)mIdleThread)
 		{
 			break;
 		}
@@ -176,32 +229,53 @@ void LLQueuedThread::waitOnPending()
 // MAIN thread
 void LLQueuedThread::printQueueStats()
 {
-	lockData();
+	mQueueMutex.lock();
 	if (!mRequestQueue.empty())
 	{
 		QueuedRequest *req = *mRequestQueue.begin();
-		llinfos << llformat("Pending Requests:%d Current status:%d", mRequestQueue.size(), req->getStatus()) << llendl;
+		llinfos << llformat("Pending Requests:%d Current status:%d", getPending(), req->getStatus()) << llendl;
+	}
+	else if (getPending())
+	{
+		llinfos << llformat("Pending Requests:%d", getPending()) << llendl;
 	}
 	else
 	{
 		llinfos << "Queued Thread Idle" << llendl;
 	}
-	unlockData();
+	mQueueMutex.unlock();
 }
 
 // MAIN thread
 LLQueuedThread::handle_t LLQueuedThread::generateHandle()
 {
-	lockData();
-	while ((mNextHandle == nullHandle()) || (mRequestHash.find(mNextHandle)))
+	LLMutexLock lock(&mIncomingMutex);
+	while (1)
 	{
+		if (mNextHandle != nullHandle())
+		{
+			LLMutexLock hash_lock(getHashMutex(mNextHandle));
+			if (!getRequestHash(mNextHandle).find(mNextHandle))
+			{
+				break;
+			}
+		}
 		mNextHandle++;
 	}
 	const LLQueuedThread::handle_t res = mNextHandle++;
-	unlockData();
 	return res;
 }
 
+void LLQueuedThread::pushRequestOp(const RequestOp& op)
+{
+	LLMutexLock lock(&mIncomingMutex);
+	mIncomingOps.push_back(op);
+	if (op.mOp != OP_PRIORITY)
+	{
+		mPendingCount++;
+	}
+}
+
 // MAIN thread
 bool LLQueuedThread::addRequest(QueuedRequest* req)
 {
@@ -210,14 +284,16 @@ bool LLQueuedThread::addRequest(QueuedRequest* req)
 		return false;
 	}
 	
-	lockData();
-	req->setStatus(STATUS_QUEUED);
-	mRequestQueue.insert(req);
-	mRequestHash.insert(req);
+	handle_t handle = req->getHashKey();
+	{
+		LLMutexLock lock(getHashMutex(handle));
+		req->setStatus(STATUS_QUEUED);
+		getRequestHash(handle).insert(req);
+	}
+	pushRequestOp(RequestOp(OP_ADD, handle, req));
 #if _DEBUG
 // 	llinfos << llformat("LLQueuedThread::Added req [%08d]",handle) << llendl;
 #endif
-	unlockData();
 
 	incQueue();
 
@@ -234,8 +310,9 @@ bool LLQueuedThread::waitForResult(LLQueuedThread::handle_t handle, bool auto_co
 	while(!done)
 	{
 		update(0); // unpauses
-		lockData();
-		QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
+		LLMutex* mutex = getHashMutex(handle);
+		mutex->lock();
+		QueuedRequest* req = (QueuedRequest*)getRequestHash(handle).find(handle);
 		if (!req)
 		{
 			done = true; // request does not exist
@@ -245,13 +322,13 @@ bool LLQueuedThread::waitForResult(LLQueuedThread::handle_t handle, bool auto_co
 			res = true;
 			if (auto_complete)
 			{
-				mRequestHash.erase(handle);
+				getRequestHash(handle).erase(handle);
 				req->deleteRequest();
 // 				check();
 			}
 			done = true;
 		}
-		unlockData();
+		mutex->unlock();
 		
 		if (!done && mThreaded)
 		{
@@ -272,75 +349,64 @@ LLQueuedThread::QueuedRequest* LLQueuedThread::getRequest(handle_t handle)
 	{
 		return 0;
 	}
-	lockData();
-	QueuedRequest* res = (QueuedRequest*)mRequestHash.find(handle);
-	unlockData();
+	LLMutexLock lock(getHashMutex(handle));
+	QueuedRequest* res = (QueuedRequest*)getRequestHash(handle).find(handle);
 	return res;
 }
 
 LLQueuedThread::status_t LLQueuedThread::getRequestStatus(handle_t handle)
 {
 	status_t res = STATUS_EXPIRED;
-	lockData();
-	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
+	LLMutexLock lock(getHashMutex(handle));
+	QueuedRequest* req = (QueuedRequest*)getRequestHash(handle).find(handle);
 	if (req)
 	{
 		res = req->getStatus();
 	}
-	unlockData();
 	return res;
 }
 
 void LLQueuedThread::abortRequest(handle_t handle, bool autocomplete)
 {
-	lockData();
-	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
+	LLMutexLock lock(getHashMutex(handle));
+	QueuedRequest* req = (QueuedRequest*)getRequestHash(handle).find(handle);
 	if (req)
 	{
 		req->setFlags(FLAG_ABORT | (autocomplete ? FLAG_AUTO_COMPLETE : 0));
 	}
-	unlockData();
 }
 
 // MAIN thread
 void LLQueuedThread::setFlags(handle_t handle, U32 flags)
 {
-	lockData();
-	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
+	LLMutexLock lock(getHashMutex(handle));
+	QueuedRequest* req = (QueuedRequest*)getRequestHash(handle).find(handle);
 	if (req)
 	{
 		req->setFlags(flags);
 	}
-	unlockData();
 }
 
 void LLQueuedThread::setPriority(handle_t handle, U32 priority)
 {
-	lockData();
-	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
-	if (req)
+	bool queued = false;
 	{
-		if(req->getStatus() == STATUS_INPROGRESS)
-		{
-			// not in list
-			req->setPriority(priority);
-		}
-		else if(req->getStatus() == STATUS_QUEUED)
-		{
-			// remove from list then re-insert
-			llverify(mRequestQueue.erase(req) == 1);
-			req->setPriority(priority);
-			mRequestQueue.insert(req);
-		}
+		LLMutexLock lock(getHashMutex(handle));
+		QueuedRequest* req = (QueuedRequest*)getRequestHash(handle).find(handle);
+		queued = req && (req->getStatus() == STATUS_INPROGRESS || req->getStatus() == STATUS_QUEUED);
+	}
+	if (queued)
+	{
+		// re-sorting the queue is left to applyRequestOps(), which looks the handle up again
+		pushRequestOp(RequestOp(OP_PRIORITY, handle, NULL, priority));
 	}
-	unlockData();
 }
 
 bool LLQueuedThread::completeRequest(handle_t handle)
 {
 	bool res = false;
-	lockData();
-	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
+	getHashMutex(handle)->lock();
+	QueuedRequest* req = (QueuedRequest*)getRequestHash(handle).find(handle);
 	if (req)
 	{
 		llassert_always(req->getStatus() != STATUS_QUEUED);
@@ -348,29 +414,37 @@ bool LLQueuedThread::completeRequest(handle_t handle)
 #if _DEBUG
 // 		llinfos << llformat("LLQueuedThread::Completed req [%08d]",handle) << llendl;
 #endif
-		//re insert to the queue to schedule for a delete later
+		// schedule for a delete on the processing thread
 		req->setStatus(STATUS_DELETE);
-		mRequestQueue.insert(req);
 		res = true;
 	}
-	unlockData();
+	// Don't hold a hash mutex while taking mIncomingMutex (see generateHandle()).
+	// Only applyRequestOps() deletes a STATUS_DELETE request, so req stays valid.
+	getHashMutex(handle)->unlock();
+	if (res)
+	{
+		pushRequestOp(RequestOp(OP_DELETE, handle, req));
+	}
 	return res;
 }
 
 bool LLQueuedThread::check()
 {
 #if 0 // not a reliable check once mNextHandle wraps, just for quick and dirty debugging
-	for (int i=0; i<REQUEST_HASH_SIZE; i++)
+	for (int s=0; s<REQUEST_HASH_SHARDS; s++)
 	{
-		LLSimpleHashEntry<handle_t>* entry = mRequestHash.get_element_at_index(i);
-		while (entry)
+		for (int i=0; i<REQUEST_HASH_SIZE; i++)
 		{
-			if (entry->getHashKey() > mNextHandle)
+			LLSimpleHashEntry<handle_t>* entry = mRequestHash[s].get_element_at_index(i);
+			while (entry)
 			{
-				llerrs << "Hash Error" << llendl;
-				return false;
+				if (entry->getHashKey() > mNextHandle)
+				{
+					llerrs << "Hash Error" << llendl;
+					return false;
+				}
+				entry = entry->getNextEntry();
 			}
-			entry = entry->getNextEntry();
 		}
 	}
 #endif
@@ -380,11 +454,64 @@ bool LLQueuedThread::check()
 //============================================================================
 // Runs on its OWN thread
 
+// Applies the queue changes made by other threads, in the order they were made
+void LLQueuedThread::applyRequestOps()
+{
+	request_op_list_t ops;
+	mIncomingMutex.lock();
+	ops.swap(mIncomingOps);
+	mIncomingMutex.unlock();
+
+	for (request_op_list_t::iterator iter = ops.begin(); iter != ops.end(); ++iter)
+	{
+		const RequestOp& op = *iter;
+		switch (op.mOp)
+		{
+		  case OP_ADD:
+			mRequestQueue.insert(op.mRequest);
+			break;
+		  case OP_PRIORITY:
+		  {
+			LLMutexLock lock(getHashMutex(op.mHandle));
+			QueuedRequest* req = (QueuedRequest*)getRequestHash(op.mHandle).find(op.mHandle);
+			if (req && req->getPriority() != op.mPriority)
+			{
+				if (req->getStatus() == STATUS_QUEUED)
+				{
+					// remove from list then re-insert
+					llverify(mRequestQueue.erase(req) == 1);
+					req->setPriority(op.mPriority);
+					mRequestQueue.insert(req);
+				}
+				else
+				{
+					// not in list
+					req->setPriority(op.mPriority);
+				}
+			}
+			break;
+		  }
+		  case OP_DELETE:
+		  {
+			LLMutexLock lock(getHashMutex(op.mHandle));
+			getRequestHash(op.mHandle).erase(op.mRequest);
+			op.mRequest->deleteRequest();
+			mPendingCount--;
+			break;
+		  }
+		  default:
+			llassert_always(0);
+			break;
+		}
+	}
+}
+
 S32 LLQueuedThread::processNextRequest()
 {
 	QueuedRequest *req;
 	// Get next request from pool
-	lockData();
+	mQueueMutex.lock();
+	applyRequestOps();
 	while(1)
 	{
 		req = NULL;
@@ -394,13 +521,7 @@ S32 LLQueuedThread::processNextRequest()
 		}
 		req = *mRequestQueue.begin();
 		mRequestQueue.erase(mRequestQueue.begin());
-
-		if(req->getStatus() == STATUS_DELETE)
-		{
-				mRequestHash.erase(req);
-				req->deleteRequest();
-				continue;
-		}
+		mPendingCount--;
 
 		if ((req->getFlags() & FLAG_ABORT) || (mStatus == QUITTING))
 		{
@@ -408,7 +529,9 @@ S32 LLQueuedThread::processNextRequest()
 			req->finishRequest(false);
 			if ((req->getFlags() & FLAG_AUTO_COMPLETE))
 			{
-				mRequestHash.erase(req);
+				handle_t handle = req->getHashKey();
+				LLMutexLock lock(getHashMutex(handle));
+				getRequestHash(handle).erase(req);
 				req->deleteRequest();
 // 				check();
 			}
@@ -421,7 +544,7 @@ S32 LLQueuedThread::processNextRequest()
 	{
 		req->setStatus(STATUS_INPROGRESS);
 	}
-	unlockData();
+	mQueueMutex.unlock();
 
 	// This is the only place we will call req->setStatus() after
 	// it has initially been seet to STATUS_QUEUED, so it is
@@ -430,30 +553,31 @@ S32 LLQueuedThread::processNextRequest()
 	{
 		// process request
 		bool complete = req->processRequest();
+		handle_t handle = req->getHashKey();
 
 		if (complete)
 		{
-			lockData();
-			req->setStatus(STATUS_COMPLETE);
-			unlockData();
-
+			// Finish before publishing STATUS_COMPLETE: once the status is set
+			// completeRequest() may schedule a delete, which another pool thread
+			// can apply while this one would still be using req.
 			req->finishRequest(true);
 
+			LLMutexLock lock(getHashMutex(handle));
+			req->setStatus(STATUS_COMPLETE);
 			if ((req->getFlags() & FLAG_AUTO_COMPLETE))
 			{
-				lockData();
-				mRequestHash.erase(req);
+				getRequestHash(handle).erase(req);
 				req->deleteRequest();
-				unlockData();
 			}
 		}
 		else
 		{
-			lockData();
+			mQueueMutex.lock();
 			req->setStatus(STATUS_QUEUED);
 			mRequestQueue.insert(req);
+			mPendingCount++;
 			U32 priority = req->getPriority();
-			unlockData();
+			mQueueMutex.unlock();
 			if (priority < PRIORITY_NORMAL)
 			{
 				ms_sleep(1); // sleep the thread a little
@@ -470,7 +594,7 @@ S32 LLQueuedThread::processNextRequest()
 bool LLQueuedThread::runCondition()
 {
 	// mRunCondition must be locked here
-	if (mRequestQueue.empty() && mIdleThread)
+	if (getPending() == 0 && mIdleThread && mPoolUsers == 0)
 		return false;
 	else
 		return true;
@@ -509,6 +633,23 @@ void LLQueuedThread::run()
 	llinfos << "LLQueuedThread " << mName << " EXITING." << llendl;
 		}
 		
+//============================================================================
+// Runs on a POOL thread
+
+bool LLQueuedThread::hasPoolWork()
+{
+	return getPending() > 0 && !isPaused() && !isQuitting();
+}
+
+// The pool has called addPoolUser() for us
+void LLQueuedThread::processPoolRequest()
+{
+	processNextRequest();
+	mPoolUsers--;
+}
+
+//============================================================================
+
 // virtual
 void LLQueuedThread::startThread()
 		{
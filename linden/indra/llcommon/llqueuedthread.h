@@ -37,18 +37,32 @@
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
 
 #include "llapr.h"
 
 #include "llthread.h"
 #include "llsimplehash.h"
 
+class LLThreadPool;
+
 //============================================================================
 // Note: ~LLQueuedThread is O(N) N=# of queued threads, assumed to be small
 //   It is assumed that LLQueuedThreads are rarely created/destroyed.
+//
+// Locking: the request hash is split into REQUEST_HASH_SHARDS shards with a
+//   mutex each, so handle lookups from the main thread only contend with the
+//   worker when they hit the same shard. mRequestQueue belongs to the thread
+//   processing requests (mQueueMutex); the main thread never touches it and
+//   instead appends adds, priority changes and deletes to mIncomingOps, which
+//   processNextRequest() applies in order.
+//
+// A threaded LLQueuedThread either runs its own thread or, if given an
+//   LLThreadPool, has its requests run by the pool's threads (see llthreadpool.h).
 
 class LLQueuedThread : public LLThread
 {
+	friend class LLThreadPool;
 	//------------------------------------------------------------------------
 public:
 	enum priority_t {
@@ -148,13 +162,29 @@ protected:
 		}
 	};
 
+	// Queue changes made outside of processNextRequest()
+	enum request_op_t {
+		OP_ADD = 0,
+		OP_PRIORITY = 1,
+		OP_DELETE = 2
+	};
+	struct RequestOp
+	{
+		RequestOp(U32 op, handle_t handle, QueuedRequest* req, U32 priority = 0) :
+			mOp(op), mHandle(handle), mRequest(req), mPriority(priority) {}
+		U32 mOp;
+		handle_t mHandle;
+		QueuedRequest* mRequest; // OP_ADD, OP_DELETE only, the request may be gone by OP_PRIORITY
+		U32 mPriority;
+	};
+
 	//------------------------------------------------------------------------
 	
 public:
 	static handle_t nullHandle() { return handle_t(0); }
 	
 public:
-	LLQueuedThread(const std::string& name, bool threaded = true);
+	LLQueuedThread(const std::string& name, bool threaded = true, LLThreadPool* pool = NULL);
 	virtual ~LLQueuedThread();	
 	virtual void shutdown();
 	
@@ -169,11 +199,19 @@ private:
 	virtual void endThread(void);
 	virtual void threadedUpdate(void);
 
+	// Called by LLThreadPool
+	bool hasPoolWork();
+	void addPoolUser() { mPoolUsers++; }
+	S32 getPoolUsers() { return mPoolUsers; }
+	void processPoolRequest();
+
 protected:
 	handle_t generateHandle();
 	bool addRequest(QueuedRequest* req);
 	S32  processNextRequest(void);
 	void incQueue();
+	void pushRequestOp(const RequestOp& op);
+	void applyRequestOps(); // mQueueMutex must be locked
 
 public:
 	bool waitForResult(handle_t handle, bool auto_complete = true);
@@ -203,15 +241,33 @@ public:
 protected:
 	BOOL mThreaded;  // if false, run on main thread and do updates during update()
 	LLAtomic32<BOOL> mIdleThread; // request queue is empty (or we are quitting) and the thread is idle
+	LLThreadPool* mPool; // runs our requests instead of our own thread, if set
+	LLAtomicS32 mPoolUsers; // pool threads currently processing a request of ours
 	
 	typedef std::set<QueuedRequest*, queued_request_less> request_queue_t;
-	request_queue_t mRequestQueue;
+	request_queue_t mRequestQueue; // protected by mQueueMutex
+	LLMutex mQueueMutex;
+	LLAtomicS32 mPendingCount; // queued requests, including ops not yet applied
+
+	typedef std::vector<RequestOp> request_op_list_t;
+	request_op_list_t mIncomingOps; // protected by mIncomingMutex
+	LLMutex mIncomingMutex;
 
-	enum { REQUEST_HASH_SIZE = 512 }; // must be power of 2
-	typedef LLSimpleHash<handle_t, REQUEST_HASH_SIZE> request_hash_t;
-	request_hash_t mRequestHash;
+	enum { REQUEST_HASH_SHARDS = 8 }; // must be power of 2
+	enum { REQUEST_HASH_SIZE = 64 }; // per shard, must be power of 2
+	class request_hash_t : public LLSimpleHash<handle_t, REQUEST_HASH_SIZE>
+	{
+	public:
+		// the low bits of a handle select the shard
+		/*virtual*/ int getIndex(handle_t key) { return (key / REQUEST_HASH_SHARDS) & (REQUEST_HASH_SIZE-1); }
+	};
+	request_hash_t mRequestHash[REQUEST_HASH_SHARDS];
+	LLMutex* mHashMutexes[REQUEST_HASH_SHARDS];
+	U32 mHashShardMask; // REQUEST_HASH_SHARDS-1, or 0 to keep every request in shard 0 (unsharded baseline)
+	request_hash_t& getRequestHash(handle_t handle) { return mRequestHash[handle & mHashShardMask]; }
+	LLMutex* getHashMutex(handle_t handle) { return mHashMutexes[handle & mHashShardMask]; }
 
-	handle_t mNextHandle;
+	handle_t mNextHandle; // protected by mIncomingMutex
 };
 
 #endif // LL_LLQUEUEDTHREAD_H
@@ -36,6 +36,7 @@
 #include "llsdserialize.h"
 #include "llmemory.h"
 #include "llstreamtools.h" // for fullread
+#include "llmemorystream.h"
 
 #include <iostream>
 #include "apr_base64.h"
@@ -1206,6 +1207,343 @@ bool LLSDBinaryParser::parseString(
 	return true;
 }
 
+// Helpers for the buffer based parser. Sizes in the data are checked
+// against the bytes actually remaining, which makes them the limit
+// check as well as the bounds check.
+static inline bool buffer_has(const U8* cur, const U8* end, S32 bytes)
+{
+	return (bytes >= 0) && ((end - cur) >= bytes);
+}
+
+static inline bool buffer_read_size(const U8*& cur, const U8* end, S32& size)
+{
+	if(!buffer_has(cur, end, sizeof(U32))) return false;
+	U32 size_nbo = 0;
+	memcpy(&size_nbo, cur, sizeof(U32));		/* Flawfinder: ignore */
+	cur += sizeof(U32);
+	size = (S32)ntohl(size_nbo);
+	return buffer_has(cur, end, size);
+}
+
+// Legacy notation style strings are rare in binary data, so rather
+// than duplicate the unescaping we hand the remaining bytes to the
+// stream code without copying them.
+static bool buffer_read_delim(
+	const U8*& cur,
+	const U8* end,
+	std::string& value,
+	char delim)
+{
+	LLMemoryStream istr(cur, (S32)(end - cur));
+	int cnt = deserialize_string_delim(istr, value, delim);
+	if(LLSDParser::PARSE_FAILURE == cnt) return false;
+	cur += cnt;
+	return true;
+}
+
+S32 LLSDBinaryParser::parseBuffer(
+	const U8* buf,
+	S32 len,
+	LLSD& data,
+	S32* bytes_read) const
+{
+	const U8* cur = buf;
+	S32 parse_count = PARSE_FAILURE;
+	if(buf && (len > 0))
+	{
+		parse_count = parseBufferValue(cur, buf + len, data);
+	}
+	else
+	{
+		data.clear();
+	}
+	if(bytes_read)
+	{
+		*bytes_read = (S32)(cur - buf);
+	}
+	return parse_count;
+}
+
+S32 LLSDBinaryParser::parseBufferValue(
+	const U8*& cur,
+	const U8* end,
+	LLSD& data) const
+{
+	// See doParse() for the format.
+	if(cur >= end)
+	{
+		data.clear();
+		return PARSE_FAILURE;
+	}
+	char c = (char)*cur++;
+	S32 parse_count = 1;
+	switch(c)
+	{
+	case '{':
+	{
+		S32 child_count = parseBufferMap(cur, end, data);
+		if(PARSE_FAILURE == child_count)
+		{
+			parse_count = PARSE_FAILURE;
+		}
+		else
+		{
+			parse_count += child_count;
+		}
+		break;
+	}
+
+	case '[':
+	{
+		S32 child_count = parseBufferArray(cur, end, data);
+		if(PARSE_FAILURE == child_count)
+		{
+			parse_count = PARSE_FAILURE;
+		}
+		else
+		{
+			parse_count += child_count;
+		}
+		break;
+	}
+
+	case '!':
+		data.clear();
+		break;
+
+	case '0':
+		data = false;
+		break;
+
+	case '1':
+		data = true;
+		break;
+
+	case 'i':
+	{
+		if(!buffer_has(cur, end, sizeof(U32)))
+		{
+			parse_count = PARSE_FAILURE;
+			break;
+		}
+		U32 value_nbo = 0;
+		memcpy(&value_nbo, cur, sizeof(U32));		/* Flawfinder: ignore */
+		cur += sizeof(U32);
+		data = (S32)ntohl(value_nbo);
+		break;
+	}
+
+	case 'r':
+	{
+		if(!buffer_has(cur, end, sizeof(F64)))
+		{
+			parse_count = PARSE_FAILURE;
+			break;
+		}
+		F64 real_nbo = 0.0;
+		memcpy(&real_nbo, cur, sizeof(F64));		/* Flawfinder: ignore */
+		cur += sizeof(F64);
+		data = ll_ntohd(real_nbo);
+		break;
+	}
+
+	case 'u':
+	{
+		if(!buffer_has(cur, end, UUID_BYTES))
+		{
+			parse_count = PARSE_FAILURE;
+			break;
+		}
+		LLUUID id;
+		memcpy(id.mData, cur, UUID_BYTES);		/* Flawfinder: ignore */
+		cur += UUID_BYTES;
+		data = id;
+		break;
+	}
+
+	case '\'':
+	case '"':
+	{
+		std::string value;
+		if(buffer_read_delim(cur, end, value, c))
+		{
+			data = value;
+		}
+		else
+		{
+			parse_count = PARSE_FAILURE;
+		}
+		break;
+	}
+
+	case 's':
+	case 'l':
+	{
+		S32 size = 0;
+		if(!buffer_read_size(cur, end, size))
+		{
+			parse_count = PARSE_FAILURE;
+			break;
+		}
+		std::string value((const char*)cur, size);
+		cur += size;
+		if('s' == c)
+		{
+			data = value;
+		}
+		else
+		{
+			data = LLURI(value);
+		}
+		break;
+	}
+
+	case 'd':
+	{
+		if(!buffer_has(cur, end, sizeof(F64)))
+		{
+			parse_count = PARSE_FAILURE;
+			break;
+		}
+		F64 real = 0.0;
+		memcpy(&real, cur, sizeof(F64));		/* Flawfinder: ignore */
+		cur += sizeof(F64);
+		data = LLDate(real);
+		break;
+	}
+
+	case 'b':
+	{
+		S32 size = 0;
+		if(!buffer_read_size(cur, end, size))
+		{
+			parse_count = PARSE_FAILURE;
+			break;
+		}
+		std::vector<U8> value(cur, cur + size);
+		cur += size;
+		data = value;
+		break;
+	}
+
+	default:
+		parse_count = PARSE_FAILURE;
+		llinfos << "Unrecognized character while parsing: int(" << (int)c
+			<< ")" << llendl;
+		break;
+	}
+	if(PARSE_FAILURE == parse_count)
+	{
+		data.clear();
+	}
+	return parse_count;
+}
+
+S32 LLSDBinaryParser::parseBufferMap(
+	const U8*& cur,
+	const U8* end,
+	LLSD& map) const
+{
+	map = LLSD::emptyMap();
+	if(!buffer_has(cur, end, sizeof(U32))) return PARSE_FAILURE;
+	U32 size_nbo = 0;
+	memcpy(&size_nbo, cur, sizeof(U32));		/* Flawfinder: ignore */
+	cur += sizeof(U32);
+	S32 size = (S32)ntohl(size_nbo);
+
+	// The key storage is reused for every entry in this map.
+	std::string key;
+	S32 parse_count = 0;
+	S32 count = 0;
+	while((cur < end) && (*cur != '}') && (count < size))
+	{
+		char c = (char)*cur++;
+		switch(c)
+		{
+		case 'k':
+		{
+			S32 key_size = 0;
+			if(!buffer_read_size(cur, end, key_size)) return PARSE_FAILURE;
+			key.assign((const char*)cur, key_size);
+			cur += key_size;
+			break;
+		}
+		case '\'':
+		case '"':
+			if(!buffer_read_delim(cur, end, key, c)) return PARSE_FAILURE;
+			break;
+		default:
+			key.clear();
+			break;
+		}
+		LLSD child;
+		S32 child_count = parseBufferValue(cur, end, child);
+		if(child_count > 0)
+		{
+			// There must be a value for every key, thus child_count
+			// must be greater than 0.
+			parse_count += child_count;
+			map.insert(key, child);
+		}
+		else
+		{
+			return PARSE_FAILURE;
+		}
+		++count;
+	}
+	if((cur >= end) || (*cur != '}') || (count < size))
+	{
+		// Make sure it is correctly terminated and we parsed as many
+		// as were said to be there.
+		return PARSE_FAILURE;
+	}
+	++cur;
+	return parse_count;
+}
+
+S32 LLSDBinaryParser::parseBufferArray(
+	const U8*& cur,
+	const U8* end,
+	LLSD& array) const
+{
+	array = LLSD::emptyArray();
+	if(!buffer_has(cur, end, sizeof(U32))) return PARSE_FAILURE;
+	U32 size_nbo = 0;
+	memcpy(&size_nbo, cur, sizeof(U32));		/* Flawfinder: ignore */
+	cur += sizeof(U32);
+	S32 size = (S32)ntohl(size_nbo);
+
+	// Every element takes at least one byte, so a size larger than
+	// what is left is bogus. Otherwise size the array up front and
+	// parse each child in place.
+	if(!buffer_has(cur, end, size)) return PARSE_FAILURE;
+	if(size > 0)
+	{
+		array[size - 1] = LLSD();
+	}
+
+	S32 parse_count = 0;
+	S32 count = 0;
+	while((cur < end) && (*cur != ']') && (count < size))
+	{
+		S32 child_count = parseBufferValue(cur, end, array[count]);
+		if(PARSE_FAILURE == child_count)
+		{
+			return PARSE_FAILURE;
+		}
+		parse_count += child_count;
+		++count;
+	}
+	if((cur >= end) || (*cur != ']') || (count < size))
+	{
+		// Make sure it is correctly terminated and we parsed as many
+		// as were said to be there.
+		return PARSE_FAILURE;
+	}
+	++cur;
+	return parse_count;
+}
+
 
 /**
  * LLSDFormatter
@@ -1488,6 +1826,111 @@ S32 LLSDBinaryFormatter::format(const LLSD& data, std::ostream& ostr, U32 option
 	return format_count;
 }
 
+S32 LLSDBinaryFormatter::formatBuffer(const LLSD& data, std::string& buffer) const
+{
+	S32 format_count = 1;
+	switch(data.type())
+	{
+	case LLSD::TypeMap:
+	{
+		buffer.push_back('{');
+		U32 size_nbo = htonl(data.size());
+		buffer.append((const char*)(&size_nbo), sizeof(U32));
+		LLSD::map_const_iterator iter = data.beginMap();
+		LLSD::map_const_iterator end = data.endMap();
+		for(; iter != end; ++iter)
+		{
+			buffer.push_back('k');
+			formatString((*iter).first, buffer);
+			format_count += formatBuffer((*iter).second, buffer);
+		}
+		buffer.push_back('}');
+		break;
+	}
+
+	case LLSD::TypeArray:
+	{
+		buffer.push_back('[');
+		U32 size_nbo = htonl(data.size());
+		buffer.append((const char*)(&size_nbo), sizeof(U32));
+		LLSD::array_const_iterator iter = data.beginArray();
+		LLSD::array_const_iterator end = data.endArray();
+		for(; iter != end; ++iter)
+		{
+			format_count += formatBuffer(*iter, buffer);
+		}
+		buffer.push_back(']');
+		break;
+	}
+
+	case LLSD::TypeUndefined:
+		buffer.push_back('!');
+		break;
+
+	case LLSD::TypeBoolean:
+		buffer.push_back(data.asBoolean() ? BINARY_TRUE_SERIAL : BINARY_FALSE_SERIAL);
+		break;
+
+	case LLSD::TypeInteger:
+	{
+		buffer.push_back('i');
+		U32 value_nbo = htonl(data.asInteger());
+		buffer.append((const char*)(&value_nbo), sizeof(U32));
+		break;
+	}
+
+	case LLSD::TypeReal:
+	{
+		buffer.push_back('r');
+		F64 value_nbo = ll_htond(data.asReal());
+		buffer.append((const char*)(&value_nbo), sizeof(F64));
+		break;
+	}
+
+	case LLSD::TypeUUID:
+	{
+		buffer.push_back('u');
+		LLUUID id = data.asUUID();
+		buffer.append((const char*)id.mData, UUID_BYTES);
+		break;
+	}
+
+	case LLSD::TypeString:
+		buffer.push_back('s');
+		formatString(data.asString(), buffer);
+		break;
+
+	case LLSD::TypeDate:
+	{
+		buffer.push_back('d');
+		F64 value = data.asReal();
+		buffer.append((const char*)(&value), sizeof(F64));
+		break;
+	}
+
+	case LLSD::TypeURI:
+		buffer.push_back('l');
+		formatString(data.asString(), buffer);
+		break;
+
+	case LLSD::TypeBinary:
+	{
+		buffer.push_back('b');
+		std::vector<U8> value = data.asBinary();
+		U32 size_nbo = htonl(value.size());
+		buffer.append((const char*)(&size_nbo), sizeof(U32));
+		if(value.size()) buffer.append((const char*)&value[0], value.size());
+		break;
+	}
+
+	default:
+		// *NOTE: This should never happen.
+		buffer.push_back('!');
+		break;
+	}
+	return format_count;
+}
+
 void LLSDBinaryFormatter::formatString(
 	const std::string& string,
 	std::ostream& ostr) const
@@ -1497,6 +1940,15 @@ void LLSDBinaryFormatter::formatString(
 	ostr.write(string.c_str(), string.size());
 }
 
+void LLSDBinaryFormatter::formatString(
+	const std::string& string,
+	std::string& buffer) const
+{
+	U32 size_nbo = htonl(string.size());
+	buffer.append((const char*)(&size_nbo), sizeof(U32));
+	buffer.append(string);
+}
+
 /**
  * local functions
  */
@@ -292,6 +292,12 @@ private:
 /** 
  * @class LLSDXMLParser
  * @brief Parser which handles XML format LLSD.
+ *
+ * Normally the whole document is built into one LLSD. For very large
+ * documents, eg, inventory fetch responses, a StreamHandler can be
+ * attached which sees each array element as soon as it is complete
+ * and may consume it, so that it is never kept in the result. Input
+ * may also be fed in pieces as it arrives with parseIncremental().
  */
 class LLSDXMLParser : public LLSDParser
 {
@@ -307,6 +313,60 @@ public:
 	 */
 	LLSDXMLParser();
 
+	/** 
+	 * @class StreamHandler
+	 * @brief Interface for receiving array elements as they are parsed.
+	 */
+	class StreamHandler
+	{
+	public:
+		virtual ~StreamHandler() {}
+
+		/** 
+		 * @brief Called when an element of any array finishes parsing.
+		 *
+		 * @param key The map key the array is stored under, or empty
+		 * if the array is the root or an element of another array.
+		 * @param container The map or array holding the array, as far
+		 * as it has been parsed. Undefined if the array is the root.
+		 * @param element The completed element.
+		 * @return Return true if the element was consumed and should
+		 * be dropped from the parse result.
+		 */
+		virtual bool handleArrayElement(
+			const std::string& key,
+			const LLSD& container,
+			const LLSD& element) = 0;
+	};
+
+	/** 
+	 * @brief Attach a handler for streamed array elements.
+	 *
+	 * The handler is not owned by the parser and stays attached
+	 * across reset(). Pass NULL to detach it.
+	 */
+	void setStreamHandler(StreamHandler* handler);
+
+	/** 
+	 * @brief Feed the next piece of a document to the parser.
+	 *
+	 * Call finishIncremental() once all of the document has been fed.
+	 * @param buf The next bytes of the document.
+	 * @param len The number of bytes at buf.
+	 * @return Returns false if the document is not well formed.
+	 */
+	bool parseIncremental(const char* buf, S32 len);
+
+	/** 
+	 * @brief Complete a parse started with parseIncremental().
+	 *
+	 * @param data[out] The parsed structured data, less any array
+	 * elements consumed by the stream handler.
+	 * @return Returns the number of LLSD objects parsed, including
+	 * consumed ones. Returns PARSE_FAILURE (-1) on parse failure.
+	 */
+	S32 finishIncremental(LLSD& data);
+
 protected:
 	/** 
 	 * @brief Call this method to parse a stream for LLSD.
@@ -355,6 +415,29 @@ public:
 	 */
 	LLSDBinaryParser();
 
+	/** 
+	 * @brief Call this method to parse binary LLSD out of memory.
+	 *
+	 * This walks the buffer directly rather than pulling every byte
+	 * through the istream interface, so it is considerably cheaper
+	 * than parse() when the whole serialization is already contiguous
+	 * in memory, eg, a message field or a single buffer segment. The
+	 * length of the buffer bounds every size read from the data, so
+	 * no max_bytes is needed. Like parse(), this reads one data
+	 * object and leaves any trailing bytes alone.
+	 * @param buf The start of the serialized data.
+	 * @param len The number of bytes available at buf.
+	 * @param data[out] The newly parse structured data.
+	 * @param bytes_read[out] If not NULL, the number of bytes consumed.
+	 * @return Returns the number of LLSD objects parsed into
+	 * data. Returns PARSE_FAILURE (-1) on parse failure.
+	 */
+	S32 parseBuffer(
+		const U8* buf,
+		S32 len,
+		LLSD& data,
+		S32* bytes_read = NULL) const;
+
 protected:
 	/** 
 	 * @brief Call this method to parse a stream for LLSD.
@@ -399,6 +482,40 @@ private:
 	 * @return Retuns true if a complete string was parsed.
 	 */
 	bool parseString(std::istream& istr, std::string& value) const;
+
+	/** 
+	 * @brief Parse one value from a buffer, advancing cur past it.
+	 *
+	 * @param cur The read position, updated on return.
+	 * @param end One past the last readable byte.
+	 * @param data[out] The newly parse structured data.
+	 * @return Returns the number of LLSD objects parsed into
+	 * data. Returns -1 on parse failure.
+	 */
+	S32 parseBufferValue(
+		const U8*& cur,
+		const U8* end,
+		LLSD& data) const;
+
+	/** 
+	 * @brief Parse a map from a buffer.
+	 *
+	 * @return Returns The number of LLSD objects parsed into data.
+	 */
+	S32 parseBufferMap(
+		const U8*& cur,
+		const U8* end,
+		LLSD& map) const;
+
+	/** 
+	 * @brief Parse an array from a buffer.
+	 *
+	 * @return Returns The number of LLSD objects parsed into data.
+	 */
+	S32 parseBufferArray(
+		const U8*& cur,
+		const U8* end,
+		LLSD& array) const;
 };
 
 
@@ -610,6 +727,18 @@ public:
 	 */
 	virtual S32 format(const LLSD& data, std::ostream& ostr, U32 options = LLSDFormatter::OPTIONS_NONE) const;
 
+	/** 
+	 * @brief Call this method to format an LLSD into memory.
+	 *
+	 * Produces exactly the same bytes as format(), appended to buffer,
+	 * without going through an ostream. Callers which format many
+	 * objects can keep reusing the same buffer to avoid reallocation.
+	 * @param data The data to write.
+	 * @param buffer The destination for the data. Output is appended.
+	 * @return Returns The number of LLSD objects fomatted out
+	 */
+	S32 formatBuffer(const LLSD& data, std::string& buffer) const;
+
 protected:
 	/** 
 	 * @brief Helper method to serialize strings
@@ -620,6 +749,14 @@ protected:
 	 * @param ostr The destination stream for the data.
 	 */
 	void formatString(const std::string& string, std::ostream& ostr) const;
+
+	/** 
+	 * @brief Helper method to serialize strings into memory.
+	 *
+	 * @param string The string to write.
+	 * @param buffer The destination for the data.
+	 */
+	void formatString(const std::string& string, std::string& buffer) const;
 };
 
 
@@ -784,6 +921,16 @@ public:
 		(void)p->parse(str, sd, max_bytes);
 		return sd;
 	}
+	static S32 toBinary(const LLSD& sd, std::string& buffer)
+	{
+		LLPointer<LLSDBinaryFormatter> f = new LLSDBinaryFormatter;
+		return f->formatBuffer(sd, buffer);
+	}
+	static S32 fromBinary(LLSD& sd, const U8* buf, S32 len)
+	{
+		LLPointer<LLSDBinaryParser> p = new LLSDBinaryParser;
+		return p->parseBuffer(buf, len, sd);
+	}
 };
 
 #endif // LL_LLSDSERIALIZE_H
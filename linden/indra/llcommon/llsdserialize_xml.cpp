@@ -266,9 +266,16 @@ public:
 	S32 parseLines(std::istream& input, LLSD& data);
 
 	void parsePart(const char *buf, int len);
+	bool parseIncremental(const char* buf, int len);
+	S32 finishIncremental(LLSD& data);
 	
 	void reset();
 
+	void setStreamHandler(LLSDXMLParser::StreamHandler* handler)
+	{
+		mStreamHandler = handler;
+	}
+
 private:
 	void startElementHandler(const XML_Char* name, const XML_Char** attributes);
 	void endElementHandler(const XML_Char* name);
@@ -282,6 +289,8 @@ private:
 		void* userData, const XML_Char* data, int length);
 
 	void startSkipping();
+	void pushElement(LLSD& element, const std::string& key);
+	void popElement(LLSD& element);
 	
 	enum Element {
 		ELEMENT_LLSD,
@@ -321,10 +330,16 @@ private:
 	
 	std::string mCurrentKey;		// Current XML <tag>
 	std::string mCurrentContent;	// String data between <tag> and </tag>
+
+	// Only maintained when there is a stream handler: the map key
+	// each entry of mStack was inserted under, empty in arrays.
+	LLSDXMLParser::StreamHandler* mStreamHandler;
+	std::deque<std::string> mKeyStack;
 };
 
 
-LLSDXMLParser::Impl::Impl()
+LLSDXMLParser::Impl::Impl() :
+	mStreamHandler(NULL)
 {
 	mParser = XML_ParserCreate(NULL);
 	reset();
@@ -507,6 +522,7 @@ void LLSDXMLParser::Impl::reset()
 	mGracefullStop = false;
 
 	mStack.clear();
+	mKeyStack.clear();
 	
 	mSkipping = false;
 	
@@ -557,6 +573,73 @@ void LLSDXMLParser::Impl::parsePart(const char* buf, int len)
 	}
 }
 
+bool LLSDXMLParser::Impl::parseIncremental(const char* buf, int len)
+{
+	if (mGracefullStop)
+	{
+		// Already saw </llsd>, anything after it is ignored.
+		return true;
+	}
+	if (buf == NULL || len <= 0)
+	{
+		return true;
+	}
+	XML_Status status = XML_Parse(mParser, buf, len, false);
+	return (status != XML_STATUS_ERROR) || mGracefullStop;
+}
+
+S32 LLSDXMLParser::Impl::finishIncremental(LLSD& data)
+{
+	if (!mGracefullStop)
+	{
+		XML_Status status = XML_Parse(mParser, NULL, 0, true);
+		if (status == XML_STATUS_ERROR && !mGracefullStop)
+		{
+			llinfos << "LLSDXMLParser::Impl::finishIncremental: XML_STATUS_ERROR "
+				<< XML_ErrorString(XML_GetErrorCode(mParser)) << llendl;
+			data = LLSD();
+			return LLSDParser::PARSE_FAILURE;
+		}
+	}
+	data = mResult;
+	return mParseCount;
+}
+
+void LLSDXMLParser::Impl::pushElement(LLSD& element, const std::string& key)
+{
+	mStack.push_back(&element);
+	if (mStreamHandler)
+	{
+		mKeyStack.push_back(key);
+	}
+}
+
+void LLSDXMLParser::Impl::popElement(LLSD& element)
+{
+	mStack.pop_back();
+	if (!mStreamHandler)
+	{
+		return;
+	}
+	mKeyStack.pop_back();
+
+	// Hand finished array elements to the handler, and drop the ones
+	// it consumes so the tree never holds more than one of them.
+	if (mStack.empty() || !mStack.back()->isArray())
+	{
+		return;
+	}
+	LLSD& array = *mStack.back();
+	const std::string& key = mKeyStack.back();
+	static const LLSD sNoContainer;
+	const LLSD& container =
+		(mStack.size() > 1) ? *mStack[mStack.size() - 2] : sNoContainer;
+	if (mStreamHandler->handleArrayElement(key, container, element))
+	{
+		array.erase(array.size() - 1);
+	}
+}
+
 // Performance testing code
 //#define	XML_PARSER_PERFORMANCE_TESTS
 
@@ -633,7 +716,7 @@ void LLSDXMLParser::Impl::startElementHandler(const XML_Char* name, const XML_Ch
 	
 	if (mStack.empty())
 	{
-		mStack.push_back(&mResult);
+		pushElement(mResult, LLStringUtil::null);
 	}
 	else if (mStack.back()->isMap())
 	{
@@ -641,7 +724,7 @@ void LLSDXMLParser::Impl::startElementHandler(const XML_Char* name, const XML_Ch
 		
 		LLSD& map = *mStack.back();
 		LLSD& newElement = map[mCurrentKey];
-		mStack.push_back(&newElement);		
+		pushElement(newElement, mCurrentKey);
 
 #if( LL_WINDOWS || __GNUC__ > 2)
 		mCurrentKey.clear();
@@ -654,7 +737,7 @@ void LLSDXMLParser::Impl::startElementHandler(const XML_Char* name, const XML_Ch
 		LLSD& array = *mStack.back();
 		array.append(LLSD());
 		LLSD& newElement = array[array.size()-1];
-		mStack.push_back(&newElement);
+		pushElement(newElement, LLStringUtil::null);
 	}
 	else {
 		// improperly nested value in a non-structure
@@ -719,7 +802,6 @@ void LLSDXMLParser::Impl::endElementHandler(const XML_Char* name)
 	if (!mInLLSDElement) { return; }
 
 	LLSD& value = *mStack.back();
-	mStack.pop_back();
 	
 	switch (element)
 	{
@@ -796,6 +878,7 @@ void LLSDXMLParser::Impl::endElementHandler(const XML_Char* name)
 	}
 
 	mCurrentContent.clear();
+	popElement(value);
 }
 
 void LLSDXMLParser::Impl::characterDataHandler(const XML_Char* data, int length)
@@ -914,6 +997,21 @@ void LLSDXMLParser::parsePart(const char *buf, int len)
 	impl.parsePart(buf, len);
 }
 
+void LLSDXMLParser::setStreamHandler(StreamHandler* handler)
+{
+	impl.setStreamHandler(handler);
+}
+
+bool LLSDXMLParser::parseIncremental(const char* buf, S32 len)
+{
+	return impl.parseIncremental(buf, len);
+}
+
+S32 LLSDXMLParser::finishIncremental(LLSD& data)
+{
+	return impl.finishIncremental(data);
+}
+
 // virtual
 S32 LLSDXMLParser::doParse(std::istream& input, LLSD& data) const
 {
@@ -69,8 +69,7 @@ void *APR_THREAD_FUNC LLThread::staticRun(apr_thread_t *apr_threadp, void *datap
 {
 	LLThread *threadp = (LLThread *)datap;
 
-	// Set thread state to running
-	threadp->mStatus = RUNNING;
+	// start() has already set the thread state to running
 
 	// Create a thread local APRFile pool.
 	LLVolatileAPRPool::createLocalAPRFilePool();
@@ -164,6 +163,9 @@ void LLThread::shutdown()
 
 void LLThread::start()
 {
+	// Set the state here rather than in staticRun(), so a thread that has
+	// not got going yet is not taken for stopped and deleted under it.
+	mStatus = RUNNING;
 	apr_thread_create(&mAPRThreadp, NULL, staticRun, (void *)this, mAPRPoolp);	
 
 	// We won't bother joining
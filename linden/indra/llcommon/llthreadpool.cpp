@@ -0,0 +1,237 @@
+/** 
+ * @file llthreadpool.cpp
+ * @brief A set of threads shared by several LLQueuedThread request queues
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "llthreadpool.h"
+#include "llqueuedthread.h"
+
+#if LL_WINDOWS
+#	define WIN32_LEAN_AND_MEAN
+#	include <winsock2.h>
+#	include <windows.h>
+#else
+#	include <unistd.h>
+#endif
+
+//============================================================================
+
+// static
+S32 LLThreadPool::getProcessorCount()
+{
+	S32 count = 1;
+#if LL_WINDOWS
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	count = (S32)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	count = (S32)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return llmax(count, 1);
+}
+
+// MAIN THREAD
+LLThreadPool::LLThreadPool(const std::string& name, S32 thread_count) :
+	mName(name),
+	mQueuesMutex(NULL),
+	mNextWake(0)
+{
+	if (thread_count <= 0)
+	{
+		thread_count = getProcessorCount();
+	}
+	llinfos << "LLThreadPool " << mName << " starting " << thread_count << " threads" << llendl;
+	for (S32 i = 0; i < thread_count; i++)
+	{
+		PoolThread* thread = new PoolThread(this, i);
+		mThreads.push_back(thread);
+		thread->start();
+	}
+}
+
+// MAIN THREAD
+LLThreadPool::~LLThreadPool()
+{
+	mQueuesMutex.lock();
+	if (!mQueues.empty())
+	{
+		llwarns << "~LLThreadPool (" << mName << ") called with " << mQueues.size() << " queues attached" << llendl;
+		mQueues.clear();
+	}
+	mQueuesMutex.unlock();
+	for (std::vector<PoolThread*>::iterator iter = mThreads.begin(); iter != mThreads.end(); ++iter)
+	{
+		delete *iter; // ~LLThread() stops the thread
+	}
+	mThreads.clear();
+}
+
+//----------------------------------------------------------------------------
+
+void LLThreadPool::addQueue(LLQueuedThread* queue)
+{
+	mQueuesMutex.lock();
+	mQueues.push_back(queue);
+	mQueuesMutex.unlock();
+	wake();
+}
+
+void LLThreadPool::removeQueue(LLQueuedThread* queue)
+{
+	mQueuesMutex.lock();
+	queue_list_t::iterator iter = std::find(mQueues.begin(), mQueues.end(), queue);
+	if (iter != mQueues.end())
+	{
+		mQueues.erase(iter);
+	}
+	mQueuesMutex.unlock();
+	// Pool threads register with the queue while holding mQueuesMutex,
+	// so nobody new can start on it now; wait for the ones already inside.
+	while (queue->getPoolUsers() > 0)
+	{
+		ms_sleep(1);
+	}
+}
+
+// May be called from any thread
+void LLThreadPool::wake()
+{
+	// Wake one idle thread, busy threads look for more work between requests anyway
+	S32 count = (S32)mThreads.size();
+	S32 start = (S32)(mNextWake++ % (U32)count);
+	for (S32 i = 0; i < count; i++)
+	{
+		PoolThread* thread = mThreads[(start + i) % count];
+		if (thread->isIdle())
+		{
+			thread->wake();
+			break;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// POOL THREADS
+
+bool LLThreadPool::hasWork()
+{
+	LLMutexLock lock(&mQueuesMutex);
+	for (queue_list_t::iterator iter = mQueues.begin(); iter != mQueues.end(); ++iter)
+	{
+		if ((*iter)->hasPoolWork())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LLThreadPool::processNextRequest(S32 index)
+{
+	LLQueuedThread* queue = NULL;
+	mQueuesMutex.lock();
+	S32 count = (S32)mQueues.size();
+	for (S32 i = 0; i < count; i++)
+	{
+		// home queue first, then steal from the others
+		LLQueuedThread* q = mQueues[(index + i) % count];
+		if (q->hasPoolWork())
+		{
+			queue = q;
+			queue->addPoolUser();
+			break;
+		}
+	}
+	mQueuesMutex.unlock();
+
+	if (!queue)
+	{
+		return false;
+	}
+	queue->processPoolRequest();
+	return true;
+}
+
+//============================================================================
+
+LLThreadPool::PoolThread::PoolThread(LLThreadPool* pool, S32 index) :
+	LLThread(llformat("%s %d", pool->mName.c_str(), index)),
+	mPool(pool),
+	mIndex(index),
+	mIdle(TRUE)
+{
+}
+
+LLThreadPool::PoolThread::~PoolThread()
+{
+	// Stop the thread while run() and runCondition() are still ours;
+	// by the time ~LLThread() waits for it they are pure virtual.
+	// Give up after as long as LLThread::shutdown() waits.
+	setQuitting();
+	const S32 MAX_WAIT = 6000;
+	for (S32 counter = 0; counter < MAX_WAIT && !isStopped(); counter++)
+	{
+		ms_sleep(10);
+	}
+}
+
+// virtual
+bool LLThreadPool::PoolThread::runCondition()
+{
+	// mRunCondition must be locked here
+	return mPool->hasWork();
+}
+
+// virtual
+void LLThreadPool::PoolThread::run()
+{
+	while (1)
+	{
+		// sleeps until some queue has work or the thread leaves the RUNNING state
+		mIdle = TRUE;
+		checkPause();
+		mIdle = FALSE;
+		
+		if (isQuitting())
+		{
+			break;
+		}
+
+		while (mPool->processNextRequest(mIndex))
+		{
+			if (isQuitting())
+			{
+				break;
+			}
+		}
+	}
+	llinfos << "LLThreadPool thread " << mName << " EXITING." << llendl;
+}
@@ -0,0 +1,104 @@
+/** 
+ * @file llthreadpool.h
+ * @brief A set of threads shared by several LLQueuedThread request queues
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLTHREADPOOL_H
+#define LL_LLTHREADPOOL_H
+
+#include <string>
+#include <vector>
+
+#include "llthread.h"
+
+class LLQueuedThread;
+
+//============================================================================
+// LLThreadPool runs the requests of any number of LLQueuedThreads on a fixed
+// set of threads. Each pool thread has a home queue (its index modulo the
+// number of queues) which it serves first; when that queue is empty it steals
+// the next request from the other queues in turn. Within a queue requests are
+// still taken highest priority first, and aborts and finishRequest() behave
+// exactly as they do on a dedicated thread.
+//
+// A queue opts in by passing the pool to the LLQueuedThread constructor.
+// startThread(), endThread() and threadedUpdate() are not called for pooled
+// queues, so queues that need thread affinity (e.g. LLTextureFetch's curl
+// handles) must keep their own thread.
+// The pool must outlive every queue that uses it.
+
+class LLThreadPool
+{
+public:
+	LLThreadPool(const std::string& name, S32 thread_count = 0); // 0 = one per processor
+	~LLThreadPool();
+
+	S32 getThreadCount() const { return (S32)mThreads.size(); }
+	static S32 getProcessorCount();
+
+	// Called by LLQueuedThread
+	void addQueue(LLQueuedThread* queue);
+	void removeQueue(LLQueuedThread* queue); // blocks until no pool thread is using queue
+	void wake(); // a queue has new work
+
+private:
+	// No copy constructor or copy assignment
+	LLThreadPool(const LLThreadPool&);
+	LLThreadPool& operator=(const LLThreadPool&);
+
+	class PoolThread : public LLThread
+	{
+	public:
+		PoolThread(LLThreadPool* pool, S32 index);
+		~PoolThread();
+		bool isIdle() { return mIdle ? true : false; }
+		
+	private:
+		/*virtual*/ bool runCondition(void);
+		/*virtual*/ void run(void);
+
+		LLThreadPool* mPool;
+		S32 mIndex;
+		LLAtomic32<BOOL> mIdle;
+	};
+	friend class PoolThread;
+
+	bool hasWork();
+	bool processNextRequest(S32 index); // false if no queue had work
+
+	std::string mName;
+	std::vector<PoolThread*> mThreads;
+	typedef std::vector<LLQueuedThread*> queue_list_t;
+	queue_list_t mQueues; // protected by mQueuesMutex
+	LLMutex mQueuesMutex;
+	LLAtomicU32 mNextWake; // round robin start for wake()
+};
+
+#endif // LL_LLTHREADPOOL_H
@@ -40,8 +40,8 @@
 //============================================================================
 // Run on MAIN thread
 
-LLWorkerThread::LLWorkerThread(const std::string& name, bool threaded) :
-	LLQueuedThread(name, threaded)
+LLWorkerThread::LLWorkerThread(const std::string& name, bool threaded, LLThreadPool* pool) :
+	LLQueuedThread(name, threaded, pool)
 {
 	mDeleteMutex = new LLMutex(NULL);
 }
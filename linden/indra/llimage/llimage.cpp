@@ -246,14 +246,14 @@ U8* LLImageBase::allocateDataSize(S32 width, S32 height, S32 ncomponents, S32 si
 // LLImageRaw
 //---------------------------------------------------------------------------
 
-S32 LLImageRaw::sGlobalRawMemory = 0;
-S32 LLImageRaw::sRawImageCount = 0;
+LLAtomicS32 LLImageRaw::sGlobalRawMemory;
+LLAtomicS32 LLImageRaw::sRawImageCount;
 
 LLImageRaw::LLImageRaw()
 	: LLImageBase()
 {
 	mMemType = LLMemType::MTYPE_IMAGERAW;
-	++sRawImageCount;
+	sRawImageCount++;
 }
 
 LLImageRaw::LLImageRaw(U16 width, U16 height, S8 components)
@@ -262,7 +262,7 @@ LLImageRaw::LLImageRaw(U16 width, U16 height, S8 components)
 	mMemType = LLMemType::MTYPE_IMAGERAW;
 	llassert( S32(width) * S32(height) * S32(components) <= MAX_IMAGE_DATA_SIZE );
 	allocateDataSize(width, height, components);
-	++sRawImageCount;
+	sRawImageCount++;
 }
 
 LLImageRaw::LLImageRaw(U8 *data, U16 width, U16 height, S8 components)
@@ -273,7 +273,7 @@ LLImageRaw::LLImageRaw(U8 *data, U16 width, U16 height, S8 components)
 	{
 		memcpy(getData(), data, width*height*components);
 	}
-	++sRawImageCount;
+	sRawImageCount++;
 }
 
 LLImageRaw::LLImageRaw(const std::string& filename, bool j2c_lowest_mip_only)
@@ -287,7 +287,7 @@ LLImageRaw::~LLImageRaw()
 	// NOTE: ~LLimageBase() call to deleteData() calls LLImageBase::deleteData()
 	//        NOT LLImageRaw::deleteData()
 	deleteData();
-	--sRawImageCount;
+	sRawImageCount--;
 }
 
 // virtual
@@ -1321,7 +1321,7 @@ bool LLImageRaw::createFromFile(const std::string &filename, bool j2c_lowest_mip
 //---------------------------------------------------------------------------
 
 //static
-S32 LLImageFormatted::sGlobalFormattedMemory = 0;
+LLAtomicS32 LLImageFormatted::sGlobalFormattedMemory;
 
 LLImageFormatted::LLImageFormatted(S8 codec)
 	: LLImageBase(),
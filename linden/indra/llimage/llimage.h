@@ -244,8 +244,9 @@ protected:
 	void setDataAndSize(U8 *data, S32 width, S32 height, S8 components) ;
 
 public:
-	static S32 sGlobalRawMemory;
-	static S32 sRawImageCount;
+	// Images are allocated and freed on the decode and worker pool threads too.
+	static LLAtomicS32 sGlobalRawMemory;
+	static LLAtomicS32 sRawImageCount;
 };
 
 // Compressed representation of image.
@@ -317,7 +318,7 @@ protected:
 	S8 mDiscardLevel;
 	
 public:
-	static S32 sGlobalFormattedMemory;
+	static LLAtomicS32 sGlobalFormattedMemory;
 };
 
 #endif
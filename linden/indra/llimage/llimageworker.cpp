@@ -38,8 +38,8 @@
 //----------------------------------------------------------------------------
 
 // MAIN THREAD
-LLImageDecodeThread::LLImageDecodeThread(bool threaded)
-	: LLQueuedThread("imagedecode", threaded)
+LLImageDecodeThread::LLImageDecodeThread(bool threaded, LLThreadPool* pool)
+	: LLQueuedThread("imagedecode", threaded, pool)
 {
 	mCreationMutex = new LLMutex(getAPRPool());
 }
@@ -77,7 +77,9 @@ public:
 	};
 	
 public:
-	LLImageDecodeThread(bool threaded = true);
+	// With a pool, one image is decoded at a time on each pool thread.
+	// Every decode has its own codec state, so the images decode in parallel.
+	LLImageDecodeThread(bool threaded = true, LLThreadPool* pool = NULL);
 	handle_t decodeImage(LLImageFormatted* image,
 						 U32 priority, S32 discard, BOOL needs_aux,
 						 Responder* responder);
@@ -34,6 +34,16 @@
 
 #include "llmath.h"
 #include "llcamera.h"
+#include "llpackedbounds.h"
+
+// Only use SSE when the whole build does its float math with it, so that
+// the packed and scalar frustum tests round identically.
+#if (LL_GNUC && defined(__SSE_MATH__)) || (LL_MSVC && (defined(_M_X64) || _M_IX86_FP >= 1))
+#define LL_CAMERA_SSE 1
+#include <xmmintrin.h>
+#else
+#define LL_CAMERA_SSE 0
+#endif
 
 // ---------------- Constructors and destructors ----------------
 
@@ -316,6 +326,130 @@ S32 LLCamera::AABBInFrustumNoFarClip(const LLVector3 &center, const LLVector3& r
 	return result;
 }
 
+void LLCamera::AABBInFrustumPacked(const LLPackedBounds& bounds, S8* results)
+{
+	packedAABBInFrustum(bounds, results, TRUE);
+}
+
+void LLCamera::AABBInFrustumNoFarClipPacked(const LLPackedBounds& bounds, S8* results)
+{
+	packedAABBInFrustum(bounds, results, FALSE);
+}
+
+#if LL_CAMERA_SSE
+
+// Same plane tests as AABBInFrustum(), with each lane of a register holding
+// a different box and the dot products summed in the same order, so every
+// box gets the same answer it would one at a time.  Boxes big enough for the
+// frustum quad test fall back to AABBInFrustum().
+void LLCamera::packedAABBInFrustum(const LLPackedBounds& bounds, S8* results, BOOL far_clip)
+{
+	S32 count = bounds.getSlotCount();
+	if (count == 0)
+	{
+		return;
+	}
+
+	__m128 nx[7], ny[7], nz[7], neg_d[7];
+	__m128 sx[7], sy[7], sz[7];
+	U32 plane_count = 0;
+	for (U32 i = 0; i < mPlaneCount; i++)
+	{
+		if (i == 5 && !far_clip)
+		{
+			continue;
+		}
+
+		const LLPlane& p = mAgentPlanes[i].p;
+		U8 mask = mAgentPlanes[i].mask;
+		nx[plane_count] = _mm_set1_ps(p.mV[0]);
+		ny[plane_count] = _mm_set1_ps(p.mV[1]);
+		nz[plane_count] = _mm_set1_ps(p.mV[2]);
+		neg_d[plane_count] = _mm_set1_ps(-p.mV[3]);
+		sx[plane_count] = _mm_set1_ps(mask & 1 ? 1.f : -1.f);
+		sy[plane_count] = _mm_set1_ps(mask & 2 ? 1.f : -1.f);
+		sz[plane_count] = _mm_set1_ps(mask & 4 ? 1.f : -1.f);
+		plane_count++;
+	}
+
+	const __m128 corner_dist_sq = _mm_set1_ps(mFrustumCornerDist * mFrustumCornerDist);
+	const F32* center_x = bounds.getCenters(VX);
+	const F32* center_y = bounds.getCenters(VY);
+	const F32* center_z = bounds.getCenters(VZ);
+	const F32* radius_x = bounds.getRadii(VX);
+	const F32* radius_y = bounds.getRadii(VY);
+	const F32* radius_z = bounds.getRadii(VZ);
+
+	for (S32 i = 0; i < count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(center_x + i);
+		__m128 cy = _mm_loadu_ps(center_y + i);
+		__m128 cz = _mm_loadu_ps(center_z + i);
+		__m128 rx = _mm_loadu_ps(radius_x + i);
+		__m128 ry = _mm_loadu_ps(radius_y + i);
+		__m128 rz = _mm_loadu_ps(radius_z + i);
+
+		__m128 outside = _mm_setzero_ps();
+		__m128 straddle = _mm_setzero_ps();
+		for (U32 j = 0; j < plane_count; j++)
+		{
+			__m128 rsx = _mm_mul_ps(rx, sx[j]);
+			__m128 rsy = _mm_mul_ps(ry, sy[j]);
+			__m128 rsz = _mm_mul_ps(rz, sz[j]);
+
+			__m128 min_dist = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(nx[j], _mm_sub_ps(cx, rsx)),
+				_mm_mul_ps(ny[j], _mm_sub_ps(cy, rsy))),
+				_mm_mul_ps(nz[j], _mm_sub_ps(cz, rsz)));
+			__m128 max_dist = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(nx[j], _mm_add_ps(cx, rsx)),
+				_mm_mul_ps(ny[j], _mm_add_ps(cy, rsy))),
+				_mm_mul_ps(nz[j], _mm_add_ps(cz, rsz)));
+
+			outside = _mm_or_ps(outside, _mm_cmpgt_ps(min_dist, neg_d[j]));
+			straddle = _mm_or_ps(straddle, _mm_cmpgt_ps(max_dist, neg_d[j]));
+		}
+
+		S32 outside_mask = _mm_movemask_ps(outside);
+		S32 straddle_mask = _mm_movemask_ps(straddle);
+		S32 big_mask = 0;
+		if (far_clip)
+		{
+			__m128 radius_sq = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_mul_ps(rz, rz));
+			big_mask = _mm_movemask_ps(_mm_cmpgt_ps(radius_sq, corner_dist_sq));
+		}
+
+		for (S32 k = 0; k < 4; k++)
+		{
+			S32 bit = 1 << k;
+			if (big_mask & bit)
+			{
+				results[i+k] = (S8) AABBInFrustum(bounds.getCenter(i+k), bounds.getRadius(i+k));
+			}
+			else
+			{
+				results[i+k] = (outside_mask & bit) ? 0 : ((straddle_mask & bit) ? 1 : 2);
+			}
+		}
+	}
+}
+
+#else // LL_CAMERA_SSE
+
+void LLCamera::packedAABBInFrustum(const LLPackedBounds& bounds, S8* results, BOOL far_clip)
+{
+	S32 count = bounds.getSlotCount();
+	for (S32 i = 0; i < count; i++)
+	{
+		LLVector3 center = bounds.getCenter(i);
+		LLVector3 radius = bounds.getRadius(i);
+		results[i] = (S8) (far_clip ? AABBInFrustum(center, radius) : AABBInFrustumNoFarClip(center, radius));
+	}
+}
+
+#endif // LL_CAMERA_SSE
+
 int LLCamera::sphereInFrustumQuick(const LLVector3 &sphere_center, const F32 radius) 
 {
 	LLVector3 dist = sphere_center-mFrustCenter;
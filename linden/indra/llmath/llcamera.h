@@ -38,6 +38,8 @@
 #include "llcoordframe.h"
 #include "llplane.h"
 
+class LLPackedBounds;
+
 const F32 DEFAULT_FIELD_OF_VIEW 	= 60.f * DEG_TO_RAD;
 const F32 DEFAULT_ASPECT_RATIO 		= 640.f / 480.f;
 const F32 DEFAULT_NEAR_PLANE 		= 0.25f;
@@ -187,6 +189,11 @@ public:
 	S32 sphereInFrustumFull(const LLVector3 &center, const F32 radius) const { return sphereInFrustum(center, radius); }
 	S32 AABBInFrustum(const LLVector3 &center, const LLVector3& radius);
 	S32 AABBInFrustumNoFarClip(const LLVector3 &center, const LLVector3& radius);
+	// Write what AABBInFrustum() (or AABBInFrustumNoFarClip()) returns for
+	// every slot of bounds into results, which must hold
+	// bounds.getSlotCount() values.  With SSE this tests four boxes at a time.
+	void AABBInFrustumPacked(const LLPackedBounds& bounds, S8* results);
+	void AABBInFrustumNoFarClipPacked(const LLPackedBounds& bounds, S8* results);
 
 	//does a quick 'n dirty sphere-sphere check
 	S32 sphereInFrustumQuick(const LLVector3 &sphere_center, const F32 radius); 
@@ -207,6 +214,7 @@ protected:
 	void calculateFrustumPlanes(F32 left, F32 right, F32 top, F32 bottom);
 	void calculateFrustumPlanesFromWindow(F32 x1, F32 y1, F32 x2, F32 y2);
 	void calculateWorldFrustumPlanes();
+	void packedAABBInFrustum(const LLPackedBounds& bounds, S8* results, BOOL far_clip);
 };
 
 
@@ -33,6 +33,7 @@
 #ifndef LL_LLOCTREE_H
 #define LL_LLOCTREE_H
 
+#include "llfixedsizepool.h"
 #include "lltreenode.h"
 #include "v3math.h"
 #include <vector>
@@ -51,6 +52,9 @@
 #define LL_OCTREE_MAX_CAPACITY 128
 #endif
 
+#define LL_OCTREE_MAX_CHILDREN 8
+#define LL_OCTREE_NODES_PER_SLAB 256
+
 template <class T> class LLOctreeNode;
 
 template <class T>
@@ -83,7 +87,6 @@ public:
 	typedef typename std::set<LLPointer<T> >::iterator			element_iter;
 	typedef typename std::set<LLPointer<T> >::const_iterator	const_element_iter;
 	typedef typename std::vector<LLTreeListener<T>*>::iterator	tree_listener_iter;
-	typedef typename std::vector<LLOctreeNode<T>* >				child_list;
 	typedef LLTreeNode<T>		BaseType;
 	typedef LLOctreeNode<T>		oct_node;
 	typedef LLOctreeListener<T>	oct_listener;
@@ -96,7 +99,8 @@ public:
 					LLVector3d size, 
 					BaseType* parent, 
 					U8 octant = 255)
-	:	mParent((oct_node*)parent), 
+	:	mChildCount(0),
+		mParent((oct_node*)parent), 
 		mCenter(center), 
 		mSize(size), 
 		mOctant(octant) 
@@ -120,6 +124,36 @@ public:
 		} 
 	}
 
+	// Nodes come from a per type pool rather than the heap, since regions
+	// with lots of moving objects make and destroy them constantly.
+	// Subclasses with members of their own are a different size and use
+	// the heap.
+	static void* operator new(size_t size)
+	{
+		if (size != sizeof(LLOctreeNode<T>))
+		{
+			return ::operator new(size);
+		}
+		return getNodePool().allocate();
+	}
+
+	static void operator delete(void* ptr, size_t size)
+	{
+		if (size != sizeof(LLOctreeNode<T>))
+		{
+			::operator delete(ptr);
+			return;
+		}
+		getNodePool().free(ptr);
+	}
+
+	// Never destroyed, so nodes may be deleted during static destruction.
+	static LLFixedSizePool& getNodePool()
+	{
+		static LLFixedSizePool* pool = new LLFixedSizePool(sizeof(LLOctreeNode<T>), LL_OCTREE_NODES_PER_SLAB);
+		return *pool;
+	}
+
 	inline const BaseType* getParent()	const			{ return mParent; }
 	inline void setParent(BaseType* parent)			{ mParent = (oct_node*) parent; }
 	inline const LLVector3d& getCenter() const			{ return mCenter; }
@@ -229,17 +263,15 @@ public:
 	}
 
 	void accept(oct_traveler* visitor)				{ visitor->visit(this); }
-	virtual bool isLeaf() const						{ return mChild.empty(); }
+	virtual bool isLeaf() const						{ return mChildCount == 0; }
 	
 	U32 getElementCount() const						{ return mData.size(); }
 	element_list& getData()							{ return mData; }
 	const element_list& getData() const				{ return mData; }
 	
-	U32 getChildCount()	const						{ return mChild.size(); }
+	U32 getChildCount()	const						{ return mChildCount; }
 	oct_node* getChild(U32 index)					{ return mChild[index]; }
 	const oct_node* getChild(U32 index) const		{ return mChild[index]; }
-	child_list& getChildren()						{ return mChild; }
-	const child_list& getChildren() const			{ return mChild; }
 	
 	void accept(tree_traveler* visitor) const		{ visitor->visit(this); }
 	void accept(oct_traveler* visitor) const		{ visitor->visit(this); }
@@ -341,14 +373,16 @@ public:
 					return true;
 				}
 
-#if LL_OCTREE_PARANOIA_CHECK
-				if (getChildCount() == 8)
+				if (getChildCount() == LL_OCTREE_MAX_CHILDREN)
 				{
 					//this really isn't possible, something bad has happened
 					OCT_ERRS << "Octree detected floating point error and gave up." << llendl;
-					return false;
+					mData.insert(data);
+					BaseType::insert(data);
+					return true;
 				}
-				
+
+#if LL_OCTREE_PARANOIA_CHECK
 				//make sure no existing node matches this position
 				for (U32 i = 0; i < getChildCount(); i++)
 				{
@@ -369,15 +403,22 @@ public:
 		}
 		else 
 		{
-			//it's not in here, give it to the root
-			//OCT_ERRS << "Octree insertion failed, starting over from root!" << llendl;
-
+			//it's not in here, give it to the nearest ancestor big enough
+			//to hold it, which is where a search from the root would get to,
+			//or to the root if none is
 			oct_node* node = this;
 
 			while (parent)
 			{
 				node = parent;
 				parent = node->getOctParent();
+				if (parent &&
+					node->getSize().mdV[0] > data->getBinRadius() &&
+					node->isInside(data->getPositionGroup()))
+				{
+					node = node->getNodeAt(data);
+					break;
+				}
 			}
 
 			node->insert(data);
@@ -443,7 +484,7 @@ public:
 
 	void clearChildren()
 	{
-		mChild.clear();
+		mChildCount = 0;
 	}
 
 	void validate()
@@ -489,13 +530,14 @@ public:
 			}
 		}
 
-		if (mChild.size() >= 8)
+#endif
+
+		if (mChildCount >= LL_OCTREE_MAX_CHILDREN)
 		{
-			OCT_ERRS <<"Octree node has too many children... why?" << llendl;
+			llerrs << "Octree node has too many children... why?" << llendl;
 		}
-#endif
 
-		mChild.push_back(child);
+		mChild[mChildCount++] = child;
 		child->setParent(this);
 
 		if (!silent)
@@ -521,7 +563,11 @@ public:
 			mChild[index]->destroy();
 			delete mChild[index];
 		}
-		mChild.erase(mChild.begin() + index);
+		for (U32 i = index + 1; i < mChildCount; i++)
+		{
+			mChild[i-1] = mChild[i];
+		}
+		mChildCount--;
 
 		checkAlive();
 	}
@@ -553,7 +599,8 @@ public:
 	}
 
 protected:	
-	child_list mChild;
+	oct_node* mChild[LL_OCTREE_MAX_CHILDREN];
+	U8 mChildCount;
 	element_list mData;
 	oct_node* mParent;
 	LLVector3d mCenter;
@@ -0,0 +1,92 @@
+/**
+ * @file llpackedbounds.cpp
+ * @brief Structure of arrays storage for axis aligned bounding boxes
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include "llpackedbounds.h"
+
+// Slots are added this many at a time, so the arrays can always be read
+// four floats at a time.
+static const S32 SLOT_BLOCK = 4;
+
+LLPackedBounds::LLPackedBounds()
+{
+}
+
+S32 LLPackedBounds::allocate()
+{
+	if (mFreeSlots.empty())
+	{
+		S32 count = getSlotCount();
+		for (S32 axis = 0; axis < 3; axis++)
+		{
+			mCenter[axis].resize(count + SLOT_BLOCK, 0.f);
+			mRadius[axis].resize(count + SLOT_BLOCK, 0.f);
+		}
+		for (S32 slot = count + SLOT_BLOCK - 1; slot >= count; slot--)
+		{	//lowest slot on top
+			mFreeSlots.push_back(slot);
+		}
+	}
+
+	S32 slot = mFreeSlots.back();
+	mFreeSlots.pop_back();
+	return slot;
+}
+
+void LLPackedBounds::release(S32 slot)
+{
+	llassert(slot >= 0 && slot < getSlotCount());
+	set(slot, LLVector3::zero, LLVector3::zero);
+	mFreeSlots.push_back(slot);
+}
+
+void LLPackedBounds::set(S32 slot, const LLVector3& center, const LLVector3& radius)
+{
+	llassert(slot >= 0 && slot < getSlotCount());
+	for (S32 axis = 0; axis < 3; axis++)
+	{
+		mCenter[axis][slot] = center.mV[axis];
+		mRadius[axis][slot] = radius.mV[axis];
+	}
+}
+
+LLVector3 LLPackedBounds::getCenter(S32 slot) const
+{
+	return LLVector3(mCenter[VX][slot], mCenter[VY][slot], mCenter[VZ][slot]);
+}
+
+LLVector3 LLPackedBounds::getRadius(S32 slot) const
+{
+	return LLVector3(mRadius[VX][slot], mRadius[VY][slot], mRadius[VZ][slot]);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file llpackedbounds.h
+ * @brief Structure of arrays storage for axis aligned bounding boxes
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#ifndef LL_LLPACKEDBOUNDS_H
+#define LL_LLPACKEDBOUNDS_H
+
+#include <vector>
+
+#include "v3math.h"
+
+// Axis aligned boxes, as a center and a radius (half size), stored as six
+// float arrays so that SIMD code can test several boxes at once, as
+// LLCamera::AABBInFrustumPacked() does.  Boxes live in slots handed out by
+// allocate(); freed slots are reused.  The slot count is always a multiple
+// of four, and unused slots hold an empty box at the origin.
+class LLPackedBounds
+{
+public:
+	LLPackedBounds();
+
+	// Returns a slot for a new box, which is empty until set() is called.
+	S32 allocate();
+	void release(S32 slot);
+
+	void set(S32 slot, const LLVector3& center, const LLVector3& radius);
+	LLVector3 getCenter(S32 slot) const;
+	LLVector3 getRadius(S32 slot) const;
+
+	// Number of slots, in use or not.
+	S32 getSlotCount() const			{ return (S32) mCenter[VX].size(); }
+	S32 getFreeCount() const			{ return (S32) mFreeSlots.size(); }
+
+	// Arrays of getSlotCount() values for the given axis (VX, VY or VZ).
+	const F32* getCenters(S32 axis) const	{ return &mCenter[axis][0]; }
+	const F32* getRadii(S32 axis) const		{ return &mRadius[axis][0]; }
+
+private:
+	std::vector<F32> mCenter[3];
+	std::vector<F32> mRadius[3];
+	std::vector<S32> mFreeSlots;
+};
+
+#endif
@@ -1651,17 +1651,19 @@ void LLPathParams::copyParams(const LLPathParams &params)
 	setSkew(params.getSkew());
 }
 
-S32 profile_delete_lock = 1 ; 
+// Counts the volumes deleting their profile.  A count rather than a flag,
+// since volumes may be deleted on the volume generation threads.
+LLAtomicS32 profile_delete_lock;
 LLProfile::~LLProfile()
 {
-	if(profile_delete_lock)
+	if(!profile_delete_lock)
 	{
 		llerrs << "LLProfile should not be deleted here!" << llendl ;
 	}
 }
 
 
-S32 LLVolume::sNumMeshPoints = 0;
+LLAtomicS32 LLVolume::sNumMeshPoints;
 
 LLVolume::LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL generate_single_face, const BOOL is_unique)
 	: mParams(params)
@@ -1693,6 +1695,22 @@ LLVolume::LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL ge
 	}
 }
 
+S32 LLVolume::getDataSize() const
+{
+	S32 size = sizeof(LLVolume);
+	size += mPathp->mPath.capacity() * sizeof(LLPath::PathPt);
+	size += mProfilep->mProfile.capacity() * sizeof(LLVector3);
+	size += mMesh.capacity() * sizeof(Point);
+	for (face_list_t::const_iterator iter = mVolumeFaces.begin(); iter != mVolumeFaces.end(); ++iter)
+	{
+		size += sizeof(LLVolumeFace);
+		size += iter->mVertices.capacity() * sizeof(LLVolumeFace::VertexData);
+		size += iter->mIndices.capacity() * sizeof(U16);
+		size += iter->mEdge.capacity() * sizeof(S32);
+	}
+	return size;
+}
+
 void LLVolume::resizePath(S32 length)
 {
 	mPathp->resizePath(length);
@@ -1715,9 +1733,9 @@ LLVolume::~LLVolume()
 	sNumMeshPoints -= mMesh.size();
 	delete mPathp;
 
-	profile_delete_lock = 0 ;
+	profile_delete_lock++ ;
 	delete mProfilep;
-	profile_delete_lock = 1 ;
+	profile_delete_lock-- ;
 
 	mPathp = NULL;
 	mProfilep = NULL;
@@ -54,6 +54,7 @@ class LLVolume;
 #include "v4coloru.h"
 #include "llmemory.h"
 #include "llfile.h"
+#include "llapr.h"
 
 //============================================================================
 
@@ -931,7 +932,12 @@ public:
 	LLFaceID generateFaceMask();
 
 	BOOL isFaceMaskValid(LLFaceID face_mask);
-	static S32 sNumMeshPoints;
+
+	// Approximate bytes held by the path, profile, mesh and volume faces.
+	S32 getDataSize() const;
+
+	// Volumes may be generated on the volume generation threads.
+	static LLAtomicS32 sNumMeshPoints;
 
 	friend std::ostream& operator<<(std::ostream &s, const LLVolume &volume);
 	friend std::ostream& operator<<(std::ostream &s, const LLVolume *volumep);		// HACK to bypass Windoze confusion over 
@@ -0,0 +1,295 @@
+/**
+ * @file llvolumefacefill.cpp
+ * @brief Fills vertex arrays from an LLVolumeFace
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llvolumefacefill.h"
+
+#include "llbatchthread.h"
+#include "llvolume.h"
+
+// Vertices per fill job.  Enough work to be worth a queued request, and
+// small enough to spread a frame's rebuilds over a few cores.
+static const S32 VERTICES_PER_JOB = 4096;
+
+class LLVolumeFaceFillJob : public LLBatchThread::Job
+{
+public:
+	LLVolumeFaceFillJob(LLVolumeFaceFill* begin, LLVolumeFaceFill* end)
+	:	mBegin(begin), mEnd(end)
+	{
+	}
+
+	/*virtual*/ void run()
+	{
+		for (LLVolumeFaceFill* fill = mBegin; fill != mEnd; ++fill)
+		{
+			fill->fill();
+		}
+	}
+
+private:
+	LLVolumeFaceFill* mBegin;
+	LLVolumeFaceFill* mEnd;
+};
+
+LLVolumeFaceFill::LLVolumeFaceFill()
+:	mFace(NULL),
+	mIndexOffset(0),
+	mPlanarTexGen(FALSE),
+	mTexGenScale(1.f, 1.f, 1.f),
+	mTextureMatrix(NULL),
+	mCosAng(1.f),
+	mSinAng(0.f),
+	mOffsetS(0.f),
+	mOffsetT(0.f),
+	mScaleS(1.f),
+	mScaleT(1.f),
+	mBinormalDir(0.f, 1.f, 0.f),
+	mRotateBinormal(FALSE)
+{
+}
+
+S32 LLVolumeFaceFill::getNumVertices() const
+{
+	return mFace ? (S32)mFace->mVertices.size() : 0;
+}
+
+//static
+void LLVolumeFaceFill::fillAll(fill_list_t& fills, LLBatchThread* thread)
+{
+	if (fills.empty())
+	{
+		return;
+	}
+
+	LLVolumeFaceFill* first = &fills[0];
+	LLVolumeFaceFill* last = first + fills.size();
+
+	std::vector<LLVolumeFaceFillJob> jobs;
+	if (thread)
+	{
+		LLVolumeFaceFill* begin = first;
+		S32 vertices = 0;
+		for (LLVolumeFaceFill* fill = first; fill != last; ++fill)
+		{
+			vertices += fill->getNumVertices();
+			if (vertices >= VERTICES_PER_JOB)
+			{
+				jobs.push_back(LLVolumeFaceFillJob(begin, fill + 1));
+				begin = fill + 1;
+				vertices = 0;
+			}
+		}
+		if (begin != last)
+		{
+			jobs.push_back(LLVolumeFaceFillJob(begin, last));
+		}
+	}
+
+	if (jobs.size() < 2)
+	{	//not worth a batch
+		LLVolumeFaceFillJob(first, last).run();
+		return;
+	}
+
+	LLBatchThread::job_list_t job_list;
+	for (std::vector<LLVolumeFaceFillJob>::iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+	{
+		job_list.push_back(&(*iter));
+	}
+	thread->runJobs(job_list);
+}
+
+/*
+For each vertex, given:
+	B - binormal
+	T - tangent
+	N - normal
+	P - position
+
+The resulting texture coordinate <u,v> is:
+
+	u = 2(B dot P)
+	v = 2(T dot P)
+*/
+//static
+void LLVolumeFaceFill::planarProjection(LLVector2& tc, const LLVector3& normal, const LLVector3& vec)
+{
+	LLVector3 binormal;
+	float d = normal * LLVector3(1,0,0);
+	if (d >= 0.5f || d <= -0.5f)
+	{
+		binormal = LLVector3(0,1,0);
+		if (normal.mV[0] < 0)
+		{
+			binormal = -binormal;
+		}
+	}
+	else
+	{
+		binormal = LLVector3(1,0,0);
+		if (normal.mV[1] > 0)
+		{
+			binormal = -binormal;
+		}
+	}
+	LLVector3 tangent = binormal % normal;
+
+	tc.mV[1] = -((tangent*vec)*2 - 0.5f);
+	tc.mV[0] = 1.0f+((binormal*vec)*2 - 0.5f);
+}
+
+//static
+void LLVolumeFaceFill::transformTexCoord(LLVector2& tc, F32 cos_ang, F32 sin_ang,
+										 F32 offset_s, F32 offset_t, F32 scale_s, F32 scale_t)
+{
+	F32 s = tc.mV[0];
+	F32 t = tc.mV[1];
+
+	// Texture transforms are done about the center of the face.
+	s -= 0.5; 
+	t -= 0.5;
+
+	// Handle rotation
+	F32 temp = s;
+	s  = s     * cos_ang + t * sin_ang;
+	t  = -temp * sin_ang + t * cos_ang;
+
+	// Then scale
+	s *= scale_s;
+	t *= scale_t;
+
+	// Then offset
+	s += offset_s + 0.5f; 
+	t += offset_t + 0.5f;
+
+	tc.mV[0] = s;
+	tc.mV[1] = t;
+}
+
+void LLVolumeFaceFill::fill()
+{
+	const LLVolumeFace& vf = *mFace;
+	S32 num_vertices = (S32)vf.mVertices.size();
+	S32 num_indices = (S32)vf.mIndices.size();
+
+	if (mIndices.get())
+	{
+		for (S32 i = 0; i < num_indices; i++)
+		{
+			*mIndices++ = vf.mIndices[i] + mIndexOffset;
+		}
+	}
+
+	BOOL rebuild_tcoord = mTexCoords.get() != NULL;
+	BOOL rebuild_bump = rebuild_tcoord && mBumpTexCoords.get() != NULL;
+	BOOL rebuild_pos = mVertices.get() != NULL;
+	BOOL rebuild_normal = mNormals.get() != NULL;
+	BOOL rebuild_binormal = mBinormals.get() != NULL;
+	BOOL rebuild_color = mColors.get() != NULL;
+
+	for (S32 i = 0; i < num_vertices; i++)
+	{
+		const LLVolumeFace::VertexData& v = vf.mVertices[i];
+
+		if (rebuild_tcoord)
+		{
+			LLVector2 tc = v.mTexCoord;
+
+			if (mPlanarTexGen)
+			{
+				LLVector3 vec = v.mPosition;
+				vec.scaleVec(mTexGenScale);
+				planarProjection(tc, v.mNormal, vec);
+			}
+
+			if (mTextureMatrix)
+			{
+				LLVector3 tmp(tc.mV[0], tc.mV[1], 0.f);
+				tmp = tmp * *mTextureMatrix;
+				tc.mV[0] = tmp.mV[0];
+				tc.mV[1] = tmp.mV[1];
+			}
+			else
+			{
+				transformTexCoord(tc, mCosAng, mSinAng, mOffsetS, mOffsetT, mScaleS, mScaleT);
+			}
+
+			*mTexCoords++ = tc;
+
+			if (rebuild_bump)
+			{
+				LLVector3 tangent = v.mBinormal % v.mNormal;
+
+				LLMatrix3 tangent_to_object;
+				tangent_to_object.setRows(tangent, v.mBinormal, v.mNormal);
+				LLVector3 binormal = mBinormalDir * tangent_to_object;
+				binormal = binormal * mNormalMatrix;
+
+				if (mRotateBinormal)
+				{
+					binormal *= mBinormalRotation;
+				}
+
+				binormal.normVec();
+				tc += LLVector2( mBumpS * tangent, mBumpT * binormal );
+
+				*mBumpTexCoords++ = tc;
+			}
+		}
+
+		if (rebuild_pos)
+		{
+			*mVertices++ = v.mPosition * mVertexMatrix;
+		}
+
+		if (rebuild_normal)
+		{
+			LLVector3 normal = v.mNormal * mNormalMatrix;
+			normal.normVec();
+			*mNormals++ = normal;
+		}
+
+		if (rebuild_binormal)
+		{
+			LLVector3 binormal = v.mBinormal * mNormalMatrix;
+			binormal.normVec();
+			*mBinormals++ = binormal;
+		}
+
+		if (rebuild_color)
+		{
+			*mColors++ = mColor;
+		}
+	}
+}
@@ -0,0 +1,120 @@
+/**
+ * @file llvolumefacefill.h
+ * @brief Fills vertex arrays from an LLVolumeFace
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLVOLUMEFACEFILL_H
+#define LL_LLVOLUMEFACEFILL_H
+
+#include <vector>
+
+#include "llstrider.h"
+#include "llquaternion.h"
+#include "m3math.h"
+#include "m4math.h"
+#include "v2math.h"
+#include "v3math.h"
+#include "v4coloru.h"
+
+class LLBatchThread;
+class LLVolumeFace;
+
+// Everything needed to write one volume face into vertex arrays: where to
+// write, which attributes, and how to transform them.  The caller sets it up
+// (LLFace::prepareGeometryVolume() does, from the object and its texture
+// entry) and fill() then only reads the face and this object, so fills for
+// different faces may run on different threads as long as the volume is not
+// changed meanwhile.
+//
+// Attributes whose strider is left NULL are not written.
+class LLVolumeFaceFill
+{
+public:
+	LLVolumeFaceFill();
+
+	// Writes the indices and the vertex attributes.
+	void fill();
+
+	S32 getNumVertices() const;
+
+	typedef std::vector<LLVolumeFaceFill> fill_list_t;
+
+	// Runs fill() for each of fills.  With a thread, large lists are split
+	// into jobs of whole faces and run on it and the calling thread at once.
+	static void fillAll(fill_list_t& fills, LLBatchThread* thread);
+
+	// Planar texgen of a position, scaled by the object scale, about normal.
+	static void planarProjection(LLVector2& tc, const LLVector3& normal, const LLVector3& vec);
+
+	// Texture entry transform: rotation, then scale, then offset, about the
+	// center of the texture.
+	static void transformTexCoord(LLVector2& tc, F32 cos_ang, F32 sin_ang,
+								  F32 offset_s, F32 offset_t, F32 scale_s, F32 scale_t);
+
+public:
+	const LLVolumeFace* mFace;
+	LLMatrix4 mVertexMatrix;
+	LLMatrix3 mNormalMatrix;
+
+	// Added to every index.
+	U16 mIndexOffset;
+
+	LLStrider<LLVector3> mVertices;
+	LLStrider<LLVector3> mNormals;
+	LLStrider<LLVector3> mBinormals;
+	LLStrider<LLVector2> mTexCoords;
+	LLStrider<LLVector2> mBumpTexCoords;
+	LLStrider<LLColor4U> mColors;
+	LLStrider<U16>       mIndices;
+
+	// Texture coordinates.  With a texture matrix, it replaces the texture
+	// entry transform.
+	BOOL mPlanarTexGen;
+	LLVector3 mTexGenScale;
+	const LLMatrix4* mTextureMatrix;
+	F32 mCosAng;
+	F32 mSinAng;
+	F32 mOffsetS;
+	F32 mOffsetT;
+	F32 mScaleS;
+	F32 mScaleT;
+
+	// Bump map texture coordinates, offset along the light ray in tangent
+	// space.  Needs the face binormals.
+	LLVector3 mBinormalDir;
+	LLVector3 mBumpS;
+	LLVector3 mBumpT;
+	BOOL mRotateBinormal;
+	LLQuaternion mBinormalRotation;
+
+	LLColor4U mColor;
+};
+
+#endif
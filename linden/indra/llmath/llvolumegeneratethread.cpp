@@ -0,0 +1,106 @@
+/**
+ * @file llvolumegeneratethread.cpp
+ * @brief Generates LLVolumes off the main thread
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llvolumegeneratethread.h"
+
+//----------------------------------------------------------------------------
+
+// MAIN THREAD
+LLVolumeGenerateThread::LLVolumeGenerateThread(bool threaded, LLThreadPool* pool)
+	: LLQueuedThread("volumegenerate", threaded, pool)
+{
+}
+
+// MAIN THREAD
+LLVolumeGenerateThread::handle_t LLVolumeGenerateThread::generateVolume(const LLVolumeParams& params, F32 detail, U32 priority)
+{
+	handle_t handle = generateHandle();
+	VolumeRequest* req = new VolumeRequest(handle, priority, params, detail);
+	bool res = addRequest(req);
+	if (!res)
+	{
+		llerrs << "request added after LLVolumeGenerateThread::shutdown()" << llendl;
+	}
+	return handle;
+}
+
+// MAIN THREAD
+LLPointer<LLVolume> LLVolumeGenerateThread::takeGeneratedVolume(handle_t handle)
+{
+	if (getRequestStatus(handle) != STATUS_COMPLETE)
+	{
+		return NULL;
+	}
+	return ((VolumeRequest*)getRequest(handle))->takeVolume();
+}
+
+// MAIN THREAD
+void LLVolumeGenerateThread::releaseVolume(handle_t handle)
+{
+	// Flag first, so a request that finishes from here on deletes itself.
+	// One that had already finished is still there to complete.
+	abortRequest(handle, true);
+	if (getRequestStatus(handle) == STATUS_COMPLETE)
+	{
+		completeRequest(handle);
+	}
+}
+
+//----------------------------------------------------------------------------
+
+LLVolumeGenerateThread::VolumeRequest::VolumeRequest(handle_t handle, U32 priority, const LLVolumeParams& params, F32 detail)
+	: LLQueuedThread::QueuedRequest(handle, priority),
+	  mParams(params),
+	  mDetail(detail)
+{
+}
+
+LLVolumeGenerateThread::VolumeRequest::~VolumeRequest()
+{
+}
+
+// MAIN THREAD
+LLPointer<LLVolume> LLVolumeGenerateThread::VolumeRequest::takeVolume()
+{
+	// Leaves the request nothing to unref when a worker deletes it
+	LLPointer<LLVolume> volume = mVolume;
+	mVolume = NULL;
+	return volume;
+}
+
+bool LLVolumeGenerateThread::VolumeRequest::processRequest()
+{
+	mVolume = new LLVolume(mParams, mDetail);
+	return true;
+}
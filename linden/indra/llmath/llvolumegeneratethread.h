@@ -0,0 +1,86 @@
+/**
+ * @file llvolumegeneratethread.h
+ * @brief Generates LLVolumes off the main thread
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLVOLUMEGENERATETHREAD_H
+#define LL_LLVOLUMEGENERATETHREAD_H
+
+#include "llqueuedthread.h"
+#include "llvolume.h"
+
+// Generates volumes (path, profile, mesh and volume faces, but not sculpts)
+// on its own thread or on the threads of an LLThreadPool.  LLVolumeMgr
+// queues a volume with generateVolume(), polls takeGeneratedVolume() until
+// it is ready, and hands the handle back with releaseVolume().
+//
+// LLVolume's reference count is not thread safe, so a volume the main
+// thread has seen is never referenced or released on a worker: the main
+// thread takes the request's reference before the request is deleted.
+
+class LLVolumeGenerateThread : public LLQueuedThread
+{
+public:
+	class VolumeRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		virtual ~VolumeRequest(); // use deleteRequest()
+
+	public:
+		VolumeRequest(handle_t handle, U32 priority, const LLVolumeParams& params, F32 detail);
+
+		/*virtual*/ bool processRequest();
+
+		// Hands over the request's reference to the volume.
+		LLPointer<LLVolume> takeVolume();
+
+	private:
+		LLVolumeParams mParams;
+		F32 mDetail;
+		LLPointer<LLVolume> mVolume;
+	};
+
+public:
+	LLVolumeGenerateThread(bool threaded = true, LLThreadPool* pool = NULL);
+
+	// Queues a volume of params at detail (a volume scale, see
+	// LLVolumeLODGroup::getVolumeScaleFromDetail()).
+	handle_t generateVolume(const LLVolumeParams& params, F32 detail, U32 priority = PRIORITY_NORMAL);
+
+	// Returns the volume, or NULL while it is still being generated.  The
+	// caller gets the request's reference, so only the first call for a
+	// handle returns it.
+	LLPointer<LLVolume> takeGeneratedVolume(handle_t handle);
+
+	// Frees a request, or abandons one that has not finished.
+	void releaseVolume(handle_t handle);
+};
+
+#endif // LL_LLVOLUMEGENERATETHREAD_H
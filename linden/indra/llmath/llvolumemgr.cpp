@@ -48,10 +48,32 @@ F32 LLVolumeLODGroup::mDetailThresholds[NUM_LODS] = {BASE_THRESHOLD,
 F32 LLVolumeLODGroup::mDetailScales[NUM_LODS] = {1.f, 1.5f, 2.5f, 4.f};
 
 
+//============================================================================
+
+LLVolumeMgr::Stats::Stats()
+:	mRequests(0),
+	mSharedHits(0),
+	mCacheHits(0),
+	mGenerated(0),
+	mEvictions(0),
+	mBytesSaved(0),
+	mCachedVolumes(0),
+	mCachedBytes(0)
+{
+}
+
+F32 LLVolumeMgr::Stats::getHitRate() const
+{
+	return mRequests ? (F32)(mSharedHits + mCacheHits) / (F32)mRequests : 0.f;
+}
+
 //============================================================================
 
 LLVolumeMgr::LLVolumeMgr()
-:	mDataMutex(NULL)
+:	mDataMutex(NULL),
+	mCacheSize(0),
+	mGenerateThread(NULL),
+	mUpdateCount(0)
 {
 	// the LLMutex magic interferes with easy unit testing,
 	// so you now must manually call useMutex() to use it
@@ -73,6 +95,11 @@ BOOL LLVolumeMgr::cleanup()
 	{
 		mDataMutex->lock();
 	}
+	abortRequests();
+	mCache.clear();
+	mCacheMap.clear();
+	mStats.mCachedVolumes = 0;
+	mStats.mCachedBytes = 0;
 	for (volume_lod_group_map_t::iterator iter = mVolumeLODGroups.begin(),
 			 end = mVolumeLODGroups.end();
 		 iter != end; iter++)
@@ -112,11 +139,140 @@ LLVolume* LLVolumeMgr::refVolume(const LLVolumeParams &volume_params, const S32
 	{
 		volgroupp = iter->second;
 	}
+
+	mStats.mRequests++;
+	BOOL shared = volgroupp->getNumLODRefs(detail) > 0;
+	LLVolume* volumep = volgroupp->refLOD(detail, mGenerateThread);
+	cache_map_t::iterator cached = mCacheMap.find(volumep);
+	if (cached != mCacheMap.end())
+	{
+		const CacheEntry& entry = *cached->second;
+		if (entry.mGenerated)
+		{
+			// Generated ahead for this ref, not saved by the cache
+			mStats.mGenerated++;
+		}
+		else
+		{
+			mStats.mCacheHits++;
+			mStats.mBytesSaved += entry.mBytes;
+		}
+		uncacheVolume(volumep);
+	}
+	else if (shared)
+	{
+		mStats.mSharedHits++;
+		mStats.mBytesSaved += volumep->getDataSize();
+	}
+	else
+	{
+		mStats.mGenerated++;
+	}
+
+	if (mDataMutex)
+	{
+		mDataMutex->unlock();
+	}
+	return volumep;
+}
+
+BOOL LLVolumeMgr::requestVolume(const LLVolumeParams &volume_params, const S32 detail)
+{
+	if (!mGenerateThread || volume_params.getSculptID().notNull())
+	{
+		return TRUE;
+	}
+	if (mDataMutex)
+	{
+		mDataMutex->lock();
+	}
+	LLVolumeLODGroup* volgroupp;
+	volume_lod_group_map_t::iterator iter = mVolumeLODGroups.find(&volume_params);
+	if( iter == mVolumeLODGroups.end() )
+	{
+		volgroupp = createNewGroup(volume_params);
+	}
+	else
+	{
+		volgroupp = iter->second;
+	}
+	BOOL ready = volgroupp->requestLOD(detail, mGenerateThread);
+	if (!ready)
+	{
+		mPendingGroups.insert(volgroupp);
+	}
+	if (mDataMutex)
+	{
+		mDataMutex->unlock();
+	}
+	return ready;
+}
+
+void LLVolumeMgr::update()
+{
+	if (!mGenerateThread)
+	{
+		return;
+	}
+	mGenerateThread->update(1); // unpauses the generate thread
+
+	if (mDataMutex)
+	{
+		mDataMutex->lock();
+	}
+	mUpdateCount++;
+	// Volumes generated ahead that nothing took since the last update are
+	// now cached like any other
+	trimCache();
+
+	std::vector<LLVolume*> volumes;
+	for (group_set_t::iterator iter = mPendingGroups.begin(); iter != mPendingGroups.end(); )
+	{
+		group_set_t::iterator cur = iter++;
+		if ((*cur)->collectLODs(mGenerateThread, volumes) == 0)
+		{
+			mPendingGroups.erase(cur);
+		}
+	}
+	for (std::vector<LLVolume*>::iterator iter = volumes.begin(); iter != volumes.end(); ++iter)
+	{
+		cacheVolume(*iter, TRUE);
+	}
+	if (mDataMutex)
+	{
+		mDataMutex->unlock();
+	}
+}
+
+void LLVolumeMgr::setCacheSize(S32 max_bytes)
+{
+	if (mDataMutex)
+	{
+		mDataMutex->lock();
+	}
+	mCacheSize = llmax(max_bytes, 0);
+	trimCache();
+	if (mDataMutex)
+	{
+		mDataMutex->unlock();
+	}
+}
+
+void LLVolumeMgr::setGenerateThread(LLVolumeGenerateThread* thread)
+{
+	if (mDataMutex)
+	{
+		mDataMutex->lock();
+	}
+	if (thread != mGenerateThread)
+	{
+		abortRequests();
+		mGenerateThread = thread;
+	}
 	if (mDataMutex)
 	{
 		mDataMutex->unlock();
 	}
-	return volgroupp->refLOD(detail);
 }
 
 // virtual
@@ -166,10 +322,17 @@ void LLVolumeMgr::unrefVolume(LLVolume *volumep)
 		LLVolumeLODGroup* volgroupp = iter->second;
 
 		volgroupp->derefLOD(volumep);
-		if (volgroupp->getNumRefs() == 0)
+		if (volgroupp->getNumLODRefs(volgroupp->getDetail(volumep)) == 0)
 		{
-			mVolumeLODGroups.erase(params);
-			delete volgroupp;
+			// Sculpties are not cached, their mesh comes from the texture
+			if (mCacheSize > 0 && params->getSculptID().isNull())
+			{
+				cacheVolume(volumep, FALSE);
+			}
+			else
+			{
+				releaseVolume(volumep);
+			}
 		}
 	}
 	if (mDataMutex)
@@ -194,6 +357,93 @@ LLVolumeLODGroup* LLVolumeMgr::createNewGroup(const LLVolumeParams& volume_param
 	return volgroup;
 }
 
+// protected
+void LLVolumeMgr::cacheVolume(LLVolume* volumep, BOOL generated)
+{
+	CacheEntry entry;
+	entry.mVolume = volumep;
+	entry.mBytes = volumep->getDataSize();
+	entry.mUpdate = mUpdateCount;
+	entry.mGenerated = generated;
+	mCacheMap[volumep] = mCache.insert(mCache.end(), entry);
+	mStats.mCachedVolumes++;
+	mStats.mCachedBytes += entry.mBytes;
+	trimCache();
+}
+
+// protected
+BOOL LLVolumeMgr::uncacheVolume(LLVolume* volumep)
+{
+	cache_map_t::iterator iter = mCacheMap.find(volumep);
+	if (iter == mCacheMap.end())
+	{
+		return FALSE;
+	}
+	mStats.mCachedVolumes--;
+	mStats.mCachedBytes -= iter->second->mBytes;
+	mCache.erase(iter->second);
+	mCacheMap.erase(iter);
+	return TRUE;
+}
+
+// protected
+void LLVolumeMgr::trimCache()
+{
+	cache_list_t::iterator iter = mCache.begin();
+	while (mStats.mCachedBytes > mCacheSize && iter != mCache.end())
+	{
+		if (iter->mGenerated && iter->mUpdate == mUpdateCount)
+		{
+			// Keep until whatever requested it has had the chance to ref it
+			++iter;
+			continue;
+		}
+		LLVolume* volumep = iter->mVolume;
+		mStats.mCachedVolumes--;
+		mStats.mCachedBytes -= iter->mBytes;
+		mStats.mEvictions++;
+		mCacheMap.erase(volumep);
+		iter = mCache.erase(iter);
+		releaseVolume(volumep);
+	}
+}
+
+// protected
+// Drops an unreferenced volume, and its group once that holds nothing.
+// volumep may be deleted.
+void LLVolumeMgr::releaseVolume(LLVolume* volumep)
+{
+	volume_lod_group_map_t::iterator iter = mVolumeLODGroups.find(&(volumep->getParams()));
+	if (iter == mVolumeLODGroups.end())
+	{
+		return;
+	}
+	LLVolumeLODGroup* volgroupp = iter->second;
+	volgroupp->releaseLOD(volumep);
+	if (volgroupp->isEmpty())
+	{
+		mVolumeLODGroups.erase(iter);
+		mPendingGroups.erase(volgroupp);
+		delete volgroupp;
+	}
+}
+
+// protected
+void LLVolumeMgr::abortRequests()
+{
+	for (group_set_t::iterator iter = mPendingGroups.begin(); iter != mPendingGroups.end(); ++iter)
+	{
+		LLVolumeLODGroup* volgroupp = *iter;
+		volgroupp->abortRequests(mGenerateThread);
+		if (volgroupp->isEmpty())
+		{
+			mVolumeLODGroups.erase(volgroupp->getVolumeParams());
+			delete volgroupp;
+		}
+	}
+	mPendingGroups.clear();
+}
+
 // virtual
 void LLVolumeMgr::dump()
 {
@@ -216,6 +466,13 @@ void LLVolumeMgr::dump()
 		mDataMutex->unlock();
 	}
 	llinfos << "Average usage of LODs " << avg << llendl;
+	llinfos << "Volume requests " << mStats.mRequests
+			<< " hit rate " << mStats.getHitRate()
+			<< " (shared " << mStats.mSharedHits << ", cached " << mStats.mCacheHits << ")"
+			<< " generated " << mStats.mGenerated
+			<< " evicted " << mStats.mEvictions
+			<< " bytes saved " << mStats.mBytesSaved
+			<< " cache " << mStats.mCachedVolumes << " volumes " << mStats.mCachedBytes << " bytes" << llendl;
 }
 
 void LLVolumeMgr::useMutex()
@@ -261,6 +518,7 @@ LLVolumeLODGroup::LLVolumeLODGroup(const LLVolumeParams &params)
 	{
 		mLODRefs[i] = 0;
 		mAccessCount[i] = 0;
+		mRequests[i] = LLVolumeGenerateThread::nullHandle();
 	}
 }
 
@@ -295,12 +553,23 @@ bool LLVolumeLODGroup::cleanupRefs()
 	return res;
 }
 
-LLVolume* LLVolumeLODGroup::refLOD(const S32 detail)
+LLVolume* LLVolumeLODGroup::refLOD(const S32 detail, LLVolumeGenerateThread* thread)
 {
 	llassert(detail >=0 && detail < NUM_LODS);
 	mAccessCount[detail]++;
 	
 	mRefs++;
+	if (thread && mRequests[detail] != LLVolumeGenerateThread::nullHandle())
+	{
+		// Take the request if it is done, otherwise abandon it
+		LLPointer<LLVolume> volumep = thread->takeGeneratedVolume(mRequests[detail]);
+		if (volumep.notNull() && mVolumeLODs[detail].isNull())
+		{
+			mVolumeLODs[detail] = volumep;
+		}
+		thread->releaseVolume(mRequests[detail]);
+		mRequests[detail] = LLVolumeGenerateThread::nullHandle();
+	}
 	if (mVolumeLODs[detail].isNull())
 	{
 		LLMemType m1(LLMemType::MTYPE_VOLUME);
@@ -320,12 +589,6 @@ BOOL LLVolumeLODGroup::derefLOD(LLVolume *volumep)
 		{
 			llassert_always(mLODRefs[i] > 0);
 			mLODRefs[i]--;
-#if 1 // SJB: Possible opt: keep other lods around
-			if (!mLODRefs[i])
-			{
-				mVolumeLODs[i] = NULL;
-			}
-#endif
 			return TRUE;
 		}
 	}
@@ -333,6 +596,100 @@ BOOL LLVolumeLODGroup::derefLOD(LLVolume *volumep)
 	return FALSE;
 }
 
+BOOL LLVolumeLODGroup::releaseLOD(LLVolume *volumep)
+{
+	for (S32 i = 0; i < NUM_LODS; i++)
+	{
+		if (mVolumeLODs[i] == volumep)
+		{
+			llassert_always(mLODRefs[i] == 0);
+			mVolumeLODs[i] = NULL;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+S32 LLVolumeLODGroup::getDetail(LLVolume *volumep) const
+{
+	for (S32 i = 0; i < NUM_LODS; i++)
+	{
+		if (mVolumeLODs[i] == volumep)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+BOOL LLVolumeLODGroup::isEmpty() const
+{
+	if (mRefs)
+	{
+		return FALSE;
+	}
+	for (S32 i = 0; i < NUM_LODS; i++)
+	{
+		if (mVolumeLODs[i].notNull() || mRequests[i] != LLVolumeGenerateThread::nullHandle())
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+BOOL LLVolumeLODGroup::requestLOD(const S32 detail, LLVolumeGenerateThread* thread)
+{
+	llassert(detail >=0 && detail < NUM_LODS);
+	if (mVolumeLODs[detail].notNull())
+	{
+		return TRUE;
+	}
+	if (mRequests[detail] == LLVolumeGenerateThread::nullHandle())
+	{
+		mRequests[detail] = thread->generateVolume(mVolumeParams, mDetailScales[detail]);
+	}
+	return FALSE;
+}
+
+S32 LLVolumeLODGroup::collectLODs(LLVolumeGenerateThread* thread, std::vector<LLVolume*>& volumes)
+{
+	S32 pending = 0;
+	for (S32 i = 0; i < NUM_LODS; i++)
+	{
+		if (mRequests[i] == LLVolumeGenerateThread::nullHandle())
+		{
+			continue;
+		}
+		LLPointer<LLVolume> volumep = thread->takeGeneratedVolume(mRequests[i]);
+		if (volumep.isNull())
+		{
+			pending++;
+			continue;
+		}
+		if (mVolumeLODs[i].isNull())
+		{
+			mVolumeLODs[i] = volumep;
+			volumes.push_back(volumep);
+		}
+		thread->releaseVolume(mRequests[i]);
+		mRequests[i] = LLVolumeGenerateThread::nullHandle();
+	}
+	return pending;
+}
+
+void LLVolumeLODGroup::abortRequests(LLVolumeGenerateThread* thread)
+{
+	for (S32 i = 0; i < NUM_LODS; i++)
+	{
+		if (mRequests[i] != LLVolumeGenerateThread::nullHandle())
+		{
+			thread->releaseVolume(mRequests[i]);
+			mRequests[i] = LLVolumeGenerateThread::nullHandle();
+		}
+	}
+}
+
 S32 LLVolumeLODGroup::getDetailFromTan(const F32 tan_angle)
 {
 	S32 i = 0;
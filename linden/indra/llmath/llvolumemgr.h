@@ -33,11 +33,15 @@
 #ifndef LL_LLVOLUMEMGR_H
 #define LL_LLVOLUMEMGR_H
 
+#include <list>
 #include <map>
+#include <set>
+#include <vector>
 
 #include "llvolume.h"
 #include "llmemory.h"
 #include "llthread.h"
+#include "llvolumegeneratethread.h"
 
 class LLVolumeParams;
 class LLVolumeLODGroup;
@@ -60,9 +64,26 @@ public:
 	static void getDetailProximity(const F32 tan_angle, F32 &to_lower, F32& to_higher);
 	static F32 getVolumeScaleFromDetail(const S32 detail);
 
-	LLVolume* refLOD(const S32 detail);
+	// If thread has generated the LOD it is used, otherwise it is generated here.
+	LLVolume* refLOD(const S32 detail, LLVolumeGenerateThread* thread = NULL);
+	// Keeps the LOD, even once it has no refs, until releaseLOD().
 	BOOL derefLOD(LLVolume *volumep);
+	// Drops an LOD that has no refs.  Returns TRUE if the group held it.
+	BOOL releaseLOD(LLVolume *volumep);
 	S32 getNumRefs() const { return mRefs; }
+	S32 getNumLODRefs(const S32 detail) const { return mLODRefs[detail]; }
+	// Returns the detail of volumep, or -1 if the group does not hold it.
+	S32 getDetail(LLVolume *volumep) const;
+	BOOL hasLOD(const S32 detail) const { return mVolumeLODs[detail].notNull(); }
+	// No refs, LODs or generation requests left.
+	BOOL isEmpty() const;
+
+	// Returns TRUE if the LOD is ready to ref, otherwise has thread generate it.
+	BOOL requestLOD(const S32 detail, LLVolumeGenerateThread* thread);
+	// Takes the LODs thread has finished, adding them to volumes.  Returns
+	// the number of requests still pending.
+	S32 collectLODs(LLVolumeGenerateThread* thread, std::vector<LLVolume*>& volumes);
+	void abortRequests(LLVolumeGenerateThread* thread);
 	
 	const LLVolumeParams* getVolumeParams() const { return &mVolumeParams; };
 
@@ -75,14 +96,36 @@ protected:
 	S32 mRefs;
 	S32 mLODRefs[NUM_LODS];
 	LLPointer<LLVolume> mVolumeLODs[NUM_LODS];
+	LLVolumeGenerateThread::handle_t mRequests[NUM_LODS];
 	static F32 mDetailThresholds[NUM_LODS];
 	static F32 mDetailScales[NUM_LODS];
 	S32		mAccessCount[NUM_LODS];
 };
 
+// Shares volumes between objects with the same params and LOD.  Optionally
+// (setCacheSize()) volumes nothing refs any longer are kept, least recently
+// used first out, so objects switching LOD or reappearing do not generate
+// them again.  With setGenerateThread(), requestVolume() generates LODs
+// ahead of refVolume() off the main thread; callers keep showing the LOD
+// they have until it returns TRUE.
 class LLVolumeMgr
 {
 public:
+	struct Stats
+	{
+		Stats();
+		F32 getHitRate() const;
+
+		S32 mRequests;		// refVolume() calls for managed volumes
+		S32 mSharedHits;	// volume already referenced by another object
+		S32 mCacheHits;		// volume taken back from the cache
+		S32 mGenerated;		// volume generated, here or on the generate thread
+		S32 mEvictions;		// volumes dropped from the cache
+		S64 mBytesSaved;	// data of the volumes not generated again
+		S32 mCachedVolumes;
+		S32 mCachedBytes;
+	};
+
 	LLVolumeMgr();
 	virtual ~LLVolumeMgr();
 	BOOL cleanup();			// Cleanup all volumes being managed, returns TRUE if no dangling references
@@ -95,6 +138,20 @@ public:
 	LLVolume *refVolume(const LLVolumeParams &volume_params, const S32 detail);
 	void unrefVolume(LLVolume *volumep);
 
+	// Returns TRUE if refVolume() can return the volume without generating
+	// it, otherwise has the generate thread generate it.  Always TRUE
+	// without a generate thread, or for sculpties, which need their texture.
+	BOOL requestVolume(const LLVolumeParams &volume_params, const S32 detail);
+	// Call once a frame to collect the volumes requestVolume() generated.
+	void update();
+
+	// Bytes of unreferenced volumes to keep.  0 (the default) drops them.
+	void setCacheSize(S32 max_bytes);
+	S32 getCacheSize() const { return mCacheSize; }
+	// NULL (the default) generates everything in refVolume().
+	void setGenerateThread(LLVolumeGenerateThread* thread);
+
+	const Stats& getStats() const { return mStats; }
 	void dump();
 
 	// manually call this for mutex magic
@@ -107,11 +164,38 @@ protected:
 	// Overridden in llphysics/abstract/utils/llphysicsvolumemanager.h
 	virtual LLVolumeLODGroup* createNewGroup(const LLVolumeParams& volume_params);
 
+	// Cache helpers, called with mDataMutex held.
+	void cacheVolume(LLVolume* volumep, BOOL generated);
+	BOOL uncacheVolume(LLVolume* volumep);
+	void trimCache();
+	void releaseVolume(LLVolume* volumep);
+	void abortRequests();
+
 protected:
 	typedef std::map<const LLVolumeParams*, LLVolumeLODGroup*, LLVolumeParams::compare> volume_lod_group_map_t;
 	volume_lod_group_map_t mVolumeLODGroups;
 
 	LLMutex* mDataMutex;
+
+	struct CacheEntry
+	{
+		LLVolume* mVolume;	// held by its LLVolumeLODGroup
+		S32 mBytes;
+		U32 mUpdate;		// mUpdateCount when cached
+		BOOL mGenerated;	// generated ahead by requestVolume(), not yet used
+	};
+	typedef std::list<CacheEntry> cache_list_t;
+	typedef std::map<LLVolume*, cache_list_t::iterator> cache_map_t;
+	cache_list_t mCache;	// least recently used first
+	cache_map_t mCacheMap;
+	S32 mCacheSize;
+
+	LLVolumeGenerateThread* mGenerateThread;
+	typedef std::set<LLVolumeLODGroup*> group_set_t;
+	group_set_t mPendingGroups;	// groups with generation requests
+	U32 mUpdateCount;
+
+	Stats mStats;
 };
 
 #endif // LL_LLVOLUMEMGR_H
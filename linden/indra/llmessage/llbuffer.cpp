@@ -38,6 +38,102 @@
 #include "llmath.h"
 #include "llmemtype.h"
 #include "llstl.h"
+#include "llthread.h"
+
+/** 
+ * LLHeapBufferPool
+ *
+ * Hands out default sized heap buffer memory from slabs, and keeps
+ * the memory of destroyed buffers on a free list for the next one.
+ */
+class LLHeapBufferPool
+{
+public:
+	LLHeapBufferPool(S32 max_slabs);
+	~LLHeapBufferPool();
+
+	// Returns NULL when every slab is in use.
+	U8* allocate();
+	void free(U8* block);
+
+	// Returns true if no buffer is using memory from the pool.
+	bool isIdle();
+	LLHeapBuffer::PoolStats getStats();
+
+protected:
+	LLMutex mMutex;
+	S32 mMaxSlabs;
+	std::vector<U8*> mSlabs;
+	std::vector<U8*> mFreeBlocks;
+	U32 mHits;
+	U32 mMisses;
+};
+
+// Number of buffers carved out of each slab.
+const S32 BLOCKS_PER_SLAB = 16;
+
+static LLHeapBufferPool* sHeapBufferPool = NULL;
+
+LLHeapBufferPool::LLHeapBufferPool(S32 max_slabs) :
+	mMutex(NULL),
+	mMaxSlabs(max_slabs),
+	mHits(0),
+	mMisses(0)
+{
+}
+
+LLHeapBufferPool::~LLHeapBufferPool()
+{
+	std::for_each(mSlabs.begin(), mSlabs.end(), DeletePointerArray());
+}
+
+U8* LLHeapBufferPool::allocate()
+{
+	LLMutexLock lock(&mMutex);
+	if(mFreeBlocks.empty())
+	{
+		if((S32)mSlabs.size() >= mMaxSlabs)
+		{
+			++mMisses;
+			return NULL;
+		}
+		U8* slab = new U8[BLOCKS_PER_SLAB * LLHeapBuffer::DEFAULT_SIZE];
+		mSlabs.push_back(slab);
+		for(S32 i = BLOCKS_PER_SLAB - 1; i >= 0; --i)
+		{
+			mFreeBlocks.push_back(slab + i * LLHeapBuffer::DEFAULT_SIZE);
+		}
+	}
+	++mHits;
+	U8* block = mFreeBlocks.back();
+	mFreeBlocks.pop_back();
+	return block;
+}
+
+void LLHeapBufferPool::free(U8* block)
+{
+	LLMutexLock lock(&mMutex);
+	// Most recently freed memory is handed out first, since it is the
+	// most likely to still be in cache.
+	mFreeBlocks.push_back(block);
+}
+
+bool LLHeapBufferPool::isIdle()
+{
+	LLMutexLock lock(&mMutex);
+	return (mFreeBlocks.size() == mSlabs.size() * BLOCKS_PER_SLAB);
+}
+
+LLHeapBuffer::PoolStats LLHeapBufferPool::getStats()
+{
+	LLMutexLock lock(&mMutex);
+	LLHeapBuffer::PoolStats stats;
+	stats.mSlabs = (S32)mSlabs.size();
+	stats.mFreeBlocks = (S32)mFreeBlocks.size();
+	stats.mHits = mHits;
+	stats.mMisses = mMisses;
+	return stats;
+}
 
 /** 
  * LLSegment
@@ -101,22 +197,77 @@ bool LLSegment::operator==(const LLSegment& rhs) const
 /** 
  * LLHeapBuffer
  */
+const S32 LLHeapBuffer::DEFAULT_SIZE;
+const S32 LLHeapBuffer::DEFAULT_MAX_SLABS;
+
+// static
+void LLHeapBuffer::initClass(S32 max_slabs)
+{
+	if(!sHeapBufferPool)
+	{
+		sHeapBufferPool = new LLHeapBufferPool(max_slabs);
+	}
+}
+
+// static
+void LLHeapBuffer::cleanupClass()
+{
+	if(!sHeapBufferPool) return;
+	if(!sHeapBufferPool->isIdle())
+	{
+		// Buffers still own pool memory, so leave it alone. Those
+		// buffers will leak their memory when destroyed.
+		llwarns << "LLHeapBuffer pool still in use at cleanup." << llendl;
+	}
+	else
+	{
+		delete sHeapBufferPool;
+	}
+	sHeapBufferPool = NULL;
+}
+
+// static
+LLHeapBuffer::PoolStats LLHeapBuffer::getPoolStats()
+{
+	if(sHeapBufferPool)
+	{
+		return sHeapBufferPool->getStats();
+	}
+	PoolStats stats;
+	memset(&stats, 0, sizeof(PoolStats));
+	return stats;
+}
+
 LLHeapBuffer::LLHeapBuffer() :
 	mBuffer(NULL),
 	mSize(0),
 	mNextFree(NULL),
-	mReclaimedBytes(0)
+	mReclaimedBytes(0),
+	mPooled(false)
 {
 	LLMemType m1(LLMemType::MTYPE_IO_BUFFER);
-	const S32 DEFAULT_HEAP_BUFFER_SIZE = 16384;
-	allocate(DEFAULT_HEAP_BUFFER_SIZE);
+	if(sHeapBufferPool)
+	{
+		mBuffer = sHeapBufferPool->allocate();
+	}
+	if(mBuffer)
+	{
+		mPooled = true;
+		mSize = DEFAULT_SIZE;
+		mNextFree = mBuffer;
+	}
+	else
+	{
+		allocate(DEFAULT_SIZE);
+	}
 }
 
 LLHeapBuffer::LLHeapBuffer(S32 size) :
 	mBuffer(NULL),
 	mSize(0),
 	mNextFree(NULL),
-	mReclaimedBytes(0)
+	mReclaimedBytes(0),
+	mPooled(false)
 {
 	LLMemType m1(LLMemType::MTYPE_IO_BUFFER);
 	allocate(size);
@@ -126,7 +277,8 @@ LLHeapBuffer::LLHeapBuffer(const U8* src, S32 len) :
 	mBuffer(NULL),
 	mSize(0),
 	mNextFree(NULL),
-	mReclaimedBytes(0)
+	mReclaimedBytes(0),
+	mPooled(false)
 {
 	LLMemType m1(LLMemType::MTYPE_IO_BUFFER);
 	if((len > 0) && src)
@@ -143,7 +295,14 @@ LLHeapBuffer::LLHeapBuffer(const U8* src, S32 len) :
 LLHeapBuffer::~LLHeapBuffer()
 {
 	LLMemType m1(LLMemType::MTYPE_IO_BUFFER);
-	delete[] mBuffer;
+	if(!mPooled)
+	{
+		delete[] mBuffer;
+	}
+	else if(sHeapBufferPool)
+	{
+		sHeapBufferPool->free(mBuffer);
+	}
 	mBuffer = NULL;
 	mSize = 0;
 	mNextFree = NULL;
@@ -181,16 +340,26 @@ bool LLHeapBuffer::reclaimSegment(const LLSegment& segment)
 {
 	if(containsSegment(segment))
 	{
-		mReclaimedBytes += segment.size();
-		if(mReclaimedBytes == mSize)
+		if(segment.data() + segment.size() == mNextFree)
 		{
-			// We have reclaimed all of the memory from this
-			// buffer. Therefore, we can reset the mNextFree to the
-			// start of the buffer, and reset the reclaimed bytes.
+			// This was the last segment handed out, so simply hand
+			// it out again.
+			mNextFree = segment.data();
+		}
+		else
+		{
+			mReclaimedBytes += segment.size();
+		}
+		S32 handed_out = (S32)(mNextFree - mBuffer);
+		if(mReclaimedBytes == handed_out)
+		{
+			// We have reclaimed all of the memory handed out from
+			// this buffer. Therefore, we can reset the mNextFree to
+			// the start of the buffer, and reset the reclaimed bytes.
 			mReclaimedBytes = 0;
 			mNextFree = mBuffer;
 		}
-		else if(mReclaimedBytes > mSize)
+		else if(mReclaimedBytes > handed_out)
 		{
 			llwarns << "LLHeapBuffer reclaimed more memory than allocated."
 				<< " This is probably programmer error." << llendl;
@@ -771,6 +940,31 @@ LLBufferArray::segment_iterator_t LLBufferArray::makeSegment(
 	return send;
 }
 
+bool LLBufferArray::trimSegment(const segment_iterator_t& iter, S32 size)
+{
+	LLMemType m1(LLMemType::MTYPE_IO_BUFFER);
+	if(size <= 0)
+	{
+		return eraseSegment(iter);
+	}
+	if(size >= (*iter).size())
+	{
+		return true;
+	}
+	LLSegment tail((*iter).getChannel(), (*iter).data() + size, (*iter).size() - size);
+	*iter = LLSegment((*iter).getChannel(), (*iter).data(), size);
+	buffer_iterator_t it = mBuffers.begin();
+	buffer_iterator_t end = mBuffers.end();
+	for(; it != end; ++it)
+	{
+		if((*it)->reclaimSegment(tail))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 bool LLBufferArray::eraseSegment(const segment_iterator_t& erase_iter)
 {
 	LLMemType m1(LLMemType::MTYPE_IO_BUFFER);
@@ -281,11 +281,44 @@ public:
 	 */
 	virtual S32 capacity() const { return mSize; }
 
+	/** 
+	 * @brief Start recycling the memory of default sized heap buffers.
+	 *
+	 * The memory is carved out of slabs holding several buffers each,
+	 * and goes back on a free list when a buffer is destroyed, so that
+	 * buffer arrays stop going to the heap for every buffer. Call this
+	 * before other threads use buffers. Until it is called, and once
+	 * all the slabs are in use, buffers allocate their own memory.
+	 * @param max_slabs The most slabs to allocate.
+	 */
+	static void initClass(S32 max_slabs = DEFAULT_MAX_SLABS);
+
+	/** 
+	 * @brief Stop recycling, freeing the slabs if no buffer uses them.
+	 */
+	static void cleanupClass();
+
+	/** 
+	 * @brief Counters for the buffer memory pool.
+	 */
+	struct PoolStats
+	{
+		S32 mSlabs;			// slabs allocated
+		S32 mFreeBlocks;	// buffers worth of memory on the free list
+		U32 mHits;			// buffers given memory from the pool
+		U32 mMisses;		// default sized buffers which went to the heap
+	};
+	static PoolStats getPoolStats();
+
+	static const S32 DEFAULT_SIZE = 16384;
+	static const S32 DEFAULT_MAX_SLABS = 64;
+
 protected:
 	U8* mBuffer;
 	S32 mSize;
 	U8* mNextFree;
 	S32 mReclaimedBytes;
+	bool mPooled;
 
 private:
 	/** 
@@ -563,6 +596,18 @@ public:
 	 */
 	segment_iterator_t makeSegment(S32 channel, S32 length);
 
+	/** 
+	 * @brief Shrink a segment to its first size bytes.
+	 *
+	 * This is for handing back the unused end of a segment from
+	 * <code>makeSegment()</code> once it has been filled, eg, by a
+	 * scatter read. The segment is erased if size is zero.
+	 * @param iter An iterator referring to the segment to trim.
+	 * @param size The number of bytes to keep.
+	 * @return Returns true on success.
+	 */
+	bool trimSegment(const segment_iterator_t& iter, S32 size);
+
 	/** 
 	 * @brief Erase the segment if it is in the buffer array.
 	 *
@@ -67,8 +67,11 @@ const S32 PING_START_BLOCK = 3;		// How many pings behind we have to be to consi
 const S32 PING_RELEASE_BLOCK = 2;	// How many pings behind we have to be to consider ourself unblocked.
 
 const F32 TARGET_PERIOD_LENGTH = 5.f;	// seconds
-const F32 LL_DUPLICATE_SUPPRESSION_TIMEOUT = 60.f; //seconds - this can be long, as time-based cleanup is
-													// only done when wrapping packetids, now...
+
+static U64 resend_tick(const F64 seconds)
+{
+	return (U64)(seconds / LL_RESEND_SLOT_SECONDS);
+}
 
 LLCircuitData::LLCircuitData(const LLHost &host, TPACKETID in_id, 
 							 const F32 circuit_heartbeat_interval, const F32 circuit_timeout)
@@ -89,6 +92,9 @@ LLCircuitData::LLCircuitData(const LLHost &host, TPACKETID in_id,
 	mLastPingID(0),
 	mPingDelay(INITIAL_PING_VALUE_MSEC), 
 	mPingDelayAveraged((F32)INITIAL_PING_VALUE_MSEC), 
+	mRecentlyReceivedReliablePackets(64, LL_MAX_DUPLICATE_WINDOW),
+	mResendWheel(LL_RESEND_WHEEL_SLOTS),
+	mResendTick(0),
 	mUnackedPacketCount(0),
 	mUnackedPacketBytes(0),
 	mLocalEndPointID(),
@@ -120,6 +126,7 @@ LLCircuitData::LLCircuitData(const LLHost &host, TPACKETID in_id,
 	mLastPingReceivedTime = mt_sec;
 	mNextPingSendTime = mLastPingSendTime + 0.95*mHeartbeatInterval + ll_frand(0.1f*mHeartbeatInterval);
 	mPeriodTime = mt_sec;
+	mResendTick = resend_tick(mt_sec);
 
 	mTimeoutCallback = NULL;
 	mTimeoutUserData = NULL;
@@ -137,37 +144,13 @@ LLCircuitData::~LLCircuitData()
 
 	// remove all pending reliable messages on this circuit
 	std::vector<TPACKETID> doomed;
-	reliable_iter iter;
-	reliable_iter end = mUnackedPackets.end();
-	for(iter = mUnackedPackets.begin(); iter != end; ++iter)
+	TPACKETID packet_id;
+	while (mUnackedPackets.popOldest(packet_id, packetp))
 	{
-		packetp = iter->second;
 		gMessageSystem->mFailedResendPackets++;
 		if(gMessageSystem->mVerboseLog)
 		{
-			doomed.push_back(packetp->mPacketID);
-		}
-		if (packetp->mCallback)
-		{
-			packetp->mCallback(packetp->mCallbackData,LL_ERR_CIRCUIT_GONE);
-		}
-
-		// Update stats
-		mUnackedPacketCount--;
-		mUnackedPacketBytes -= packetp->mBufferLength;
-
-		delete packetp;
-	}
-
-	// remove all pending final retry reliable messages on this circuit
-	end = mFinalRetryPackets.end();
-	for(iter = mFinalRetryPackets.begin(); iter != end; ++iter)
-	{
-		packetp = iter->second;
-		gMessageSystem->mFailedResendPackets++;
-		if(gMessageSystem->mVerboseLog)
-		{
-			doomed.push_back(packetp->mPacketID);
+			doomed.push_back(packet_id);
 		}
 		if (packetp->mCallback)
 		{
@@ -195,102 +178,192 @@ LLCircuitData::~LLCircuitData()
 
 void LLCircuitData::ackReliablePacket(TPACKETID packet_num)
 {
-	reliable_iter iter;
-	LLReliablePacket *packetp;
-
-	iter = mUnackedPackets.find(packet_num);
-	if (iter != mUnackedPackets.end())
+	LLReliablePacket** packetpp = mUnackedPackets.find(packet_num);
+	if (!packetpp)
 	{
-		packetp = iter->second;
+		// Couldn't find this packet on the unacked list.
+		// maybe it's a duplicate ack?
+		return;
+	}
+	LLReliablePacket *packetp = *packetpp;
 
-		if(gMessageSystem->mVerboseLog)
+	if(gMessageSystem->mVerboseLog)
+	{
+		std::ostringstream str;
+		str << "MSG: <- " << packetp->mHost << "\tRELIABLE ACKED:\t"
+			<< packetp->mPacketID;
+		llinfos << str.str() << llendl;
+	}
+	if (packetp->mCallback)
+	{
+		if (packetp->mTimeout < 0.f)   // negative timeout will always return timeout even for successful ack, for debugging
 		{
-			std::ostringstream str;
-			str << "MSG: <- " << packetp->mHost << "\tRELIABLE ACKED:\t"
-				<< packetp->mPacketID;
-			llinfos << str.str() << llendl;
+			packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);					
 		}
-		if (packetp->mCallback)
+		else
 		{
-			if (packetp->mTimeout < 0.f)   // negative timeout will always return timeout even for successful ack, for debugging
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);					
-			}
-			else
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_NOERR);
-			}
+			packetp->mCallback(packetp->mCallbackData,LL_ERR_NOERR);
 		}
+	}
 
-		// Update stats
-		mUnackedPacketCount--;
-		mUnackedPacketBytes -= packetp->mBufferLength;
+	// Update stats
+	mUnackedPacketCount--;
+	mUnackedPacketBytes -= packetp->mBufferLength;
 
-		// Cleanup
-		delete packetp;
-		mUnackedPackets.erase(iter);
-		return;
+	// Cleanup.  Its resend wheel entry goes stale and is skipped.
+	mUnackedPackets.erase(packet_num);
+	delete packetp;
+}
+
+
+void LLCircuitData::scheduleResend(LLReliablePacket* packetp)
+{
+	// Check the slot after the one the packet expires in, so that it has
+	// always expired by the time its slot comes up, unless it is further
+	// out than the wheel reaches.
+	U64 tick = llmax(resend_tick(packetp->mExpirationTime) + 1, mResendTick);
+	tick = llmin(tick, mResendTick + LL_RESEND_WHEEL_SLOTS - 1);
+
+	ResendEntry entry;
+	entry.mPacketID = packetp->mPacketID;
+	entry.mExpirationTime = packetp->mExpirationTime;
+	mResendWheel[tick & (LL_RESEND_WHEEL_SLOTS - 1)].push_back(entry);
+}
+
+
+LLReliablePacket* LLCircuitData::findResendPacket(TPACKETID packet_id, F64 expiration_time)
+{
+	LLReliablePacket** packetpp = mUnackedPackets.find(packet_id);
+	if (!packetpp || (*packetpp)->mExpirationTime != expiration_time)
+	{
+		return NULL;
 	}
+	return *packetpp;
+}
+
 
-	iter = mFinalRetryPackets.find(packet_num);
-	if (iter != mFinalRetryPackets.end())
+void LLCircuitData::resendReliablePacket(LLReliablePacket* packetp, const F64 now)
+{
+	packetp->mRetries--;
+	
+	// retry		
+	mCurrentResendCount++;
+
+	gMessageSystem->mResentPackets++;
+
+	if(gMessageSystem->mVerboseLog)
 	{
-		packetp = iter->second;
-		// llinfos << "Packet " << packet_num << " removed from the pending list" << llendl;
-		if(gMessageSystem->mVerboseLog)
-		{
-			std::ostringstream str;
-			str << "MSG: <- " << packetp->mHost << "\tRELIABLE ACKED:\t"
-				<< packetp->mPacketID;
-			llinfos << str.str() << llendl;
-		}
-		if (packetp->mCallback)
-		{
-			if (packetp->mTimeout < 0.f)   // negative timeout will always return timeout even for successful ack, for debugging
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);					
-			}
-			else
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_NOERR);
-			}
-		}
+		std::ostringstream str;
+		str << "MSG: -> " << packetp->mHost
+			<< "\tRESENDING RELIABLE:\t" << packetp->mPacketID;
+		llinfos << str.str() << llendl;
+	}
 
-		// Update stats
-		mUnackedPacketCount--;
-		mUnackedPacketBytes -= packetp->mBufferLength;
+	packetp->mBuffer[0] |= LL_RESENT_FLAG;  // tag packet id as being a resend	
 
-		// Cleanup
-		delete packetp;
-		mFinalRetryPackets.erase(iter);
+	gMessageSystem->mPacketRing.sendPacket(packetp->mSocket, 
+									   (char *)packetp->mBuffer, packetp->mBufferLength, 
+									   packetp->mHost, LLPacketScheduler::PC_RESEND);
+
+	mThrottles.throttleOverflow(TC_RESEND, packetp->mBufferLength * 8.f);
+
+	// The new method, retry time based on ping
+	if (packetp->mPingBasedRetry)
+	{
+		packetp->mExpirationTime = now + llmax(LL_MINIMUM_RELIABLE_TIMEOUT_SECONDS, (LL_RELIABLE_TIMEOUT_FACTOR * getPingDelayAveraged()));
 	}
 	else
 	{
-		// Couldn't find this packet on either of the unacked lists.
-		// maybe it's a duplicate ack?
+		// custom, constant retry time
+		packetp->mExpirationTime = now + packetp->mTimeout;
 	}
+
+	// After the last resend it waits one more timeout to be acked.
+	scheduleResend(packetp);
 }
 
 
+void LLCircuitData::failReliablePacket(LLReliablePacket* packetp)
+{
+	// fail (too many retries)
+	gMessageSystem->mFailedResendPackets++;
+
+	if(gMessageSystem->mVerboseLog)
+	{
+		std::ostringstream str;
+		str << "MSG: -> " << packetp->mHost << "\tABORTING RELIABLE:\t"
+			<< packetp->mPacketID;
+		llinfos << str.str() << llendl;
+	}
+
+	if (packetp->mCallback)
+	{
+		packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);
+	}
+
+	// Update stats
+	mUnackedPacketCount--;
+	mUnackedPacketBytes -= packetp->mBufferLength;
+
+	mUnackedPackets.erase(packetp->mPacketID);
+	delete packetp;
+}
+
 
 S32 LLCircuitData::resendUnackedPackets(const F64 now)
 {
 	S32 resent_packets = 0;
 	LLReliablePacket *packetp;
 
+	// Only the wheel slots that have come due since the last call are
+	// looked at, so quiet circuits with many packets in flight are cheap.
+	U64 now_tick = resend_tick(now);
+	if (now_tick >= mResendTick + LL_RESEND_WHEEL_SLOTS)
+	{
+		// Every slot is due, visit each once.
+		mResendTick = now_tick - LL_RESEND_WHEEL_SLOTS + 1;
+	}
+	for ( ; mResendTick <= now_tick; ++mResendTick)
+	{
+		resend_slot& slot = mResendWheel[mResendTick & (LL_RESEND_WHEEL_SLOTS - 1)];
+		for (resend_slot::size_type i = 0; i < slot.size(); ++i)
+		{
+			packetp = findResendPacket(slot[i].mPacketID, slot[i].mExpirationTime);
+			if (!packetp)
+			{
+				continue;
+			}
+			if (now <= packetp->mExpirationTime)
+			{
+				// Was further out than the wheel reaches.
+				scheduleResend(packetp);
+			}
+			else if (!packetp->mRetries)
+			{
+				failReliablePacket(packetp);
+			}
+			else
+			{
+				mResendBacklog.push_back(slot[i]);
+			}
+		}
+		slot.clear();
+	}
 
 	//
-	// Theoretically we should search through the list for the packet with the oldest
-	// packet ID, as otherwise when we WRAP we will resend reliable packets out of order.
-	// Since resends are ALREADY out of order, and wrapping is highly rare (16+million packets),
-	// I'm not going to worry about this for now - djs
+	// Resends go out in the order they came due, which is not packet
+	// id order.  Since resends are ALREADY out of order, that is fine.
 	//
-
-	reliable_iter iter;
 	BOOL have_resend_overflow = FALSE;
-	for (iter = mUnackedPackets.begin(); iter != mUnackedPackets.end();)
+	while (!mResendBacklog.empty())
 	{
-		packetp = iter->second;
+		ResendEntry& entry = mResendBacklog.front();
+		packetp = findResendPacket(entry.mPacketID, entry.mExpirationTime);
+		if (!packetp)
+		{
+			mResendBacklog.pop_front();
+			continue;
+		}
 
 		// Only check overflow if we haven't had one yet.
 		if (!have_resend_overflow)
@@ -306,19 +379,9 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 			// If we have too many unacked packets, we need to start dropping expired ones.
 			if (mUnackedPacketBytes > 512000)
 			{
-				if (now > packetp->mExpirationTime)
-				{
-					// This circuit has overflowed.  Do not retry.  Do not pass go.
-					packetp->mRetries = 0;
-					// Remove it from this list and add it to the final list.
-					mUnackedPackets.erase(iter++);
-					mFinalRetryPackets[packetp->mPacketID] = packetp;
-				}
-				else
-				{
-					++iter;
-				}
-				// Move on to the next unacked packet.
+				// This circuit has overflowed.  Do not retry.  Do not pass go.
+				mResendBacklog.pop_front();
+				failReliablePacket(packetp);
 				continue;
 			}
 			
@@ -332,100 +395,9 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 			break;
 		}
 
-		if (now > packetp->mExpirationTime)
-		{
-			packetp->mRetries--;
-			
-			// retry		
-			mCurrentResendCount++;
-
-			gMessageSystem->mResentPackets++;
-
-			if(gMessageSystem->mVerboseLog)
-			{
-				std::ostringstream str;
-				str << "MSG: -> " << packetp->mHost
-					<< "\tRESENDING RELIABLE:\t" << packetp->mPacketID;
-				llinfos << str.str() << llendl;
-			}
-
-			packetp->mBuffer[0] |= LL_RESENT_FLAG;  // tag packet id as being a resend	
-
-			gMessageSystem->mPacketRing.sendPacket(packetp->mSocket, 
-											   (char *)packetp->mBuffer, packetp->mBufferLength, 
-											   packetp->mHost);
-
-			mThrottles.throttleOverflow(TC_RESEND, packetp->mBufferLength * 8.f);
-
-			// The new method, retry time based on ping
-			if (packetp->mPingBasedRetry)
-			{
-				packetp->mExpirationTime = now + llmax(LL_MINIMUM_RELIABLE_TIMEOUT_SECONDS, (LL_RELIABLE_TIMEOUT_FACTOR * getPingDelayAveraged()));
-			}
-			else
-			{
-				// custom, constant retry time
-				packetp->mExpirationTime = now + packetp->mTimeout;
-			}
-
-			if (!packetp->mRetries)
-			{
-				// Last resend, remove it from this list and add it to the final list.
-				mUnackedPackets.erase(iter++);
-				mFinalRetryPackets[packetp->mPacketID] = packetp;
-			}
-			else
-			{
-				// Don't remove it yet, it still gets to try to resend at least once.
-				++iter;
-			}
-			resent_packets++;
-		}
-		else
-		{
-			// Don't need to do anything with this packet, keep iterating.
-			++iter;
-		}
-	}
-
-
-	for (iter = mFinalRetryPackets.begin(); iter != mFinalRetryPackets.end();)
-	{
-		packetp = iter->second;
-		if (now > packetp->mExpirationTime)
-		{
-			// fail (too many retries)
-			//llinfos << "Packet " << packetp->mPacketID << " removed from the pending list: exceeded retry limit" << llendl;
-			//if (packetp->mMessageName)
-			//{
-			//	llinfos << "Packet name " << packetp->mMessageName << llendl;
-			//}
-			gMessageSystem->mFailedResendPackets++;
-
-			if(gMessageSystem->mVerboseLog)
-			{
-				std::ostringstream str;
-				str << "MSG: -> " << packetp->mHost << "\tABORTING RELIABLE:\t"
-					<< packetp->mPacketID;
-				llinfos << str.str() << llendl;
-			}
-
-			if (packetp->mCallback)
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);
-			}
-
-			// Update stats
-			mUnackedPacketCount--;
-			mUnackedPacketBytes -= packetp->mBufferLength;
-
-			mFinalRetryPackets.erase(iter++);
-			delete packetp;
-		}
-		else
-		{
-			++iter;
-		}
+		mResendBacklog.pop_front();
+		resendReliablePacket(packetp, now);
+		resent_packets++;
 	}
 
 	return mUnackedPacketCount;
@@ -576,14 +548,8 @@ void LLCircuitData::addReliablePacket(S32 mSocket, U8 *buf_ptr, S32 buf_len, LLR
 	mUnackedPacketCount++;
 	mUnackedPacketBytes += packet_info->mBufferLength;
 
-	if (params && params->mRetries)
-	{
-		mUnackedPackets[packet_info->mPacketID] = packet_info;
-	}
-	else
-	{
-		mFinalRetryPackets[packet_info->mPacketID] = packet_info;
-	}
+	mUnackedPackets.insert(packet_info->mPacketID, packet_info);
+	scheduleResend(packet_info);
 }
 
 
@@ -606,7 +572,21 @@ void LLCircuit::resendUnackedPackets(S32& unacked_list_length, S32& unacked_list
 
 BOOL LLCircuitData::isDuplicateResend(TPACKETID packetnum)
 {
-	return (mRecentlyReceivedReliablePackets.find(packetnum) != mRecentlyReceivedReliablePackets.end());
+	return (mRecentlyReceivedReliablePackets.find(packetnum) != NULL);
+}
+
+
+TPACKETID LLCircuitData::getOldestUnackedPacketID() const
+{
+	if (mUnackedPackets.empty())
+	{
+		// Send the ID of the last packet we sent out.
+		// This will flush all of the destination's
+		// unacked packets, theoretically.
+		return getPacketOutID();
+	}
+	// The ring keeps ids in order across wraps.
+	return mUnackedPackets.getOldestID();
 }
 
 
@@ -867,93 +847,7 @@ BOOL LLCircuitData::updateWatchDogTimers(LLMessageSystem *msgsys)
 	// for the packet that it was out of order with was received BEFORE
 	// the ping was sent.
 
-	// Find the current oldest reliable packetID
-	// This is to handle the case if we actually manage to wrap our
-	// packet IDs - the oldest will actually have a higher packet ID
-	// than the current.
-	BOOL wrapped = FALSE;
-	reliable_iter iter;
-	iter = mUnackedPackets.upper_bound(getPacketOutID());
-	if (iter == mUnackedPackets.end())
-	{
-		// Nothing AFTER this one, so we want the lowest packet ID
-		// then.
-		iter = mUnackedPackets.begin();
-		wrapped = TRUE;
-	}
-
-	TPACKETID packet_id = 0;
-
-	// Check against the "final" packets
-	BOOL wrapped_final = FALSE;
-	reliable_iter iter_final;
-	iter_final = mFinalRetryPackets.upper_bound(getPacketOutID());
-	if (iter_final == mFinalRetryPackets.end())
-	{
-		iter_final = mFinalRetryPackets.begin();
-		wrapped_final = TRUE;
-	}
-
-	//llinfos << mHost << " - unacked count " << mUnackedPackets.size() << llendl;
-	//llinfos << mHost << " - final count " << mFinalRetryPackets.size() << llendl;
-	if (wrapped != wrapped_final)
-	{
-		// One of the "unacked" or "final" lists hasn't wrapped.  Whichever one
-		// hasn't has the oldest packet.
-		if (!wrapped)
-		{
-			// Hasn't wrapped, so the one on the
-			// unacked packet list is older
-			packet_id = iter->first;
-			//llinfos << mHost << ": nowrapped unacked" << llendl;
-		}
-		else
-		{
-			packet_id = iter_final->first;
-			//llinfos << mHost << ": nowrapped final" << llendl;
-		}
-	}
-	else
-	{
-		// They both wrapped, we can just use the minimum of the two.
-		if ((iter == mUnackedPackets.end()) && (iter_final == mFinalRetryPackets.end()))
-		{
-			// Wow!  No unacked packets at all!
-			// Send the ID of the last packet we sent out.
-			// This will flush all of the destination's
-			// unacked packets, theoretically.
-			//llinfos << mHost << ": No unacked!" << llendl;
-			packet_id = getPacketOutID();
-		}
-		else
-		{
-			BOOL had_unacked = FALSE;
-			if (iter != mUnackedPackets.end())
-			{
-				// Unacked list has the lowest so far
-				packet_id = iter->first;
-				had_unacked = TRUE;
-				//llinfos << mHost << ": Unacked" << llendl;
-			}
-
-			if (iter_final != mFinalRetryPackets.end())
-			{
-				// Use the lowest of the unacked list and the final list
-				if (had_unacked)
-				{
-					// Both had a packet, use the lowest.
-					packet_id = llmin(packet_id, iter_final->first);
-					//llinfos << mHost << ": Min of unacked/final" << llendl;
-				}
-				else
-				{
-					// Only the final had a packet, use it.
-					packet_id = iter_final->first;
-					//llinfos << mHost << ": Final!" << llendl;
-				}
-			}
-		}
-	}
+	TPACKETID packet_id = getOldestUnackedPacketID();
 
 	// Send off the another ping.
 	pingTimerStart();
@@ -1003,47 +897,8 @@ void LLCircuitData::clearDuplicateList(TPACKETID oldest_id)
 	// purge old data from the duplicate suppression queue
 
 	// we want to KEEP all x where oldest_id <= x <= last incoming packet, and delete everything else.
-
-	//llinfos << mHost << ": clearing before oldest " << oldest_id << llendl;
-	//llinfos << "Recent list before: " << mRecentlyReceivedReliablePackets.size() << llendl;
-	if (oldest_id < mHighestPacketID)
-	{
-		// Clean up everything with a packet ID less than oldest_id.
-		packet_time_map::iterator pit_start;
-		packet_time_map::iterator pit_end;
-		pit_start = mRecentlyReceivedReliablePackets.begin();
-		pit_end = mRecentlyReceivedReliablePackets.lower_bound(oldest_id);
-		mRecentlyReceivedReliablePackets.erase(pit_start, pit_end);
-	}
-
-	// Do timeout checks on everything with an ID > mHighestPacketID.
-	// This should be empty except for wrapping IDs.  Thus, this should be
-	// highly rare.
-	U64 mt_usec = LLMessageSystem::getMessageTimeUsecs();
-
-	packet_time_map::iterator pit;
-	for(pit = mRecentlyReceivedReliablePackets.upper_bound(mHighestPacketID);
-		pit != mRecentlyReceivedReliablePackets.end(); )
-	{
-		// Validate that the packet ID seems far enough away
-		if ((pit->first - mHighestPacketID) < 100)
-		{
-			llwarns << "Probably incorrectly timing out non-wrapped packets!" << llendl;
-		}
-		U64 delta_t_usec = mt_usec - (*pit).second;
-		F64 delta_t_sec = delta_t_usec * SEC_PER_USEC;
-		if (delta_t_sec > LL_DUPLICATE_SUPPRESSION_TIMEOUT)
-		{
-			// enough time has elapsed we're not likely to get a duplicate on this one
-			llinfos << "Clearing " << pit->first << " from recent list" << llendl;
-			mRecentlyReceivedReliablePackets.erase(pit++);
-		}
-		else
-		{
-			++pit;
-		}
-	}
-	//llinfos << "Recent list after: " << mRecentlyReceivedReliablePackets.size() << llendl;
+	// The ring orders ids across wraps, so nothing needs timing out.
+	mRecentlyReceivedReliablePackets.eraseBefore(oldest_id);
 }
 
 BOOL LLCircuitData::checkCircuitTimeout()
@@ -34,6 +34,7 @@
 #ifndef LL_LLCIRCUIT_H
 #define LL_LLCIRCUIT_H
 
+#include <deque>
 #include <map>
 #include <vector>
 
@@ -44,6 +45,7 @@
 #include "net.h"
 #include "llhost.h"
 #include "llpacketack.h"
+#include "llpacketidring.h"
 #include "lluuid.h"
 #include "llthrottle.h"
 #include "llstat.h"
@@ -57,8 +59,6 @@ const F32 LL_AVERAGED_PING_MIN =  100;    // msec  // IW: increased to avoid ret
 
 const U32 INITIAL_PING_VALUE_MSEC = 1000; // initial value for the ping delay, or for ping delay for an unknown circuit
 
-const TPACKETID LL_MAX_OUT_PACKET_ID = 0x01000000;
-
 // 0 - flags
 // [1,4] - packetid
 // 5 - data offset (after message name)
@@ -67,6 +67,15 @@ const U8 LL_PACKET_ID_SIZE = 6;
 const S32 LL_MAX_RESENT_PACKETS_PER_FRAME = 100;
 const S32 LL_MAX_ACKED_PACKETS_PER_FRAME = 200;
 
+// Unacked packets are checked for resending in slots of this many
+// seconds, so a resend goes out at most one slot late.
+const F64 LL_RESEND_SLOT_SECONDS = 0.01;
+// Slots in the resend wheel, a power of two.  Packets due further out
+// than this many slots are checked early and put back.
+const U32 LL_RESEND_WHEEL_SLOTS = 512;
+// Most received reliable packet ids kept for duplicate suppression.
+const U32 LL_MAX_DUPLICATE_WINDOW = 65536;
+
 //
 // Prototypes and Predefines
 //
@@ -183,6 +192,9 @@ protected:
 
 	void			addReliablePacket(S32 mSocket, U8 *buf_ptr, S32 buf_len, LLReliablePacketParams *params);
 	BOOL			isDuplicateResend(TPACKETID packetnum);
+	// Oldest packet we are still waiting on an ack for, or the last one
+	// sent if there is none.
+	TPACKETID		getOldestUnackedPacketID() const;
 	// Call this method when a reliable message comes in - this will
 	// correctly place the packet in the correct list to be acked
 	// later. RAack = requested ack
@@ -196,6 +208,14 @@ protected:
 	void			setAlive(BOOL b_alive);
 	void			setAllowTimeout(BOOL allow);
 
+	// Puts packetp in the resend wheel slot for its expiration time.
+	void			scheduleResend(LLReliablePacket* packetp);
+	// The packet a wheel entry refers to, or NULL if the entry is stale.
+	LLReliablePacket*	findResendPacket(TPACKETID packet_id, F64 expiration_time);
+	void			resendReliablePacket(LLReliablePacket* packetp, const F64 now);
+	// Gives up on packetp, calls its callback and deletes it.
+	void			failReliablePacket(LLReliablePacket* packetp);
+
 protected:
 	// Identification for this circuit.
 	LLHost mHost;
@@ -240,16 +260,29 @@ protected:
 	F32		mPingDelayAveraged;     // averaged ping delay (fast attack/slow decay)
 
 	typedef std::map<TPACKETID, U64> packet_time_map;
+	typedef LLPacketIDRing<U64> packet_time_ring;
 
 	packet_time_map							mPotentialLostPackets;
-	packet_time_map							mRecentlyReceivedReliablePackets;
+	packet_time_ring						mRecentlyReceivedReliablePackets;
 	std::vector<TPACKETID> mAcks;
 
-	typedef std::map<TPACKETID, LLReliablePacket *> reliable_map;
-	typedef reliable_map::iterator					reliable_iter;
+	// Every reliable packet waiting on an ack.  Those with no retries
+	// left are only waiting to time out.
+	typedef LLPacketIDRing<LLReliablePacket *> reliable_ring;
+	reliable_ring							mUnackedPackets;
 
-	reliable_map							mUnackedPackets;
-	reliable_map							mFinalRetryPackets;
+	// A resend wheel entry is stale once its packet is acked or
+	// rescheduled with a new expiration time.
+	struct ResendEntry
+	{
+		TPACKETID	mPacketID;
+		F64			mExpirationTime;
+	};
+	typedef std::vector<ResendEntry> resend_slot;
+	std::vector<resend_slot>				mResendWheel;
+	U64										mResendTick;		// Next wheel slot to check
+	// Packets due for resend that the resend throttle held back.
+	std::deque<ResendEntry>					mResendBacklog;
 
 	S32										mUnackedPacketCount;
 	S32										mUnackedPacketBytes;
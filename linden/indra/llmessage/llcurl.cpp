@@ -45,7 +45,9 @@
 #include "llcurl.h"
 
 #include <algorithm>
+#include <deque>
 #include <iomanip>
+#include <set>
 #include <curl/curl.h>
 #if SAFE_SSL
 #include <openssl/crypto.h>
@@ -55,6 +57,7 @@
 #include "llstl.h"
 #include "llsdserialize.h"
 #include "llthread.h"
+#include "lltimer.h"
 
 //////////////////////////////////////////////////////////////////////////////
 /*
@@ -68,8 +71,11 @@
 
 	Furthermore, it would behoove us to keep track of which
 	hosts an easy handle was used for and pick an easy handle
-	that matches the next request.  This code does not current
-	do this.
+	that matches the next request.  Multi's free list is keyed
+	on host for this.  Newer versions of curl keep the
+	connection cache in the multi handle instead, so
+	LLCurlRequest also keeps a single multi for its whole life
+	rather than replacing it every hundred requests.
  */
 
 //////////////////////////////////////////////////////////////////////////////
@@ -77,7 +83,6 @@
 static const S32 EASY_HANDLE_POOL_SIZE		= 5;
 static const S32 MULTI_PERFORM_CALL_REPEAT	= 5;
 static const S32 CURL_REQUEST_TIMEOUT = 30; // seconds
-static const S32 MAX_ACTIVE_REQUEST_COUNT = 100;
 
 // DEBUG //
 S32 gCurlEasyCount = 0;
@@ -89,6 +94,10 @@ S32 gCurlMultiCount = 0;
 std::vector<LLMutex*> LLCurl::sSSLMutex;
 std::string LLCurl::sCAPath;
 std::string LLCurl::sCAFile;
+LLCurl::Stats LLCurl::sStats;
+LLMutex* LLCurl::sStatsMutex = NULL;
+LLCurlThread* LLCurl::sThread = NULL;
+S32 LLCurl::sCallbacksPerProcess = 0;
 
 //static
 void LLCurl::setCAPath(const std::string& path)
@@ -108,6 +117,90 @@ std::string LLCurl::getVersionString()
 	return std::string(curl_version());
 }
 
+// Returns "scheme://host:port" of url, which is what connections are
+// keyed on.
+static std::string get_url_host(const std::string& url)
+{
+	std::string::size_type start = url.find("://");
+	start = (start == std::string::npos) ? 0 : start + 3;
+	std::string::size_type end = url.find_first_of("/?#", start);
+	return url.substr(0, end);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+LLCurl::Stats::Stats()
+	: mRequests(0),
+	  mCompleted(0),
+	  mConnectionsReused(0),
+	  mQueueWaitTotal(0.0),
+	  mFirstByteTotal(0.0)
+{
+}
+
+void LLCurl::Stats::add(const Stats& other)
+{
+	mRequests += other.mRequests;
+	mCompleted += other.mCompleted;
+	mConnectionsReused += other.mConnectionsReused;
+	mQueueWaitTotal += other.mQueueWaitTotal;
+	mFirstByteTotal += other.mFirstByteTotal;
+}
+
+F32 LLCurl::Stats::getReuseRatio() const
+{
+	return mCompleted ? (F32)mConnectionsReused / (F32)mCompleted : 0.f;
+}
+
+F64 LLCurl::Stats::getAverageQueueWait() const
+{
+	return mRequests ? mQueueWaitTotal / mRequests : 0.0;
+}
+
+F64 LLCurl::Stats::getAverageFirstByte() const
+{
+	return mCompleted ? mFirstByteTotal / mCompleted : 0.0;
+}
+
+//static
+LLCurl::Stats LLCurl::getStats()
+{
+	if (sStatsMutex)
+	{
+		LLMutexLock lock(sStatsMutex);
+		return sStats;
+	}
+	return sStats;
+}
+
+//static
+void LLCurl::resetStats()
+{
+	if (sStatsMutex)
+	{
+		LLMutexLock lock(sStatsMutex);
+		sStats = Stats();
+	}
+	else
+	{
+		sStats = Stats();
+	}
+}
+
+//static
+void LLCurl::addStats(const Stats& stats)
+{
+	if (sStatsMutex)
+	{
+		LLMutexLock lock(sStatsMutex);
+		sStats.add(stats);
+	}
+	else
+	{
+		sStats.add(stats);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 LLCurl::Responder::Responder()
@@ -175,18 +268,131 @@ namespace boost
 {
 	void intrusive_ptr_add_ref(LLCurl::Responder* p)
 	{
-		++p->mReferenceCount;
+		p->mReferenceCount++;
 	}
 	
 	void intrusive_ptr_release(LLCurl::Responder* p)
 	{
-		if(p && 0 == --p->mReferenceCount)
+		// apr_atomic_dec32() returns zero once the count reaches zero
+		if(p && 0 == p->mReferenceCount--)
 		{
 			delete p;
 		}
 	}
 };
 
+//////////////////////////////////////////////////////////////////////////////
+
+// Everything needed to set up a transfer, so that it can be handed to the
+// curl thread rather than set up on an easy handle straight away.
+struct LLCurlQueuedRequest
+{
+	LLCurlQueuedRequest() : mOffset(0), mLength(-1), mPost(false) {}
+
+	std::string mURL;
+	LLCurlRequest::headers_t mHeaders;
+	S32 mOffset;
+	S32 mLength;
+	bool mPost;
+	std::string mPostBody;
+	LLCurl::ResponderPtr mResponder;
+};
+
+// Where the curl thread leaves one threaded LLCurlRequest's finished
+// transfers until its process() runs their responders.
+class LLCurlThreadClient
+{
+public:
+	struct Completion
+	{
+		LLCurl::ResponderPtr mResponder;
+		U32 mStatus;
+		std::string mReason;
+		LLChannelDescriptors mChannels;
+		LLIOPipe::buffer_ptr_t mOutput;
+	};
+
+	LLCurlThreadClient(U32 capacity)
+		: mMutex(NULL),
+		  mCapacity(capacity),
+		  mInFlight(0),
+		  mRemoved(false)
+	{
+	}
+
+	~LLCurlThreadClient()
+	{
+		for_each(mRequests.begin(), mRequests.end(), DeletePointer());
+	}
+
+	// CURL THREAD
+	void addCompletion(LLCurl::ResponderPtr responder, U32 status, const std::string& reason,
+					   const LLChannelDescriptors& channels, const LLIOPipe::buffer_ptr_t& output)
+	{
+		Completion completion;
+		completion.mResponder = responder;
+		completion.mStatus = status;
+		completion.mReason = reason;
+		completion.mChannels = channels;
+		completion.mOutput = output;
+
+		LLMutexLock lock(&mMutex);
+		mCompletions.push_back(completion);
+		--mInFlight;
+	}
+
+	// CURL THREAD
+	// Started but unfinished transfers count against the queue too, so the
+	// queue can never overflow.
+	bool hasRoom()
+	{
+		LLMutexLock lock(&mMutex);
+		return mInFlight + mCompletions.size() < mCapacity;
+	}
+
+	// CURL THREAD
+	void startedRequest()
+	{
+		LLMutexLock lock(&mMutex);
+		++mInFlight;
+	}
+
+	// OWNER THREAD
+	bool popCompletion(Completion& completion)
+	{
+		LLMutexLock lock(&mMutex);
+		if (mCompletions.empty())
+		{
+			return false;
+		}
+		completion = mCompletions.front();
+		mCompletions.pop_front();
+		return true;
+	}
+
+	bool isRemoved()
+	{
+		LLMutexLock lock(&mMutex);
+		return mRemoved;
+	}
+
+	void setRemoved()
+	{
+		LLMutexLock lock(&mMutex);
+		mRemoved = true;
+	}
+
+	// Waiting for room or a connection.  Only touched by the curl thread.
+	std::deque<LLCurlQueuedRequest*> mRequests;
+
+private:
+	LLMutex mMutex;
+	std::deque<Completion> mCompletions;
+	U32 mCapacity;
+	U32 mInFlight;
+	bool mRemoved;
+};
+
 
 //////////////////////////////////////////////////////////////////////////////
 
@@ -224,6 +430,19 @@ public:
 	
 	const char* getErrorBuffer();
 
+	// Host of the last request prepared on this handle.
+	const std::string& getHost() const { return mHost; }
+
+	// When the request was handed to the multi, whether or not it could
+	// start straight away.
+	void setQueuedTime(U64 time) { mQueuedTime = time; }
+	U64 getQueuedTime() const { return mQueuedTime; }
+
+	// Threaded requests have their results queued for the owning
+	// LLCurlRequest rather than passed to the responder here.
+	void setClient(LLCurlThreadClient* client) { mClient = client; }
+	LLCurlThreadClient* getClient() const { return mClient; }
+
 	std::stringstream& getInput() { return mInput; }
 	std::stringstream& getHeaderOutput() { return mHeaderOutput; }
 	LLIOPipe::buffer_ptr_t& getOutput() { return mOutput; }
@@ -246,11 +465,17 @@ private:
 	std::vector<char*>	mStrings;
 	
 	ResponderPtr		mResponder;
+
+	std::string			mHost;
+	U64					mQueuedTime;
+	LLCurlThreadClient*	mClient;
 };
 
 LLCurl::Easy::Easy()
 	: mHeaders(NULL),
-	  mCurlEasyHandle(NULL)
+	  mCurlEasyHandle(NULL),
+	  mQueuedTime(0),
+	  mClient(NULL)
 {
 	mErrorBuffer[0] = 0;
 }
@@ -304,6 +529,9 @@ void LLCurl::Easy::resetState()
 	
 	mHeaderOutput.str("");
 	mHeaderOutput.clear();
+
+	mResponder = NULL;
+	mClient = NULL;
 }
 
 void LLCurl::Easy::setErrorBuffer()
@@ -358,7 +586,14 @@ U32 LLCurl::Easy::report(CURLcode code)
 		
 	if (mResponder)
 	{	
-		mResponder->completedRaw(responseCode, responseReason, mChannels, mOutput);
+		if (mClient)
+		{
+			mClient->addCompletion(mResponder, responseCode, responseReason, mChannels, mOutput);
+		}
+		else
+		{
+			mResponder->completedRaw(responseCode, responseReason, mChannels, mOutput);
+		}
 		mResponder = NULL;
 	}
 	
@@ -460,6 +695,7 @@ void LLCurl::Easy::prepRequest(const std::string& url,
 	setopt(CURLOPT_TIMEOUT, CURL_REQUEST_TIMEOUT);
 
 	setoptString(CURLOPT_URL, url);
+	mHost = get_url_host(url);
 
 	mResponder = responder;
 
@@ -486,7 +722,8 @@ public:
 	Multi();
 	~Multi();
 
-	Easy* allocEasy();
+	// Prefers a free handle that last talked to host.
+	Easy* allocEasy(const std::string& host = std::string());
 	bool addEasy(Easy* easy);
 	
 	void removeEasy(Easy* easy);
@@ -496,11 +733,32 @@ public:
 	
 	CURLMsg* info_read(S32* msgs_in_queue);
 
+	// Caps the transfers running against any one host, holding the rest
+	// until one finishes.  0 means no limit.
+	void setMaxPerHost(S32 max_per_host);
+	S32 getPending() const { return mPendingCount; }
+
+	// Handles allocated and not yet freed, whether running or waiting.
+	S32 getActiveCount() const { return (S32)mEasyActiveList.size(); }
+
+	// Waits up to timeout_ms for activity on any transfer's sockets.
+	void wait(S32 timeout_ms);
+
+	// Drops the transfers of a threaded LLCurlRequest without reporting them.
+	void cancelClient(LLCurlThreadClient* client);
+
+	// For handles that never made it into the multi.
+	void easyFree(Easy*);
+
+	const Stats& getStats() const { return mStats; }
+
 	S32 mQueued;
 	S32 mErrorCount;
 	
 private:
-	void easyFree(Easy*);
+	bool startEasy(Easy* easy);
+	void startPending();
+	void recordTransfer(Easy* easy, CURLcode result);
 	
 	CURLM* mCurlMultiHandle;
 
@@ -508,13 +766,27 @@ private:
 	easy_active_list_t mEasyActiveList;
 	typedef std::map<CURL*, Easy*> easy_active_map_t;
 	easy_active_map_t mEasyActiveMap;
-	typedef std::set<Easy*> easy_free_list_t;
+	typedef std::multimap<std::string, Easy*> easy_free_list_t;
 	easy_free_list_t mEasyFreeList;
+	U32 mEasyFreeListLimit;
+
+	S32 mMaxPerHost;
+	typedef std::map<std::string, S32> host_count_map_t;
+	host_count_map_t mHostActiveCount;
+	typedef std::map<std::string, std::deque<Easy*> > host_queue_map_t;
+	host_queue_map_t mPendingQueue;
+	S32 mPendingCount;
+
+	Stats mStats;
+	Stats mNewStats; // not yet added to mStats and LLCurl's totals
 };
 
 LLCurl::Multi::Multi()
 	: mQueued(0),
-	  mErrorCount(0)
+	  mErrorCount(0),
+	  mEasyFreeListLimit(EASY_HANDLE_POOL_SIZE),
+	  mMaxPerHost(0),
+	  mPendingCount(0)
 {
 	mCurlMultiHandle = curl_multi_init();
 	if (!mCurlMultiHandle)
@@ -528,7 +800,7 @@ LLCurl::Multi::Multi()
 
 LLCurl::Multi::~Multi()
 {
-	// Clean up active
+	// Clean up active, including those still waiting to start
 	for(easy_active_list_t::iterator iter = mEasyActiveList.begin();
 		iter != mEasyActiveList.end(); ++iter)
 	{
@@ -538,9 +810,14 @@ LLCurl::Multi::~Multi()
 	}
 	mEasyActiveList.clear();
 	mEasyActiveMap.clear();
+	mPendingQueue.clear();
 	
 	// Clean up freed
-	for_each(mEasyFreeList.begin(), mEasyFreeList.end(), DeletePointer());	
+	for (easy_free_list_t::iterator iter = mEasyFreeList.begin();
+		 iter != mEasyFreeList.end(); ++iter)
+	{
+		delete iter->second;
+	}
 	mEasyFreeList.clear();
 
 	curl_multi_cleanup(mCurlMultiHandle);
@@ -589,6 +866,7 @@ S32 LLCurl::Multi::process()
 			if (iter != mEasyActiveMap.end())
 			{
 				Easy* easy = iter->second;
+				recordTransfer(easy, msg->data.result);
 				response = easy->report(msg->data.result);
 				removeEasy(easy);
 			}
@@ -600,15 +878,24 @@ S32 LLCurl::Multi::process()
 			}
 			if (response >= 400)
 			{
-				// failure of some sort, inc mErrorCount for debugging and flagging multi for destruction
+				// failure of some sort, inc mErrorCount for debugging
 				++mErrorCount;
 			}
 		}
 	}
+
+	startPending();
+
+	if (mNewStats.mRequests || mNewStats.mCompleted)
+	{
+		mStats.add(mNewStats);
+		LLCurl::addStats(mNewStats);
+		mNewStats = Stats();
+	}
 	return processed;
 }
 
-LLCurl::Easy* LLCurl::Multi::allocEasy()
+LLCurl::Easy* LLCurl::Multi::allocEasy(const std::string& host)
 {
 	Easy* easy = 0;
 
@@ -618,8 +905,14 @@ LLCurl::Easy* LLCurl::Multi::allocEasy()
 	}
 	else
 	{
-		easy = *(mEasyFreeList.begin());
-		mEasyFreeList.erase(easy);
+		// a handle that already has a connection to host can reuse it
+		easy_free_list_t::iterator iter = mEasyFreeList.find(host);
+		if (iter == mEasyFreeList.end())
+		{
+			iter = mEasyFreeList.begin();
+		}
+		easy = iter->second;
+		mEasyFreeList.erase(iter);
 	}
 	if (easy)
 	{
@@ -630,6 +923,20 @@ LLCurl::Easy* LLCurl::Multi::allocEasy()
 }
 
 bool LLCurl::Multi::addEasy(Easy* easy)
+{
+	easy->setQueuedTime(LLTimer::getTotalTime());
+
+	const std::string& host = easy->getHost();
+	if (mMaxPerHost > 0 && !host.empty() && mHostActiveCount[host] >= mMaxPerHost)
+	{
+		mPendingQueue[host].push_back(easy);
+		++mPendingCount;
+		return true;
+	}
+	return startEasy(easy);
+}
+
+bool LLCurl::Multi::startEasy(Easy* easy)
 {
 	CURLMcode mcode = curl_multi_add_handle(mCurlMultiHandle, easy->getCurlHandle());
 	if (mcode != CURLM_OK)
@@ -637,17 +944,141 @@ bool LLCurl::Multi::addEasy(Easy* easy)
 		llwarns << "Curl Error: " << curl_multi_strerror(mcode) << llendl;
 		return false;
 	}
+	if (!easy->getHost().empty())
+	{
+		++mHostActiveCount[easy->getHost()];
+	}
+	++mNewStats.mRequests;
+	mNewStats.mQueueWaitTotal += (F64)(LLTimer::getTotalTime() - easy->getQueuedTime()) / 1000000.0;
 	return true;
 }
 
+void LLCurl::Multi::startPending()
+{
+	for (host_queue_map_t::iterator iter = mPendingQueue.begin();
+		 iter != mPendingQueue.end(); )
+	{
+		host_queue_map_t::iterator curiter = iter++;
+		std::deque<Easy*>& queue = curiter->second;
+		S32& active = mHostActiveCount[curiter->first];
+		while (!queue.empty() && active < mMaxPerHost)
+		{
+			Easy* easy = queue.front();
+			queue.pop_front();
+			--mPendingCount;
+			if (!startEasy(easy))
+			{
+				// never went to curl, so just fail it
+				easy->report(CURLE_FAILED_INIT);
+				easyFree(easy);
+			}
+		}
+		if (queue.empty())
+		{
+			mPendingQueue.erase(curiter);
+		}
+	}
+}
+
+void LLCurl::Multi::recordTransfer(Easy* easy, CURLcode result)
+{
+	if (result != CURLE_OK)
+	{
+		return;
+	}
+	++mNewStats.mCompleted;
+
+	long connects = 0;
+	curl_easy_getinfo(easy->getCurlHandle(), CURLINFO_NUM_CONNECTS, &connects);
+	if (!connects)
+	{
+		++mNewStats.mConnectionsReused;
+	}
+
+	double first_byte = 0.0;
+	curl_easy_getinfo(easy->getCurlHandle(), CURLINFO_STARTTRANSFER_TIME, &first_byte);
+	mNewStats.mFirstByteTotal += first_byte;
+}
+
+void LLCurl::Multi::setMaxPerHost(S32 max_per_host)
+{
+	mMaxPerHost = max_per_host;
+	// keep enough handles around for a few hosts' worth of connections
+	mEasyFreeListLimit = llmax((U32)EASY_HANDLE_POOL_SIZE, (U32)(max_per_host * 4));
+}
+
+void LLCurl::Multi::wait(S32 timeout_ms)
+{
+#if LIBCURL_VERSION_NUM >= 0x071c00
+	int numfds = 0;
+	curl_multi_wait(mCurlMultiHandle, NULL, 0, timeout_ms, &numfds);
+#else
+	fd_set read_fds;
+	fd_set write_fds;
+	fd_set exc_fds;
+	FD_ZERO(&read_fds);
+	FD_ZERO(&write_fds);
+	FD_ZERO(&exc_fds);
+	int max_fd = -1;
+	curl_multi_fdset(mCurlMultiHandle, &read_fds, &write_fds, &exc_fds, &max_fd);
+	if (max_fd < 0)
+	{
+		// nothing to wait on yet, e.g. still resolving
+		ms_sleep(llmin(timeout_ms, 1));
+		return;
+	}
+	struct timeval timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+	select(max_fd + 1, &read_fds, &write_fds, &exc_fds, &timeout);
+#endif
+}
+
+void LLCurl::Multi::cancelClient(LLCurlThreadClient* client)
+{
+	for (host_queue_map_t::iterator iter = mPendingQueue.begin();
+		 iter != mPendingQueue.end(); ++iter)
+	{
+		std::deque<Easy*>& queue = iter->second;
+		for (std::deque<Easy*>::iterator easy_iter = queue.begin(); easy_iter != queue.end(); )
+		{
+			Easy* easy = *easy_iter;
+			if (easy->getClient() == client)
+			{
+				easy_iter = queue.erase(easy_iter);
+				--mPendingCount;
+				easyFree(easy);
+			}
+			else
+			{
+				++easy_iter;
+			}
+		}
+	}
+
+	std::vector<Easy*> running;
+	for (easy_active_list_t::iterator iter = mEasyActiveList.begin();
+		 iter != mEasyActiveList.end(); ++iter)
+	{
+		if ((*iter)->getClient() == client)
+		{
+			running.push_back(*iter);
+		}
+	}
+	for (std::vector<Easy*>::iterator iter = running.begin(); iter != running.end(); ++iter)
+	{
+		removeEasy(*iter);
+	}
+}
+
 void LLCurl::Multi::easyFree(Easy* easy)
 {
 	mEasyActiveList.erase(easy);
 	mEasyActiveMap.erase(easy->getCurlHandle());
-	if (mEasyFreeList.size() < EASY_HANDLE_POOL_SIZE)
+	if (mEasyFreeList.size() < mEasyFreeListLimit)
 	{
 		easy->resetState();
-		mEasyFreeList.insert(easy);
+		mEasyFreeList.insert(std::make_pair(easy->getHost(), easy));
 	}
 	else
 	{
@@ -658,9 +1089,254 @@ void LLCurl::Multi::easyFree(Easy* easy)
 void LLCurl::Multi::removeEasy(Easy* easy)
 {
 	curl_multi_remove_handle(mCurlMultiHandle, easy->getCurlHandle());
+	if (!easy->getHost().empty() && mHostActiveCount[easy->getHost()] > 0)
+	{
+		--mHostActiveCount[easy->getHost()];
+	}
 	easyFree(easy);
 }
 
+////////////////////////////////////////////////////////////////////////////
+
+// Sets up easy to make request.
+static void prep_request(LLCurl::Easy* easy, const LLCurlQueuedRequest& request)
+{
+	easy->prepRequest(request.mURL, request.mHeaders, request.mResponder);
+	if (request.mPost)
+	{
+		easy->getInput().write(request.mPostBody.data(), request.mPostBody.size());
+		S32 bytes = request.mPostBody.size();
+
+		easy->setopt(CURLOPT_POST, 1);
+		easy->setopt(CURLOPT_POSTFIELDS, (void*)NULL);
+		easy->setopt(CURLOPT_POSTFIELDSIZE, bytes);
+
+		easy->slist_append("Content-Type: application/llsd+xml");
+		lldebugs << "POSTING: " << bytes << " bytes." << llendl;
+	}
+	else
+	{
+		easy->setopt(CURLOPT_HTTPGET, 1);
+		if (request.mLength > 0)
+		{
+			std::string range = llformat("Range: bytes=%d-%d", request.mOffset, request.mOffset + request.mLength - 1);
+			easy->slist_append(range.c_str());
+		}
+	}
+	easy->setHeaders();
+}
+
+// Owns the multi handle that every threaded LLCurlRequest's transfers run
+// on, so that curl_multi_perform() and reading the results stay off the
+// threads that make the requests.
+class LLCurlThread : public LLThread
+{
+public:
+	LLCurlThread(U32 completion_queue_size);
+	virtual ~LLCurlThread();
+
+	U32 getCompletionQueueSize() const { return mCompletionQueueSize; }
+
+	// Called from the thread owning client.
+	void addRequest(LLCurlThreadClient* client, LLCurlQueuedRequest* request);
+	// Blocks until the curl thread has dropped all of client's transfers.
+	void removeClient(LLCurlThreadClient* client);
+	// A client has handed out completions, so there may be room to start more.
+	void madeRoom();
+
+private:
+	/*virtual*/ bool runCondition();
+	/*virtual*/ void run();
+	void startRequests();
+
+	U32 mCompletionQueueSize;
+	LLCurl::Multi* mMulti;
+
+	// Protected by lockData()
+	typedef std::vector<std::pair<LLCurlThreadClient*, LLCurlQueuedRequest*> > request_list_t;
+	request_list_t mIncoming;
+	std::vector<LLCurlThreadClient*> mRemoving;
+	bool mRoomMade;
+
+	// Only touched by the curl thread
+	typedef std::set<LLCurlThreadClient*> client_set_t;
+	client_set_t mClients;
+	bool mBusy;
+};
+
+// How long the thread waits on sockets before looking for new requests.
+static const S32 CURL_THREAD_WAIT_MS = 10;
+
+LLCurlThread::LLCurlThread(U32 completion_queue_size)
+	: LLThread("Curl"),
+	  mCompletionQueueSize(completion_queue_size),
+	  mMulti(NULL),
+	  mRoomMade(false),
+	  mBusy(false)
+{
+	mMulti = new LLCurl::Multi();
+	mMulti->setMaxPerHost(LLCurlRequest::DEFAULT_MAX_PER_HOST);
+}
+
+LLCurlThread::~LLCurlThread()
+{
+	// The multi handle must outlive the thread, so wait here rather than in ~LLThread().
+	setQuitting();
+	S32 timeout = 1000;
+	for ( ; timeout > 0 && !isStopped(); timeout--)
+	{
+		ms_sleep(CURL_THREAD_WAIT_MS);
+	}
+	if (!isStopped())
+	{
+		llwarns << "~LLCurlThread timed out!" << llendl;
+		return;
+	}
+	delete mMulti;
+	for (request_list_t::iterator iter = mIncoming.begin(); iter != mIncoming.end(); ++iter)
+	{
+		delete iter->second;
+	}
+	// ~LLThread() will be called here
+}
+
+void LLCurlThread::addRequest(LLCurlThreadClient* client, LLCurlQueuedRequest* request)
+{
+	lockData();
+	mIncoming.push_back(std::make_pair(client, request));
+	unlockData();
+	wake();
+}
+
+void LLCurlThread::removeClient(LLCurlThreadClient* client)
+{
+	lockData();
+	mRemoving.push_back(client);
+	unlockData();
+	wake();
+	while (!client->isRemoved() && !isStopped())
+	{
+		ms_sleep(1);
+	}
+}
+
+void LLCurlThread::madeRoom()
+{
+	lockData();
+	mRoomMade = true;
+	unlockData();
+	wake();
+}
+
+//virtual
+bool LLCurlThread::runCondition()
+{
+	// mRunCondition is locked here
+	return mBusy || mRoomMade || !mIncoming.empty() || !mRemoving.empty();
+}
+
+//virtual
+void LLCurlThread::run()
+{
+	while (!isQuitting())
+	{
+		checkPause();
+		if (isQuitting())
+		{
+			break;
+		}
+
+		request_list_t incoming;
+		std::vector<LLCurlThreadClient*> removing;
+		lockData();
+		incoming.swap(mIncoming);
+		removing.swap(mRemoving);
+		mRoomMade = false;
+		unlockData();
+
+		for (request_list_t::iterator iter = incoming.begin(); iter != incoming.end(); ++iter)
+		{
+			iter->first->mRequests.push_back(iter->second);
+			mClients.insert(iter->first);
+		}
+		// after the incoming requests, which may belong to removed clients
+		for (std::vector<LLCurlThreadClient*>::iterator iter = removing.begin();
+			 iter != removing.end(); ++iter)
+		{
+			LLCurlThreadClient* client = *iter;
+			mMulti->cancelClient(client);
+			for_each(client->mRequests.begin(), client->mRequests.end(), DeletePointer());
+			client->mRequests.clear();
+			mClients.erase(client);
+			client->setRemoved();
+		}
+		startRequests();
+
+		if (mMulti->getActiveCount() > 0)
+		{
+			mMulti->wait(CURL_THREAD_WAIT_MS);
+			mMulti->process();
+		}
+
+		// Requests held back for lack of queue room wait for madeRoom().
+		lockData();
+		mBusy = mMulti->getActiveCount() > 0;
+		unlockData();
+	}
+}
+
+void LLCurlThread::startRequests()
+{
+	for (client_set_t::iterator iter = mClients.begin(); iter != mClients.end(); ++iter)
+	{
+		LLCurlThreadClient* client = *iter;
+		while (!client->mRequests.empty() && client->hasRoom())
+		{
+			LLCurlQueuedRequest* request = client->mRequests.front();
+			client->mRequests.pop_front();
+
+			LLCurl::Easy* easy = mMulti->allocEasy(get_url_host(request->mURL));
+			if (easy)
+			{
+				prep_request(easy, *request);
+				easy->setClient(client);
+				client->startedRequest();
+				if (!mMulti->addEasy(easy))
+				{
+					// never went to curl, so just fail it
+					easy->report(CURLE_FAILED_INIT);
+					mMulti->easyFree(easy);
+				}
+			}
+			else
+			{
+				client->startedRequest();
+				client->addCompletion(request->mResponder, 499, LLCurl::strerror(CURLE_FAILED_INIT),
+									  LLChannelDescriptors(), LLIOPipe::buffer_ptr_t());
+			}
+			delete request;
+		}
+	}
+}
+
+//static
+void LLCurl::startThread(U32 completion_queue_size, S32 callbacks_per_process)
+{
+	if (!sThread)
+	{
+		sCallbacksPerProcess = callbacks_per_process;
+		sThread = new LLCurlThread(completion_queue_size);
+		sThread->start();
+	}
+}
+
+//static
+void LLCurl::stopThread()
+{
+	delete sThread;
+	sThread = NULL;
+}
+
 //static
 std::string LLCurl::strerror(CURLcode errorcode)
 {
@@ -679,46 +1355,46 @@ std::string LLCurl::strerror(CURLcode errorcode)
 // For generating a simple request for data
 // using one multi and one easy per request 
 
-LLCurlRequest::LLCurlRequest() :
-	mActiveMulti(NULL),
-	mActiveRequestCount(0)
+LLCurlRequest::LLCurlRequest(S32 max_per_host) :
+	mMulti(NULL),
+	mClient(NULL),
+	mCallbacksPerProcess(LLCurl::sCallbacksPerProcess),
+	mThreadedQueued(0)
 {
 	mThreadID = LLThread::currentID();
+	if (LLCurl::sThread)
+	{
+		mClient = new LLCurlThreadClient(LLCurl::sThread->getCompletionQueueSize());
+	}
+	else
+	{
+		mMulti = new LLCurl::Multi();
+		mMulti->setMaxPerHost(max_per_host);
+	}
 }
 
 LLCurlRequest::~LLCurlRequest()
 {
 	llassert_always(mThreadID == LLThread::currentID());
-	for_each(mMultiSet.begin(), mMultiSet.end(), DeletePointer());
-}
-
-void LLCurlRequest::addMulti()
-{
-	llassert_always(mThreadID == LLThread::currentID());
-	LLCurl::Multi* multi = new LLCurl::Multi();
-	mMultiSet.insert(multi);
-	mActiveMulti = multi;
-	mActiveRequestCount = 0;
+	if (mClient)
+	{
+		if (LLCurl::sThread)
+		{
+			LLCurl::sThread->removeClient(mClient);
+		}
+		delete mClient;
+	}
+	delete mMulti;
 }
 
-LLCurl::Easy* LLCurlRequest::allocEasy()
+LLCurl::Easy* LLCurlRequest::allocEasy(const std::string& url)
 {
-	if (!mActiveMulti ||
-		mActiveRequestCount	>= MAX_ACTIVE_REQUEST_COUNT ||
-		mActiveMulti->mErrorCount > 0)
-	{
-		addMulti();
-	}
-	llassert_always(mActiveMulti);
-	++mActiveRequestCount;
-	LLCurl::Easy* easy = mActiveMulti->allocEasy();
-	return easy;
+	return mMulti->allocEasy(get_url_host(url));
 }
 
 bool LLCurlRequest::addEasy(LLCurl::Easy* easy)
 {
-	llassert_always(mActiveMulti);
-	bool res = mActiveMulti->addEasy(easy);
+	bool res = mMulti->addEasy(easy);
 	return res;
 }
 
@@ -732,21 +1408,13 @@ bool LLCurlRequest::getByteRange(const std::string& url,
 								 S32 offset, S32 length,
 								 LLCurl::ResponderPtr responder)
 {
-	LLCurl::Easy* easy = allocEasy();
-	if (!easy)
-	{
-		return false;
-	}
-	easy->prepRequest(url, headers, responder);
-	easy->setopt(CURLOPT_HTTPGET, 1);
-	if (length > 0)
-	{
-		std::string range = llformat("Range: bytes=%d-%d", offset,offset+length-1);
-		easy->slist_append(range.c_str());
-	}
-	easy->setHeaders();
-	bool res = addEasy(easy);
-	return res;
+	LLCurlQueuedRequest* request = new LLCurlQueuedRequest;
+	request->mURL = url;
+	request->mHeaders = headers;
+	request->mOffset = offset;
+	request->mLength = length;
+	request->mResponder = responder;
+	return addRequest(request);
 }
 
 bool LLCurlRequest::post(const std::string& url,
@@ -754,61 +1422,86 @@ bool LLCurlRequest::post(const std::string& url,
 						 const LLSD& data,
 						 LLCurl::ResponderPtr responder)
 {
-	LLCurl::Easy* easy = allocEasy();
-	if (!easy)
+	LLCurlQueuedRequest* request = new LLCurlQueuedRequest;
+	request->mURL = url;
+	request->mHeaders = headers;
+	request->mPost = true;
+	// serialized here since LLSD is not thread safe
+	std::ostringstream body;
+	LLSDSerialize::toXML(data, body);
+	request->mPostBody = body.str();
+	request->mResponder = responder;
+	return addRequest(request);
+}
+
+bool LLCurlRequest::addRequest(LLCurlQueuedRequest* request)
+{
+	if (mClient)
 	{
-		return false;
+		if (!LLCurl::sThread)
+		{
+			// the curl thread has already been stopped
+			delete request;
+			return false;
+		}
+		++mThreadedQueued;
+		LLCurl::sThread->addRequest(mClient, request);
+		return true;
 	}
-	easy->prepRequest(url, headers, responder);
-
-	LLSDSerialize::toXML(data, easy->getInput());
-	S32 bytes = easy->getInput().str().length();
-	
-	easy->setopt(CURLOPT_POST, 1);
-	easy->setopt(CURLOPT_POSTFIELDS, (void*)NULL);
-	easy->setopt(CURLOPT_POSTFIELDSIZE, bytes);
-
-	easy->slist_append("Content-Type: application/llsd+xml");
-	easy->setHeaders();
 
-	lldebugs << "POSTING: " << bytes << " bytes." << llendl;
-	bool res = addEasy(easy);
-	return res;
+	LLCurl::Easy* easy = allocEasy(request->mURL);
+	if (easy)
+	{
+		prep_request(easy, *request);
+	}
+	delete request;
+	return easy && addEasy(easy);
 }
 	
 // Note: call once per frame
 S32 LLCurlRequest::process()
 {
 	llassert_always(mThreadID == LLThread::currentID());
-	S32 res = 0;
-	for (curlmulti_set_t::iterator iter = mMultiSet.begin();
-		 iter != mMultiSet.end(); )
-	{
-		curlmulti_set_t::iterator curiter = iter++;
-		LLCurl::Multi* multi = *curiter;
-		S32 tres = multi->process();
-		res += tres;
-		if (multi != mActiveMulti && tres == 0 && multi->mQueued == 0)
-		{
-			mMultiSet.erase(curiter);
-			delete multi;
-		}
+	if (!mClient)
+	{
+		return mMulti->process();
 	}
-	return res;
+
+	S32 processed = 0;
+	LLCurlThreadClient::Completion completion;
+	while ((mCallbacksPerProcess <= 0 || processed < mCallbacksPerProcess)
+		   && mClient->popCompletion(completion))
+	{
+		completion.mResponder->completedRaw(completion.mStatus, completion.mReason,
+											completion.mChannels, completion.mOutput);
+		completion = LLCurlThreadClient::Completion();
+		--mThreadedQueued;
+		++processed;
+	}
+	if (processed && LLCurl::sThread)
+	{
+		LLCurl::sThread->madeRoom();
+	}
+	return processed;
 }
 
 S32 LLCurlRequest::getQueued()
 {
 	llassert_always(mThreadID == LLThread::currentID());
-	S32 queued = 0;
-	for (curlmulti_set_t::iterator iter = mMultiSet.begin();
-		 iter != mMultiSet.end(); )
+	if (mClient)
+	{
+		return mThreadedQueued;
+	}
+	return mMulti->mQueued + mMulti->getPending();
+}
+
+LLCurl::Stats LLCurlRequest::getStats() const
+{
+	if (mClient)
 	{
-		curlmulti_set_t::iterator curiter = iter++;
-		LLCurl::Multi* multi = *curiter;
-		queued += multi->mQueued;
+		return LLCurl::getStats();
 	}
-	return queued;
+	return mMulti->getStats();
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -1025,10 +1718,25 @@ void LLCurl::initClass()
 	CRYPTO_set_id_callback(&LLCurl::ssl_thread_id);
 	CRYPTO_set_locking_callback(&LLCurl::ssl_locking_callback);
 #endif
+	sStatsMutex = new LLMutex(NULL);
 }
 
 void LLCurl::cleanupClass()
 {
+	stopThread();
+
+	Stats stats = getStats();
+	if (stats.mRequests)
+	{
+		llinfos << "HTTP requests: " << stats.mRequests
+				<< " connection reuse: " << stats.getReuseRatio() * 100.f << "%"
+				<< " average queue wait: " << stats.getAverageQueueWait() * 1000.0 << "ms"
+				<< " average time to first byte: " << stats.getAverageFirstByte() * 1000.0 << "ms"
+				<< llendl;
+	}
+	delete sStatsMutex;
+	sStatsMutex = NULL;
+
 #if SAFE_SSL
 	CRYPTO_set_locking_callback(NULL);
 	for_each(sSSLMutex.begin(), sSSLMutex.end(), DeletePointer());
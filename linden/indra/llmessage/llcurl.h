@@ -44,11 +44,15 @@
 #include <boost/intrusive_ptr.hpp>
 #include <curl/curl.h> // TODO: remove dependency
 
+#include "llapr.h"
 #include "llbuffer.h"
 #include "lliopipe.h"
 #include "llsd.h"
 
 class LLMutex;
+struct LLCurlQueuedRequest;
+class LLCurlThread;
+class LLCurlThreadClient;
 
 // For whatever reason, this is not typedef'd in curl.h
 typedef size_t (*curl_header_callback)(void *ptr, size_t size, size_t nmemb, void *stream);
@@ -68,6 +72,26 @@ public:
 		F64 mTotalTime;
 		F64 mSpeedDownload;
 	};
+
+	// Connection reuse and latency of transfers made through LLCurlRequest.
+	struct Stats
+	{
+		Stats();
+		void add(const Stats& other);
+
+		// Fraction of completed transfers that did not open a new connection.
+		F32 getReuseRatio() const;
+		// Seconds a request waited for a free connection slot to its host.
+		F64 getAverageQueueWait() const;
+		// Seconds from starting a transfer to the first byte of the response.
+		F64 getAverageFirstByte() const;
+
+		U32 mRequests;
+		U32 mCompleted;
+		U32 mConnectionsReused;
+		F64 mQueueWaitTotal;
+		F64 mFirstByteTotal;
+	};
 	
 	class Responder
 	{
@@ -121,7 +145,8 @@ public:
 			virtual void completedHeader(U32 status, const std::string& reason, const LLSD& content);
 
 	public: /* but not really -- don't touch this */
-		U32 mReferenceCount;
+		// Atomic since responders are handed to and from the curl thread.
+		LLAtomicU32 mReferenceCount;
 	};
 	typedef boost::intrusive_ptr<Responder>	ResponderPtr;
 
@@ -165,6 +190,26 @@ public:
 	 * @ brief curl error code -> string
 	 */
 	static std::string strerror(CURLcode errorcode);
+
+	/**
+	 * @ brief Totals for all LLCurlRequests since the last resetStats()
+	 */
+	static Stats getStats();
+	static void resetStats();
+
+	/**
+	 * @ brief Run the transfers of LLCurlRequests created from now on in a
+	 * thread of their own.  Their process() then only hands finished
+	 * transfers to responders, at most callbacks_per_process at a time,
+	 * and at most completion_queue_size finished transfers wait for it.
+	 */
+	static void startThread(U32 completion_queue_size, S32 callbacks_per_process);
+
+	/**
+	 * @ brief Stop the curl thread.  Destroy any threaded LLCurlRequests first.
+	 */
+	static void stopThread();
+	static bool isThreaded() { return sThread != NULL; }
 	
 	// For OpenSSL callbacks
 	static std::vector<LLMutex*> sSSLMutex;
@@ -174,8 +219,16 @@ public:
 	static unsigned long ssl_thread_id(void);
 
 private:
+	static void addStats(const Stats& stats);
+
 	static std::string sCAPath;
 	static std::string sCAFile;
+	static Stats sStats;
+	static LLMutex* sStatsMutex;
+	static LLCurlThread* sThread;
+	static S32 sCallbacksPerProcess;
+
+	friend class LLCurlRequest;
 };
 
 namespace boost
@@ -185,12 +238,21 @@ namespace boost
 };
 
 
+// Keeps one multi handle, and with it libcurl's connection cache, for its
+// whole life.  Easy handles are handed back out to the host they last
+// talked to, and at most max_per_host transfers run against any one host;
+// the rest wait in a per-host queue.  HTTP pipelining is left off, many
+// servers and proxies mishandle it.
+//
+// Once LLCurl::startThread() has been called new requests share the curl
+// thread's multi handle and per-host limit instead, and process() only
+// runs the responders for transfers that have finished.
 class LLCurlRequest
 {
 public:
 	typedef std::vector<std::string> headers_t;
 	
-	LLCurlRequest();
+	LLCurlRequest(S32 max_per_host = DEFAULT_MAX_PER_HOST);
 	~LLCurlRequest();
 
 	void get(const std::string& url, LLCurl::ResponderPtr responder);
@@ -199,16 +261,24 @@ public:
 	S32  process();
 	S32  getQueued();
 
+	// Per request object, or the LLCurl totals when threaded.
+	LLCurl::Stats getStats() const;
+
+	// Most responders run by one process() when threaded, 0 for no limit.
+	void setCallbacksPerProcess(S32 callbacks) { mCallbacksPerProcess = callbacks; }
+
+	static const S32 DEFAULT_MAX_PER_HOST = 8;
+
 private:
-	void addMulti();
-	LLCurl::Easy* allocEasy();
+	LLCurl::Easy* allocEasy(const std::string& url);
 	bool addEasy(LLCurl::Easy* easy);
+	bool addRequest(LLCurlQueuedRequest* request);
 	
 private:
-	typedef std::set<LLCurl::Multi*> curlmulti_set_t;
-	curlmulti_set_t mMultiSet;
-	LLCurl::Multi* mActiveMulti;
-	S32 mActiveRequestCount;
+	LLCurl::Multi* mMulti;			// NULL when threaded
+	LLCurlThreadClient* mClient;	// NULL unless threaded
+	S32 mCallbacksPerProcess;
+	S32 mThreadedQueued;			// handed to the curl thread and not yet processed
 	U32 mThreadID; // debug
 };
 
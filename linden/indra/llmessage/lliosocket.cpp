@@ -73,6 +73,15 @@ bool is_addr_in_use(apr_status_t status)
 #endif
 #endif
 
+#if !LL_WINDOWS
+// Read sockets straight into buffer segments with readv().
+#define LL_SOCKET_SCATTER_READ 1
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include "apr_portable.h"
+#endif
+
 
 // Quick function 
 void ll_debug_socket(const char* msg, apr_socket_t* apr_sock)
@@ -274,6 +283,57 @@ void LLSocket::setOptions()
 
 }
 
+#if LL_SOCKET_SCATTER_READ
+// Reads into vecs the way apr_socket_recv() would, including waiting
+// up to the socket's timeout for data when one is set, rather than
+// failing with EAGAIN straight away.
+static apr_status_t socket_readv(
+	apr_socket_t* socket,
+	int fd,
+	const struct iovec* vecs,
+	int count,
+	S32& len)
+{
+	len = 0;
+	ssize_t bytes = readv(fd, vecs, count);
+	if((bytes < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+	{
+		apr_interval_time_t timeout = 0;
+		apr_socket_timeout_get(socket, &timeout);
+		if(timeout > 0)
+		{
+			struct pollfd poll_fd;
+			poll_fd.fd = fd;
+			poll_fd.events = POLLIN;
+			poll_fd.revents = 0;
+			int ready;
+			do
+			{
+				ready = poll(&poll_fd, 1, (int)((timeout + 999) / 1000));
+			} while((ready < 0) && (EINTR == errno));
+			if(0 == ready)
+			{
+				return APR_TIMEUP;
+			}
+			if(ready > 0)
+			{
+				bytes = readv(fd, vecs, count);
+			}
+		}
+	}
+	if(bytes > 0)
+	{
+		len = (S32)bytes;
+		return APR_SUCCESS;
+	}
+	if(0 == bytes)
+	{
+		return APR_EOF;
+	}
+	return APR_FROM_OS_ERROR(errno);
+}
+#endif
+
 ///
 /// LLIOSocketReader
 ///
@@ -328,10 +388,59 @@ LLIOPipe::EStatus LLIOSocketReader::process_impl(
 	//	buffer = new LLBufferArray;
 	//}
 	PUMP_DEBUG;
+	apr_status_t status = APR_SUCCESS;
+#if LL_SOCKET_SCATTER_READ
+	// Make segments at the end of the buffer, read into all of them
+	// at once, and hand back whatever the read did not fill. The first
+	// read only uses one segment so small reads do not allocate more
+	// buffers than they need.
+	const S32 READ_VECTORS = 4;
+	S32 vectors = 1;
+	int fd = -1;
+	apr_os_sock_get(&fd, mSource->getSocket());
+	LLBufferArray::segment_iterator_t segments[READ_VECTORS];
+	struct iovec vecs[READ_VECTORS];
+	S32 len;
+	S32 total;
+	do
+	{
+		PUMP_DEBUG;
+		S32 count = 0;
+		total = 0;
+		for(; count < vectors; ++count)
+		{
+			segments[count] = buffer->makeSegment(
+				channels.out(),
+				LLHeapBuffer::DEFAULT_SIZE);
+			if(segments[count] == buffer->endSegment()) break;
+			vecs[count].iov_base = (*segments[count]).data();
+			vecs[count].iov_len = (*segments[count]).size();
+			total += (*segments[count]).size();
+		}
+		len = 0;
+		if(!count)
+		{
+			status = APR_ENOMEM;
+		}
+		else
+		{
+			status = socket_readv(mSource->getSocket(), fd, vecs, count, len);
+		}
+
+		// Trim from the back so each segment is the last one made in
+		// its buffer, and the memory can be handed out again.
+		S32 offset = total;
+		for(S32 i = count - 1; i >= 0; --i)
+		{
+			offset -= (S32)vecs[i].iov_len;
+			buffer->trimSegment(segments[i], llclamp(len - offset, 0, (S32)vecs[i].iov_len));
+		}
+		vectors = READ_VECTORS;
+	} while((APR_SUCCESS == status) && (total == len));
+#else
 	const apr_size_t READ_BUFFER_SIZE = 1024;
 	char read_buf[READ_BUFFER_SIZE]; /*Flawfinder: ignore*/
 	apr_size_t len;
-	apr_status_t status = APR_SUCCESS;
 	do
 	{
 		PUMP_DEBUG;
@@ -339,6 +448,7 @@ LLIOPipe::EStatus LLIOSocketReader::process_impl(
 		status = apr_socket_recv(mSource->getSocket(), read_buf, &len);
 		buffer->append(channels.out(), (U8*)read_buf, len);
 	} while((APR_SUCCESS == status) && (READ_BUFFER_SIZE == len));
+#endif
 	lldebugs << "socket read status: " << status << llendl;
 	LLIOPipe::EStatus rv = STATUS_OK;
 
@@ -425,10 +535,6 @@ LLIOPipe::EStatus LLIOSocketWriter::process_impl(
 	}
 
 	PUMP_DEBUG;
-	// *FIX: Some sort of writev implementation would be much more
-	// efficient - not only because writev() is better, but also
-	// because we won't have to do as much work to find the start
-	// address.
 	LLBufferArray::segment_iterator_t it;
 	LLBufferArray::segment_iterator_t end = buffer->endSegment();
 	LLSegment segment;
@@ -462,51 +568,73 @@ LLIOPipe::EStatus LLIOSocketWriter::process_impl(
 	*/
 
 	PUMP_DEBUG;
+	// Gather the segments on the input channel and send them with a
+	// single writev().
+	const S32 WRITE_VECTORS = 64;
+	LLSegment segments[WRITE_VECTORS];
+	struct iovec vecs[WRITE_VECTORS];
 	apr_size_t len;
 	bool done = false;
 	apr_status_t status = APR_SUCCESS;
 	while(it != end)
 	{
-
 		PUMP_DEBUG;
-		if((*it).isOnChannel(channels.in()))
+		S32 count = 0;
+		apr_size_t total = 0;
+		while((it != end) && (count < WRITE_VECTORS))
 		{
-			PUMP_DEBUG;
-			len = (apr_size_t)segment.size();
-			status = apr_socket_send(
-				mDestination->getSocket(),
-				(const char*)segment.data(),
-				&len);
-			// We sometimes get a 'non-blocking socket operation could not be 
-			// completed immediately' error from apr_socket_send.  In this
-			// case we break and the data will be sent the next time the chain
-			// is pumped.
-			if(APR_STATUS_IS_EAGAIN(status))
+			if((*it).isOnChannel(channels.in()) && segment.size())
 			{
-				ll_apr_warn_status(status);
-				break;
+				segments[count] = segment;
+				vecs[count].iov_base = (char*)segment.data();
+				vecs[count].iov_len = segment.size();
+				total += segment.size();
+				++count;
 			}
-
-			mLastWritten = segment.data() + len - 1;
-
-			PUMP_DEBUG;
-			if((S32)len < segment.size())
+			++it;
+			if(it != end)
 			{
-				break;
+				segment = (*it);
 			}
-			
+		}
+		if(!count)
+		{
+			done = true;
+			break;
 		}
 
-		++it;
-		if(it != end)
+		len = 0;
+		status = apr_socket_sendv(
+			mDestination->getSocket(),
+			vecs,
+			count,
+			&len);
+		// We sometimes get a 'non-blocking socket operation could not be 
+		// completed immediately' error from apr_socket_sendv.  In this
+		// case we break and the data will be sent the next time the chain
+		// is pumped.
+		if(APR_STATUS_IS_EAGAIN(status))
 		{
-			segment = (*it);
+			ll_apr_warn_status(status);
+			break;
 		}
-		else
+
+		PUMP_DEBUG;
+		apr_size_t left = len;
+		for(S32 i = 0; (i < count) && left; ++i)
+		{
+			apr_size_t written = llmin(left, vecs[i].iov_len);
+			mLastWritten = segments[i].data() + written - 1;
+			left -= written;
+		}
+		if(len < total)
+		{
+			break;
+		}
+		if(it == end)
 		{
 			done = true;
 		}
-
 	}
 	PUMP_DEBUG;
 	if(done && eos)
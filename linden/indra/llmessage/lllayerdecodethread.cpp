@@ -0,0 +1,101 @@
+/** 
+ * @file lllayerdecodethread.cpp
+ * @brief Decodes LayerData packets on a worker thread
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include "lllayerdecodethread.h"
+
+//----------------------------------------------------------------------------
+
+// MAIN THREAD
+LLLayerDecodeThread::LLLayerDecodeThread(bool threaded, LLThreadPool* pool)
+	: LLQueuedThread("layerdecode", threaded, pool)
+{
+	init_patch_decompressor_tables();
+}
+
+// MAIN THREAD
+LLLayerDecodeThread::handle_t LLLayerDecodeThread::decodeLayer(const U8 *data, S32 size, U32 priority)
+{
+	handle_t handle = generateHandle();
+	LayerRequest* req = new LayerRequest(handle, priority, data, size);
+	bool res = addRequest(req);
+	if (!res)
+	{
+		llerrs << "request added after LLLayerDecodeThread::shutdown()" << llendl;
+	}
+	return handle;
+}
+
+// MAIN THREAD
+LLLayerDecodeThread::LayerRequest* LLLayerDecodeThread::getDecodedLayer(handle_t handle)
+{
+	if (getRequestStatus(handle) != STATUS_COMPLETE)
+	{
+		return NULL;
+	}
+	return (LayerRequest*)getRequest(handle);
+}
+
+// MAIN THREAD
+void LLLayerDecodeThread::releaseLayer(handle_t handle)
+{
+	// Flag first, so a request that finishes from here on deletes itself.
+	// One that had already finished is still there to complete.
+	abortRequest(handle, true);
+	if (getRequestStatus(handle) == STATUS_COMPLETE)
+	{
+		completeRequest(handle);
+	}
+}
+
+//----------------------------------------------------------------------------
+
+LLLayerDecodeThread::LayerRequest::LayerRequest(handle_t handle, U32 priority, const U8 *data, S32 size)
+	: LLQueuedThread::QueuedRequest(handle, priority),
+	  mData(data, data + size),
+	  mValid(FALSE)
+{
+	memset(&mGroupHeader, 0, sizeof(mGroupHeader));
+}
+
+LLLayerDecodeThread::LayerRequest::~LayerRequest()
+{
+}
+
+bool LLLayerDecodeThread::LayerRequest::processRequest()
+{
+	const U8 *data = mData.empty() ? NULL : &mData[0];
+	mValid = decode_layer_patches(data, (S32)mData.size(), &mGroupHeader, mPatches);
+	return true;
+}
@@ -0,0 +1,86 @@
+/** 
+ * @file lllayerdecodethread.h
+ * @brief Decodes LayerData packets on a worker thread
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#ifndef LL_LLLAYERDECODETHREAD_H
+#define LL_LLLAYERDECODETHREAD_H
+
+#include <vector>
+
+#include "llqueuedthread.h"
+#include "patch_code.h"
+
+// Decodes whole LayerData packets with decode_layer_patches() on its own
+// thread or on the threads of an LLThreadPool.  The main thread queues a
+// packet with decodeLayer(), polls getDecodedLayer() until the patches are
+// ready, and hands the handle back with releaseLayer().
+
+class LLLayerDecodeThread : public LLQueuedThread
+{
+public:
+	class LayerRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		virtual ~LayerRequest(); // use deleteRequest()
+
+	public:
+		LayerRequest(handle_t handle, U32 priority, const U8 *data, S32 size);
+
+		/*virtual*/ bool processRequest();
+
+		// FALSE if the packet was malformed; mPatches holds the patches
+		// decoded before the error.
+		BOOL isValid() const { return mValid; }
+
+		LLGroupHeader mGroupHeader;
+		std::vector<LLDecodedPatch> mPatches;
+
+	private:
+		std::vector<U8> mData;
+		BOOL mValid;
+	};
+
+public:
+	LLLayerDecodeThread(bool threaded = true, LLThreadPool* pool = NULL);
+
+	// Copies size bytes of data and queues them for decoding.
+	handle_t decodeLayer(const U8 *data, S32 size, U32 priority = PRIORITY_NORMAL);
+
+	// Returns the decoded layer, or NULL while it is still being decoded.
+	// The request stays valid until releaseLayer().
+	LayerRequest* getDecodedLayer(handle_t handle);
+
+	// Frees a decoded layer, or abandons one that has not finished.
+	void releaseLayer(handle_t handle);
+};
+
+#endif // LL_LLLAYERDECODETHREAD_H
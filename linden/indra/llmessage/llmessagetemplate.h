@@ -147,16 +147,16 @@ public:
 class LLMessageVariable
 {
 public:
-	LLMessageVariable() : mName(NULL), mType(MVT_NULL), mSize(-1)
+	LLMessageVariable() : mName(NULL), mType(MVT_NULL), mSize(-1), mOffset(-1)
 	{
 	}
 
-	LLMessageVariable(char *name) : mType(MVT_NULL), mSize(-1)
+	LLMessageVariable(char *name) : mType(MVT_NULL), mSize(-1), mOffset(-1)
 	{
 		mName = name;
 	}
 
-	LLMessageVariable(const char *name, const EMsgVariableType type, const S32 size) : mType(type), mSize(size) 
+	LLMessageVariable(const char *name, const EMsgVariableType type, const S32 size, const S32 offset = -1) : mType(type), mSize(size), mOffset(offset)
 	{
 		mName = LLMessageStringTable::getInstance()->getString(name); 
 	}
@@ -168,10 +168,13 @@ public:
 	EMsgVariableType getType() const				{ return mType; }
 	S32	getSize() const								{ return mSize; }
 	char *getName() const							{ return mName; }
+	// Byte offset within the block, -1 if it follows a variable length field
+	S32 getOffset() const							{ return mOffset; }
 protected:
 	char				*mName;
 	EMsgVariableType	mType;
 	S32					mSize;
+	S32					mOffset;
 };
 
 
@@ -204,7 +207,8 @@ public:
 		{
 			llerrs << name << " has already been used as a variable name!" << llendl;
 		}
-		*varp = new LLMessageVariable(name, type, size);
+		// mTotalSize is still the running offset while the layout is fixed
+		*varp = new LLMessageVariable(name, type, size, mTotalSize);
 		if (((*varp)->getType() != MVT_VARIABLE)
 			&&(mTotalSize != -1))
 		{
@@ -232,6 +236,24 @@ public:
 		return iter != mMemberVariables.end()? *iter : NULL;
 	}
 
+	// Position of the variable in mMemberVariables, or -1.  Compares
+	// canonical name pointers, which for a handful of variables is
+	// cheaper than the index map.
+	S32 getVariableIndex(const char* name) const
+	{
+		for (S32 i = 0; i < (S32)mMemberVariables.size(); i++)
+		{
+			if (mMemberVariables.begin()[i]->getName() == name)
+			{
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	// TRUE if every variable is at a fixed offset, see LLMessageVariable::getOffset()
+	BOOL hasFixedLayout() const						{ return mTotalSize != -1; }
+
 	friend std::ostream&	 operator<<(std::ostream& s, LLMessageBlock &msg);
 
 	typedef LLDynamicArrayIndexed<LLMessageVariable*, const char *, 8> message_variable_map_t;
@@ -399,6 +421,19 @@ public:
 		return iter != mMemberBlocks.end()? *iter : NULL;
 	}
 
+	// Position of the block in mMemberBlocks, or -1.  See LLMessageBlock::getVariableIndex().
+	S32 getBlockIndex(const char* name) const
+	{
+		for (S32 i = 0; i < (S32)mMemberBlocks.size(); i++)
+		{
+			if (mMemberBlocks.begin()[i]->mName == name)
+			{
+				return i;
+			}
+		}
+		return -1;
+	}
+
 public:
 	typedef LLDynamicArrayIndexed<LLMessageBlock*, char*, 8> message_block_map_t;
 	message_block_map_t						mMemberBlocks;
@@ -40,6 +40,10 @@
 
 ///////////////////////////////////////////////////////////
 
+LLPacketBuffer::LLPacketBuffer() : mSize(0)
+{
+}
+
 LLPacketBuffer::LLPacketBuffer(const LLHost &host, const char *datap, const S32 size) : mHost(host)
 {
 	if (size > NET_BUFFER_SIZE)
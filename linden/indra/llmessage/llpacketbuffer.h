@@ -40,6 +40,7 @@
 class LLPacketBuffer
 {
 public:
+	LLPacketBuffer();                      // empty, filled in later by receive_packets()
 	LLPacketBuffer(const LLHost &host, const char *datap, const S32 size);
 	LLPacketBuffer(S32 hSocket);           // receive a packet
 	~LLPacketBuffer();
@@ -51,6 +52,8 @@ public:
 	void init(S32 hSocket);
 
 protected:
+	friend S32 receive_packets(int hSocket, LLPacketBuffer* packets, S32 max_packets);
+
 	char	mData[NET_BUFFER_SIZE];        // packet data		/* Flawfinder : ignore */
 	S32		mSize;          // size of buffer in bytes
 	LLHost	mHost;         // source/dest IP and port
@@ -0,0 +1,272 @@
+/** 
+ * @file llpacketidring.h
+ * @brief Ring of values indexed by packet id
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETIDRING_H
+#define LL_LLPACKETIDRING_H
+
+#include <vector>
+
+#include "stdtypes.h"
+
+// Packet ids count up from 0 and wrap here.
+const TPACKETID LL_MAX_OUT_PACKET_ID = 0x01000000;
+
+// Holds values for a window of recent packet ids.  Packet ids on a
+// circuit are handed out in sequence, so the ids in flight at any time
+// fall in a narrow band and can index straight into a power of two sized
+// ring: insert, find and erase are O(1) with no per packet allocation.
+// The ring grows to fit the window and understands ids wrapping past
+// LL_MAX_OUT_PACKET_ID.
+template <class T>
+class LLPacketIDRing
+{
+public:
+	// A max_window of 0 lets the window span half the packet id space.
+	// Otherwise the oldest ids are dropped to fit newer ones.
+	LLPacketIDRing(U32 initial_size = 64, U32 max_window = 0) :
+		mMask(0),
+		mOldest(0),
+		mNewest(0),
+		mCount(0),
+		mMaxWindow(max_window)
+	{
+		if (!mMaxWindow)
+		{
+			mMaxWindow = HALF_RANGE;
+		}
+		U32 size = 1;
+		while (size < initial_size)
+		{
+			size <<= 1;
+		}
+		mSlots.resize(size);
+		mMask = size - 1;
+	}
+
+	bool empty() const					{ return mCount == 0; }
+	U32 size() const					{ return mCount; }
+	// Oldest and newest ids held, only meaningful when not empty.
+	TPACKETID getOldestID() const		{ return mOldest; }
+	TPACKETID getNewestID() const		{ return mNewest; }
+
+	// Adds or replaces the value for id.  Returns false if id is
+	// too far behind the newest id to be held.
+	bool insert(TPACKETID id, const T& value)
+	{
+		id &= ID_MASK;
+		if (!mCount)
+		{
+			mOldest = mNewest = id;
+		}
+		else if (distance(mNewest, id) < HALF_RANGE)
+		{
+			// At or after the newest id.
+			U32 window = distance(mOldest, id) + 1;
+			if (window > mMaxWindow)
+			{
+				eraseBefore((id - mMaxWindow + 1) & ID_MASK);
+				if (!mCount)
+				{
+					mOldest = id;
+				}
+			}
+			grow(distance(mOldest, id) + 1);
+			mNewest = id;
+		}
+		else if (distance(id, mOldest) <= HALF_RANGE && id != mOldest
+				 && distance(mOldest, id) > distance(mOldest, mNewest))
+		{
+			// Before the oldest id.
+			U32 window = distance(id, mNewest) + 1;
+			if (window > mMaxWindow)
+			{
+				return false;
+			}
+			grow(window);
+			mOldest = id;
+		}
+
+		Slot& slot = mSlots[id & mMask];
+		if (!slot.mUsed)
+		{
+			slot.mUsed = true;
+			slot.mID = id;
+			mCount++;
+		}
+		slot.mValue = value;
+		return true;
+	}
+
+	// Returns the value for id, or NULL if it is not held.
+	T* find(TPACKETID id)
+	{
+		Slot& slot = mSlots[id & mMask];
+		return (slot.mUsed && slot.mID == id) ? &slot.mValue : NULL;
+	}
+
+	bool erase(TPACKETID id)
+	{
+		Slot& slot = mSlots[id & mMask];
+		if (!slot.mUsed || slot.mID != id)
+		{
+			return false;
+		}
+		release(slot);
+		if (mCount)
+		{
+			// Keep the window tight so it does not have to grow.
+			while (!mSlots[mOldest & mMask].mUsed)
+			{
+				mOldest = (mOldest + 1) & ID_MASK;
+			}
+			while (!mSlots[mNewest & mMask].mUsed)
+			{
+				mNewest = (mNewest - 1) & ID_MASK;
+			}
+		}
+		return true;
+	}
+
+	// Erases every id older than id.
+	void eraseBefore(TPACKETID id)
+	{
+		id &= ID_MASK;
+		if (!mCount || distance(mOldest, id) >= HALF_RANGE)
+		{
+			return;
+		}
+		if (distance(mOldest, id) > distance(mOldest, mNewest))
+		{
+			clear();
+			return;
+		}
+		for ( ; mOldest != id; mOldest = (mOldest + 1) & ID_MASK)
+		{
+			Slot& slot = mSlots[mOldest & mMask];
+			if (slot.mUsed)
+			{
+				release(slot);
+			}
+		}
+		while (!mSlots[mOldest & mMask].mUsed)
+		{
+			mOldest = (mOldest + 1) & ID_MASK;
+		}
+	}
+
+	// Removes the oldest value.  Returns false if the ring is empty.
+	bool popOldest(TPACKETID& id, T& value)
+	{
+		if (!mCount)
+		{
+			return false;
+		}
+		id = mOldest;
+		value = mSlots[mOldest & mMask].mValue;
+		erase(mOldest);
+		return true;
+	}
+
+	void clear()
+	{
+		for (typename slot_vec_t::iterator it = mSlots.begin(); it != mSlots.end(); ++it)
+		{
+			if (it->mUsed)
+			{
+				release(*it);
+			}
+		}
+		mCount = 0;
+	}
+
+private:
+	static const TPACKETID ID_MASK = LL_MAX_OUT_PACKET_ID - 1;
+	static const U32 HALF_RANGE = LL_MAX_OUT_PACKET_ID / 2;
+
+	struct Slot
+	{
+		Slot() : mID(0), mUsed(false), mValue() {}
+
+		TPACKETID mID;
+		bool mUsed;
+		T mValue;
+	};
+	typedef std::vector<Slot> slot_vec_t;
+
+	// How far the id to is ahead of from, wrapping past the end of the id space.
+	static U32 distance(TPACKETID from, TPACKETID to)
+	{
+		return (to - from) & ID_MASK;
+	}
+
+	void release(Slot& slot)
+	{
+		slot.mUsed = false;
+		slot.mValue = T();
+		mCount--;
+	}
+
+	// Makes room for a window of ids.  Sizes stay powers of two no
+	// larger than the id space, so ids keep their order in the ring
+	// as they wrap.
+	void grow(U32 window)
+	{
+		if (window <= mSlots.size())
+		{
+			return;
+		}
+		U32 size = mSlots.size();
+		while (size < window)
+		{
+			size <<= 1;
+		}
+		slot_vec_t slots(size);
+		for (typename slot_vec_t::iterator it = mSlots.begin(); it != mSlots.end(); ++it)
+		{
+			if (it->mUsed)
+			{
+				slots[it->mID & (size - 1)] = *it;
+			}
+		}
+		mSlots.swap(slots);
+		mMask = size - 1;
+	}
+
+	slot_vec_t mSlots;
+	U32 mMask;
+	TPACKETID mOldest;
+	TPACKETID mNewest;
+	U32 mCount;
+	U32 mMaxWindow;
+};
+
+#endif // LL_LLPACKETIDRING_H
@@ -0,0 +1,129 @@
+/** 
+ * @file llpacketreceivethread.cpp
+ * @brief Thread that drains the message socket into a ring of packets
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpacketreceivethread.h"
+
+#include "net.h"
+#include "lltimer.h"
+
+// How long the thread blocks in select() before checking for shutdown.
+const S32 RECEIVE_WAIT_MS = 50;
+
+// How long to back off when the consumer has fallen behind.
+const U32 RING_FULL_SLEEP_MS = 1;
+
+LLPacketReceiveThread::LLPacketReceiveThread(S32 socket, U32 ring_size) :
+	LLThread("Packet Receive"),
+	mSocket(socket),
+	mRingSize(1),
+	mRing(NULL),
+	mHead(0),
+	mTail(0),
+	mPacketsReceived(0),
+	mRingFullCount(0)
+{
+	while (mRingSize < ring_size)
+	{
+		mRingSize <<= 1;
+	}
+	mRingMask = mRingSize - 1;
+	mRing = new LLPacketBuffer[mRingSize];
+}
+
+LLPacketReceiveThread::~LLPacketReceiveThread()
+{
+	// The ring must outlive the thread, so wait here rather than in ~LLThread().
+	setQuitting();
+	S32 timeout = 100;
+	for ( ; timeout > 0 && !isStopped(); timeout--)
+	{
+		ms_sleep(RECEIVE_WAIT_MS);
+	}
+	if (!isStopped())
+	{
+		llwarns << "~LLPacketReceiveThread timed out!" << llendl;
+		// Leak the ring rather than pull it out from under the thread.
+		return;
+	}
+	delete[] mRing;
+	// ~LLThread() will be called here
+}
+
+const LLPacketBuffer* LLPacketReceiveThread::peekPacket()
+{
+	U32 tail = mTail;
+	if (tail == (U32)mHead)
+	{
+		return NULL;
+	}
+	return &mRing[tail & mRingMask];
+}
+
+void LLPacketReceiveThread::popPacket()
+{
+	mTail++;
+}
+
+void LLPacketReceiveThread::run()
+{
+	while (!isQuitting())
+	{
+		U32 head = mHead;
+		U32 free_slots = mRingSize - (head - (U32)mTail);
+		if (!free_slots)
+		{
+			// Leave the packets in the kernel buffer until the consumer
+			// catches up rather than dropping ones we already have.
+			mRingFullCount++;
+			ms_sleep(RING_FULL_SLEEP_MS);
+			continue;
+		}
+
+		if (!wait_for_packet(mSocket, RECEIVE_WAIT_MS))
+		{
+			continue;
+		}
+
+		// Only fill contiguous slots, the next pass picks up the wrap.
+		U32 first = head & mRingMask;
+		S32 max_packets = (S32)llmin(free_slots, mRingSize - first);
+		S32 count = receive_packets(mSocket, &mRing[first], max_packets);
+		if (count > 0)
+		{
+			// Publish the packets to the consumer.
+			mHead = head + count;
+			mPacketsReceived += count;
+		}
+	}
+}
@@ -0,0 +1,75 @@
+/** 
+ * @file llpacketreceivethread.h
+ * @brief Thread that drains the message socket into a ring of packets
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETRECEIVETHREAD_H
+#define LL_LLPACKETRECEIVETHREAD_H
+
+#include "llthread.h"
+#include "llpacketbuffer.h"
+
+// Reads datagrams off a UDP socket on its own thread so that bursts are
+// pulled out of the kernel receive buffer even while the main loop is
+// busy rendering.  Packets land in a fixed ring of LLPacketBuffers with a
+// single producer (this thread) and a single consumer (the message system),
+// so no locking is needed on the hot path.
+class LLPacketReceiveThread : public LLThread
+{
+public:
+	// ring_size is rounded up to a power of two.
+	LLPacketReceiveThread(S32 socket, U32 ring_size);
+	virtual ~LLPacketReceiveThread();
+
+	// Consumer side.  Returns the oldest received packet or NULL if the
+	// ring is empty.  The packet stays valid until popPacket().
+	const LLPacketBuffer* peekPacket();
+	void popPacket();
+
+	U32 getPacketsReceived()	{ return mPacketsReceived; }
+	// Number of times the thread found the ring full and had to leave
+	// packets in the kernel buffer.
+	U32 getRingFullCount()		{ return mRingFullCount; }
+
+protected:
+	/*virtual*/ void run();
+
+private:
+	S32				mSocket;
+	U32				mRingSize;
+	U32				mRingMask;
+	LLPacketBuffer*	mRing;
+	LLAtomicU32		mHead;		// Next slot to fill, only advanced by the receive thread
+	LLAtomicU32		mTail;		// Next slot to read, only advanced by the consumer
+	LLAtomicU32		mPacketsReceived;
+	LLAtomicU32		mRingFullCount;
+};
+
+#endif // LL_LLPACKETRECEIVETHREAD_H
@@ -33,6 +33,8 @@
 #include "linden_common.h"
 
 #include "llpacketring.h"
+#include "llpacketreceivethread.h"
+#include "message.h"
 
 // linden library includes
 #include "llerror.h"
@@ -46,14 +48,14 @@ LLPacketRing::LLPacketRing () :
 	mUseInThrottle(FALSE),
 	mUseOutThrottle(FALSE),
 	mInThrottle(256000.f),
-	mOutThrottle(64000.f),
+	mOutScheduler(64000.f),
 	mActualBitsIn(0),
 	mActualBitsOut(0),
 	mMaxBufferLength(64000),
 	mInBufferLength(0),
-	mOutBufferLength(0),
 	mDropPercentage(0.0f),
-	mPacketsToDrop(0x0)
+	mPacketsToDrop(0x0),
+	mReceiveThread(NULL)
 {
 }
 
@@ -68,6 +70,8 @@ void LLPacketRing::cleanup ()
 {
 	LLPacketBuffer *packetp;
 
+	stopReceiveThread();
+
 	while (!mReceiveQueue.empty())
 	{
 		packetp = mReceiveQueue.front();
@@ -75,12 +79,7 @@ void LLPacketRing::cleanup ()
 		mReceiveQueue.pop();
 	}
 
-	while (!mSendQueue.empty())
-	{
-		packetp = mSendQueue.front();
-		delete packetp;
-		mSendQueue.pop();
-	}
+	mOutScheduler.clear();
 }
 
 ///////////////////////////////////////////////////////////
@@ -112,8 +111,71 @@ void LLPacketRing::setInBandwidth(const F32 bps)
 
 void LLPacketRing::setOutBandwidth(const F32 bps)
 {
-	mOutThrottle.setRate(bps);
+	mOutScheduler.setRate(bps, LLMessageSystem::getMessageTimeSeconds());
+}
+void LLPacketRing::startReceiveThread(S32 socket, U32 ring_size)
+{
+	if (mReceiveThread)
+	{
+		return;
+	}
+	mReceiveThread = new LLPacketReceiveThread(socket, ring_size);
+	mReceiveThread->start();
+	llinfos << "Started packet receive thread, ring size " << ring_size << llendl;
+}
+
+void LLPacketRing::stopReceiveThread()
+{
+	if (mReceiveThread)
+	{
+		llinfos << "Stopping packet receive thread, received "
+				<< mReceiveThread->getPacketsReceived() << " packets, ring full "
+				<< mReceiveThread->getRingFullCount() << " times" << llendl;
+		delete mReceiveThread;
+		mReceiveThread = NULL;
+	}
+}
+
+LLPacketBuffer* LLPacketRing::receiveNetPacket(S32 socket)
+{
+	if (!mReceiveThread)
+	{
+		return new LLPacketBuffer(socket);
+	}
+
+	const LLPacketBuffer* ring_packetp = mReceiveThread->peekPacket();
+	if (!ring_packetp)
+	{
+		return new LLPacketBuffer();
+	}
+	LLPacketBuffer* packetp = new LLPacketBuffer(*ring_packetp);
+	mReceiveThread->popPacket();
+	return packetp;
+}
+
+S32 LLPacketRing::receiveNetPacket(S32 socket, char* datap)
+{
+	if (!mReceiveThread)
+	{
+		S32 packet_size = receive_packet(socket, datap);
+		mLastSender = ::get_sender();
+		mLastReceivingIF = ::get_receiving_interface();
+		return packet_size;
+	}
+
+	const LLPacketBuffer* packetp = mReceiveThread->peekPacket();
+	if (!packetp)
+	{
+		return 0;
+	}
+	S32 packet_size = packetp->getSize();
+	memcpy(datap, packetp->getData(), packet_size);	/*Flawfinder: ignore*/
+	mLastSender = packetp->getHost();
+	mLastReceivingIF = packetp->getReceivingInterface();
+	mReceiveThread->popPacket();
+	return packet_size;
 }
+
 ///////////////////////////////////////////////////////////
 S32 LLPacketRing::receiveFromRing (S32 socket, char *datap)
 {
@@ -165,7 +227,7 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 		while (!done)
 		{
 			LLPacketBuffer *packetp;
-			packetp = new LLPacketBuffer(socket);
+			packetp = receiveNetPacket(socket);
 
 			if (packetp->getSize())
 			{
@@ -222,9 +284,7 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 	else
 	{
 		// no delay, pull straight from net
-		packet_size = receive_packet(socket, datap);		
-		mLastSender = ::get_sender();
-		mLastReceivingIF = ::get_receiving_interface();
+		packet_size = receiveNetPacket(socket, datap);
 
 		if (packet_size)  // did we actually get a packet?
 		{
@@ -244,76 +304,49 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 	return packet_size;
 }
 
-BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host)
+BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host,
+							  LLPacketScheduler::EPacketCategory category)
 {
-	BOOL status = TRUE;
 	if (!mUseOutThrottle)
 	{
 		return send_packet(h_socket, send_buffer, buf_size, host.getAddress(), host.getPort() );
 	}
-	else
-	{
-		mActualBitsOut += buf_size * 8;
-		LLPacketBuffer *packetp = NULL;
-		// See if we've got enough throttle to send a packet.
-		while (!mOutThrottle.checkOverflow(0.f))
-		{
-			// While we have enough bandwidth, send a packet from the queue or the current packet
 
-			S32 packet_size = 0;
-			if (!mSendQueue.empty())
-			{
-				// Send a packet off of the queue
-				LLPacketBuffer *packetp = mSendQueue.front();
-				mSendQueue.pop();
-
-				mOutBufferLength -= packetp->getSize();
-				packet_size = packetp->getSize();
-
-				status = send_packet(h_socket, packetp->getData(), packet_size, packetp->getHost().getAddress(), packetp->getHost().getPort());
-				
-				delete packetp;
-				// Update the throttle
-				mOutThrottle.throttleOverflow(packet_size * 8.f);
-			}
-			else
-			{
-				// If the queue's empty, we can just send this packet right away.
-				status = send_packet(h_socket, send_buffer, buf_size, host.getAddress(), host.getPort() );
-				packet_size = buf_size;
-
-				// Update the throttle
-				mOutThrottle.throttleOverflow(packet_size * 8.f);
-
-				// This was the packet we're sending now, there are no other packets
-				// that we need to send
-				return status;
-			}
+	mActualBitsOut += buf_size * 8;
+	F64 now = LLMessageSystem::getMessageTimeSeconds();
+	if (!mOutScheduler.queuePacket(category, host, send_buffer, buf_size, now))
+	{
+		// Nuke this packet, we overflowed the buffer.
+		llwarns << "Throwing away outbound " << LLPacketScheduler::getCategoryName(category)
+				<< " packet, overflowing buffer" << llendl;
+	}
 
-		}
+	static LLTimer queue_timer;
+	if ((mOutScheduler.getQueuedBytes() > 4192) && queue_timer.getElapsedTimeF32() > 1.f)
+	{
+		llinfos << "Outbound packet queue " << mOutScheduler.getQueuedBytes() << " bytes" << llendl;
+		queue_timer.reset();
+	}
 
-		// We haven't sent the incoming packet, add it to the queue
-		if (mOutBufferLength + buf_size > mMaxBufferLength)
-		{
-			// Nuke this packet, we overflowed the buffer.
-			// Toss it.
-			llwarns << "Throwing away outbound packet, overflowing buffer" << llendl;
-		}
-		else
-		{
-			static LLTimer queue_timer;
-			if ((mOutBufferLength > 4192) && queue_timer.getElapsedTimeF32() > 1.f)
-			{
-				// Add it to the queue
-				llinfos << "Outbound packet queue " << mOutBufferLength << " bytes" << llendl;
-				queue_timer.reset();
-			}
-			packetp = new LLPacketBuffer(host, send_buffer, buf_size);
+	// Goes out now unless the link or something more urgent is in the way.
+	return sendQueuedPackets(h_socket);
+}
 
-			mOutBufferLength += packetp->getSize();
-			mSendQueue.push(packetp);
-		}
+BOOL LLPacketRing::sendQueuedPackets(int h_socket)
+{
+	BOOL status = TRUE;
+	if (!mUseOutThrottle)
+	{
+		return status;
 	}
 
+	F64 now = LLMessageSystem::getMessageTimeSeconds();
+	LLPacketBuffer* packetp = NULL;
+	while ((packetp = mOutScheduler.popPacket(now)) != NULL)
+	{
+		status = send_packet(h_socket, packetp->getData(), packetp->getSize(),
+							 packetp->getHost().getAddress(), packetp->getHost().getPort());
+		delete packetp;
+	}
 	return status;
 }
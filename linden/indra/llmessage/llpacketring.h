@@ -40,7 +40,9 @@
 #include "llhost.h"
 #include "net.h"
 #include "llthrottle.h"
+#include "llpacketscheduler.h"
 
+class LLPacketReceiveThread;
 
 class LLPacketRing
 {
@@ -59,7 +61,19 @@ public:
 	S32  receivePacket (S32 socket, char *datap);
 	S32  receiveFromRing (S32 socket, char *datap);
 
-	BOOL sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host);
+	// Moves socket reads onto a dedicated thread which batches them into a
+	// ring of ring_size packets.  receivePacket() then reads from the ring.
+	void startReceiveThread(S32 socket, U32 ring_size = 1024);
+	void stopReceiveThread();
+	LLPacketReceiveThread* getReceiveThread()	{ return mReceiveThread; }
+
+	// With the out throttle on, packets are queued by category and sent
+	// as the scheduler allows; sendQueuedPackets() should be called
+	// every frame to drain the queues while nothing new is being sent.
+	BOOL sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host,
+					LLPacketScheduler::EPacketCategory category = LLPacketScheduler::PC_UNRELIABLE);
+	BOOL sendQueuedPackets(int h_socket);
+	LLPacketScheduler& getOutScheduler()		{ return mOutScheduler; }
 
 	inline LLHost getLastSender();
 	inline LLHost getLastReceivingInterface();
@@ -72,22 +86,26 @@ protected:
 	
 	// For simulating a lower-bandwidth connection - BPS
 	LLThrottle mInThrottle;
-	LLThrottle mOutThrottle;
+	LLPacketScheduler mOutScheduler;
 
 	S32 mActualBitsIn;
 	S32 mActualBitsOut;
 	S32 mMaxBufferLength;			// How much data can we queue up before dropping data.
 	S32 mInBufferLength;			// Current incoming buffer length
-	S32 mOutBufferLength;			// Current outgoing buffer length
 
 	F32 mDropPercentage;			// % of packets to drop
 	U32 mPacketsToDrop;				// drop next n packets
 
 	std::queue<LLPacketBuffer *> mReceiveQueue;
-	std::queue<LLPacketBuffer *> mSendQueue;
 
 	LLHost mLastSender;
 	LLHost mLastReceivingIF;
+
+	LLPacketReceiveThread* mReceiveThread;
+
+	// Next packet from the receive thread or straight from the socket.
+	LLPacketBuffer* receiveNetPacket(S32 socket);
+	S32 receiveNetPacket(S32 socket, char* datap);
 };
 
 
@@ -0,0 +1,286 @@
+/** 
+ * @file llpacketscheduler.cpp
+ * @brief Priority aware token bucket scheduler for outbound packets
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpacketscheduler.h"
+
+#include "llmath.h"
+
+// Seconds of traffic a bucket may save up while idle.
+const F32 BURST_SECS = 0.1f;
+// Never less than this, so that a full sized packet can always go out.
+const F32 MIN_BURST_BITS = (F32)(2 * MTUBITS);
+
+// AgentUpdates go out about ten times a second, so one that has waited
+// this long has already been superseded.
+const F32 AGENT_UPDATE_DEADLINE_SECS = 0.25f;
+
+static const F32 DEFAULT_SHARES[LLPacketScheduler::PC_EOF] =
+{
+	0.2f,	// PC_RESEND
+	0.2f,	// PC_AGENT_UPDATE
+	0.35f,	// PC_RELIABLE
+	0.25f	// PC_UNRELIABLE
+};
+
+static const char* CATEGORY_NAMES[LLPacketScheduler::PC_EOF] =
+{
+	"resend",
+	"agent update",
+	"reliable",
+	"unreliable"
+};
+
+LLPacketScheduler::CategoryStats::CategoryStats() :
+	mSent(0),
+	mBytesSent(0),
+	mDeadlineDropped(0),
+	mOverflowDropped(0),
+	mTotalDelay(0.0),
+	mMaxDelay(0.0)
+{
+}
+
+LLPacketScheduler::LLPacketScheduler(F32 bps) :
+	mLastRefill(0.0),
+	mQueuedBytes(0),
+	mMaxQueuedBytes(64000)
+{
+	mLink.mRate = bps;
+	mLink.mTokens = 0.f;
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		mBuckets[i].mTokens = 0.f;
+		mShares[i] = DEFAULT_SHARES[i];
+		mDeadlines[i] = 0.f;
+	}
+	mDeadlines[PC_AGENT_UPDATE] = AGENT_UPDATE_DEADLINE_SECS;
+	updateRates();
+
+	mLink.mTokens = mLink.mBurst;
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		mBuckets[i].mTokens = mBuckets[i].mBurst;
+	}
+}
+
+LLPacketScheduler::~LLPacketScheduler()
+{
+	clear();
+}
+
+void LLPacketScheduler::setRate(F32 bps, F64 now)
+{
+	// Keep the bits earned at the old rate.
+	refill(now);
+	mLink.mRate = bps;
+	updateRates();
+}
+
+void LLPacketScheduler::setShare(EPacketCategory category, F32 share)
+{
+	mShares[category] = llclamp(share, 0.f, 1.f);
+	updateRates();
+}
+
+void LLPacketScheduler::setDeadline(EPacketCategory category, F32 seconds)
+{
+	mDeadlines[category] = llmax(seconds, 0.f);
+}
+
+void LLPacketScheduler::updateRates()
+{
+	mLink.mBurst = llmax(mLink.mRate * BURST_SECS, MIN_BURST_BITS);
+	mLink.mTokens = llmin(mLink.mTokens, mLink.mBurst);
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		Bucket& bucket = mBuckets[i];
+		bucket.mRate = mLink.mRate * mShares[i];
+		bucket.mBurst = llmax(bucket.mRate * BURST_SECS, MIN_BURST_BITS);
+		bucket.mTokens = llmin(bucket.mTokens, bucket.mBurst);
+	}
+}
+
+void LLPacketScheduler::refill(F64 now)
+{
+	F32 elapsed = (F32)(now - mLastRefill);
+	if (elapsed <= 0.f)
+	{
+		return;
+	}
+	mLastRefill = now;
+
+	mLink.mTokens = llmin(mLink.mTokens + mLink.mRate * elapsed, mLink.mBurst);
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		Bucket& bucket = mBuckets[i];
+		bucket.mTokens = llmin(bucket.mTokens + bucket.mRate * elapsed, bucket.mBurst);
+	}
+}
+
+void LLPacketScheduler::dropExpired(F64 now)
+{
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		if (mDeadlines[i] <= 0.f)
+		{
+			continue;
+		}
+		// Queues are in arrival order, so only the front can be stale.
+		packet_queue_t& queue = mQueues[i];
+		while (!queue.empty() && now - queue.front().mQueueTime > mDeadlines[i])
+		{
+			mQueuedBytes -= queue.front().mPacket->getSize();
+			delete queue.front().mPacket;
+			queue.pop_front();
+			mStats[i].mDeadlineDropped++;
+		}
+	}
+}
+
+BOOL LLPacketScheduler::queuePacket(EPacketCategory category, const LLHost& host,
+									const char* datap, S32 size, F64 now)
+{
+	if (mQueuedBytes + size > mMaxQueuedBytes)
+	{
+		// Make room by expiring stale packets before giving up.
+		dropExpired(now);
+		if (mQueuedBytes + size > mMaxQueuedBytes)
+		{
+			mStats[category].mOverflowDropped++;
+			return FALSE;
+		}
+	}
+
+	QueuedPacket queued;
+	queued.mPacket = new LLPacketBuffer(host, datap, size);
+	queued.mQueueTime = now;
+	mQueues[category].push_back(queued);
+	mQueuedBytes += size;
+	return TRUE;
+}
+
+LLPacketBuffer* LLPacketScheduler::popPacket(F64 now)
+{
+	if (!mQueuedBytes)
+	{
+		return NULL;
+	}
+
+	refill(now);
+	dropExpired(now);
+	if (mLink.mTokens < 0.f)
+	{
+		// The link is still paying off earlier sends.
+		return NULL;
+	}
+
+	// Categories with bits left in their own share go first...
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		if (!mQueues[i].empty() && mBuckets[i].mTokens >= 0.f)
+		{
+			return sendFrom((EPacketCategory)i, false, now);
+		}
+	}
+
+	// ...then the rest of the link goes to whoever is highest priority.
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		if (!mQueues[i].empty())
+		{
+			return sendFrom((EPacketCategory)i, true, now);
+		}
+	}
+	return NULL;
+}
+
+LLPacketBuffer* LLPacketScheduler::sendFrom(EPacketCategory category, bool borrowed, F64 now)
+{
+	packet_queue_t& queue = mQueues[category];
+	QueuedPacket queued = queue.front();
+	queue.pop_front();
+
+	S32 size = queued.mPacket->getSize();
+	F32 bits = size * 8.f;
+	mQueuedBytes -= size;
+
+	// Tokens may go negative so a packet never waits for a bucket
+	// smaller than itself; the debt is paid off before the next send.
+	mLink.mTokens -= bits;
+	if (!borrowed)
+	{
+		mBuckets[category].mTokens -= bits;
+	}
+
+	CategoryStats& stats = mStats[category];
+	F64 delay = now - queued.mQueueTime;
+	stats.mSent++;
+	stats.mBytesSent += size;
+	stats.mTotalDelay += delay;
+	stats.mMaxDelay = llmax(stats.mMaxDelay, delay);
+
+	return queued.mPacket;
+}
+
+void LLPacketScheduler::clear()
+{
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		packet_queue_t& queue = mQueues[i];
+		for (packet_queue_t::iterator it = queue.begin(); it != queue.end(); ++it)
+		{
+			delete it->mPacket;
+		}
+		queue.clear();
+	}
+	mQueuedBytes = 0;
+}
+
+void LLPacketScheduler::resetStats()
+{
+	for (S32 i = 0; i < PC_EOF; ++i)
+	{
+		mStats[i] = CategoryStats();
+	}
+}
+
+// static
+const char* LLPacketScheduler::getCategoryName(EPacketCategory category)
+{
+	if (category < 0 || category >= PC_EOF)
+	{
+		return "unknown";
+	}
+	return CATEGORY_NAMES[category];
+}
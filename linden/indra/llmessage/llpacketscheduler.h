@@ -0,0 +1,143 @@
+/** 
+ * @file llpacketscheduler.h
+ * @brief Priority aware token bucket scheduler for outbound packets
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETSCHEDULER_H
+#define LL_LLPACKETSCHEDULER_H
+
+#include <deque>
+
+#include "llpacketbuffer.h"
+
+// Decides which queued outbound packet goes out next when the link is
+// throttled.  Each category has its own token bucket holding a share of
+// the link rate, so bulk reliable traffic can not starve agent updates,
+// and categories may borrow whatever the link has left over, highest
+// priority first.  Packets that wait past their category's deadline are
+// dropped rather than sent late.
+//
+// Time is passed in by the caller so that traces can be replayed offline.
+class LLPacketScheduler
+{
+public:
+	// In priority order.
+	typedef enum e_packet_categories
+	{
+		PC_RESEND,			// Reliable packets that were not acked in time
+		PC_AGENT_UPDATE,	// Superseded by the next one, so worthless when stale
+		PC_RELIABLE,
+		PC_UNRELIABLE,
+		PC_EOF
+	} EPacketCategory;
+
+	struct CategoryStats
+	{
+		CategoryStats();
+
+		U32 mSent;
+		U32 mBytesSent;
+		U32 mDeadlineDropped;
+		U32 mOverflowDropped;
+		F64 mTotalDelay;		// Seconds spent queued by sent packets
+		F64 mMaxDelay;
+	};
+
+	LLPacketScheduler(F32 bps = 64000.f);
+	~LLPacketScheduler();
+
+	void setRate(F32 bps, F64 now);
+	F32 getRate() const							{ return mLink.mRate; }
+
+	// Fraction of the link rate reserved for a category.  Shares should
+	// add up to no more than 1.
+	void setShare(EPacketCategory category, F32 share);
+	F32 getShare(EPacketCategory category) const	{ return mShares[category]; }
+
+	// Packets of a category queued longer than seconds are dropped.
+	// 0 means they never expire.
+	void setDeadline(EPacketCategory category, F32 seconds);
+	F32 getDeadline(EPacketCategory category) const	{ return mDeadlines[category]; }
+
+	void setMaxQueuedBytes(S32 bytes)			{ mMaxQueuedBytes = bytes; }
+
+	// Copies a packet onto its category's queue.  Returns FALSE if it
+	// was dropped because the queue is full.
+	BOOL queuePacket(EPacketCategory category, const LLHost& host,
+					 const char* datap, S32 size, F64 now);
+
+	// Returns the next packet the link has room for at now, or NULL.
+	// The caller sends it and deletes it.
+	LLPacketBuffer* popPacket(F64 now);
+
+	// Drops every queued packet without counting it.
+	void clear();
+
+	S32 getQueuedBytes() const					{ return mQueuedBytes; }
+	S32 getQueuedPackets(EPacketCategory category) const	{ return (S32)mQueues[category].size(); }
+
+	const CategoryStats& getStats(EPacketCategory category) const	{ return mStats[category]; }
+	void resetStats();
+
+	static const char* getCategoryName(EPacketCategory category);
+
+protected:
+	struct Bucket
+	{
+		F32 mRate;		// Bits per second
+		F32 mBurst;		// Most bits that can build up while idle
+		F32 mTokens;	// Bits that may be sent now, negative when in debt
+	};
+
+	struct QueuedPacket
+	{
+		LLPacketBuffer* mPacket;
+		F64 mQueueTime;
+	};
+	typedef std::deque<QueuedPacket> packet_queue_t;
+
+	void updateRates();
+	void refill(F64 now);
+	void dropExpired(F64 now);
+	LLPacketBuffer* sendFrom(EPacketCategory category, bool borrowed, F64 now);
+
+	Bucket mLink;
+	Bucket mBuckets[PC_EOF];
+	F32 mShares[PC_EOF];
+	F32 mDeadlines[PC_EOF];
+	packet_queue_t mQueues[PC_EOF];
+	CategoryStats mStats[PC_EOF];
+
+	F64 mLastRefill;
+	S32 mQueuedBytes;
+	S32 mMaxQueuedBytes;
+};
+
+#endif // LL_LLPACKETSCHEDULER_H
@@ -59,6 +59,18 @@
 #include <typeinfo>
 #endif
 
+// Use epoll to schedule chains where we have it.
+#if LL_LINUX
+#define LL_PUMPIO_EPOLL 1
+#endif
+
+#if LL_PUMPIO_EPOLL
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "apr_portable.h"
+#endif
+
 // constants for poll timeout. if we are threading, we want to have a
 // longer poll timeout.
 #if LL_THREADS_APR
@@ -165,6 +177,135 @@ struct ll_delete_apr_pollset_fd_client_data
 	}
 };
 
+/**
+ * @struct LLPumpIO::LLChainSchedule
+ * @brief Where a running chain sits in the epoll scheduler.
+ */
+struct LLPumpIO::LLChainSchedule
+{
+	LLChainSchedule(current_chain_t chain) :
+		mChain(chain),
+		mPumpSerial(0),
+		mSignalledEvents(0),
+		mUnconditional(false),
+		mTimed(false),
+		mLock(0),
+		mPollFailed(false)
+	{
+	}
+
+	current_chain_t mChain;
+
+	// The last pump() which queued this chain to run, and the events
+	// it was signalled with.
+	U32 mPumpSerial;
+	apr_int16_t mSignalledEvents;
+
+	// Set while the chain is in mUnconditionalChains.
+	bool mUnconditional;
+	schedule_list_t::iterator mUnconditionalIt;
+
+	// Set while the chain is in mChainTimeouts.
+	bool mTimed;
+	timeout_map_t::iterator mTimeoutIt;
+
+	// The lock the chain is filed under in mLockedChains.
+	S32 mLock;
+
+	// The fd and epoll events for each conditional by client id, and
+	// the events registered for each fd.
+	typedef std::map<S32, std::pair<int, U32> > conditional_map_t;
+	conditional_map_t mConditionals;
+	typedef std::map<int, U32> fd_map_t;
+	fd_map_t mFds;
+
+	// Set if a conditional could not be registered with epoll, in
+	// which case the chain is processed every pump.
+	bool mPollFailed;
+};
+
+/**
+ * @struct LLPumpIO::LLEpollDescriptor
+ * @brief A descriptor registered with epoll, and the chains waiting on it.
+ */
+struct LLPumpIO::LLEpollDescriptor
+{
+	LLEpollDescriptor() : mEvents(0) {}
+
+	// The events registered with epoll.
+	U32 mEvents;
+
+	// The chains waiting on the descriptor, and the events each is
+	// waiting for.
+	typedef std::vector<std::pair<LLChainSchedule*, U32> > chain_list_t;
+	chain_list_t mChains;
+};
+
+#if LL_PUMPIO_EPOLL
+static U32 apr_to_epoll_events(apr_int16_t events)
+{
+	U32 rv = 0;
+	if(events & APR_POLLIN) rv |= EPOLLIN;
+	if(events & APR_POLLPRI) rv |= EPOLLPRI;
+	if(events & APR_POLLOUT) rv |= EPOLLOUT;
+	return rv;
+}
+
+static apr_int16_t epoll_to_apr_events(U32 events)
+{
+	apr_int16_t rv = 0;
+	if(events & EPOLLIN) rv |= APR_POLLIN;
+	if(events & EPOLLPRI) rv |= APR_POLLPRI;
+	if(events & EPOLLOUT) rv |= APR_POLLOUT;
+	if(events & EPOLLERR) rv |= APR_POLLERR;
+	if(events & EPOLLHUP) rv |= APR_POLLHUP;
+	return rv;
+}
+
+// Registers fd with epoll, or changes its events if it is already
+// registered. A descriptor which was closed and its number reused has
+// silently dropped out of epoll, so a failed change falls back to
+// adding it, and a failed add to changing it.
+static bool set_epoll_events(int epoll_fd, int fd, struct epoll_event* event, bool registered)
+{
+	if(0 == epoll_ctl(epoll_fd, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, event))
+	{
+		return true;
+	}
+	if(registered && (ENOENT == errno))
+	{
+		return (0 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, event));
+	}
+	if(!registered && (EEXIST == errno))
+	{
+		return (0 == epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, event));
+	}
+	return false;
+}
+
+// Returns the os descriptor polled for poll, or -1.
+static int get_poll_fd(const apr_pollfd_t* poll)
+{
+	if((APR_POLL_SOCKET == poll->desc_type) && poll->desc.s)
+	{
+		apr_os_sock_t os_sock;
+		if(APR_SUCCESS == apr_os_sock_get(&os_sock, poll->desc.s))
+		{
+			return os_sock;
+		}
+	}
+	else if((APR_POLL_FILE == poll->desc_type) && poll->desc.f)
+	{
+		apr_os_file_t os_file;
+		if(APR_SUCCESS == apr_os_file_get(&os_file, poll->desc.f))
+		{
+			return os_file;
+		}
+	}
+	return -1;
+}
+#endif
+
 /**
  * LLPumpIO
  */
@@ -179,7 +320,9 @@ LLPumpIO::LLPumpIO(apr_pool_t* pool) :
 	mCurrentPoolReallocCount(0),
 	mChainsMutex(NULL),
 	mCallbackMutex(NULL),
-	mCurrentChain(mRunningChains.end())
+	mCurrentChain(mRunningChains.end()),
+	mEpollFd(-1),
+	mPumpSerial(0)
 {
 	mCurrentChain = mRunningChains.end();
 
@@ -191,6 +334,25 @@ LLPumpIO::~LLPumpIO()
 {
 	LLMemType m1(LLMemType::MTYPE_IO_PUMP);
 	cleanup();
+	running_chains_t::iterator it = mRunningChains.begin();
+	running_chains_t::iterator end = mRunningChains.end();
+	for(; it != end; ++it)
+	{
+		delete (*it).mSchedule;
+		(*it).mSchedule = NULL;
+	}
+	std::for_each(
+		mEpollDescriptors.begin(),
+		mEpollDescriptors.end(),
+		DeletePairedPointer());
+	mEpollDescriptors.clear();
+#if LL_PUMPIO_EPOLL
+	if(mEpollFd >= 0)
+	{
+		close(mEpollFd);
+		mEpollFd = -1;
+	}
+#endif
 }
 
 bool LLPumpIO::prime(apr_pool_t* pool)
@@ -201,6 +363,33 @@ bool LLPumpIO::prime(apr_pool_t* pool)
 	return ((pool == NULL) ? false : true);
 }
 
+bool LLPumpIO::setUseEpoll(bool use_epoll)
+{
+	if(!mRunningChains.empty() || !mPendingChains.empty())
+	{
+		return getUseEpoll();
+	}
+#if LL_PUMPIO_EPOLL
+	if(use_epoll && (mEpollFd < 0))
+	{
+		// the size is only a hint
+		const S32 EPOLL_SIZE_HINT = 256;
+		mEpollFd = epoll_create(EPOLL_SIZE_HINT);
+		if(mEpollFd < 0)
+		{
+			llwarns << "Unable to create epoll fd, errno " << errno
+					<< ". Falling back to a pollset." << llendl;
+		}
+	}
+	else if(!use_epoll && (mEpollFd >= 0))
+	{
+		close(mEpollFd);
+		mEpollFd = -1;
+	}
+#endif
+	return getUseEpoll();
+}
+
 bool LLPumpIO::addChain(const chain_t& chain, F32 timeout)
 {
 	LLMemType m1(LLMemType::MTYPE_IO_PUMP);
@@ -335,6 +524,12 @@ bool LLPumpIO::setConditional(LLIOPipe* pipe, const apr_pollfd_t* poll)
 		LLChainInfo::pipe_conditional_t& value = (*it);
 		if(pipe_ptr == value.first)
 		{
+#if LL_PUMPIO_EPOLL
+			if(mEpollFd >= 0)
+			{
+				updateEpoll(*mCurrentChain, *((S32*)value.second.client_data), NULL);
+			}
+#endif
 			ll_delete_apr_pollset_fd_client_data()(value);
 			it = (*mCurrentChain).mDescriptors.erase(it);
 			mRebuildPollset = true;
@@ -364,6 +559,12 @@ bool LLPumpIO::setConditional(LLIOPipe* pipe, const apr_pollfd_t* poll)
 	value.second.client_data = new S32(++mPollsetClientID);
 	(*mCurrentChain).mDescriptors.push_back(value);
 	mRebuildPollset = true;
+#if LL_PUMPIO_EPOLL
+	if(mEpollFd >= 0)
+	{
+		updateEpoll(*mCurrentChain, mPollsetClientID, &value.second);
+	}
+#endif
 	return true;
 }
 
@@ -482,12 +683,45 @@ void LLPumpIO::pump(const S32& poll_timeout)
 				mPendingChains.begin(),
 				mPendingChains.end(),
 				std::back_insert_iterator<running_chains_t>(mRunningChains));
+#if LL_PUMPIO_EPOLL
+			if(mEpollFd >= 0)
+			{
+				// give each new chain a schedule, working back from
+				// the end of the running chains.
+				current_chain_t it = mRunningChains.end();
+				for(S32 ii = mPendingChains.size(); ii > 0; --ii)
+				{
+					--it;
+					(*it).mSchedule = new LLChainSchedule(it);
+					scheduleChain(*it);
+				}
+			}
+#endif
 			mPendingChains.clear();
 			PUMP_DEBUG;
 		}
 
 		// Clear any locks. This needs to be done here so that we do
 		// not clash during a call to clearLock().
+#if LL_PUMPIO_EPOLL
+		if((mEpollFd >= 0) && !mClearLocks.empty())
+		{
+			PUMP_DEBUG;
+			std::set<S32>::iterator it = mClearLocks.begin();
+			std::set<S32>::iterator end = mClearLocks.end();
+			for(; it != end; ++it)
+			{
+				lock_map_t::iterator locked = mLockedChains.find(*it);
+				if(locked != mLockedChains.end())
+				{
+					LLChainInfo& chain = *((*locked).second->mChain);
+					chain.mLock = 0;
+					scheduleChain(chain);
+				}
+			}
+			mClearLocks.clear();
+		}
+#endif
 		if(!mClearLocks.empty())
 		{
 			PUMP_DEBUG;
@@ -506,6 +740,14 @@ void LLPumpIO::pump(const S32& poll_timeout)
 		}
 	}
 
+#if LL_PUMPIO_EPOLL
+	if(mEpollFd >= 0)
+	{
+		pumpScheduled(poll_timeout);
+		return;
+	}
+#endif
+
 	PUMP_DEBUG;
 	// rebuild the pollset if necessary
 	if(mRebuildPollset)
@@ -913,6 +1155,440 @@ void LLPumpIO::rebuildPollset()
 	}
 }
 
+#if LL_PUMPIO_EPOLL
+void LLPumpIO::pumpScheduled(S32 poll_timeout)
+{
+	LLMemType m1(LLMemType::MTYPE_IO_PUMP);
+	PUMP_DEBUG;
+	++mPumpSerial;
+
+	// Deal with the chains that timed out, soonest first.
+	while(!mChainTimeouts.empty())
+	{
+		current_chain_t run_chain = (*mChainTimeouts.begin()).second->mChain;
+		if(!(*run_chain).mTimer.hasExpired())
+		{
+			break;
+		}
+		PUMP_DEBUG;
+		mCurrentChain = run_chain;
+		if(handleChainError(*run_chain, LLIOPipe::STATUS_EXPIRED))
+		{
+			// the pipe probably handled the error. If the handler
+			// forgot to reset the expiration then we need to do
+			// that here.
+			if((*run_chain).mTimer.getStarted()
+			   && (*run_chain).mTimer.hasExpired())
+			{
+				llinfos << "Error handler forgot to reset timeout. "
+						<< "Resetting to " << DEFAULT_CHAIN_EXPIRY_SECS
+						<< " seconds." << llendl;
+				(*run_chain).setTimeoutSeconds(DEFAULT_CHAIN_EXPIRY_SECS);
+			}
+			scheduleChain(*run_chain);
+		}
+		else
+		{
+			// it timed out and no one handled it, so we need to
+			// retire the chain
+			retireChain(run_chain);
+		}
+	}
+	mCurrentChain = mRunningChains.end();
+
+	// Collect the chains with a signalled descriptor, then the ones
+	// without conditionals.
+	PUMP_DEBUG;
+	std::vector<LLChainSchedule*> ready;
+	if(!mEpollDescriptors.empty())
+	{
+		const S32 MAX_EPOLL_EVENTS = 256;
+		struct epoll_event events[MAX_EPOLL_EVENTS];
+		S32 timeout_ms = poll_timeout;
+		if(timeout_ms > 0)
+		{
+			// poll_timeout is in microseconds.
+			timeout_ms = (poll_timeout + 999) / 1000;
+		}
+		S32 count = 0;
+		{
+			LLPerfBlock polltime("pump_poll");
+			count = epoll_wait(mEpollFd, events, MAX_EPOLL_EVENTS, timeout_ms);
+		}
+		for(S32 ii = 0; ii < count; ++ii)
+		{
+			LLEpollDescriptor* descriptor = (LLEpollDescriptor*)events[ii].data.ptr;
+			U32 signalled = events[ii].events;
+			LLEpollDescriptor::chain_list_t::iterator chain_it;
+			chain_it = descriptor->mChains.begin();
+			LLEpollDescriptor::chain_list_t::iterator chain_end;
+			chain_end = descriptor->mChains.end();
+			for(; chain_it != chain_end; ++chain_it)
+			{
+				LLChainSchedule* schedule = (*chain_it).first;
+				U32 wanted = (*chain_it).second | EPOLLERR | EPOLLHUP;
+				if(!(signalled & wanted))
+				{
+					// another chain on the descriptor is waiting on it
+					continue;
+				}
+				apr_int16_t apr_events = epoll_to_apr_events(signalled & wanted);
+				if(schedule->mPumpSerial == mPumpSerial)
+				{
+					// more than one of its descriptors were signalled
+					schedule->mSignalledEvents |= apr_events;
+					continue;
+				}
+				schedule->mPumpSerial = mPumpSerial;
+				schedule->mSignalledEvents = apr_events;
+				ready.push_back(schedule);
+			}
+		}
+	}
+	schedule_list_t::iterator sched_it = mUnconditionalChains.begin();
+	schedule_list_t::iterator sched_end = mUnconditionalChains.end();
+	for(; sched_it != sched_end; ++sched_it)
+	{
+		LLChainSchedule* schedule = *sched_it;
+		if(schedule->mPumpSerial != mPumpSerial)
+		{
+			schedule->mPumpSerial = mPumpSerial;
+			schedule->mSignalledEvents = 0;
+			ready.push_back(schedule);
+		}
+	}
+
+	// Process them. Only the chain being processed can be retired, so
+	// the rest of the list stays valid.
+	std::vector<LLChainSchedule*>::iterator ready_it = ready.begin();
+	std::vector<LLChainSchedule*>::iterator ready_end = ready.end();
+	for(; ready_it != ready_end; ++ready_it)
+	{
+		PUMP_DEBUG;
+		current_chain_t run_chain = (*ready_it)->mChain;
+		if((*run_chain).mLock)
+		{
+			continue;
+		}
+		mCurrentChain = run_chain;
+
+		bool process_this_chain = true;
+		static const apr_int16_t POLL_CHAIN_ERROR =
+			APR_POLLHUP | APR_POLLNVAL | APR_POLLERR;
+		apr_int16_t signalled = (*ready_it)->mSignalledEvents;
+		if(signalled & POLL_CHAIN_ERROR)
+		{
+			// See the matching comment in pump().
+			process_this_chain = false;
+			LLIOPipe::EStatus error_status;
+			if(signalled & APR_POLLHUP)
+				error_status = LLIOPipe::STATUS_LOST_CONNECTION;
+			else
+				error_status = LLIOPipe::STATUS_ERROR;
+			if(!handleChainError(*run_chain, error_status))
+			{
+				llwarns << "Removing pipe "
+					<< (*run_chain).mChainLinks[0].mPipe
+					<< " '"
+#if LL_DEBUG_PIPE_TYPE_IN_PUMP
+					<< typeid(
+						*((*run_chain).mChainLinks[0].mPipe)).name()
+#endif
+					<< "' because: "
+					<< events_2_string(signalled)
+					<< llendl;
+				(*run_chain).mHead = (*run_chain).mChainLinks.end();
+			}
+		}
+		if(process_this_chain)
+		{
+			PUMP_DEBUG;
+			if(!((*run_chain).mInit))
+			{
+				(*run_chain).mHead = (*run_chain).mChainLinks.begin();
+				(*run_chain).mInit = true;
+			}
+			PUMP_DEBUG;
+			processChain(*run_chain);
+		}
+
+		PUMP_DEBUG;
+		if((*run_chain).mHead == (*run_chain).mChainLinks.end())
+		{
+			retireChain(run_chain);
+		}
+		else
+		{
+			scheduleChain(*run_chain);
+		}
+	}
+
+	PUMP_DEBUG;
+	// null out the chain
+	mCurrentChain = mRunningChains.end();
+	END_PUMP_DEBUG;
+}
+
+void LLPumpIO::scheduleChain(LLChainInfo& chain)
+{
+	LLChainSchedule* schedule = chain.mSchedule;
+
+	bool unconditional = !chain.mLock
+		&& (schedule->mFds.empty() || schedule->mPollFailed);
+	if(unconditional && !schedule->mUnconditional)
+	{
+		schedule->mUnconditionalIt = mUnconditionalChains.insert(
+			mUnconditionalChains.end(),
+			schedule);
+		schedule->mUnconditional = true;
+	}
+	else if(!unconditional && schedule->mUnconditional)
+	{
+		mUnconditionalChains.erase(schedule->mUnconditionalIt);
+		schedule->mUnconditional = false;
+	}
+
+	// Chains only start timing out once they have been processed.
+	bool timed = chain.mInit && chain.mTimer.getStarted();
+	F64 expiry = timed ? chain.mTimer.expiresAt() : 0.0;
+	if(schedule->mTimed
+	   && (!timed || ((*schedule->mTimeoutIt).first != expiry)))
+	{
+		mChainTimeouts.erase(schedule->mTimeoutIt);
+		schedule->mTimed = false;
+	}
+	if(timed && !schedule->mTimed)
+	{
+		schedule->mTimeoutIt = mChainTimeouts.insert(
+			timeout_map_t::value_type(expiry, schedule));
+		schedule->mTimed = true;
+	}
+
+	if(schedule->mLock != chain.mLock)
+	{
+		if(schedule->mLock)
+		{
+			mLockedChains.erase(schedule->mLock);
+		}
+		if(chain.mLock)
+		{
+			mLockedChains[chain.mLock] = schedule;
+		}
+		schedule->mLock = chain.mLock;
+	}
+}
+
+void LLPumpIO::updateEpoll(
+	LLChainInfo& chain,
+	S32 client_id,
+	const apr_pollfd_t* poll)
+{
+	LLChainSchedule* schedule = chain.mSchedule;
+	if(!schedule) return;
+
+	int fd = -1;
+	if(poll)
+	{
+		fd = get_poll_fd(poll);
+		U32 events = apr_to_epoll_events(poll->reqevents);
+		if((fd < 0) || !events)
+		{
+			llwarns << "Unable to poll conditional, processing chain "
+					<< chain.mChainLinks[0].mPipe << " every pump." << llendl;
+			schedule->mPollFailed = true;
+			return;
+		}
+		schedule->mConditionals[client_id] = std::make_pair(fd, events);
+	}
+	else
+	{
+		LLChainSchedule::conditional_map_t::iterator it;
+		it = schedule->mConditionals.find(client_id);
+		if(it == schedule->mConditionals.end()) return;
+		fd = (*it).second.first;
+		schedule->mConditionals.erase(it);
+	}
+
+	// Several pipes on the chain may be waiting on the same fd, and
+	// epoll only takes each fd once.
+	U32 events = 0;
+	LLChainSchedule::conditional_map_t::iterator it;
+	it = schedule->mConditionals.begin();
+	LLChainSchedule::conditional_map_t::iterator end;
+	end = schedule->mConditionals.end();
+	for(; it != end; ++it)
+	{
+		if((*it).second.first == fd)
+		{
+			events |= (*it).second.second;
+		}
+	}
+
+	LLChainSchedule::fd_map_t::iterator fd_it = schedule->mFds.find(fd);
+	if(fd_it == schedule->mFds.end())
+	{
+		if(!events) return;
+		if(!updateEpollDescriptor(fd, schedule, events))
+		{
+			llwarns << "Unable to add fd " << fd << " to epoll, errno "
+					<< errno << ". Processing chain "
+					<< chain.mChainLinks[0].mPipe << " every pump." << llendl;
+			schedule->mPollFailed = true;
+			return;
+		}
+		schedule->mFds[fd] = events;
+	}
+	else if(!events)
+	{
+		updateEpollDescriptor(fd, schedule, 0);
+		schedule->mFds.erase(fd_it);
+	}
+	else if((*fd_it).second != events)
+	{
+		if(!updateEpollDescriptor(fd, schedule, events))
+		{
+			llwarns << "Unable to update fd " << fd << " in epoll, errno "
+					<< errno << ". Processing chain "
+					<< chain.mChainLinks[0].mPipe << " every pump." << llendl;
+			schedule->mPollFailed = true;
+			schedule->mFds.erase(fd_it);
+			return;
+		}
+		(*fd_it).second = events;
+	}
+}
+
+bool LLPumpIO::updateEpollDescriptor(
+	int fd,
+	LLChainSchedule* schedule,
+	U32 events)
+{
+	LLEpollDescriptor* descriptor = NULL;
+	epoll_descriptor_map_t::iterator it = mEpollDescriptors.find(fd);
+	if(it != mEpollDescriptors.end())
+	{
+		descriptor = (*it).second;
+	}
+	else if(!events)
+	{
+		return true;
+	}
+	else
+	{
+		descriptor = new LLEpollDescriptor;
+	}
+
+	// Update the chain's entry and find what all of the chains are
+	// waiting on.
+	U32 all_events = 0;
+	bool found = false;
+	LLEpollDescriptor::chain_list_t& chains = descriptor->mChains;
+	for(S32 ii = 0; ii < (S32)chains.size(); )
+	{
+		if(chains[ii].first == schedule)
+		{
+			found = true;
+			if(!events)
+			{
+				chains[ii] = chains.back();
+				chains.pop_back();
+				continue;
+			}
+			chains[ii].second = events;
+		}
+		all_events |= chains[ii].second;
+		++ii;
+	}
+	if(!found && events)
+	{
+		chains.push_back(std::make_pair(schedule, events));
+		all_events |= events;
+	}
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = all_events;
+	event.data.ptr = descriptor;
+	bool registered = (descriptor->mEvents != 0);
+	if(!all_events)
+	{
+		epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, &event);
+		mEpollDescriptors.erase(it);
+		delete descriptor;
+		return true;
+	}
+	// A chain joining or changing its events always updates the
+	// kernel, even when the combined events are unchanged: if the fd
+	// was closed and the number reused, the old registration was
+	// dropped with it and the new descriptor must be added again.
+	if(events || (descriptor->mEvents != all_events))
+	{
+		if(!set_epoll_events(mEpollFd, fd, &event, registered))
+		{
+			if(!registered)
+			{
+				delete descriptor;
+				return false;
+			}
+			// leave the descriptor to the other chains.
+			for(S32 ii = 0; ii < (S32)chains.size(); ++ii)
+			{
+				if(chains[ii].first == schedule)
+				{
+					chains[ii] = chains.back();
+					chains.pop_back();
+					break;
+				}
+			}
+			return false;
+		}
+	}
+	descriptor->mEvents = all_events;
+	if(!registered)
+	{
+		mEpollDescriptors[fd] = descriptor;
+	}
+	return true;
+}
+
+LLPumpIO::current_chain_t LLPumpIO::retireChain(current_chain_t run_chain)
+{
+#if LL_DEBUG_PIPE_TYPE_IN_PUMP
+	lldebugs << "Removing chain " << (*run_chain).mChainLinks[0].mPipe
+			<< " '"
+			<< typeid(*((*run_chain).mChainLinks[0].mPipe)).name()
+			<< "'." << llendl;
+#endif
+	LLChainSchedule* schedule = (*run_chain).mSchedule;
+	LLChainSchedule::fd_map_t::iterator fd_it = schedule->mFds.begin();
+	LLChainSchedule::fd_map_t::iterator fd_end = schedule->mFds.end();
+	for(; fd_it != fd_end; ++fd_it)
+	{
+		updateEpollDescriptor((*fd_it).first, schedule, 0);
+	}
+	if(schedule->mUnconditional)
+	{
+		mUnconditionalChains.erase(schedule->mUnconditionalIt);
+	}
+	if(schedule->mTimed)
+	{
+		mChainTimeouts.erase(schedule->mTimeoutIt);
+	}
+	if(schedule->mLock)
+	{
+		mLockedChains.erase(schedule->mLock);
+	}
+	delete schedule;
+	(*run_chain).mSchedule = NULL;
+
+	std::for_each(
+		(*run_chain).mDescriptors.begin(),
+		(*run_chain).mDescriptors.end(),
+		ll_delete_apr_pollset_fd_client_data());
+	return mRunningChains.erase(run_chain);
+}
+#endif // LL_PUMPIO_EPOLL
+
 void LLPumpIO::processChain(LLChainInfo& chain)
 {
 	PUMP_DEBUG;
@@ -1158,7 +1834,8 @@ bool LLPumpIO::handleChainError(
 LLPumpIO::LLChainInfo::LLChainInfo() :
 	mInit(false),
 	mLock(0),
-	mEOS(false)
+	mEOS(false),
+	mSchedule(NULL)
 {
 	LLMemType m1(LLMemType::MTYPE_IO_PUMP);
 	mTimer.setTimerExpirySec(DEFAULT_CHAIN_EXPIRY_SECS);
@@ -35,6 +35,8 @@
 #ifndef LL_LLPUMPIO_H
 #define LL_LLPUMPIO_H
 
+#include <list>
+#include <map>
 #include <set>
 #if LL_LINUX  // needed for PATH_MAX in APR.
 #include <sys/param.h>
@@ -188,6 +190,9 @@ public:
 	 * is a problem if the same apr_pollfd_t is on different
 	 * chains. Once we have more than just network i/o on the pump,
 	 * this might matter.
+	 * With epoll (see <code>setUseEpoll()</code>) pipes on any chain
+	 * may share a descriptor, and a chain whose descriptor can not be
+	 * registered is processed on every pump instead.
 	 * *FIX: Given the structure of the pump and pipe relationship,
 	 * this should probably go through a different mechanism than the
 	 * pump. I think it would be best if the pipe had some kind of
@@ -329,6 +334,25 @@ public:
 	 */
 	void control(EControl op);
 
+	/** 
+	 * @brief Choose between epoll and rebuilding an APR pollset.
+	 *
+	 * Epoll is only available on linux, and is off unless turned on
+	 * here. Conditionals are then registered with the kernel as they
+	 * are set, and each call to <code>pump()</code> only visits the
+	 * chains which have no conditionals, were signalled, or have timed
+	 * out, rather than every running chain. This can only be changed
+	 * while the pump has no chains.
+	 * @param use_epoll Pass in true to use epoll.
+	 * @return Returns true if the pump is using epoll.
+	 */
+	bool setUseEpoll(bool use_epoll);
+
+	/** 
+	 * @brief Returns true if the pump is using epoll.
+	 */
+	bool getUseEpoll() const { return (mEpollFd >= 0); }
+
 protected:
 	/** 
 	 * @brief State of the pump
@@ -352,6 +376,12 @@ protected:
 	// expiring locks.
 	LLRunner mRunner;
 
+	// Where a running chain sits in the epoll scheduler.
+	struct LLChainSchedule;
+
+	// A descriptor registered with epoll, and the chains waiting on it.
+	struct LLEpollDescriptor;
+
 	// This structure is the stuff we track while running chains.
 	struct LLChainInfo
 	{
@@ -374,6 +404,9 @@ protected:
 		typedef std::pair<LLIOPipe::ptr_t, apr_pollfd_t> pipe_conditional_t;
 		typedef std::vector<pipe_conditional_t> conditionals_t;
 		conditionals_t mDescriptors;
+
+		// owned by the pump, only used with epoll
+		LLChainSchedule* mSchedule;
 	};
 
 	// All the running chains & info
@@ -385,6 +418,21 @@ protected:
 	typedef running_chains_t::iterator current_chain_t;
 	current_chain_t mCurrentChain;
 
+	// The epoll scheduler. mEpollFd is -1 when the pollset is used.
+	int mEpollFd;
+	U32 mPumpSerial;
+	// Chains can share a descriptor, eg, a socket reader and writer,
+	// but epoll takes each descriptor once, so it is registered for
+	// what all of its chains are waiting on.
+	typedef std::map<int, LLEpollDescriptor*> epoll_descriptor_map_t;
+	epoll_descriptor_map_t mEpollDescriptors;
+	typedef std::list<LLChainSchedule*> schedule_list_t;
+	schedule_list_t mUnconditionalChains;
+	typedef std::multimap<F64, LLChainSchedule*> timeout_map_t;
+	timeout_map_t mChainTimeouts;
+	typedef std::map<S32, LLChainSchedule*> lock_map_t;
+	lock_map_t mLockedChains;
+
 	// structures necessary for doing callbacks
 	// since the callbacks only get one chance to run, we do not have
 	// to maintain a list.
@@ -415,6 +463,42 @@ protected:
 	 */
 	void rebuildPollset();
 
+	/** 
+	 * @brief Run the chains which are ready when using epoll.
+	 * @see pump()
+	 */
+	void pumpScheduled(S32 poll_timeout);
+
+	/** 
+	 * @brief Bring the epoll scheduler's view of a chain up to date.
+	 *
+	 * Call after anything which may have changed the lock or the
+	 * timeout of the chain.
+	 */
+	void scheduleChain(LLChainInfo& chain);
+
+	/** 
+	 * @brief (Re)register one descriptor of a chain with epoll.
+	 * @param poll The conditional, or NULL if it was removed.
+	 */
+	void updateEpoll(LLChainInfo& chain, S32 client_id, const apr_pollfd_t* poll);
+
+	/** 
+	 * @brief Set what a chain is waiting on for a descriptor, and
+	 * register the descriptor with epoll for what all of its chains
+	 * are waiting on.
+	 * @param events The epoll events, or 0 if the chain stopped waiting.
+	 * @return Returns false if epoll would not take the descriptor,
+	 * in which case the chain is no longer waiting on it.
+	 */
+	bool updateEpollDescriptor(int fd, LLChainSchedule* schedule, U32 events);
+
+	/** 
+	 * @brief Remove a chain from the scheduler and running chains.
+	 * @return Returns the next running chain.
+	 */
+	current_chain_t retireChain(current_chain_t chain);
+
 	/** 
 	 * @brief Process the chain passed in.
 	 *
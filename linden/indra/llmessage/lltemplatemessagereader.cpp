@@ -47,6 +47,7 @@ LLTemplateMessageReader::LLTemplateMessageReader(message_template_number_map_t&
 												 number_template_map) :
 	mReceiveSize(0),
 	mCurrentRMessageTemplate(NULL),
+	mCurrentRMessageDecoded(FALSE),
 	mCurrentRMessageData(NULL),
 	mMessageNumbers(number_template_map)
 {
@@ -64,10 +65,52 @@ void LLTemplateMessageReader::clearMessage()
 {
 	mReceiveSize = -1;
 	mCurrentRMessageTemplate = NULL;
+	mCurrentRMessageDecoded = FALSE;
 	delete mCurrentRMessageData;
 	mCurrentRMessageData = NULL;
 }
 
+void LLTemplateMessageReader::getVariableLocation(S32 block_index, S32 blocknum, S32 var_index,
+												  S32& offset, S32& size) const
+{
+	const BlockIndex& index = mBlockIndex[block_index];
+	const LLMessageBlock* block = mCurrentRMessageTemplate->mMemberBlocks.begin()[block_index];
+	if (index.mFirstVar < 0)
+	{
+		// fixed layout, the template already knows where everything is
+		const LLMessageVariable* var = block->mMemberVariables.begin()[var_index];
+		offset = index.mOffset + blocknum * block->mTotalSize + var->getOffset();
+		size = var->getSize();
+	}
+	else
+	{
+		const VarIndex& var_data = mVarIndex[index.mFirstVar + blocknum * block->mMemberVariables.size() + var_index];
+		offset = var_data.mOffset;
+		size = var_data.mSize;
+	}
+}
+
+S32 LLTemplateMessageReader::findVariable(const char* blockname, S32 blocknum, const char* varname,
+										  const LLMessageVariable*& var, S32& offset, S32& size) const
+{
+	S32 block_index = mCurrentRMessageTemplate->getBlockIndex(blockname);
+	if (block_index < 0 || blocknum < 0 || blocknum >= mBlockIndex[block_index].mCount)
+	{
+		return LL_BLOCK_NOT_IN_MESSAGE;
+	}
+
+	const LLMessageBlock* block = mCurrentRMessageTemplate->mMemberBlocks.begin()[block_index];
+	S32 var_index = block->getVariableIndex(varname);
+	if (var_index < 0)
+	{
+		return LL_VARIABLE_NOT_IN_BLOCK;
+	}
+
+	var = block->mMemberVariables.begin()[var_index];
+	getVariableLocation(block_index, blocknum, var_index, offset, size);
+	return 0;
+}
+
 void LLTemplateMessageReader::getData(const char *blockname, const char *varname, void *datap, S32 size, S32 blocknum, S32 max_size)
 {
 	// is there a message ready to go?
@@ -77,77 +120,83 @@ void LLTemplateMessageReader::getData(const char *blockname, const char *varname
 		return;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{
-		llerrs << "Invalid mCurrentMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getData!" << llendl;
 		return;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; // this works because it's just a hash.  The bnamep is never derefference
-	char *vnamep = (char *)varname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
+	const LLMessageVariable* var = NULL;
+	S32 offset = 0;
+	S32 vardata_size = 0;
+	S32 result = findVariable(blockname, blocknum, varname, var, offset, vardata_size);
 
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	if (result == LL_BLOCK_NOT_IN_MESSAGE)
 	{
 		llerrs << "Block " << blockname << " #" << blocknum
-			<< " not in message " << mCurrentRMessageData->mName << llendl;
+			<< " not in message " << mCurrentRMessageTemplate->mName << llendl;
 		return;
 	}
 
-	LLMsgBlkData *msg_block_data = iter->second;
-	LLMsgVarData& vardata = msg_block_data->mMemberVarData[vnamep];
-
-	if (!vardata.getName())
+	if (result == LL_VARIABLE_NOT_IN_BLOCK)
 	{
-		llerrs << "Variable "<< vnamep << " not in message "
-			<< mCurrentRMessageData->mName<< " block " << bnamep << llendl;
+		llerrs << "Variable "<< varname << " not in message "
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return;
 	}
 
-	if (size && size != vardata.getSize())
+	if (size && size != vardata_size)
 	{
-		llerrs << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llerrs << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << varname
+			<< " is size " << vardata_size
 			<< " but copying into buffer of size " << size
 			<< llendl;
 		return;
 	}
 
-
-	const S32 vardata_size = vardata.getSize();
+	const U8* vardata = &mReceiveBuffer[0] + offset;
 	if( max_size >= vardata_size )
 	{   
+#ifdef LL_BIG_ENDIAN
+		htonmemcpy(datap, vardata, var->getType(), vardata_size);
+#else
+		// constant sizes let the compiler inline the copies
 		switch( vardata_size )
 		{ 
 		case 1:
-			*((U8*)datap) = *((U8*)vardata.getData());
+			*((U8*)datap) = *vardata;
 			break;
 		case 2:
-			*((U16*)datap) = *((U16*)vardata.getData());
+			memcpy(datap, vardata, 2);	/* Flawfinder: ignore */
 			break;
 		case 4:
-			*((U32*)datap) = *((U32*)vardata.getData());
+			memcpy(datap, vardata, 4);	/* Flawfinder: ignore */
 			break;
 		case 8:
-			((U32*)datap)[0] = ((U32*)vardata.getData())[0];
-			((U32*)datap)[1] = ((U32*)vardata.getData())[1];
+			memcpy(datap, vardata, 8);	/* Flawfinder: ignore */
+			break;
+		case 12:
+			memcpy(datap, vardata, 12);	/* Flawfinder: ignore */
+			break;
+		case 16:
+			memcpy(datap, vardata, 16);	/* Flawfinder: ignore */
 			break;
 		default:
-			memcpy(datap, vardata.getData(), vardata_size);
+			memcpy(datap, vardata, vardata_size);	/* Flawfinder: ignore */
 			break;
 		}
+#endif
 	}
 	else
 	{
-		llwarns << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llwarns << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << varname
+			<< " is size " << vardata_size
 			<< " but truncated to max size of " << max_size
 			<< llendl;
 
-		memcpy(datap, vardata.getData(), max_size);
+		memcpy(datap, vardata, max_size);	/* Flawfinder: ignore */
 	}
 }
 
@@ -160,22 +209,19 @@ S32 LLTemplateMessageReader::getNumberOfBlocks(const char *blockname)
 		return -1;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getNumberOfBlocks!" << llendl;
 		return -1;
 	}
 
-	char *bnamep = (char *)blockname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	S32 block_index = mCurrentRMessageTemplate->getBlockIndex(blockname);
+	if (block_index < 0)
 	{
 		return 0;
 	}
 
-	return (iter->second)->mBlockNumber;
+	return mBlockIndex[block_index].mCount;
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
@@ -187,43 +233,39 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{	// This is a serious error - crash
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getSize!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname; 
+	const LLMessageVariable* var = NULL;
+	S32 offset = 0;
+	S32 size = 0;
+	S32 result = findVariable(blockname, 0, varname, var, offset, size);
 
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	if (result == LL_BLOCK_NOT_IN_MESSAGE)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message "
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " not in message "
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
 
-	char *vnamep = (char *)varname; 
-
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	if (result == LL_VARIABLE_NOT_IN_BLOCK)
 	{	// don't crash
 		llinfos << "Variable " << varname << " not in message "
-			<< mCurrentRMessageData->mName << " block " << bnamep << llendl;
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	if (mCurrentRMessageTemplate->mMemberBlocks[bnamep]->mType != MBT_SINGLE)
+	if (mCurrentRMessageTemplate->getBlock((char*)blockname)->mType != MBT_SINGLE)
 	{	// This is a serious error - crash
-		llerrs << "Block " << bnamep << " isn't type MBT_SINGLE,"
+		llerrs << "Block " << blockname << " isn't type MBT_SINGLE,"
 			" use getSize with blocknum argument!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	return vardata.getSize();
+	return size;
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const char *varname)
@@ -235,35 +277,32 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{	// This is a serious error - crash
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getSize!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; 
-	char *vnamep = (char *)varname; 
+	const LLMessageVariable* var = NULL;
+	S32 offset = 0;
+	S32 size = 0;
+	S32 result = findVariable(blockname, blocknum, varname, var, offset, size);
 
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	if (result == LL_BLOCK_NOT_IN_MESSAGE)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message " 
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " #" << blocknum << " not in message " 
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
 
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	if (result == LL_VARIABLE_NOT_IN_BLOCK)
 	{	// don't crash
-		llinfos << "Variable " << vnamep << " not in message "
-			<<  mCurrentRMessageData->mName << " block " << bnamep << llendl;
+		llinfos << "Variable " << varname << " not in message "
+			<<  mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	return vardata.getSize();
+	return size;
 }
 
 void LLTemplateMessageReader::getBinaryData(const char *blockname, 
@@ -542,16 +581,17 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 		delete mCurrentRMessageData;
 		mCurrentRMessageData = 0;
 	}
+	mCurrentRMessageDecoded = FALSE;
+	mBlockIndex.clear();
+	mVarIndex.clear();
 
 	// The offset tells us how may bytes to skip after the end of the
 	// message name.
 	U8 offset = buffer[PHL_OFFSET];
 	S32 decode_pos = LL_PACKET_ID_SIZE + (S32)(mCurrentRMessageTemplate->mFrequency) + offset;
+	S32 total_blocks = 0;
 
-	// create base working data set
-	mCurrentRMessageData = new LLMsgData(mCurrentRMessageTemplate->mName);
-	
-	// loop through the template building the data structure as we go
+	// loop through the template recording where each block and variable is
 	LLMessageTemplate::message_block_map_t::const_iterator iter;
 	for(iter = mCurrentRMessageTemplate->mMemberBlocks.begin();
 		iter != mCurrentRMessageTemplate->mMemberBlocks.end();
@@ -598,112 +638,136 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 			return FALSE;
 		}
 
-		LLMsgBlkData* cur_data_block = NULL;
+		BlockIndex block_index;
+		block_index.mCount = repeat_number;
+		block_index.mOffset = decode_pos;
+		block_index.mFirstVar = -1;
+		total_blocks += repeat_number;
 
-		// now loop through the block
-		for (i = 0; i < repeat_number; i++)
+		if (mbci->hasFixedLayout())
 		{
-			if (i)
+			// nothing to read, just step over the block
+			S32 block_end = decode_pos + repeat_number * mbci->mTotalSize;
+			if (block_end > mReceiveSize)
 			{
-				// build new name to prevent collisions
-				// TODO: This should really change to a vector
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
-				cur_data_block->mName = mbci->mName + i;
-			}
-			else
-			{
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
+				// missing variables are zeroed below, warn about each one
+				for (i = 0; i < repeat_number; i++)
+				{
+					for (LLMessageBlock::message_variable_map_t::const_iterator iter = 
+							 mbci->mMemberVariables.begin();
+						 iter != mbci->mMemberVariables.end(); iter++)
+					{
+						const LLMessageVariable& mvci = **iter;
+						S32 var_pos = decode_pos + i * mbci->mTotalSize + mvci.getOffset();
+						if (var_pos + mvci.getSize() > mReceiveSize)
+						{
+							logRanOffEndOfPacket(sender, var_pos, mvci.getSize());
+						}
+					}
+				}
 			}
+			decode_pos = block_end;
+		}
+		else
+		{
+			block_index.mFirstVar = mVarIndex.size();
 
-			// add the block to the message
-			mCurrentRMessageData->addBlock(cur_data_block);
-
-			// now read the variables
-			for (LLMessageBlock::message_variable_map_t::const_iterator iter = 
-					 mbci->mMemberVariables.begin();
-				 iter != mbci->mMemberVariables.end(); iter++)
+			// now loop through the block
+			for (i = 0; i < repeat_number; i++)
 			{
-				const LLMessageVariable& mvci = **iter;
-
-				// ok, build out the variables
-				// add variable block
-				cur_data_block->addVariable(mvci.getName(), mvci.getType());
-
-				// what type of variable?
-				if (mvci.getType() == MVT_VARIABLE)
+				// now read the variables
+				for (LLMessageBlock::message_variable_map_t::const_iterator iter = 
+						 mbci->mMemberVariables.begin();
+					 iter != mbci->mMemberVariables.end(); iter++)
 				{
-					// variable, get the number of bytes to read from the template
-					S32 data_size = mvci.getSize();
-					U8 tsizeb = 0;
-					U16 tsizeh = 0;
-					U32 tsize = 0;
+					const LLMessageVariable& mvci = **iter;
+					VarIndex var_index;
 
-					if ((decode_pos + data_size) > mReceiveSize)
+					// what type of variable?
+					if (mvci.getType() == MVT_VARIABLE)
 					{
-						logRanOffEndOfPacket(sender, decode_pos, data_size);
+						// variable, get the number of bytes to read from the template
+						S32 data_size = mvci.getSize();
+						U8 tsizeb = 0;
+						U16 tsizeh = 0;
+						U32 tsize = 0;
 
-						// default to 0 length variable blocks
-						tsize = 0;
-					}
-					else
-					{
-						switch(data_size)
+						if ((decode_pos + data_size) > mReceiveSize)
 						{
-						case 1:
-							htonmemcpy(&tsizeb, &buffer[decode_pos], MVT_U8, 1);
-							tsize = tsizeb;
-							break;
-						case 2:
-							htonmemcpy(&tsizeh, &buffer[decode_pos], MVT_U16, 2);
-							tsize = tsizeh;
-							break;
-						case 4:
-							htonmemcpy(&tsize, &buffer[decode_pos], MVT_U32, 4);
-							break;
-						default:
-							llerrs << "Attempting to read variable field with unknown size of " << data_size << llendl;
-							break;
+							logRanOffEndOfPacket(sender, decode_pos, data_size);
+
+							// default to 0 length variable blocks
+							tsize = 0;
 						}
-					}
-					decode_pos += data_size;
+						else
+						{
+							switch(data_size)
+							{
+							case 1:
+								htonmemcpy(&tsizeb, &buffer[decode_pos], MVT_U8, 1);
+								tsize = tsizeb;
+								break;
+							case 2:
+								htonmemcpy(&tsizeh, &buffer[decode_pos], MVT_U16, 2);
+								tsize = tsizeh;
+								break;
+							case 4:
+								htonmemcpy(&tsize, &buffer[decode_pos], MVT_U32, 4);
+								break;
+							default:
+								llerrs << "Attempting to read variable field with unknown size of " << data_size << llendl;
+								break;
+							}
+						}
+						decode_pos += data_size;
 
-					cur_data_block->addData(mvci.getName(), &buffer[decode_pos], tsize, mvci.getType());
-					decode_pos += tsize;
-				}
-				else
-				{
-					// fixed!
-					// so, copy data pointer and set data size to fixed size
-					if ((decode_pos + mvci.getSize()) > mReceiveSize)
-					{
-						logRanOffEndOfPacket(sender, decode_pos, mvci.getSize());
+						if (tsize > (U32)llmax(mReceiveSize - decode_pos, 0))
+						{
+							// don't trust the length further than the packet goes
+							logRanOffEndOfPacket(sender, decode_pos, tsize);
+							tsize = llmax(mReceiveSize - decode_pos, 0);
+						}
 
-						// default to 0s.
-						U32 size = mvci.getSize();
-						std::vector<U8> data(size, 0);
-						cur_data_block->addData(mvci.getName(), &(data[0]), 
-												size, mvci.getType());
+						var_index.mOffset = decode_pos;
+						var_index.mSize = tsize;
+						decode_pos += tsize;
 					}
 					else
 					{
-						cur_data_block->addData(mvci.getName(), 
-												&buffer[decode_pos], 
-												mvci.getSize(), 
-												mvci.getType());
+						// fixed!
+						if ((decode_pos + mvci.getSize()) > mReceiveSize)
+						{
+							// zeroed below
+							logRanOffEndOfPacket(sender, decode_pos, mvci.getSize());
+						}
+						var_index.mOffset = decode_pos;
+						var_index.mSize = mvci.getSize();
+						decode_pos += mvci.getSize();
 					}
-					decode_pos += mvci.getSize();
+					mVarIndex.push_back(var_index);
 				}
 			}
 		}
+		mBlockIndex.push_back(block_index);
 	}
 
-	if (mCurrentRMessageData->mMemberBlocks.empty()
+	if (!total_blocks
 		&& !mCurrentRMessageTemplate->mMemberBlocks.empty())
 	{
 		lldebugs << "Empty message '" << mCurrentRMessageTemplate->mName << "' (no blocks)" << llendl;
 		return FALSE;
 	}
 
+	// Keep our own copy, getters may be called after the caller reuses
+	// its buffer. Anything the template read past the end reads as 0.
+	mReceiveBuffer.resize(mReceiveSize);
+	memcpy(&mReceiveBuffer[0], buffer, mReceiveSize);	/* Flawfinder: ignore */
+	if (decode_pos > mReceiveSize)
+	{
+		mReceiveBuffer.resize(decode_pos, 0);
+	}
+	mCurrentRMessageDecoded = TRUE;
+
 	{
 		static LLTimer decode_timer;
 
@@ -825,12 +889,49 @@ bool LLTemplateMessageReader::isUdpBanned() const
 	return mCurrentRMessageTemplate->isUdpBanned();
 }
 
+void LLTemplateMessageReader::buildMessageData() const
+{
+	if (mCurrentRMessageData)
+	{
+		return;
+	}
+
+	mCurrentRMessageData = new LLMsgData(mCurrentRMessageTemplate->mName);
+	for (S32 block_index = 0; block_index < (S32)mBlockIndex.size(); block_index++)
+	{
+		const LLMessageBlock* mbci = mCurrentRMessageTemplate->mMemberBlocks.begin()[block_index];
+		S32 repeat_number = mBlockIndex[block_index].mCount;
+		for (S32 i = 0; i < repeat_number; i++)
+		{
+			LLMsgBlkData* cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
+			// build new name to prevent collisions
+			cur_data_block->mName = mbci->mName + i;
+			mCurrentRMessageData->addBlock(cur_data_block);
+
+			S32 var_index = 0;
+			for (LLMessageBlock::message_variable_map_t::const_iterator iter = 
+					 mbci->mMemberVariables.begin();
+				 iter != mbci->mMemberVariables.end(); iter++, var_index++)
+			{
+				const LLMessageVariable& mvci = **iter;
+				S32 offset = 0;
+				S32 size = 0;
+				getVariableLocation(block_index, i, var_index, offset, size);
+				cur_data_block->addVariable(mvci.getName(), mvci.getType());
+				cur_data_block->addData(mvci.getName(), &mReceiveBuffer[0] + offset, 
+										size, mvci.getType());
+			}
+		}
+	}
+}
+
 //virtual 
 void LLTemplateMessageReader::copyToBuilder(LLMessageBuilder& builder) const
 {
-	if(NULL == mCurrentRMessageTemplate)
+	if(NULL == mCurrentRMessageTemplate || !mCurrentRMessageDecoded)
     {
         return;
     }
+	buildMessageData();
 	builder.copyFromMessageData(*mCurrentRMessageData);
 }
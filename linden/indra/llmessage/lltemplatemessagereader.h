@@ -36,8 +36,10 @@
 #include "llmessagereader.h"
 
 #include <map>
+#include <vector>
 
 class LLMessageTemplate;
+class LLMessageVariable;
 class LLMsgData;
 
 class LLTemplateMessageReader : public LLMessageReader
@@ -124,10 +126,44 @@ private:
 
 	BOOL decodeData(const U8* buffer, const LLHost& sender );
 
+	// Finds the bytes of a variable in mReceiveBuffer. Returns 0 or
+	// LL_BLOCK_NOT_IN_MESSAGE / LL_VARIABLE_NOT_IN_BLOCK.
+	S32 findVariable(const char* blockname, S32 blocknum, const char* varname,
+					 const LLMessageVariable*& var, S32& offset, S32& size) const;
+	void getVariableLocation(S32 block_index, S32 blocknum, S32 var_index,
+							 S32& offset, S32& size) const;
+
+	// Builds the LLMsgData tree on demand, only copyToBuilder() needs it.
+	void buildMessageData() const;
+
+	// Where the instances of one template block were found.
+	struct BlockIndex
+	{
+		S32 mCount;			// Instances in this message
+		S32 mOffset;		// Offset of the first instance if the block has a fixed layout
+		S32 mFirstVar;		// Else index of its first variable in mVarIndex
+	};
+
+	// Where one variable of a block with variable length fields was found.
+	struct VarIndex
+	{
+		S32 mOffset;
+		S32 mSize;
+	};
+
 	S32	mReceiveSize;
 	LLMessageTemplate* mCurrentRMessageTemplate;
-	LLMsgData* mCurrentRMessageData;
+	BOOL mCurrentRMessageDecoded;
+	mutable LLMsgData* mCurrentRMessageData;
 	message_template_number_map_t& mMessageNumbers;
+
+	// Flat index of the current message, in template order. These are
+	// cleared rather than freed so decoding does not allocate once they
+	// have grown to the largest message seen.
+	std::vector<BlockIndex> mBlockIndex;
+	std::vector<VarIndex> mVarIndex;
+	// Copy of the packet, zero padded where the template ran past its end.
+	std::vector<U8> mReceiveBuffer;
 };
 
 #endif // LL_LLTEMPLATEMESSAGEREADER_H
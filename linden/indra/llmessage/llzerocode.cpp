@@ -0,0 +1,312 @@
+/** 
+ * @file llzerocode.cpp
+ * @brief Zero run-length coding of message system packet bodies
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llzerocode.h"
+
+// Only use SSE2 when the whole build targets it, same as LL_VECTORIZE.
+#if (LL_GNUC && defined(__SSE2__)) || (LL_MSVC && (defined(_M_X64) || _M_IX86_FP >= 2))
+#define LL_ZERO_CODE_SSE2 1
+#include <emmintrin.h>
+#if LL_MSVC
+#include <intrin.h>
+#endif
+#else
+#define LL_ZERO_CODE_SSE2 0
+#endif
+
+//-----------------------------------------------------------------------------
+// Scalar
+//-----------------------------------------------------------------------------
+
+S32 zero_code_encode_scalar(const U8* in, S32 in_size, U8* out)
+{
+	U8* outptr = out;
+	U8 num_zeroes = 0;
+
+	for (S32 i = 0; i < in_size; ++i)
+	{
+		if (!in[i])
+		{
+			if (num_zeroes)
+			{
+				if (++num_zeroes > 254)
+				{
+					*outptr++ = num_zeroes;
+					num_zeroes = 0;
+				}
+			}
+			else
+			{
+				*outptr++ = 0;
+				num_zeroes = 1;
+			}
+		}
+		else
+		{
+			if (num_zeroes)
+			{
+				*outptr++ = num_zeroes;
+				num_zeroes = 0;
+			}
+			*outptr++ = in[i];
+		}
+	}
+
+	if (num_zeroes)
+	{
+		*outptr++ = num_zeroes;
+	}
+	return (S32)(outptr - out);
+}
+
+S32 zero_code_expand_scalar(const U8* in, S32 in_size, U8* out, S32 out_size)
+{
+	S32 i = 0;
+	S32 o = 0;
+	while (i < in_size)
+	{
+		if (o >= out_size)
+		{
+			return -1;
+		}
+		if ((out[o++] = in[i++]))
+		{
+			continue;
+		}
+
+		// each further 0 is a wrap of 256
+		while (i < in_size && !in[i])
+		{
+			if (o + 256 > out_size)
+			{
+				return -1;
+			}
+			memset(out + o, 0, 256);
+			o += 256;
+			++i;
+		}
+		if (i >= in_size)
+		{
+			break;
+		}
+
+		S32 run = in[i++] - 1;
+		if (o + run > out_size)
+		{
+			return -1;
+		}
+		memset(out + o, 0, run);
+		o += run;
+	}
+	return o;
+}
+
+//-----------------------------------------------------------------------------
+// SSE2
+//-----------------------------------------------------------------------------
+
+#if LL_ZERO_CODE_SSE2
+
+static inline U32 first_set_bit(U32 mask)
+{
+#if LL_MSVC
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (U32)index;
+#else
+	return (U32)__builtin_ctz(mask);
+#endif
+}
+
+// Returns the index of the first non-zero byte, or size if there is none.
+static inline S32 find_nonzero(const U8* data, S32 size)
+{
+	const __m128i zero = _mm_setzero_si128();
+	S32 i = 0;
+	for ( ; i + 16 <= size; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+		U32 mask = (U32)_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)) ^ 0xFFFF;
+		if (mask)
+		{
+			return i + first_set_bit(mask);
+		}
+	}
+	while (i < size && !data[i])
+	{
+		++i;
+	}
+	return i;
+}
+
+// Literal runs are mostly short, so rather than find the end and call
+// memcpy each block is stored whole and the pointers advanced past the
+// bytes that were literals.  The caller guarantees room for the extra
+// bytes.
+
+S32 zero_code_encode(const U8* in, S32 in_size, U8* out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	S32 i = 0;
+	S32 o = 0;
+	while (i < in_size)
+	{
+		// out always has room for 16 bytes while in does
+		while (i + 16 <= in_size)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)(in + i));
+			_mm_storeu_si128((__m128i*)(out + o), block);
+			U32 mask = (U32)_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero));
+			if (mask)
+			{
+				S32 length = first_set_bit(mask);
+				i += length;
+				o += length;
+				break;
+			}
+			i += 16;
+			o += 16;
+		}
+		while (i < in_size && in[i])
+		{
+			out[o++] = in[i++];
+		}
+		if (i >= in_size)
+		{
+			break;
+		}
+
+		S32 run = find_nonzero(in + i, in_size - i);
+		i += run;
+		for ( ; run >= 255; run -= 255)
+		{
+			out[o++] = 0;
+			out[o++] = 255;
+		}
+		if (run)
+		{
+			out[o++] = 0;
+			out[o++] = (U8)run;
+		}
+	}
+	return o;
+}
+
+S32 zero_code_expand(const U8* in, S32 in_size, U8* out, S32 out_size)
+{
+	const __m128i zero = _mm_setzero_si128();
+	S32 i = 0;
+	S32 o = 0;
+	while (i < in_size)
+	{
+		// copy up to and including the next 0
+		BOOL found_zero = FALSE;
+		while (i + 16 <= in_size && o + 16 <= out_size)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)(in + i));
+			_mm_storeu_si128((__m128i*)(out + o), block);
+			U32 mask = (U32)_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero));
+			if (mask)
+			{
+				S32 length = first_set_bit(mask) + 1;
+				i += length;
+				o += length;
+				found_zero = TRUE;
+				break;
+			}
+			i += 16;
+			o += 16;
+		}
+		if (!found_zero)
+		{
+			if (i >= in_size)
+			{
+				break;
+			}
+			if (o >= out_size)
+			{
+				return -1;
+			}
+			if ((out[o++] = in[i++]))
+			{
+				continue;
+			}
+		}
+
+		while (i < in_size && !in[i])
+		{
+			if (o + 256 > out_size)
+			{
+				return -1;
+			}
+			memset(out + o, 0, 256);
+			o += 256;
+			++i;
+		}
+		if (i >= in_size)
+		{
+			break;
+		}
+
+		S32 run = in[i++] - 1;
+		if (o + run > out_size)
+		{
+			return -1;
+		}
+		if (run <= 16 && o + 16 <= out_size)
+		{
+			_mm_storeu_si128((__m128i*)(out + o), zero);
+		}
+		else
+		{
+			memset(out + o, 0, run);
+		}
+		o += run;
+	}
+	return o;
+}
+
+#else // LL_ZERO_CODE_SSE2
+
+S32 zero_code_encode(const U8* in, S32 in_size, U8* out)
+{
+	return zero_code_encode_scalar(in, in_size, out);
+}
+
+S32 zero_code_expand(const U8* in, S32 in_size, U8* out, S32 out_size)
+{
+	return zero_code_expand_scalar(in, in_size, out, out_size);
+}
+
+#endif // LL_ZERO_CODE_SSE2
@@ -0,0 +1,58 @@
+/** 
+ * @file llzerocode.h
+ * @brief Zero run-length coding of message system packet bodies
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLZEROCODE_H
+#define LL_LLZEROCODE_H
+
+// Messages flagged ME_ZEROCODED have every run of zero bytes in their
+// body replaced by a 0 followed by the run length.  Runs longer than 255
+// are split, and on expansion a 0 in the length position stands for 256
+// zeroes.  The packet header is never coded; callers pass the body only.
+//
+// The plain functions pick the SSE2 implementation when the build has
+// it, which scans and copies 16 bytes at a time.
+// The _scalar versions are the byte at a time reference used by tests.
+
+// Worst case is a zero between every literal, which grows by half.
+inline S32 zero_code_max_encoded_size(S32 size) { return size + (size + 1) / 2; }
+
+// Encodes in_size bytes into out, which must hold
+// zero_code_max_encoded_size(in_size).  Returns the encoded size.
+S32 zero_code_encode(const U8* in, S32 in_size, U8* out);
+S32 zero_code_encode_scalar(const U8* in, S32 in_size, U8* out);
+
+// Expands in_size coded bytes into out.  Returns the expanded size, or -1
+// if the result would not fit in out_size bytes.
+S32 zero_code_expand(const U8* in, S32 in_size, U8* out, S32 out_size);
+S32 zero_code_expand_scalar(const U8* in, S32 in_size, U8* out, S32 out_size);
+
+#endif // LL_LLZEROCODE_H
@@ -79,6 +79,7 @@
 #include "lltransfermanager.h"
 #include "lluuid.h"
 #include "llxfermanager.h"
+#include "llzerocode.h"
 #include "timing.h"
 #include "llquaternion.h"
 #include "u64.h"
@@ -366,6 +367,9 @@ LLMessageSystem::~LLMessageSystem()
 	for_each(mMessageNumbers.begin(), mMessageNumbers.end(), DeletePairedPointer());
 	mMessageNumbers.clear();
 	
+	// The receive thread must not outlive the socket.
+	mPacketRing.stopReceiveThread();
+
 	if (!mbError)
 	{
 		end_net(mSocket);
@@ -741,7 +745,7 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 				if (cdp && recv_reliable)
 				{
 					// Add to the recently received list for duplicate suppression
-					cdp->mRecentlyReceivedReliablePackets[mCurrentRecvPacketID] = getMessageTimeUsecs();
+					cdp->mRecentlyReceivedReliablePackets.insert(mCurrentRecvPacketID, getMessageTimeUsecs());
 
 					// Put it onto the list of packets to be acked
 					cdp->collectRAck(mCurrentRecvPacketID);
@@ -820,6 +824,9 @@ void LLMessageSystem::processAcks()
 		//cycle through ack list for each host we need to send acks to
 		mCircuitInfo.sendAcks();
 
+		// send whatever the out throttle held back
+		mPacketRing.sendQueuedPackets(mSocket);
+
 		if (!mDenyTrustedCircuitSet.empty())
 		{
 			LL_INFOS("Messaging") << "Sending queued DenyTrustedCircuit messages." << llendl;
@@ -1332,8 +1339,18 @@ S32 LLMessageSystem::sendMessage(const LLHost &host)
 		is_ack_appended = TRUE;
 	}
 
+	LLPacketScheduler::EPacketCategory category = LLPacketScheduler::PC_UNRELIABLE;
+	if (mMessageBuilder->getMessageName() == _PREHASH_AgentUpdate)
+	{
+		category = LLPacketScheduler::PC_AGENT_UPDATE;
+	}
+	else if (mSendReliable)
+	{
+		category = LLPacketScheduler::PC_RELIABLE;
+	}
+
 	BOOL success;
-	success = mPacketRing.sendPacket(mSocket, (char *)buf_ptr, buffer_length, host);
+	success = mPacketRing.sendPacket(mSocket, (char *)buf_ptr, buffer_length, host, category);
 
 	if (!success)
 	{
@@ -2214,9 +2231,8 @@ S32 LLMessageSystem::sendError(
 	if(temp.size() > (size_t)MTUBYTES) temp.resize((size_t)MTUBYTES);
 	addString("Message", message);
 	LLPointer<LLSDBinaryFormatter> formatter = new LLSDBinaryFormatter;
-	std::ostringstream ostr;
-	formatter->format(data, ostr);
-	temp = ostr.str();
+	temp.clear();
+	formatter->formatBuffer(data, temp);
 	bool pack_data = true;
 	static const std::string ERROR_MESSAGE_NAME("Error");
 	if (LLMessageConfig::getMessageFlavor(ERROR_MESSAGE_NAME) ==
@@ -2891,72 +2907,25 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 	
 	*data[0] &= (~LL_ZERO_CODE_FLAG);
 
-	S32 count = (*data_size);  
-	
-	U8 *inptr = (U8 *)*data;
-	U8 *outptr = (U8 *)mEncodedRecvBuffer;
-
-// skip the packet id field
+	// skip the packet id field
+	S32 header_size = llmin(in_size, (S32)LL_PACKET_ID_SIZE);
+	memcpy(mEncodedRecvBuffer, *data, header_size);	/* Flawfinder: ignore */
 
-	for (U32 ii = 0; ii < LL_PACKET_ID_SIZE; ++ii)
+	S32 expanded_size = zero_code_expand(*data + header_size,
+										 in_size - header_size,
+										 mEncodedRecvBuffer + header_size,
+										 MAX_BUFFER_SIZE - header_size);
+	if (expanded_size < 0)
 	{
-		count--;
-		*outptr++ = *inptr++;
+		LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size" << llendl;
+		callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
+		*data = mEncodedRecvBuffer;
+		*data_size = 0;
+		return(in_size);
 	}
 
-// reconstruct encoded packet, keeping track of net size gain
-
-// sequential zero bytes are encoded as 0 [U8 count] 
-// with 0 0 [count] representing wrap (>256 zeroes)
-
-	while (count--)
-	{
-		if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-1]))
-		{
-			LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 1" << llendl;
-			callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-			outptr = mEncodedRecvBuffer;					
-			break;
-		}
-		if (!((*outptr++ = *inptr++)))
-		{
-			while (((count--)) && (!(*inptr)))
-			{
-				*outptr++ = *inptr++;
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-256]))
-  				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 2" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;
-					count = -1;
-					break;
-  				}
-				memset(outptr,0,255);
-				outptr += 255;
-			}
-			
-			if (count < 0)
-			{
-				break;
-			}
-
-			else
-			{
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-(*inptr)]))
-				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 3" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;					
-				}
-				memset(outptr,0,(*inptr) - 1);
-				outptr += ((*inptr) - 1);
-				inptr++;
-			}
-		}		
-	}
-	
 	*data = mEncodedRecvBuffer;
-	*data_size = (S32)(outptr - mEncodedRecvBuffer);
+	*data_size = header_size + expanded_size;
 	mUncompressedBytesIn += *data_size;
 
 	return(in_size);
@@ -48,6 +48,7 @@
 	#include <arpa/inet.h>
 	#include <fcntl.h>
 	#include <errno.h>
+	#include <sys/select.h>
 #endif
 
 // linden library includes
@@ -55,6 +56,7 @@
 #include "llhost.h"
 #include "lltimer.h"
 #include "indra_constants.h"
+#include "llpacketbuffer.h"
 
 
 // Globals
@@ -655,4 +657,98 @@ BOOL send_packet(int hSocket, const char * sendBuffer, int size, U32 recipient,
 
 #endif
 
+#if LL_LINUX && defined(MSG_WAITFORONE)
+// Largest batch handed to a single recvmmsg() call.
+const S32 RECEIVE_BATCH_SIZE = 64;
+
+S32 receive_packets(int hSocket, LLPacketBuffer* packets, S32 max_packets)
+{
+	struct mmsghdr msgs[RECEIVE_BATCH_SIZE];
+	struct iovec iovs[RECEIVE_BATCH_SIZE];
+	struct sockaddr_in addrs[RECEIVE_BATCH_SIZE];
+	char cmsgs[RECEIVE_BATCH_SIZE][CMSG_SPACE(sizeof(struct in_pktinfo))];
+
+	S32 received = 0;
+	while (received < max_packets)
+	{
+		S32 batch = llmin(max_packets - received, RECEIVE_BATCH_SIZE);
+		memset(msgs, 0, sizeof(msgs[0]) * batch);
+		for (S32 i = 0; i < batch; i++)
+		{
+			iovs[i].iov_base = packets[received + i].mData;
+			iovs[i].iov_len = NET_BUFFER_SIZE;
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = cmsgs[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(cmsgs[i]);
+		}
+
+		int count = recvmmsg(hSocket, msgs, batch, MSG_DONTWAIT, NULL);
+		if (count <= 0)
+		{
+			// EAGAIN just means the socket is drained.
+			break;
+		}
+
+		for (S32 i = 0; i < count; i++)
+		{
+			LLPacketBuffer& packet = packets[received + i];
+			packet.mSize = msgs[i].msg_len;
+			packet.mHost = LLHost(addrs[i].sin_addr.s_addr, ntohs(addrs[i].sin_port));
+
+			U32 dstip = INVALID_HOST_IP_ADDRESS;
+			for (struct cmsghdr* cmsgptr = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+				 cmsgptr != NULL;
+				 cmsgptr = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsgptr))
+			{
+				if (cmsgptr->cmsg_level == SOL_IP && cmsgptr->cmsg_type == IP_PKTINFO)
+				{
+					// See recvfrom_destip() for why this is ipi_spec_dst.
+					dstip = ((in_pktinfo*)CMSG_DATA(cmsgptr))->ipi_spec_dst.s_addr;
+				}
+			}
+			packet.mReceivingIF = LLHost(dstip, INVALID_PORT);
+		}
+
+		received += count;
+		if (count < batch)
+		{
+			break;
+		}
+	}
+	return received;
+}
+#else
+S32 receive_packets(int hSocket, LLPacketBuffer* packets, S32 max_packets)
+{
+	// No batched receive on this platform, fall back to one call per packet.
+	S32 received = 0;
+	while (received < max_packets)
+	{
+		packets[received].init(hSocket);
+		if (packets[received].getSize() <= 0)
+		{
+			break;
+		}
+		received++;
+	}
+	return received;
+}
+#endif
+
+BOOL wait_for_packet(int hSocket, S32 timeout_ms)
+{
+	fd_set readfds;
+	FD_ZERO(&readfds);
+	FD_SET(hSocket, &readfds);
+
+	struct timeval timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+	return select(hSocket + 1, &readfds, NULL, NULL, &timeout) > 0;
+}
+
 //EOF
@@ -35,6 +35,7 @@
 
 class LLTimer;
 class LLHost;
+class LLPacketBuffer;
 
 #define NET_BUFFER_SIZE (0x2000)
 
@@ -49,6 +50,15 @@ void	end_net(S32& socket_out);
 // returns size of packet or -1 in case of error
 S32		receive_packet(int hSocket, char * receiveBuffer);
 
+// Receives up to max_packets waiting datagrams into packets without
+// blocking, using a single recvmmsg() where available. Sender and
+// receiving interface are stored in each packet rather than globally.
+// Returns the number of packets received.
+S32		receive_packets(int hSocket, LLPacketBuffer* packets, S32 max_packets);
+
+// Waits up to timeout_ms for a datagram to arrive. Returns TRUE if one is waiting.
+BOOL	wait_for_packet(int hSocket, S32 timeout_ms);
+
 BOOL	send_packet(int hSocket, const char *sendBuffer, int size, U32 recipient, int nPort);	// Returns TRUE on success.
 
 //void	get_sender(char * tmp);
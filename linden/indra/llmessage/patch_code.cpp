@@ -210,7 +210,7 @@ void	init_patch_decoding(LLBitPack &bitpack)
 	bitpack.resetBitPacking();
 }
 
-void	decode_patch_group_header(LLBitPack &bitpack, LLGroupHeader *gopp)
+static void	unpack_patch_group_header(LLBitPack &bitpack, LLGroupHeader *gopp)
 {
 	U16 retvalu16;
 
@@ -231,11 +231,15 @@ void	decode_patch_group_header(LLBitPack &bitpack, LLGroupHeader *gopp)
 	retvalu8 = 0;
 	bitpack.bitUnpack(&retvalu8, 8);
 	gopp->layer_type = retvalu8;
+}
 
+void	decode_patch_group_header(LLBitPack &bitpack, LLGroupHeader *gopp)
+{
+	unpack_patch_group_header(bitpack, gopp);
 	gPatchSize = gopp->patch_size; 
 }
 
-void	decode_patch_header(LLBitPack &bitpack, LLPatchHeader *ph)
+static void	unpack_patch_header(LLBitPack &bitpack, LLPatchHeader *ph)
 {
 	U8 retvalu8;
 
@@ -283,14 +287,21 @@ void	decode_patch_header(LLBitPack &bitpack, LLPatchHeader *ph)
 	bitpack.bitUnpack((U8 *)&retvalu16, 10);
 #endif
 	ph->patchids = retvalu16;
+}
 
-	gWordBits = (ph->quant_wbits & 0xf) + 2;
+void	decode_patch_header(LLBitPack &bitpack, LLPatchHeader *ph)
+{
+	unpack_patch_header(bitpack, ph);
+	if (END_OF_PATCHES != ph->quant_wbits)
+	{
+		gWordBits = (ph->quant_wbits & 0xf) + 2;
+	}
 }
 
-void	decode_patch(LLBitPack &bitpack, S32 *patches)
+static void	unpack_patch(LLBitPack &bitpack, S32 *patches, S32 patch_size, S32 wbits)
 {
 #ifdef LL_BIG_ENDIAN
-	S32		i, j, patch_size = gPatchSize, wbits = gWordBits;
+	S32		i, j;
 	U8		tempu8;
 	U16		tempu16;
 	U32		tempu32;
@@ -363,7 +374,7 @@ void	decode_patch(LLBitPack &bitpack, S32 *patches)
 		}
 	}
 #else
-	S32		i, j, patch_size = gPatchSize, wbits = gWordBits;
+	S32		i, j;
 	U32		temp;
 	for (i = 0; i < patch_size*patch_size; i++)
 	{
@@ -412,3 +423,64 @@ void	decode_patch(LLBitPack &bitpack, S32 *patches)
 #endif
 }
 
+void	decode_patch(LLBitPack &bitpack, S32 *patches)
+{
+	unpack_patch(bitpack, patches, gPatchSize, gWordBits);
+}
+
+// Most a patch header and patch can read: 66 header bits, then 3 code bits
+// and up to 17 word bits per coefficient.
+const S32 MAX_CODED_PATCH_BYTES = (66 + LARGE_PATCH_SIZE*LARGE_PATCH_SIZE*20)/8 + 1;
+
+BOOL	decode_layer_patches(const U8 *data, S32 size, LLGroupHeader *gopp, std::vector<LLDecodedPatch> &patches)
+{
+	// LLBitPack does not check for the end of its buffer, so decode from a
+	// copy padded to cover the largest patch that could start before it.
+	std::vector<U8> buffer(size + MAX_CODED_PATCH_BYTES, 0);
+	if (size > 0)
+	{
+		memcpy(&buffer[0], data, size);
+	}
+	LLBitPack bitpack(&buffer[0], buffer.size());
+	LLPatchHeader ph;
+	S32 cpatch[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+
+	if (size < 4)
+	{
+		return FALSE;
+	}
+
+	unpack_patch_group_header(bitpack, gopp);
+	S32 patch_size = gopp->patch_size;
+	if (  (patch_size != NORMAL_PATCH_SIZE)
+		&&(patch_size != LARGE_PATCH_SIZE))
+	{
+		return FALSE;
+	}
+
+	while (1)
+	{
+		// Headers and patches are at least a byte, so a well formed packet
+		// never runs up to its end before END_OF_PATCHES.
+		if ((S32)bitpack.mBufferSize >= size)
+		{
+			return FALSE;
+		}
+		unpack_patch_header(bitpack, &ph);
+		if (END_OF_PATCHES == ph.quant_wbits)
+		{
+			return TRUE;
+		}
+
+		unpack_patch(bitpack, cpatch, patch_size, (ph.quant_wbits & 0xf) + 2);
+		if ((S32)bitpack.mBufferSize > size)
+		{
+			return FALSE;
+		}
+
+		patches.resize(patches.size() + 1);
+		LLDecodedPatch &patch = patches.back();
+		patch.mHeader = ph;
+		decompress_patch_sized(patch.mData, patch_size, cpatch, &ph, patch_size);
+	}
+}
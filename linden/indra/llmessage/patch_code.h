@@ -33,9 +33,11 @@
 #ifndef LL_PATCH_CODE_H
 #define LL_PATCH_CODE_H
 
+#include <vector>
+
+#include "patch_dct.h"
+
 class LLBitPack;
-class LLGroupHeader;
-class LLPatchHeader;
 
 void	init_patch_coding(LLBitPack &bitpack);
 void	code_patch_group_header(LLBitPack &bitpack, LLGroupHeader *gopp);
@@ -49,4 +51,19 @@ void	decode_patch_group_header(LLBitPack &bitpack, LLGroupHeader *gopp);
 void	decode_patch_header(LLBitPack &bitpack, LLPatchHeader *ph);
 void	decode_patch(LLBitPack &bitpack, S32 *patches);
 
+// A decompressed patch, size x size values in rows of size.
+class LLDecodedPatch
+{
+public:
+	LLPatchHeader	mHeader;
+	F32				mData[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+};
+
+// Decodes and decompresses every patch of a LayerData packet in one call,
+// appending them to patches in packet order.  Returns FALSE if the packet
+// is malformed, keeping the patches decoded before the error.  Uses no
+// globals, so it may run on any thread once init_patch_decompressor_tables()
+// has been called.
+BOOL	decode_layer_patches(const U8 *data, S32 size, LLGroupHeader *gopp, std::vector<LLDecodedPatch> &patches);
+
 #endif
@@ -94,4 +94,17 @@ void init_patch_decompressor(S32 size);
 void decompress_patch(F32 *patch, S32 *cpatch, LLPatchHeader *ph);
 void decompress_patchv(LLVector3 *v, S32 *cpatch, LLPatchHeader *ph);
 
+// decompress_patch() runs an SSE IDCT when the build has it, computing four
+// outputs at a time in the same order of operations as the scalar loops, so
+// the results are identical.  decompress_patch_scalar() is the original
+// implementation, kept as the reference for tests.
+void decompress_patch_scalar(F32 *patch, S32 *cpatch, LLPatchHeader *ph);
+
+// Decompresses a size x size patch (16 or 32) into patch, whose rows are
+// stride apart.  Does not use the group header or the tables of
+// init_patch_decompressor(), so it may run on any thread once
+// init_patch_decompressor_tables() has been called.
+void init_patch_decompressor_tables();
+void decompress_patch_sized(F32 *patch, S32 stride, const S32 *cpatch, const LLPatchHeader *ph, S32 size);
+
 #endif
@@ -37,6 +37,15 @@
 #include "v3math.h"
 #include "patch_dct.h"
 
+// Only use SSE when the whole build does its float math with it, so that
+// the scalar and vector paths round identically.
+#if (LL_GNUC && defined(__SSE_MATH__)) || (LL_MSVC && (defined(_M_X64) || _M_IX86_FP >= 1))
+#define LL_PATCH_IDCT_SSE 1
+#include <xmmintrin.h>
+#else
+#define LL_PATCH_IDCT_SSE 0
+#endif
+
 LLGroupHeader	*gGOPP;
 
 void set_group_of_patch_header(LLGroupHeader *gopp)
@@ -45,14 +54,14 @@ void set_group_of_patch_header(LLGroupHeader *gopp)
 }
 
 F32 gPatchDequantizeTable[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
-void build_patch_dequantize_table(S32 size)
+void build_patch_dequantize_table(F32 *table, S32 size)
 {
 	S32 i, j;
 	for (j = 0; j < size; j++)
 	{
 		for (i = 0; i < size; i++)
 		{
-			gPatchDequantizeTable[j*size + i] = (1.f + 2.f*(i+j));
+			table[j*size + i] = (1.f + 2.f*(i+j));
 		}
 	}
 }
@@ -61,7 +70,7 @@ S32	gCurrentDeSize = 0;
 
 F32	gPatchICosines[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
 
-void setup_patch_icosines(S32 size)
+void setup_patch_icosines(F32 *icosines, S32 size)
 {
 	S32 n, u;
 	F32 oosob = F_PI*0.5f/size;
@@ -70,14 +79,14 @@ void setup_patch_icosines(S32 size)
 	{
 		for (n = 0; n < size; n++)
 		{
-			gPatchICosines[u*size+n] = cosf((2.f*n+1.f)*u*oosob);
+			icosines[u*size+n] = cosf((2.f*n+1.f)*u*oosob);
 		}
 	}
 }
 
 S32	gDeCopyMatrix[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
 
-void build_decopy_matrix(S32 size)
+void build_decopy_matrix(S32 *matrix, S32 size)
 {
 	S32 i, j, count;
 	BOOL	b_diag = FALSE;
@@ -90,7 +99,7 @@ void build_decopy_matrix(S32 size)
 	while (  (i < size)
 		   &&(j < size))
 	{
-		gDeCopyMatrix[j*size + i] = count;
+		matrix[j*size + i] = count;
 
 		count++;
 
@@ -141,14 +150,46 @@ void build_decopy_matrix(S32 size)
 	}
 }
 
+// Tables for decompress_patch_sized(), one set per patch size, so that a
+// decode on another thread never sees init_patch_decompressor() rebuild them.
+class LLPatchDecompressTables
+{
+public:
+	void build(S32 size)
+	{
+		build_patch_dequantize_table(mDequantize, size);
+		setup_patch_icosines(mICosines, size);
+		build_decopy_matrix(mDeCopy, size);
+	}
+
+	F32	mDequantize[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+	F32	mICosines[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+	S32	mDeCopy[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+};
+
+LLPatchDecompressTables gNormalPatchTables;
+LLPatchDecompressTables gLargePatchTables;
+BOOL gPatchTablesBuilt = FALSE;
+
+void init_patch_decompressor_tables()
+{
+	if (!gPatchTablesBuilt)
+	{
+		gNormalPatchTables.build(NORMAL_PATCH_SIZE);
+		gLargePatchTables.build(LARGE_PATCH_SIZE);
+		gPatchTablesBuilt = TRUE;
+	}
+}
+
 void init_patch_decompressor(S32 size)
 {
+	init_patch_decompressor_tables();
 	if (size != gCurrentDeSize)
 	{
 		gCurrentDeSize = size;
-		build_patch_dequantize_table(size);
-		setup_patch_icosines(size);
-		build_decopy_matrix(size);
+		build_patch_dequantize_table(gPatchDequantizeTable, size);
+		setup_patch_icosines(gPatchICosines, size);
+		build_decopy_matrix(gDeCopyMatrix, size);
 	}
 }
 
@@ -594,7 +635,7 @@ inline void idct_patch_large(F32 *block)
 
 S32	gDitherNoise = 128;
 
-void decompress_patch(F32 *patch, S32 *cpatch, LLPatchHeader *ph)
+void decompress_patch_scalar(F32 *patch, S32 *cpatch, LLPatchHeader *ph)
 {
 	S32		i, j;
 
@@ -641,50 +682,214 @@ void decompress_patch(F32 *patch, S32 *cpatch, LLPatchHeader *ph)
 	}
 }
 
+// idct_patch_sized() sums each output in the same order as idct_column()
+// and idct_line(), so it matches decompress_patch_scalar() bit for bit.
 
-void decompress_patchv(LLVector3 *v, S32 *cpatch, LLPatchHeader *ph)
+#if LL_PATCH_IDCT_SSE
+
+// Sixteen columns at a time, in four independent sums:
+// out[n*SIZE + c] = OO_SQRT2*in[c] + sum(u) in[u*SIZE + c]*icosines[u*SIZE + n]
+template <S32 SIZE>
+inline void idct_columns_sse(const F32 *in, F32 *out, const F32 *icosines)
+{
+	const __m128 oosqrt2 = _mm_set1_ps(OO_SQRT2);
+	S32 n, u, c;
+
+	for (n = 0; n < SIZE; n++)
+	{
+		for (c = 0; c < SIZE; c += 16)
+		{
+			const F32 *tin = in + c;
+			__m128 total0 = _mm_mul_ps(oosqrt2, _mm_loadu_ps(tin));
+			__m128 total1 = _mm_mul_ps(oosqrt2, _mm_loadu_ps(tin + 4));
+			__m128 total2 = _mm_mul_ps(oosqrt2, _mm_loadu_ps(tin + 8));
+			__m128 total3 = _mm_mul_ps(oosqrt2, _mm_loadu_ps(tin + 12));
+			for (u = 1; u < SIZE; u++)
+			{
+				tin += SIZE;
+				const __m128 icos = _mm_set1_ps(icosines[u*SIZE + n]);
+				total0 = _mm_add_ps(total0, _mm_mul_ps(_mm_loadu_ps(tin), icos));
+				total1 = _mm_add_ps(total1, _mm_mul_ps(_mm_loadu_ps(tin + 4), icos));
+				total2 = _mm_add_ps(total2, _mm_mul_ps(_mm_loadu_ps(tin + 8), icos));
+				total3 = _mm_add_ps(total3, _mm_mul_ps(_mm_loadu_ps(tin + 12), icos));
+			}
+			F32 *tout = out + n*SIZE + c;
+			_mm_storeu_ps(tout, total0);
+			_mm_storeu_ps(tout + 4, total1);
+			_mm_storeu_ps(tout + 8, total2);
+			_mm_storeu_ps(tout + 12, total3);
+		}
+	}
+}
+
+// Sixteen outputs of a line at a time, in four independent sums:
+// out[line*SIZE + n] = (OO_SQRT2*in[line*SIZE] + sum(u) in[line*SIZE + u]*icosines[u*SIZE + n])*2/SIZE
+template <S32 SIZE>
+inline void idct_lines_sse(const F32 *in, F32 *out, const F32 *icosines)
+{
+	const __m128 oosqrt2 = _mm_set1_ps(OO_SQRT2);
+	const __m128 oosob = _mm_set1_ps(2.f/SIZE);
+	S32 line, u, n;
+
+	for (line = 0; line < SIZE; line++)
+	{
+		const F32 *row = in + line*SIZE;
+		const __m128 dc = _mm_mul_ps(oosqrt2, _mm_set1_ps(row[0]));
+		for (n = 0; n < SIZE; n += 16)
+		{
+			const F32 *icos = icosines + n;
+			__m128 total0 = dc;
+			__m128 total1 = dc;
+			__m128 total2 = dc;
+			__m128 total3 = dc;
+			for (u = 1; u < SIZE; u++)
+			{
+				icos += SIZE;
+				const __m128 coef = _mm_set1_ps(row[u]);
+				total0 = _mm_add_ps(total0, _mm_mul_ps(coef, _mm_loadu_ps(icos)));
+				total1 = _mm_add_ps(total1, _mm_mul_ps(coef, _mm_loadu_ps(icos + 4)));
+				total2 = _mm_add_ps(total2, _mm_mul_ps(coef, _mm_loadu_ps(icos + 8)));
+				total3 = _mm_add_ps(total3, _mm_mul_ps(coef, _mm_loadu_ps(icos + 12)));
+			}
+			F32 *tout = out + line*SIZE + n;
+			_mm_storeu_ps(tout, _mm_mul_ps(total0, oosob));
+			_mm_storeu_ps(tout + 4, _mm_mul_ps(total1, oosob));
+			_mm_storeu_ps(tout + 8, _mm_mul_ps(total2, oosob));
+			_mm_storeu_ps(tout + 12, _mm_mul_ps(total3, oosob));
+		}
+	}
+}
+
+template <S32 SIZE>
+inline void idct_patch_sized(F32 *block, const F32 *icosines)
+{
+	F32 temp[SIZE*SIZE];
+
+	idct_columns_sse<SIZE>(block, temp, icosines);
+	idct_lines_sse<SIZE>(temp, block, icosines);
+}
+
+#else // LL_PATCH_IDCT_SSE
+
+template <S32 SIZE>
+inline void idct_patch_sized(F32 *block, const F32 *icosines)
+{
+	F32 temp[SIZE*SIZE];
+	F32 total;
+	F32 oosob = 2.f/SIZE;
+	S32 n, u, c, line;
+
+	for (n = 0; n < SIZE; n++)
+	{
+		for (c = 0; c < SIZE; c++)
+		{
+			total = OO_SQRT2*block[c];
+			for (u = 1; u < SIZE; u++)
+			{
+				total += block[u*SIZE + c]*icosines[u*SIZE + n];
+			}
+			temp[n*SIZE + c] = total;
+		}
+	}
+	for (line = 0; line < SIZE; line++)
+	{
+		for (n = 0; n < SIZE; n++)
+		{
+			total = OO_SQRT2*temp[line*SIZE];
+			for (u = 1; u < SIZE; u++)
+			{
+				total += temp[line*SIZE + u]*icosines[u*SIZE + n];
+			}
+			block[line*SIZE + n] = total*oosob;
+		}
+	}
+}
+
+#endif // LL_PATCH_IDCT_SSE
+
+void decompress_patch_sized(F32 *patch, S32 stride, const S32 *cpatch, const LLPatchHeader *ph, S32 size)
 {
 	S32		i, j;
 
-	F32			block[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE], *tblock = block;
-	LLVector3	*tvec;
+	F32		block[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE], *tblock;
+	F32		*tpatch;
 
-	LLGroupHeader	*gopp = gGOPP;
-	S32		size = gopp->patch_size;
+	const LLPatchDecompressTables &tables = (size == NORMAL_PATCH_SIZE) ? gNormalPatchTables : gLargePatchTables;
 	F32		range = ph->range;
 	S32		prequant = (ph->quant_wbits >> 4) + 2;
 	S32		quantize = 1<<prequant;
 	F32		hmin = ph->dc_offset;
-	S32		stride = gopp->stride;
 
 	F32		ooq = 1.f/(F32)quantize;
-	F32     *dq = gPatchDequantizeTable;
-	S32		*decopy_matrix = gDeCopyMatrix;
-
 	F32		mult = ooq*range;
 	F32		addval = mult*(F32)(1<<(prequant - 1))+hmin;
 
-//	BOOL	b_diag = FALSE;
-//	BOOL	b_right = TRUE;
+	llassert(gPatchTablesBuilt);
 
 	for (i = 0; i < size*size; i++)
 	{
-		*(tblock++) = *(cpatch + *(decopy_matrix++))*(*dq++);
+		block[i] = cpatch[tables.mDeCopy[i]]*tables.mDequantize[i];
 	}
 
-	if (size == 16)
-		idct_patch(block);
+	if (size == NORMAL_PATCH_SIZE)
+	{
+		idct_patch_sized<NORMAL_PATCH_SIZE>(block, tables.mICosines);
+	}
 	else
-		idct_patch_large(block);
+	{
+		idct_patch_sized<LARGE_PATCH_SIZE>(block, tables.mICosines);
+	}
 
+#if LL_PATCH_IDCT_SSE
+	const __m128 vmult = _mm_set1_ps(mult);
+	const __m128 vaddval = _mm_set1_ps(addval);
 	for (j = 0; j < size; j++)
 	{
-		tvec = v + j*stride;
+		tpatch = patch + j*stride;
+		tblock = block + j*size;
+		for (i = 0; i < size; i += 4)
+		{
+			_mm_storeu_ps(tpatch + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(tblock + i), vmult), vaddval));
+		}
+	}
+#else
+	for (j = 0; j < size; j++)
+	{
+		tpatch = patch + j*stride;
 		tblock = block + j*size;
 		for (i = 0; i < size; i++)
 		{
-			(*tvec++).mV[VZ] = *(tblock++)*mult+addval;
+			*(tpatch++) = *(tblock++)*mult+addval;
 		}
 	}
+#endif
+}
+
+void decompress_patch(F32 *patch, S32 *cpatch, LLPatchHeader *ph)
+{
+	decompress_patch_sized(patch, gGOPP->stride, cpatch, ph, gGOPP->patch_size);
 }
 
+void decompress_patchv(LLVector3 *v, S32 *cpatch, LLPatchHeader *ph)
+{
+	S32		i, j;
+
+	F32			block[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE], *tblock;
+	LLVector3	*tvec;
+
+	LLGroupHeader	*gopp = gGOPP;
+	S32		size = gopp->patch_size;
+	S32		stride = gopp->stride;
+
+	decompress_patch_sized(block, size, cpatch, ph, size);
+
+	for (j = 0; j < size; j++)
+	{
+		tvec = v + j*stride;
+		tblock = block + j*size;
+		for (i = 0; i < size; i++)
+		{
+			(*tvec++).mV[VZ] = *(tblock++);
+		}
+	}
+}
@@ -37,6 +37,8 @@
 #include <map>
 #if LL_WINDOWS
 #include <share.h>
+#include <io.h>
+#include <windows.h>
 #elif LL_SOLARIS
 #include <sys/types.h>
 #include <unistd.h>
@@ -44,14 +46,37 @@
 #else
 #include <sys/file.h>
 #endif
+#if !LL_WINDOWS
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
     
 #include "llvfs.h"
+#include "llcrc.h"
 #include "llstl.h"
     
 const S32 FILE_BLOCK_MASK = 0x000003FF;	 // 1024-byte blocks
 const S32 VFS_CLEANUP_SIZE = 5242880;  // how much space we free up in a single stroke
 const S32 BLOCK_LENGTH_INVALID = -1;	// mLength for invalid LLVFSFileBlocks
 
+// Index journal records are a serialized LLVFSFileBlock followed by its crc.
+// A record with zero length removes the file.
+const S32 VFS_JOURNAL_RECORD_SIZE = 34 + 4;	// LLVFSFileBlock::SERIAL_SIZE + crc
+const S32 VFS_JOURNAL_FLUSH_SIZE = VFS_JOURNAL_RECORD_SIZE * 128;
+const F32 VFS_JOURNAL_FLUSH_SECONDS = 1.f;
+// Rewrite the full index once the journal holds this many records, or as
+// many records as there are files, whichever is larger.
+const S32 VFS_JOURNAL_COMPACT_RECORDS = 16384;
+// Index entries written to the new index per journal record while a
+// compaction is running, which bounds how long it holds mDataMutex.
+const S32 VFS_JOURNAL_COMPACT_CHUNK = 1024;
+
+// defragment() leaves the data file alone below this fragmentation, and
+// bounds how many files and free blocks it looks at per call.
+const F32 VFS_DEFRAG_MIN_FRAGMENTATION = 0.25f;
+const S32 VFS_DEFRAG_MAX_CANDIDATES = 64;
+const S32 VFS_DEFRAG_MAX_SCAN = 1024;
+
 LLVFS *gVFS = NULL;
 
 // internal class definitions
@@ -81,6 +106,13 @@ public:
 	U32 mLocation;
 	S32	mLength;		// allocated block size
 };
+
+bool LLVFSBlock_length_less::operator()(const LLVFSBlock* lhs, const LLVFSBlock* rhs) const
+{
+	return (lhs->mLength == rhs->mLength)
+		? lhs->mLocation < rhs->mLocation
+		: lhs->mLength < rhs->mLength;
+}
     
 LLVFSFileSpecifier::LLVFSFileSpecifier()
 :	mFileID(),
@@ -203,6 +235,20 @@ public:
 		swizzleCopy(&mSize, buffer, 4);
 	}
     
+	// Sanity check for an entry read back from the index or its journal.
+	// Note that this rejects zero size blocks, which helps VFS
+	// to heal after some errors. JC
+	BOOL isValidEntry(U32 data_size) const
+	{
+		return (mLength > 0 &&
+				(U32)mLength <= data_size &&
+				mLocation < data_size &&
+				mSize > 0 &&
+				mSize <= mLength &&
+				mFileType >= LLAssetType::AT_NONE &&
+				mFileType < LLAssetType::AT_COUNT);
+	}
+    
 	static BOOL insertLRU(LLVFSFileBlock* const& first,
 						  LLVFSFileBlock* const& second)
 	{
@@ -233,12 +279,29 @@ struct LLVFSFileBlock_less
 const S32 LLVFSFileBlock::SERIAL_SIZE = 34;
      
 
-LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash)
-:	mRemoveAfterCrash(remove_after_crash)
+LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash, const BOOL use_mapped_data)
+:	mFreeClassMask(0),
+	mFreeBytes(0),
+	mDefragBytes(0),
+	mEvictedFiles(0),
+	mDataFP(NULL),
+	mIndexFP(NULL),
+	mJournalFP(NULL),
+	mDataMap(NULL),
+	mDataMapSize(0),
+	mJournalRecords(0),
+	mJournalFreedSpace(FALSE),
+	mCompactFP(NULL),
+	mCompactIndexLocation(0),
+	mRemoveAfterCrash(remove_after_crash)
 {
 	mDataMutex = new LLMutex(0);
 
 	S32 i;
+	for (i = 0; i < VFS_DATA_LOCK_STRIPES; i++)
+	{
+		mFileMutexes[i] = new LLMutex(0);
+	}
 	for (i = 0; i < VFSLOCK_COUNT; i++)
 	{
 		mLockCounts[i] = 0;
@@ -247,6 +310,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	mReadOnly = read_only;
 	mIndexFilename = index_filename;
 	mDataFilename = data_filename;
+	mJournalFilename = mIndexFilename + ".journal";
+	mOldJournalFilename = mJournalFilename + ".old";
     
 	const char *file_mode = mReadOnly ? "rb" : "r+b";
     
@@ -265,6 +330,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			// Since we're creating this data file, assume any index file is bogus
 			// remove the index, since this vfs is now blank
 			LLFile::remove(mIndexFilename);
+			LLFile::remove(mJournalFilename);
+			LLFile::remove(mOldJournalFilename);
 		}
 		else
 		{
@@ -288,6 +355,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 				{
 					// we're creating the datafile, so nuke the indexfile
 					LLFile::remove(temp_index);
+					LLFile::remove(temp_index + ".journal");
+					LLFile::remove(temp_index + ".journal.old");
 					break;
 				}
 			}
@@ -301,6 +370,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 
 			mIndexFilename = temp_index;
 			mDataFilename = temp_data;
+			mJournalFilename = mIndexFilename + ".journal";
+			mOldJournalFilename = mJournalFilename + ".old";
 		}
     
 		if (presize)
@@ -323,6 +394,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 
 			LL_WARNS("VFS") << "VFS: File left open on last run, removing old VFS file " << mDataFilename << LL_ENDL;
 			LLFile::remove(mIndexFilename);
+			LLFile::remove(mJournalFilename);
+			LLFile::remove(mOldJournalFilename);
 			LLFile::remove(mDataFilename);
 			LLFile::remove(marker);
 
@@ -345,17 +418,39 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	fseek(mDataFP, 0, SEEK_END);
 	U32 data_size = ftell(mDataFP);
 
-	// read the index file
-	// make sure there's at least one file in it too
+#if LL_WINDOWS
+	// A compaction interrupted between removing the old index and renaming
+	// the new one into place leaves only the new one.
+	llstat temp_info;
+	if (!mReadOnly &&
+		LLFile::stat(mIndexFilename, &temp_info) &&
+		!LLFile::stat(mIndexFilename + ".tmp", &temp_info))
+	{
+		LLFile::rename(mIndexFilename + ".tmp", mIndexFilename);
+	}
+#endif
+
+	// read the index file and replay the journals on top of it
+	// make sure there's at least one file in them too
 	// if not, we'll treat this as a new vfs
 	llstat fbuf;
-	if (! LLFile::stat(mIndexFilename, &fbuf) &&
-		fbuf.st_size >= LLVFSFileBlock::SERIAL_SIZE &&
-		(mIndexFP = openAndLock(mIndexFilename, file_mode, mReadOnly))
+	llstat jbuf;
+	BOOL have_index = (! LLFile::stat(mIndexFilename, &fbuf) &&
+					   fbuf.st_size >= LLVFSFileBlock::SERIAL_SIZE);
+	BOOL have_journal = (! mReadOnly &&
+						 ! LLFile::stat(mJournalFilename, &jbuf) &&
+						 jbuf.st_size >= VFS_JOURNAL_RECORD_SIZE);
+	// A journal set aside by a compaction that didn't finish.  Its records
+	// come before the ones in mJournalFilename.
+	BOOL have_old_journal = (! mReadOnly &&
+							 ! LLFile::stat(mOldJournalFilename, &jbuf) &&
+							 jbuf.st_size >= VFS_JOURNAL_RECORD_SIZE);
+	if ((have_index || have_journal || have_old_journal) &&
+		(mIndexFP = openAndLock(mIndexFilename, have_index ? file_mode : "w+b", mReadOnly))
 		)
 	{	
-		U8 *buffer = new U8[fbuf.st_size];
-		size_t nread = fread(buffer, 1, fbuf.st_size, mIndexFP);
+		U8 *buffer = new U8[have_index ? fbuf.st_size : 0];
+		size_t nread = have_index ? fread(buffer, 1, fbuf.st_size, mIndexFP) : 0;
     
 		U8 *tmp_ptr = buffer;
     
@@ -368,18 +463,15 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			block->deserialize(tmp_ptr, (S32)(tmp_ptr - buffer));
     
 			// Do sanity check on this block.
-			// Note that this skips zero size blocks, which helps VFS
-			// to heal after some errors. JC
-			if (block->mLength > 0 &&
-				(U32)block->mLength <= data_size &&
-				block->mLocation < data_size &&
-				block->mSize > 0 &&
-				block->mSize <= block->mLength &&
-				block->mFileType >= LLAssetType::AT_NONE &&
-				block->mFileType < LLAssetType::AT_COUNT)
+			if (block->isValidEntry(data_size))
 			{
-				mFileBlocks.insert(fileblock_map::value_type(*block, block));
-				files_by_loc.push_back(block);
+				if (!mFileBlocks.insert(fileblock_map::value_type(*block, block)).second)
+				{
+					// Same file twice, keep the first and let the other
+					// become free space.
+					LL_WARNS("VFS") << "VFS: removing duplicate index entry for " << block->mFileID << LL_ENDL;
+					delete block;
+				}
 			}
 			else
 			if (block->mLength && block->mSize > 0)
@@ -395,6 +487,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 				unlockAndClose( mIndexFP );
 				mIndexFP = NULL;
 				LLFile::remove( mIndexFilename );
+				LLFile::remove( mJournalFilename );
+				LLFile::remove( mOldJournalFilename );
 
 				unlockAndClose( mDataFP );
 				mDataFP = NULL;
@@ -412,9 +506,6 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			else
 			{
 				// this is a null or bad entry, skip it
-				S32 index_loc = (S32)(tmp_ptr - buffer);
-				mIndexHoles.push_back(index_loc);
-    
 				delete block;
 			}
     
@@ -422,6 +513,20 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 		}
 		delete[] buffer;
 
+		if (have_old_journal)
+		{
+			replayJournal(mOldJournalFilename, data_size);
+		}
+		if (have_journal)
+		{
+			replayJournal(mJournalFilename, data_size);
+		}
+
+		for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+		{
+			files_by_loc.push_back(it->second);
+		}
+
 		std::sort(
 			files_by_loc.begin(),
 			files_by_loc.end(),
@@ -500,6 +605,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 					unlockAndClose( mIndexFP );
 					mIndexFP = NULL;
 					LLFile::remove( mIndexFilename );
+					LLFile::remove( mJournalFilename );
+					LLFile::remove( mOldJournalFilename );
 
 					unlockAndClose( mDataFP );
 					mDataFP = NULL;
@@ -571,6 +678,67 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 		addFreeBlock(first_block);
 	}
 
+	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	{
+		LLVFSFileBlock* file_block = it->second;
+		if (file_block->mLength > 0)
+		{
+			mFileBlocksByLocation[file_block->mLocation] = file_block;
+		}
+	}
+
+	if (use_mapped_data)
+	{
+		// Map everything the free and file lists can address.
+		U32 map_size = data_size;
+		if (!mFreeBlocksByLocation.empty())
+		{
+			LLVFSBlock* last_free = mFreeBlocksByLocation.rbegin()->second;
+			map_size = llmax(map_size, last_free->mLocation + (U32)last_free->mLength);
+		}
+		for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+		{
+			LLVFSFileBlock* file_block = it->second;
+			if (file_block->mLength > 0)
+			{
+				map_size = llmax(map_size, file_block->mLocation + (U32)file_block->mLength);
+			}
+		}
+
+		if (!mapDataFile(map_size))
+		{
+			LL_WARNS("VFS") << "Unable to map VFS data file " << mDataFilename << ", using buffered file access" << LL_ENDL;
+		}
+	}
+
+	if (!mReadOnly)
+	{
+		lockData();
+		if (have_old_journal)
+		{
+			// Interrupted compaction, fold both journals into a fresh index.
+			compactIndex();
+		}
+		else if (have_journal)
+		{
+			// Set the replayed journal aside and fold it into the index a
+			// chunk at a time as new records arrive.
+			startCompaction();
+		}
+		else
+		{
+			mJournalFP = openAndLock(mJournalFilename, "w+b", FALSE);
+		}
+
+		if (!mJournalFP)
+		{
+			LL_WARNS("VFS") << "Couldn't open VFS index journal " << mJournalFilename << LL_ENDL;
+		}
+		// write anything journaled while loading
+		flushJournal();
+		unlockData();
+	}
+
 	// Open marker file to look for bad shutdowns
 	if (!mReadOnly && mRemoveAfterCrash)
 	{
@@ -596,9 +764,26 @@ LLVFS::~LLVFS()
 		LL_ERRS("VFS") << "LLVFS destroyed with mutex locked" << LL_ENDL;
 	}
 	
+	if (isValid() && !mReadOnly)
+	{
+		// Finish any compaction, the next startup just replays the journal.
+		lockData();
+		while (mCompactFP)
+		{
+			continueCompaction();
+		}
+		flushJournal();
+		unlockData();
+	}
+
+	unlockAndClose(mJournalFP);
+	mJournalFP = NULL;
+
 	unlockAndClose(mIndexFP);
 	mIndexFP = NULL;
 
+	unmapDataFile();
+
 	fileblock_map::const_iterator it;
 	for (it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
 	{
@@ -606,7 +791,11 @@ LLVFS::~LLVFS()
 	}
 	mFileBlocks.clear();
 	
-	mFreeBlocksByLength.clear();
+	mFileBlocksByLocation.clear();
+	for (S32 i = 0; i < VFS_FREE_CLASS_COUNT; i++)
+	{
+		mFreeBlocksByClass[i].clear();
+	}
 
 	for_each(mFreeBlocksByLocation.begin(), mFreeBlocksByLocation.end(), DeletePairedPointer());
     
@@ -620,9 +809,97 @@ LLVFS::~LLVFS()
 		LLFile::remove(marker);
 	}
 
+	for (S32 i = 0; i < VFS_DATA_LOCK_STRIPES; i++)
+	{
+		delete mFileMutexes[i];
+	}
 	delete mDataMutex;
 }
 
+BOOL LLVFS::mapDataFile(U32 map_size)
+{
+	if (!mDataFP || !map_size)
+	{
+		return FALSE;
+	}
+
+	fflush(mDataFP);
+
+	fseek(mDataFP, 0, SEEK_END);
+	U32 file_size = ftell(mDataFP);
+	if (file_size < map_size && mReadOnly)
+	{
+		map_size = file_size;
+	}
+	if (!map_size)
+	{
+		return FALSE;
+	}
+
+#if LL_WINDOWS
+	// A writable mapping larger than the file grows the file to map_size.
+	HANDLE file = (HANDLE)_get_osfhandle(_fileno(mDataFP));
+	if (INVALID_HANDLE_VALUE == file)
+	{
+		return FALSE;
+	}
+	HANDLE mapping = CreateFileMapping(file, NULL, mReadOnly ? PAGE_READONLY : PAGE_READWRITE, 0, map_size, NULL);
+	if (!mapping)
+	{
+		llwarns << "VFS: Could not create a " << map_size << " byte mapping of the data file" << llendl;
+		return FALSE;
+	}
+	void* addr = MapViewOfFile(mapping, mReadOnly ? FILE_MAP_READ : FILE_MAP_WRITE, 0, 0, map_size);
+	// the view holds its own reference to the mapping
+	CloseHandle(mapping);
+	if (!addr)
+	{
+		return FALSE;
+	}
+#else
+	int fd = fileno(mDataFP);
+	if (file_size < map_size && ftruncate(fd, map_size) != 0)
+	{
+		llwarns << "VFS: Could not grow data file to " << map_size << " bytes for mapping" << llendl;
+		return FALSE;
+	}
+
+	int prot = mReadOnly ? PROT_READ : (PROT_READ | PROT_WRITE);
+	void* addr = mmap(NULL, map_size, prot, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == addr)
+	{
+		return FALSE;
+	}
+#endif
+
+	mDataMap = (U8*)addr;
+	mDataMapSize = map_size;
+	llinfos << "VFS: Mapped " << map_size << " bytes of " << mDataFilename << llendl;
+	return TRUE;
+}
+
+void LLVFS::unmapDataFile()
+{
+	if (mDataMap)
+	{
+#if LL_WINDOWS
+		if (!mReadOnly)
+		{
+			FlushViewOfFile(mDataMap, 0);
+		}
+		UnmapViewOfFile(mDataMap);
+#else
+		if (!mReadOnly)
+		{
+			msync(mDataMap, mDataMapSize, MS_ASYNC);
+		}
+		munmap(mDataMap, mDataMapSize);
+#endif
+	}
+	mDataMap = NULL;
+	mDataMapSize = 0;
+}
+
 void LLVFS::presizeDataFile(const U32 size)
 {
 	if (!mDataFP)
@@ -639,6 +916,8 @@ void LLVFS::presizeDataFile(const U32 size)
 
 	// also remove any index, since this vfs is now blank
 	LLFile::remove(mIndexFilename);
+	LLFile::remove(mJournalFilename);
+	LLFile::remove(mOldJournalFilename);
 
 	if (tmp)
 	{
@@ -733,8 +1012,7 @@ BOOL LLVFS::checkAvailable(S32 max_size)
 {
 	lockData();
 	
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(max_size); // first entry >= size
-	const BOOL res(iter == mFreeBlocksByLength.end() ? FALSE : TRUE);
+	const BOOL res(findBestFit(max_size) ? TRUE : FALSE);
 
 	unlockData();
 	
@@ -791,9 +1069,10 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 		else if (max_size < block->mLength)
 		{
 			// this file is shrinking
+			LLMutexLock lock_file(getFileMutex(*block));
 			LLVFSBlock *free_block = new LLVFSBlock(block->mLocation + max_size, block->mLength - max_size);
 
-			addFreeBlock(free_block);
+			releaseFileSpace(free_block);
     
 			block->mLength = max_size;
     
@@ -856,9 +1135,16 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 					// create a new free block where this file used to be
 					LLVFSBlock *new_free_block = new LLVFSBlock(block->mLocation, block->mLength);
 
-					addFreeBlock(new_free_block);
+					releaseFileSpace(new_free_block);
 					
-					if (block->mSize > 0)
+					if (block->mSize > 0 && mDataMap)
+					{
+						// move the file into the new block, readers of this
+						// file may still be copying out of the old location
+						LLMutexLock lock_file(getFileMutex(*block));
+						memcpy(mDataMap + new_data_location, mDataMap + block->mLocation, block->mSize); /* Flawfinder: ignore */
+					}
+					else if (block->mSize > 0)
 					{
 						// move the file into the new block
 						U8 *buffer = new U8[block->mSize];
@@ -878,7 +1164,9 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 					}
 				}
     
+				mFileBlocksByLocation.erase(block->mLocation);
 				block->mLocation = new_data_location;
+				mFileBlocksByLocation[new_data_location] = block;
     
 				block->mLength = max_size;
 
@@ -916,6 +1204,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 				block = new LLVFSFileBlock(file_id, file_type, free_block->mLocation, max_size);
 				mFileBlocks.insert(fileblock_map::value_type(spec, block));
 			}
+			mFileBlocksByLocation[block->mLocation] = block;
 
 			// Must call useFreeSpace before sync(), as sync()
 			// unlocks data structures.
@@ -990,13 +1279,29 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 			delete dest_block;
 		}
 
+		// The file changes stripes, so hold both while the ID changes.
+		LLMutex* old_mutex = getFileMutex(old_spec);
+		LLMutex* new_mutex = getFileMutex(new_spec);
+		old_mutex->lock();
+		if (new_mutex != old_mutex)
+		{
+			new_mutex->lock();
+		}
+
 		src_block->mFileID = new_id;
 		src_block->mFileType = new_type;
 		src_block->mAccessTime = (U32)time(NULL);
+
+		if (new_mutex != old_mutex)
+		{
+			new_mutex->unlock();
+		}
+		old_mutex->unlock();
    
 		mFileBlocks.erase(old_spec);
 		mFileBlocks.insert(fileblock_map::value_type(new_spec, src_block));
 
+		appendJournal(old_spec, NULL);
 		sync(src_block);
 	}
 	else
@@ -1009,23 +1314,36 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 // mDataMutex must be LOCKED before calling this
 void LLVFS::removeFileBlock(LLVFSFileBlock *fileblock)
 {
-	// convert this into an unsaved, dummy fileblock to preserve locks
-	// a more rubust solution would store the locks in a seperate data structure
-	sync(fileblock, TRUE);
+	// Wait for any reader still copying out of the mapped file before the
+	// space can be handed to another file.
+	LLMutexLock lock_file(getFileMutex(*fileblock));
 	
 	if (fileblock->mLength > 0)
 	{
+		mFileBlocksByLocation.erase(fileblock->mLocation);
+
 		// turn this file into an empty block
 		LLVFSBlock *free_block = new LLVFSBlock(fileblock->mLocation, fileblock->mLength);
 		
-		addFreeBlock(free_block);
+		releaseFileSpace(free_block);
 	}
+
+	// convert this into an unsaved, dummy fileblock to preserve locks
+	// a more rubust solution would store the locks in a seperate data structure
+	BOOL was_saved = (fileblock->mLength != BLOCK_LENGTH_INVALID);
 	
 	fileblock->mLocation = 0;
 	fileblock->mSize = 0;
 	fileblock->mLength = BLOCK_LENGTH_INVALID;
 	fileblock->mIndexLocation = -1;
 
+	// Journal the removal only once the block no longer looks like a
+	// file, sync() may compact the index from mFileBlocks.
+	if (was_saved)
+	{
+		sync(fileblock, TRUE);
+	}
+
 	//mergeFreeBlocks();
 }
 
@@ -1096,6 +1414,23 @@ S32 LLVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8
 		}
 	}
 
+	if (do_read && mDataMap)
+	{
+		// Only hold the index lock long enough to pin this file's stripe.
+		LLMutex* file_mutex = getFileMutex(spec);
+		file_mutex->lock();
+		unlockData();
+
+		if ((U32)location < mDataMapSize)
+		{
+			bytesread = llmin(length, (S32)(mDataMapSize - location));
+			memcpy(buffer, mDataMap + location, bytesread);	/* Flawfinder: ignore */
+		}
+
+		file_mutex->unlock();
+		return bytesread;
+	}
+
 	if (do_read)
 	{
 		fseek(mDataFP, location, SEEK_SET);
@@ -1167,6 +1502,42 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
 				length = block->mLength - location;
 			}
 			U32 file_location = location + block->mLocation;
+
+			if (mDataMap)
+			{
+				// Copy holding only this file's stripe, then commit any new
+				// size, so readers and the index never see a size past the
+				// bytes written.
+				U32 block_location = block->mLocation;
+				LLMutex* file_mutex = getFileMutex(spec);
+				file_mutex->lock();
+				unlockData();
+
+				memcpy(mDataMap + file_location, buffer, length);	/* Flawfinder: ignore */
+
+				file_mutex->unlock();
+
+				lockData();
+				it = mFileBlocks.find(spec);
+				if (it != mFileBlocks.end() && (*it).second->mLength >= location + length)
+				{
+					block = (*it).second;
+					if (location + length > block->mSize)
+					{
+						if (block->mLocation != block_location)
+						{
+							// The file was moved before the size was
+							// committed, and a move only carries mSize bytes.
+							LLMutexLock lock_file(file_mutex);
+							memcpy(mDataMap + block->mLocation + location, buffer, length);	/* Flawfinder: ignore */
+						}
+						block->mSize = location + length;
+						sync(block);
+					}
+				}
+				unlockData();
+				return length;
+			}
 			
 			fseek(mDataFP, file_location, SEEK_SET);
 			S32 write_len = (S32)fwrite(buffer, 1, length, mDataFP);
@@ -1268,29 +1639,84 @@ BOOL LLVFS::isLocked(const LLUUID &file_id, const LLAssetType::EType file_type,
 
 void LLVFS::eraseBlockLength(LLVFSBlock *block)
 {
-	// find the corresponding map entry in the length map and erase it
-	S32 length = block->mLength;
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(length);
-	blocks_length_map_t::iterator end = mFreeBlocksByLength.end();
-	bool found_block = false;
-	while(iter != end)
-	{
-		LLVFSBlock *tblock = iter->second;
-		llassert(tblock->mLength == length); // there had -better- be an entry with our length!
-		if (tblock == block)
-		{
-			mFreeBlocksByLength.erase(iter);
-			found_block = true;
-			break;
+	// find the corresponding entry in its size class and erase it
+	S32 free_class = getFreeClass(block->mLength);
+	blocks_length_set_t& free_list = mFreeBlocksByClass[free_class];
+	if (free_list.erase(block) != 1)
+	{
+		llerrs << "eraseBlock could not find block" << llendl;
+	}
+	if (free_list.empty())
+	{
+		mFreeClassMask &= ~(1U << free_class);
+	}
+	mFreeBytes -= block->mLength;
+}
+
+void LLVFS::insertBlockLength(LLVFSBlock *block)
+{
+	S32 free_class = getFreeClass(block->mLength);
+	mFreeBlocksByClass[free_class].insert(block);
+	mFreeClassMask |= (1U << free_class);
+	mFreeBytes += block->mLength;
+}
+
+// static
+S32 LLVFS::getFreeClass(S32 length)
+{
+	S32 free_class = 0;
+	while (length > 1 && free_class < VFS_FREE_CLASS_COUNT - 1)
+	{
+		length >>= 1;
+		free_class++;
+	}
+	return free_class;
+}
+
+LLVFSBlock *LLVFS::findBestFit(S32 size)
+{
+	// smallest block of this size class that fits, lowest address first
+	S32 free_class = getFreeClass(size);
+	LLVFSBlock probe(0, size);
+	blocks_length_set_t& free_list = mFreeBlocksByClass[free_class];
+	blocks_length_set_t::iterator iter = free_list.lower_bound(&probe);
+	if (iter != free_list.end())
+	{
+		return *iter;
+	}
+
+	// otherwise the smallest block of the next non-empty class
+	U32 larger_classes = mFreeClassMask & ~((2U << free_class) - 1);
+	for (S32 i = free_class + 1; larger_classes && i < VFS_FREE_CLASS_COUNT; i++)
+	{
+		if (larger_classes & (1U << i))
+		{
+			return *mFreeBlocksByClass[i].begin();
 		}
-		++iter;
 	}
-	if(!found_block)
+	return NULL;
+}
+
+S32 LLVFS::getLargestFreeBlock()
+{
+	for (S32 i = VFS_FREE_CLASS_COUNT - 1; i >= 0; i--)
 	{
-		llerrs << "eraseBlock could not find block" << llendl;
+		if (mFreeClassMask & (1U << i))
+		{
+			return (*mFreeBlocksByClass[i].rbegin())->mLength;
+		}
 	}
+	return 0;
 }
 
+F32 LLVFS::getFragmentation()
+{
+	if (mFreeBytes <= 0)
+	{
+		return 0.f;
+	}
+	return 1.f - (F32)getLargestFreeBlock() / (F32)mFreeBytes;
+}
 
 // Remove block from both free lists (by location and by length).
 void LLVFS::eraseBlock(LLVFSBlock *block)
@@ -1345,7 +1771,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		eraseBlockLength(prev_block);
 		eraseBlock(next_block);
 		prev_block->mLength += block->mLength + next_block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block));
+		insertBlockLength(prev_block);
 		delete block;
 		block = NULL;
 		delete next_block;
@@ -1358,7 +1784,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		// therefore only need to update the length map. JC
 		eraseBlockLength(prev_block);
 		prev_block->mLength += block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block)); // multimap insert
+		insertBlockLength(prev_block);
 		delete block;
 		block = NULL;
 	}
@@ -1372,7 +1798,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		next_block->mLength += block->mLength;
 		// Don't hint here, next_free_it iterator may be invalid.
 		mFreeBlocksByLocation.insert(blocks_location_map_t::value_type(next_block->mLocation, next_block)); // multimap insert
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(next_block->mLength, next_block)); // multimap insert			
+		insertBlockLength(next_block);
 		delete block;
 		block = NULL;
 	}
@@ -1381,7 +1807,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		// Can't merge with other free blocks.
 		// Hint that insert should go near next_free_it.
  		mFreeBlocksByLocation.insert(next_free_it, blocks_location_map_t::value_type(block->mLocation, block)); // multimap insert
- 		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(block->mLength, block)); // multimap insert
+ 		insertBlockLength(block);
 	}
 }
 
@@ -1424,9 +1850,26 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 // 	}
 //}
 	
+// NOTE! mDataMutex must be LOCKED before calling this
+// Hand space a file stopped using back to the free lists.
+void LLVFS::releaseFileSpace(LLVFSBlock *free_block)
+{
+	addFreeBlock(free_block);
+	mJournalFreedSpace = TRUE;
+}
+
 // length bytes from free_block are going to be used (so they are no longer free)
 void LLVFS::useFreeSpace(LLVFSBlock *free_block, S32 length)
 {
+	if (mJournalFreedSpace)
+	{
+		// The records that released this space have to reach the journal
+		// before another file's data does, or a crash could leave the
+		// index pointing at the new file's bytes.
+		flushJournal();
+		mJournalFreedSpace = FALSE;
+	}
+
 	if (free_block->mLength == length)
 	{
 		eraseBlock(free_block);
@@ -1444,7 +1887,7 @@ void LLVFS::useFreeSpace(LLVFSBlock *free_block, S32 length)
 }
 
 // NOTE! mDataMutex must be LOCKED before calling this
-// sync this index entry out to the index file
+// sync this index entry out to the index journal
 // we need to do this constantly to avoid corruption on viewer crash
 void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 {
@@ -1457,6 +1900,11 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 		llwarns << "Attempt to sync read-only VFS" << llendl;
 		return;
 	}
+	if (remove)
+	{
+		appendJournal(*block, NULL);
+		return;
+	}
 	if (block->mLength == BLOCK_LENGTH_INVALID)
 	{
 		// This is a dummy file, don't save
@@ -1467,62 +1915,352 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 		llerrs << "VFS syncing zero-length block" << llendl;
 	}
 
-    BOOL set_index_to_end = FALSE;
-	long seek_pos = block->mIndexLocation;
-		
-	if (-1 == seek_pos)
+	appendJournal(*block, block);
+}
+
+// NOTE! mDataMutex must be LOCKED before calling this
+// Pass a NULL block to record that spec was removed.
+void LLVFS::appendJournal(const LLVFSFileSpecifier& spec, LLVFSFileBlock* block)
+{
+	U8 record[VFS_JOURNAL_RECORD_SIZE];
+	if (block)
+	{
+		block->serialize(record);
+	}
+	else
+	{
+		LLVFSFileBlock removed(spec.mFileID, spec.mFileType);
+		removed.serialize(record);
+	}
+
+	LLCRC crc;
+	crc.update(record, LLVFSFileBlock::SERIAL_SIZE);
+	U32 crc_value = crc.getCRC();
+	for (S32 i = 0; i < 4; i++)
+	{
+		record[LLVFSFileBlock::SERIAL_SIZE + i] = (U8)(crc_value >> (i * 8));
+	}
+
+	mJournalBuffer.insert(mJournalBuffer.end(), record, record + VFS_JOURNAL_RECORD_SIZE);
+	mJournalRecords++;
+
+	if (!mJournalFP)
+	{
+		// Still starting up, the constructor compacts these.
+		return;
+	}
+
+	if (mCompactFP)
+	{
+		continueCompaction();
+	}
+	else if (mJournalRecords > llmax(VFS_JOURNAL_COMPACT_RECORDS, (S32)mFileBlocks.size()))
+	{
+		startCompaction();
+	}
+
+	if ((S32)mJournalBuffer.size() >= VFS_JOURNAL_FLUSH_SIZE ||
+		mJournalFlushTimer.getElapsedTimeF32() > VFS_JOURNAL_FLUSH_SECONDS)
+	{
+		flushJournal();
+	}
+}
+
+// NOTE! mDataMutex must be LOCKED before calling this
+void LLVFS::flushJournal()
+{
+	if (mJournalBuffer.empty() || !mJournalFP)
+	{
+		return;
+	}
+
+	// Data has to reach the OS before the index records that point at it,
+	// so a crash can't leave the index ahead of the data.  A mapped data
+	// file is shared with the OS as soon as it is written.
+	if (!mDataMap)
+	{
+		fflush(mDataFP);
+	}
+
+	if (fwrite(&mJournalBuffer[0], mJournalBuffer.size(), 1, mJournalFP) != 1)
+	{
+		llwarns << "VFS: Short write to index journal" << llendl;
+	}
+	fflush(mJournalFP);
+
+	mJournalBuffer.clear();
+	mJournalFlushTimer.reset();
+}
+
+// NOTE! mDataMutex must be LOCKED before calling this
+// Write the whole in-memory index to a new index file, swap it in and
+// start an empty journal, all without letting go of mDataMutex.
+void LLVFS::compactIndex()
+{
+	if (mReadOnly)
+	{
+		return;
+	}
+
+	if (mCompactFP)
+	{
+		// Drop the compaction in progress, this one covers it.
+		fclose(mCompactFP);
+		mCompactFP = NULL;
+		LLFile::remove(mIndexFilename + ".tmp");
+	}
+
+	if (!mDataMap)
+	{
+		fflush(mDataFP);
+	}
+
+	mCompactFP = LLFile::fopen(mIndexFilename + ".tmp", "wb");	/* Flawfinder: ignore */
+	if (!mCompactFP)
+	{
+		llwarns << "VFS: Can't open " << mIndexFilename << ".tmp to compact index" << llendl;
+		flushJournal();
+		return;
+	}
+	mCompactIndexLocation = 0;
+	mCompactNext = mFileBlocks.empty() ? LLVFSFileSpecifier() : mFileBlocks.begin()->first;
+
+	while (mCompactFP && !writeCompactChunk(mFileBlocks.size()))
+	{
+	}
+
+	if (!finishCompaction())
+	{
+		// The old index and journals are still intact, keep appending.
+		flushJournal();
+		return;
+	}
+
+	// Everything in the journals is in the index now.
+	unlockAndClose(mJournalFP);
+	mJournalFP = openAndLock(mJournalFilename, "w+b", FALSE);
+	LLFile::remove(mOldJournalFilename);
+	mJournalBuffer.clear();
+	mJournalRecords = 0;
+	mJournalFlushTimer.reset();
+}
+
+// NOTE! mDataMutex must be LOCKED before calling this
+// Set the journal aside and start writing a new index that
+// continueCompaction() finishes a chunk at a time.  Records appended in the
+// meantime go to a fresh journal, and replaying the old journal on top of
+// the new index is harmless, so a crash at any point loses nothing that was
+// flushed.
+void LLVFS::startCompaction()
+{
+	if (mReadOnly || mCompactFP)
 	{
-		if (!mIndexHoles.empty())
+		return;
+	}
+
+	llstat old_info;
+	if (!LLFile::stat(mOldJournalFilename, &old_info))
+	{
+		// Only left behind by a compaction that failed to swap in its index.
+		compactIndex();
+		return;
+	}
+
+	flushJournal();
+	mCompactFP = LLFile::fopen(mIndexFilename + ".tmp", "wb");	/* Flawfinder: ignore */
+	if (!mCompactFP)
+	{
+		llwarns << "VFS: Can't open " << mIndexFilename << ".tmp to compact index" << llendl;
+		return;
+	}
+
+	unlockAndClose(mJournalFP);
+	mJournalFP = NULL;
+	llstat journal_info;
+	if (!LLFile::stat(mJournalFilename, &journal_info) &&
+		LLFile::rename(mJournalFilename, mOldJournalFilename) != 0)
+	{
+		llwarns << "VFS: Can't set aside index journal " << mJournalFilename << llendl;
+		fclose(mCompactFP);
+		mCompactFP = NULL;
+		LLFile::remove(mIndexFilename + ".tmp");
+		mJournalFP = openAndLock(mJournalFilename, "ab", FALSE);
+		return;
+	}
+	mJournalFP = openAndLock(mJournalFilename, "w+b", FALSE);
+
+	mJournalRecords = 0;
+	mCompactIndexLocation = 0;
+	mCompactNext = mFileBlocks.empty() ? LLVFSFileSpecifier() : mFileBlocks.begin()->first;
+}
+
+// NOTE! mDataMutex must be LOCKED before calling this
+// Write the next chunk of the new index, and swap it in once it's complete.
+void LLVFS::continueCompaction()
+{
+	if (mCompactFP && writeCompactChunk(VFS_JOURNAL_COMPACT_CHUNK))
+	{
+		if (finishCompaction())
+		{
+			LLFile::remove(mOldJournalFilename);
+		}
+	}
+}
+
+// NOTE! mDataMutex must be LOCKED before calling this
+// Write up to max_entries index entries, starting at mCompactNext, to the
+// new index.  Returns TRUE once every entry is written.
+BOOL LLVFS::writeCompactChunk(S32 max_entries)
+{
+	// The new index mustn't point at data still in the stdio buffer.
+	if (!mDataMap)
+	{
+		fflush(mDataFP);
+	}
+
+	U8 buffer[LLVFSFileBlock::SERIAL_SIZE];
+	fileblock_map::iterator it = mFileBlocks.lower_bound(mCompactNext);
+	for (S32 count = 0; it != mFileBlocks.end() && count < max_entries; ++it, ++count)
+	{
+		LLVFSFileBlock* block = it->second;
+		if (block->mLength > 0 && block->mSize > 0)
 		{
-			seek_pos = mIndexHoles.front();
-			mIndexHoles.pop_front();
+			block->serialize(buffer);
+			if (fwrite(buffer, LLVFSFileBlock::SERIAL_SIZE, 1, mCompactFP) != 1)
+			{
+				llwarns << "VFS: Short write compacting index " << mIndexFilename << llendl;
+				fclose(mCompactFP);
+				mCompactFP = NULL;
+				LLFile::remove(mIndexFilename + ".tmp");
+				return TRUE;
+			}
+			block->mIndexLocation = mCompactIndexLocation;
+			mCompactIndexLocation += LLVFSFileBlock::SERIAL_SIZE;
 		}
 		else
 		{
-			set_index_to_end = TRUE;
+			block->mIndexLocation = -1;
 		}
 	}
 
-    if (set_index_to_end)
+	if (it != mFileBlocks.end())
 	{
-		// Need fseek/ftell to update the seek_pos and hence data
-		// structures, so can't unlockData() before this.
-		fseek(mIndexFP, 0, SEEK_END);
-		seek_pos = ftell(mIndexFP);
+		mCompactNext = it->first;
+		return FALSE;
 	}
-	    
-	block->mIndexLocation = seek_pos;
-	if (remove)
+	return TRUE;
+}
+
+// NOTE! mDataMutex must be LOCKED before calling this
+// Swap the new index in for the old one.  Returns FALSE, leaving the old
+// index in place, if anything went wrong.
+BOOL LLVFS::finishCompaction()
+{
+	if (!mCompactFP)
 	{
-		mIndexHoles.push_back(seek_pos);
+		return FALSE;
 	}
 
-	U8 buffer[LLVFSFileBlock::SERIAL_SIZE];
-	if (remove)
+	std::string temp_index = mIndexFilename + ".tmp";
+	BOOL ok = (fflush(mCompactFP) == 0);
+	fclose(mCompactFP);
+	mCompactFP = NULL;
+
+	if (ok)
 	{
-		memset(buffer, 0, LLVFSFileBlock::SERIAL_SIZE);
+		unlockAndClose(mIndexFP);
+		mIndexFP = NULL;
+#if LL_WINDOWS
+		// rename() won't replace an existing file
+		LLFile::remove(mIndexFilename);
+#endif
+		ok = (LLFile::rename(temp_index, mIndexFilename) == 0);
+		mIndexFP = openAndLock(mIndexFilename, "r+b", FALSE);
 	}
-	else
+
+	if (!ok)
 	{
-		block->serialize(buffer);
+		llwarns << "VFS: Failed to compact index " << mIndexFilename << llendl;
+		LLFile::remove(temp_index);
 	}
+	return ok;
+}
 
-	// If set_index_to_end, file pointer is already at seek_pos
-	// and we don't need to do anything.  Only seek if not at end.
-	if (!set_index_to_end)
+// Apply journal records on top of the index entries already in mFileBlocks.
+// Stops at the first incomplete or corrupt record, which is where a crash
+// interrupted the last write.  Returns the number of records applied.
+S32 LLVFS::replayJournal(const std::string& filename, U32 data_size)
+{
+	LLFILE* fp = LLFile::fopen(filename, "rb");	/* Flawfinder: ignore */
+	if (!fp)
 	{
-		fseek(mIndexFP, seek_pos, SEEK_SET);
+		return 0;
 	}
 
-	if (fwrite(buffer, LLVFSFileBlock::SERIAL_SIZE, 1, mIndexFP) != 1)
+	fseek(fp, 0, SEEK_END);
+	long journal_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	std::vector<U8> buffer(journal_size > 0 ? journal_size : 1);
+	size_t nread = journal_size > 0 ? fread(&buffer[0], 1, journal_size, fp) : 0;
+	fclose(fp);
+
+	S32 records = 0;
+	size_t offset = 0;
+	while (offset + VFS_JOURNAL_RECORD_SIZE <= nread)
 	{
-		llwarns << "Short write" << llendl;
+		U8* record = &buffer[offset];
+
+		LLCRC crc;
+		crc.update(record, LLVFSFileBlock::SERIAL_SIZE);
+		U32 stored_crc = 0;
+		for (S32 i = 0; i < 4; i++)
+		{
+			stored_crc |= (U32)record[LLVFSFileBlock::SERIAL_SIZE + i] << (i * 8);
+		}
+		if (crc.getCRC() != stored_crc)
+		{
+			break;
+		}
+
+		LLVFSFileBlock journal_block;
+		journal_block.deserialize(record, -1);
+
+		fileblock_map::iterator it = mFileBlocks.find(journal_block);
+		if (journal_block.isValidEntry(data_size))
+		{
+			if (it != mFileBlocks.end())
+			{
+				LLVFSFileBlock* block = it->second;
+				block->mLocation = journal_block.mLocation;
+				block->mLength = journal_block.mLength;
+				block->mSize = journal_block.mSize;
+				block->mAccessTime = journal_block.mAccessTime;
+			}
+			else
+			{
+				LLVFSFileBlock* block = new LLVFSFileBlock(journal_block);
+				mFileBlocks.insert(fileblock_map::value_type(*block, block));
+			}
+		}
+		else if (it != mFileBlocks.end())
+		{
+			// removed, or too broken to keep
+			delete it->second;
+			mFileBlocks.erase(it);
+		}
+
+		offset += VFS_JOURNAL_RECORD_SIZE;
+		records++;
 	}
 
-	// *NOTE:  Why was this commented out?
-	// fflush(mIndexFP);
-	
-	return;
+	if (offset < nread)
+	{
+		LL_WARNS("VFS") << "VFS: Discarding " << (S32)(nread - offset) << " bytes of incomplete index journal" << LL_ENDL;
+	}
+	LL_INFOS("VFS") << "VFS: Replayed " << records << " index journal records" << LL_ENDL;
+
+	return records;
 }
 
 // mDataMutex must be LOCKED before calling this
@@ -1546,9 +2284,7 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 	while (! block)
 	{
 		// look for a suitable free block
-		blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(size); // first entry >= size
-		if (iter != mFreeBlocksByLength.end())
-			block = iter->second;
+		block = findBestFit(size);
     	
 		// no large enough free blocks, time to clean out some junk
 		if (! block)
@@ -1591,6 +2327,7 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 				llinfos << "LRU: Removing " << file_block->mFileID << ":" << file_block->mFileType << llendl;
 				lru_list.erase(it);
 				removeFileBlock(file_block);
+				mEvictedFiles++;
 				file_block = NULL;
 				continue;
 			}
@@ -1616,6 +2353,7 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 				cleaned_up += file_block->mLength;
 				lru_list.erase(it++);
 				removeFileBlock(file_block);
+				mEvictedFiles++;
 				file_block = NULL;
 			}
 			//mergeFreeBlocks();
@@ -1645,8 +2383,9 @@ void LLVFS::pokeFiles()
 	
 	// only write data if we actually read 4 bytes
 	// otherwise we're writing garbage and screwing up the file
+	// (a mapped data file is already paged in on demand)
 	fseek(mDataFP, 0, SEEK_SET);
-	if (fread(&word, sizeof(word), 1, mDataFP) == 1)
+	if (!mDataMap && fread(&word, sizeof(word), 1, mDataFP) == 1)
 	{
 		fseek(mDataFP, 0, SEEK_SET);
 		if (fwrite(&word, sizeof(word), 1, mDataFP) != 1)
@@ -1694,6 +2433,9 @@ void LLVFS::audit()
 {
 	// Lock the mutex through this whole function.
 	LLMutexLock lock_data(mDataMutex);
+
+	// The index file only matches memory once the journal is folded in.
+	compactIndex();
 	
 	fflush(mIndexFP);
 
@@ -1843,16 +2585,6 @@ void LLVFS::checkMem()
 		llassert(block->mFileType >= LLAssetType::AT_NONE &&
 				 block->mFileType < LLAssetType::AT_COUNT &&
 				 block->mFileID != LLUUID::null);
-    
-		for (std::deque<S32>::iterator iter = mIndexHoles.begin();
-			 iter != mIndexHoles.end(); ++iter)
-		{
-			S32 index_loc = *iter;
-			if (index_loc == block->mIndexLocation)
-			{
-				llwarns << "VFile block " << block->mFileID << ":" << block->mFileType << " is marked as a hole" << llendl;
-			}
-		}
 	}
     
 	llinfos << "VFS: mem check OK" << llendl;
@@ -1960,7 +2692,15 @@ void LLVFS::dumpStatistics()
 	llinfos << "Invalid blocks: " << invalid_file_count << llendl;
 	llinfos << "File blocks:    " << mFileBlocks.size() << llendl;
 
-	S32 length_list_count = (S32)mFreeBlocksByLength.size();
+	S32 length_list_count = 0;
+	for (S32 i = 0; i < VFS_FREE_CLASS_COUNT; i++)
+	{
+		if (mFreeBlocksByClass[i].size())
+		{
+			llinfos << "Free class " << (1 << i) << "+ bytes count " << mFreeBlocksByClass[i].size() << llendl;
+		}
+		length_list_count += (S32)mFreeBlocksByClass[i].size();
+	}
 	S32 location_list_count = (S32)mFreeBlocksByLocation.size();
 	if (length_list_count == location_list_count)
 	{
@@ -1978,6 +2718,9 @@ void LLVFS::dumpStatistics()
 	llinfos << "Total free size: " << total_free_size/1024 << "K" << llendl;
 	llinfos << "Sum: " << (total_file_size + total_free_size) << " bytes" << llendl;
 	llinfos << llformat("%.0f%% full",((F32)(total_file_size)/(F32)(total_file_size+total_free_size))*100.f) << llendl;
+	llinfos << llformat("%.0f%% fragmented", getFragmentation()*100.f) << llendl;
+	llinfos << "Defragmented: " << mDefragBytes/1024 << "K" << llendl;
+	llinfos << "LRU evictions: " << mEvictedFiles << llendl;
 
 	llinfos << " " << llendl;
 	for (std::map<LLAssetType::EType, std::pair<S32,S32> >::iterator iter = filetype_counts.begin();
@@ -2008,6 +2751,139 @@ void LLVFS::dumpStatistics()
 	unlockData();
 }
 
+LLSD LLVFS::getStatistics()
+{
+	LLMutexLock lock_data(mDataMutex);
+
+	S32 file_bytes = 0;
+	S32 used_bytes = 0;
+	for (fileblock_location_map_t::iterator it = mFileBlocksByLocation.begin();
+		 it != mFileBlocksByLocation.end(); ++it)
+	{
+		file_bytes += it->second->mLength;
+		used_bytes += it->second->mSize;
+	}
+	S32 total_bytes = file_bytes + mFreeBytes;
+
+	LLSD stats;
+	stats["files"] = (S32)mFileBlocksByLocation.size();
+	stats["file_bytes"] = file_bytes;
+	stats["used_bytes"] = used_bytes;
+	stats["free_bytes"] = mFreeBytes;
+	stats["free_blocks"] = (S32)mFreeBlocksByLocation.size();
+	stats["largest_free"] = getLargestFreeBlock();
+	stats["fragmentation"] = getFragmentation();
+	stats["utilization"] = total_bytes ? (F32)file_bytes / (F32)total_bytes : 0.f;
+	stats["defrag_bytes"] = mDefragBytes;
+	stats["evicted_files"] = mEvictedFiles;
+	return stats;
+}
+
+S32 LLVFS::defragment(S32 max_bytes)
+{
+	if (!isValid() || mReadOnly)
+	{
+		return 0;
+	}
+
+	LLMutexLock lock_data(mDataMutex);
+
+	S32 moved = 0;
+	S32 candidates = 0;
+	U32 cursor = U32_MAX;
+	while (moved < max_bytes &&
+		   candidates++ < VFS_DEFRAG_MAX_CANDIDATES &&
+		   getFragmentation() >= VFS_DEFRAG_MIN_FRAGMENTATION)
+	{
+		// next file down from the end of the data file
+		fileblock_location_map_t::iterator it = mFileBlocksByLocation.lower_bound(cursor);
+		if (it == mFileBlocksByLocation.begin())
+		{
+			break;
+		}
+		--it;
+		LLVFSFileBlock* block = it->second;
+		cursor = block->mLocation;
+
+		if (block->mLocks[VFSLOCK_READ] ||
+			block->mLocks[VFSLOCK_APPEND] ||
+			block->mLocks[VFSLOCK_OPEN] ||
+			block->mSize > max_bytes - moved)
+		{
+			continue;
+		}
+
+		// lowest free block below it that can hold it
+		LLVFSBlock* free_block = NULL;
+		S32 scanned = 0;
+		for (blocks_location_map_t::iterator iter = mFreeBlocksByLocation.begin();
+			 iter != mFreeBlocksByLocation.end() && iter->first < block->mLocation && scanned < VFS_DEFRAG_MAX_SCAN;
+			 ++iter, ++scanned)
+		{
+			if (iter->second->mLength >= block->mLength)
+			{
+				free_block = iter->second;
+				break;
+			}
+		}
+
+		if (free_block)
+		{
+			moved += block->mSize;
+			moveFileBlock(block, free_block);
+		}
+	}
+
+	mDefragBytes += moved;
+	return moved;
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::moveFileBlock(LLVFSFileBlock *block, LLVFSBlock *free_block)
+{
+	U32 old_location = block->mLocation;
+	U32 new_location = free_block->mLocation;
+
+	// Must call useFreeSpace before addFreeBlock, so the old and new
+	// locations can't merge.
+	useFreeSpace(free_block, block->mLength);	// takes ownership (and may delete) free_block
+
+	if (block->mSize > 0)
+	{
+		// readers of this file may still be copying out of the old location
+		LLMutexLock lock_file(getFileMutex(*block));
+		if (mDataMap)
+		{
+			memcpy(mDataMap + new_location, mDataMap + old_location, block->mSize); /* Flawfinder: ignore */
+		}
+		else
+		{
+			U8 *buffer = new U8[block->mSize];
+			fseek(mDataFP, old_location, SEEK_SET);
+			if (fread(buffer, block->mSize, 1, mDataFP) == 1)
+			{
+				fseek(mDataFP, new_location, SEEK_SET);
+				if (fwrite(buffer, block->mSize, 1, mDataFP) != 1)
+				{
+					llwarns << "Short write" << llendl;
+				}
+			}
+			else
+			{
+				llwarns << "Short read" << llendl;
+			}
+			delete[] buffer;
+		}
+	}
+
+	mFileBlocksByLocation.erase(old_location);
+	releaseFileSpace(new LLVFSBlock(old_location, block->mLength));
+	block->mLocation = new_location;
+	mFileBlocksByLocation[new_location] = block;
+
+	sync(block);
+}
+
 // Debug Only!
 std::string get_extension(LLAssetType::EType type)
 {
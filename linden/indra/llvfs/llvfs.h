@@ -33,11 +33,14 @@
 #ifndef LL_LLVFS_H
 #define LL_LLVFS_H
 
-#include <deque>
+#include <set>
+#include <vector>
 #include "lluuid.h"
 #include "linked_lists.h"
 #include "llassettype.h"
+#include "llsd.h"
 #include "llthread.h"
+#include "lltimer.h"
 
 enum EVFSValid 
 {
@@ -59,9 +62,24 @@ enum EVFSLock
 	VFSLOCK_COUNT = 3
 };
 
+// Number of striped locks guarding file contents when the data file is
+// memory mapped.  Files hash onto a stripe by ID, so readers and writers
+// of different files only contend on the short index lookup.
+const S32 VFS_DATA_LOCK_STRIPES = 32;
+
+// Free blocks are kept in segregated lists, one per power of two of length.
+const S32 VFS_FREE_CLASS_COUNT = 32;
+
 // internal classes
 class LLVFSBlock;
 class LLVFSFileBlock;
+
+// Orders free blocks by length, then by location, so the first block of a
+// size class that fits is the best fit with the lowest address.
+struct LLVFSBlock_length_less
+{
+	bool operator()(const LLVFSBlock* lhs, const LLVFSBlock* rhs) const;
+};
 class LLVFSFileSpecifier
 {
 public:
@@ -79,11 +97,13 @@ class LLVFS
 {
 public:
 	// Pass 0 to not presize
-	LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash);
+	// Pass use_mapped_data to memory map the data file
+	LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash, const BOOL use_mapped_data = FALSE);
 	~LLVFS();
 
 	BOOL isValid() const			{ return (VFSVALID_OK == mValid); }
 	EVFSValid getValidState() const	{ return mValid; }
+	BOOL isDataMapped() const		{ return (mDataMap != NULL); }
 
 	// ---------- The following fucntions lock/unlock mDataMutex ----------
 	BOOL getExists(const LLUUID &file_id, const LLAssetType::EType file_type);
@@ -121,19 +141,62 @@ public:
 	void listFiles();
 	void dumpFiles();
 
+	// Space usage summary: file and free bytes, free block count, largest
+	// free block, fragmentation (0 when all free space is one block),
+	// utilization, defragmentation and eviction totals.
+	LLSD getStatistics();
+
+	// Idle-time defragmentation.  Moves unlocked files from the end of the
+	// data file into the lowest free blocks that hold them, copying at most
+	// max_bytes.  Files larger than what is left of max_bytes are skipped.
+	// Returns the number of bytes moved.
+	S32 defragment(S32 max_bytes);
+
 protected:
 	void removeFileBlock(LLVFSFileBlock *fileblock);
 	
 	void eraseBlockLength(LLVFSBlock *block);
+	void insertBlockLength(LLVFSBlock *block);
 	void eraseBlock(LLVFSBlock *block);
 	void addFreeBlock(LLVFSBlock *block);
+	// Best fit from the size class lists, NULL if nothing is big enough.
+	LLVFSBlock *findBestFit(S32 size);
+	static S32 getFreeClass(S32 length);
+	S32 getLargestFreeBlock();
+	// mFreeBytes versus the largest free block, 0.0 to 1.0
+	F32 getFragmentation();
+	// Move a file's contents into part of free_block (takes ownership).
+	void moveFileBlock(LLVFSFileBlock *block, LLVFSBlock *free_block);
 	//void mergeFreeBlocks();
 	void useFreeSpace(LLVFSBlock *free_block, S32 length);
+	// Returns file space to the free lists, useFreeSpace() flushes the
+	// journal before handing it out again.
+	void releaseFileSpace(LLVFSBlock *free_block);
 	void sync(LLVFSFileBlock *block, BOOL remove = FALSE);
 	void presizeDataFile(const U32 size);
 
+	// Index changes are appended to a journal next to the index file and
+	// folded back into the index by a compaction, so a crash only loses
+	// records that were never flushed.  startCompaction() sets the journal
+	// aside and each later record writes another chunk of the new index,
+	// compactIndex() does the whole thing at once.
+	void appendJournal(const LLVFSFileSpecifier& spec, LLVFSFileBlock* block);
+	void flushJournal();
+	void compactIndex();
+	void startCompaction();
+	void continueCompaction();
+	BOOL writeCompactChunk(S32 max_entries);
+	BOOL finishCompaction();
+	S32 replayJournal(const std::string& filename, U32 data_size);
+
 	static LLFILE *openAndLock(const std::string& filename, const char* mode, BOOL read_lock);
 	static void unlockAndClose(FILE *fp);
+
+	// Map/unmap the whole data file.  mapDataFile() grows the file to
+	// map_size if needed and returns FALSE (leaving stdio access in place)
+	// on failure.
+	BOOL mapDataFile(U32 map_size);
+	void unmapDataFile();
 	
 	// Can initiate LRU-based file removal to make space.
 	// The immune file block will not be removed.
@@ -142,6 +205,12 @@ protected:
 	// lock/unlock data mutex (mDataMutex)
 	void lockData() { mDataMutex->lock(); }
 	void unlockData() { mDataMutex->unlock(); }	
+
+	// Lock/unlock the contents of a single file in the mapped data file.
+	// Lock order is mDataMutex first, then a stripe.  A thread may only hold
+	// more than one stripe while it also holds mDataMutex.
+	LLMutex* getFileMutex(const LLVFSFileSpecifier& spec) const
+		{ return mFileMutexes[(spec.mFileID.getCRC32() + (U32)spec.mFileType) % VFS_DATA_LOCK_STRIPES]; }
 	
 protected:
 	LLMutex* mDataMutex;
@@ -149,18 +218,42 @@ protected:
 	typedef std::map<LLVFSFileSpecifier, LLVFSFileBlock*> fileblock_map;
 	fileblock_map mFileBlocks;
 
-	typedef std::multimap<S32, LLVFSBlock*>	blocks_length_map_t;
-	blocks_length_map_t 	mFreeBlocksByLength;
+	// Live files (mLength > 0) by data file location
+	typedef std::map<U32, LLVFSFileBlock*> fileblock_location_map_t;
+	fileblock_location_map_t mFileBlocksByLocation;
+
+	typedef std::set<LLVFSBlock*, LLVFSBlock_length_less> blocks_length_set_t;
+	blocks_length_set_t 	mFreeBlocksByClass[VFS_FREE_CLASS_COUNT];
+	U32						mFreeClassMask;	// bit set for each non-empty class
+	S32						mFreeBytes;
 	typedef std::multimap<U32, LLVFSBlock*>	blocks_location_map_t;
 	blocks_location_map_t 	mFreeBlocksByLocation;
 
+	S32 mDefragBytes;	// total bytes moved by defragment()
+	S32 mEvictedFiles;	// files removed by LRU to make space
+
+	LLMutex* mFileMutexes[VFS_DATA_LOCK_STRIPES];
+
 	LLFILE *mDataFP;
 	LLFILE *mIndexFP;
+	LLFILE *mJournalFP;
+
+	U8* mDataMap;		// NULL unless the data file is memory mapped
+	U32 mDataMapSize;
+
+	std::vector<U8> mJournalBuffer;	// records not yet written to mJournalFP
+	S32 mJournalRecords;			// records since the last compaction
+	LLTimer mJournalFlushTimer;
+	BOOL mJournalFreedSpace;		// mJournalBuffer may release file space
 
-	std::deque<S32> mIndexHoles;
+	LLFILE *mCompactFP;				// new index being written, NULL when not compacting
+	LLVFSFileSpecifier mCompactNext;	// first entry not yet in the new index
+	S32 mCompactIndexLocation;
 
 	std::string mIndexFilename;
 	std::string mDataFilename;
+	std::string mJournalFilename;
+	std::string mOldJournalFilename;	// journal being folded into the new index
 	BOOL mReadOnly;
 
 	EVFSValid mValid;
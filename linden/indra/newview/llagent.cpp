@@ -112,6 +112,7 @@
 #include "llui.h"			// for make_ui_sound
 #include "llurldispatcher.h"
 #include "llviewercamera.h"
+#include "llviewerimagelist.h"
 #include "llviewerinventory.h"
 #include "llviewermenu.h"
 #include "llviewernetwork.h"
@@ -906,6 +907,15 @@ void LLAgent::setRegion(LLViewerRegion *regionp)
 		std::string ip = regionp->getHost().getString();
 		llinfos << "Moving agent into region: " << regionp->getName()
 				<< " located at " << ip << llendl;
+
+		// Remember what was resident in the region we are leaving and
+		// start loading what was resident here last time
+		if (mRegionp)
+		{
+			gImageList.recordRegionImages(mRegionp->getHandle());
+		}
+		gImageList.prefetchRegionImages(regionp->getHandle());
+
 		if (mRegionp)
 		{
 			// We've changed regions, we're now going to change our agent coordinate frame.
@@ -55,6 +55,7 @@
 #include "llviewerjoystick.h"
 #include "llfloaterjoystick.h"
 #include "llares.h" 
+#include "llbuffer.h"
 #include "llcurl.h"
 #include "llfloatersnapshot.h"
 #include "lltexturestats.h"
@@ -91,9 +92,13 @@
 #include "llviewerkeyboard.h"
 #include "lllfsthread.h"
 #include "llworkerthread.h"
+#include "llthreadpool.h"
 #include "lltexturecache.h"
 #include "lltexturefetch.h"
 #include "llimageworker.h"
+#include "lllayerdecodethread.h"
+#include "llbatchthread.h"
+#include "llvolumegeneratethread.h"
 
 // The files below handle dependencies from cleanup.
 #include "llkeyframemotion.h"
@@ -539,7 +544,12 @@ const std::string LLAppViewer::sCrashSettingsName = "CrashSettings";
 
 LLTextureCache* LLAppViewer::sTextureCache = NULL; 
 LLImageDecodeThread* LLAppViewer::sImageDecodeThread = NULL; 
+LLLayerDecodeThread* LLAppViewer::sLayerDecodeThread = NULL;
+LLBatchThread* LLAppViewer::sCullThread = NULL;
+LLBatchThread* LLAppViewer::sGeometryThread = NULL;
+LLVolumeGenerateThread* LLAppViewer::sVolumeThread = NULL;
 LLTextureFetch* LLAppViewer::sTextureFetch = NULL; 
+LLThreadPool* LLAppViewer::sWorkerThreadPool = NULL;
 
 LLAppViewer::LLAppViewer() : 
 	mMarkerFile(),
@@ -597,9 +607,21 @@ bool LLAppViewer::init()
     if (!initConfiguration())
 		return false;
 
+    // Network buffers are shared with the curl thread, so set up the
+    // pool before threads are created too.
+    if (gSavedSettings.getS32("IOBufferPoolSlabs") > 0)
+    {
+        LLHeapBuffer::initClass(gSavedSettings.getS32("IOBufferPoolSlabs"));
+    }
+
     // *NOTE:Mani - LLCurl::initClass is not thread safe. 
     // Called before threads are created.
     LLCurl::initClass();
+    if (gSavedSettings.getBOOL("CurlThread"))
+    {
+        LLCurl::startThread(gSavedSettings.getU32("CurlCompletionQueueSize"),
+                            gSavedSettings.getS32("CurlCallbacksPerFrame"));
+    }
 
     initThreads();
 
@@ -899,6 +921,7 @@ bool LLAppViewer::mainLoop()
 
 	// Create IO Pump to use for HTTP Requests.
 	gServicePump = new LLPumpIO(gAPRPoolp);
+	gServicePump->setUseEpoll(gSavedSettings.getBOOL("IOPumpUseEpoll"));
 	LLHTTPClient::setPump(*gServicePump);
 	LLCurl::setCAFile(gDirUtilp->getCAFile());
 	
@@ -1090,6 +1113,13 @@ bool LLAppViewer::mainLoop()
 						break;
 					}
 				}
+
+				// Use quiet frames to pull the local file cache back together.
+				U32 defrag_bytes = gSavedSettings.getU32("VFSIdleDefragBytes");
+				if (defrag_bytes && gVFS && LLVFile::getVFSThread()->getPending() == 0)
+				{
+					gVFS->defragment((S32)defrag_bytes);
+				}
 				if ((LLStartUp::getStartupState() >= STATE_CLEANUP) &&
 					(frameTimer.getElapsedTimeF64() > FRAME_STALL_THRESHOLD))
 				{
@@ -1361,6 +1391,7 @@ bool LLAppViewer::cleanup()
 #endif
 
 	LLVolumeMgr* volume_manager = LLPrimitive::getVolumeManager();
+	volume_manager->dump();
 	if (!volume_manager->cleanup())
 	{
 		llwarns << "Remaining references in the volume manager!" << llendflush;
@@ -1473,12 +1504,26 @@ bool LLAppViewer::cleanup()
 	sTextureCache->shutdown();
 	sTextureFetch->shutdown();
 	sImageDecodeThread->shutdown();
+	sLayerDecodeThread->shutdown();
+	sCullThread->shutdown();
+	sGeometryThread->shutdown();
+	sVolumeThread->shutdown();
 	delete sTextureCache;
     sTextureCache = NULL;
 	delete sTextureFetch;
     sTextureFetch = NULL;
 	delete sImageDecodeThread;
     sImageDecodeThread = NULL;
+	delete sLayerDecodeThread;
+	sLayerDecodeThread = NULL;
+	delete sCullThread;
+	sCullThread = NULL;
+	delete sGeometryThread;
+	sGeometryThread = NULL;
+	delete sVolumeThread;
+	sVolumeThread = NULL;
+	delete sWorkerThreadPool; // after every queue using it
+	sWorkerThreadPool = NULL;
 
 	gSavedSettings.cleanup();//do this after last time gSavedSettings is used  *surprise*
 
@@ -1518,6 +1563,8 @@ bool LLAppViewer::cleanup()
 	LLCurl::cleanupClass();
 	llinfos << "LLCurl cleaned up." << llendflush;
 
+	LLHeapBuffer::cleanupClass();
+
 	// If we're exiting to launch an URL, do that here so the screen
 	// is at the right resolution before we launch IE.
 	if (!gLaunchFileOnQuit.empty())
@@ -1579,10 +1626,35 @@ bool LLAppViewer::initThreads()
 	LLVFSThread::initClass(enable_threads && false);
 	LLLFSThread::initClass(enable_threads && false);
 
+	// Texture cache I/O and image decoding can share a pool of threads (off by default)
+	S32 pool_size = gSavedSettings.getS32("WorkerThreadPoolSize");
+	if (pool_size == 0)
+	{
+		pool_size = llmax(LLThreadPool::getProcessorCount() - 1, 1);
+	}
+	if (enable_threads && pool_size > 0)
+	{
+		LLAppViewer::sWorkerThreadPool = new LLThreadPool("WorkerPool", pool_size);
+	}
+
 	// Image decoding
-	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && true);
-	LLAppViewer::sTextureCache = new LLTextureCache(enable_threads && true);
+	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && true, sWorkerThreadPool);
+	LLAppViewer::sTextureCache = new LLTextureCache(enable_threads && true, sWorkerThreadPool);
 	LLAppViewer::sTextureFetch = new LLTextureFetch(LLAppViewer::getTextureCache(), sImageDecodeThread, enable_threads && true);
+	// Terrain LayerData decoding
+	LLAppViewer::sLayerDecodeThread = new LLLayerDecodeThread(enable_threads && true, sWorkerThreadPool);
+	// Parallel octree culling, the main thread takes jobs too
+	LLAppViewer::sCullThread = new LLBatchThread("cull", enable_threads && true, sWorkerThreadPool);
+	// Volume vertex writes for mesh rebuilds
+	LLAppViewer::sGeometryThread = new LLBatchThread("geometry", enable_threads && true, sWorkerThreadPool);
+	// Volume LODs generated ahead of LOD changes, and a cache of released ones
+	LLAppViewer::sVolumeThread = new LLVolumeGenerateThread(enable_threads && true, sWorkerThreadPool);
+	LLVolumeMgr* volume_manager = LLPrimitive::getVolumeManager();
+	volume_manager->setCacheSize(gSavedSettings.getS32("RenderVolumeCacheSize") * 1024);
+	if (gSavedSettings.getBOOL("RenderAsyncVolumeLOD"))
+	{
+		volume_manager->setGenerateThread(sVolumeThread);
+	}
 	LLImage::initClass(gSavedSettings.getBOOL("UseKDUIfAvailable"));
 
 	// *FIX: no error handling here!
@@ -2970,7 +3042,8 @@ bool LLAppViewer::initCache()
 	const S64 MAX_CACHE_SIZE = 1024*MB;
 	cache_size = llmin(cache_size, MAX_CACHE_SIZE);
 	S64 texture_cache_size = ((cache_size * 8)/10);
-	S64 extra = LLAppViewer::getTextureCache()->initCache(LL_PATH_CACHE, texture_cache_size, read_only);
+	BOOL use_slabs = gSavedSettings.getBOOL("TextureCacheUseSlabs");
+	S64 extra = LLAppViewer::getTextureCache()->initCache(LL_PATH_CACHE, texture_cache_size, read_only, use_slabs);
 	texture_cache_size -= extra;
 
 	LLSplashScreen::update("Initializing VFS...");
@@ -3098,15 +3171,17 @@ bool LLAppViewer::initCache()
 	// Startup the VFS...
 	gSavedSettings.setU32("VFSSalt", new_salt);
 
+	BOOL use_mapped_vfs = gSavedSettings.getBOOL("VFSUseMappedData");
+
 	// Don't remove VFS after viewer crashes.  If user has corrupt data, they can reinstall. JC
-	gVFS = new LLVFS(new_vfs_index_file, new_vfs_data_file, false, vfs_size_u32, false);
+	gVFS = new LLVFS(new_vfs_index_file, new_vfs_data_file, false, vfs_size_u32, false, use_mapped_vfs);
 	if( VFSVALID_BAD_CORRUPT == gVFS->getValidState() )
 	{
 		// Try again with fresh files 
 		// (The constructor deletes corrupt files when it finds them.)
 		LL_WARNS("AppCache") << "VFS corrupt, deleted.  Making new VFS." << LL_ENDL;
 		delete gVFS;
-		gVFS = new LLVFS(new_vfs_index_file, new_vfs_data_file, false, vfs_size_u32, false);
+		gVFS = new LLVFS(new_vfs_index_file, new_vfs_data_file, false, vfs_size_u32, false, use_mapped_vfs);
 	}
 
 	gStaticVFS = new LLVFS(static_vfs_index_file, static_vfs_data_file, true, 0, false);
@@ -4058,6 +4133,12 @@ void LLAppViewer::disconnectViewer()
 
 	saveNameCache();
 
+	// Record the textures of the region we are leaving, saved with the image list
+	if (gAgent.getRegion())
+	{
+		gImageList.recordRegionImages(gAgent.getRegion()->getHandle());
+	}
+
 	// close inventory interface, close all windows
 	LLInventoryView::cleanup();
 	// Don't cleanup menus on disconnect in order to avoid crashes -- MC
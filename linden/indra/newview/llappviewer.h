@@ -35,7 +35,11 @@
 
 class LLTextureCache;
 class LLImageDecodeThread;
+class LLLayerDecodeThread;
+class LLBatchThread;
+class LLVolumeGenerateThread;
 class LLTextureFetch;
+class LLThreadPool;
 class LLWatchdogTimeout;
 class LLCommandLineParser;
 
@@ -92,6 +96,10 @@ public:
 	// Thread accessors
 	static LLTextureCache* getTextureCache() { return sTextureCache; }
 	static LLImageDecodeThread* getImageDecodeThread() { return sImageDecodeThread; }
+	static LLLayerDecodeThread* getLayerDecodeThread() { return sLayerDecodeThread; }
+	static LLBatchThread* getCullThread() { return sCullThread; }
+	static LLBatchThread* getGeometryThread() { return sGeometryThread; }
+	static LLVolumeGenerateThread* getVolumeThread() { return sVolumeThread; }
 	static LLTextureFetch* getTextureFetch() { return sTextureFetch; }
 
 	const std::string& getSerialNumber() { return mSerialNumber; }
@@ -214,7 +222,12 @@ private:
 	// Thread objects.
 	static LLTextureCache* sTextureCache; 
 	static LLImageDecodeThread* sImageDecodeThread; 
+	static LLLayerDecodeThread* sLayerDecodeThread;
+	static LLBatchThread* sCullThread;
+	static LLBatchThread* sGeometryThread;
+	static LLVolumeGenerateThread* sVolumeThread;
 	static LLTextureFetch* sTextureFetch;
+	static LLThreadPool* sWorkerThreadPool;
 
 	S32 mNumSessions;
 
@@ -38,6 +38,7 @@
 
 #include "llviewercontrol.h"
 #include "llvolume.h"
+#include "llvolumefacefill.h"
 #include "m3math.h"
 #include "v3color.h"
 
@@ -61,43 +62,10 @@ BOOL LLFace::sSafeRenderSelect = TRUE; // FALSE
 #define DOTVEC(a,b) (a.mV[0]*b.mV[0] + a.mV[1]*b.mV[1] + a.mV[2]*b.mV[2])
 
 
-/*
-For each vertex, given:
-	B - binormal
-	T - tangent
-	N - normal
-	P - position
-
-The resulting texture coordinate <u,v> is:
-
-	u = 2(B dot P)
-	v = 2(T dot P)
-*/
 void planarProjection(LLVector2 &tc, const LLVector3& normal,
 					  const LLVector3 &mCenter, const LLVector3& vec)
-{	//DONE!
-	LLVector3 binormal;
-	float d = normal * LLVector3(1,0,0);
-	if (d >= 0.5f || d <= -0.5f)
-	{
-		binormal = LLVector3(0,1,0);
-		if (normal.mV[0] < 0)
-		{
-			binormal = -binormal;
-		}
-	}
-	else
-	{
-        binormal = LLVector3(1,0,0);
-		if (normal.mV[1] > 0)
-		{
-			binormal = -binormal;
-		}
-	}
-	LLVector3 tangent = binormal % normal;
-
-	tc.mV[1] = -((tangent*vec)*2 - 0.5f);
-	tc.mV[0] = 1.0f+((binormal*vec)*2 - 0.5f);
+{
+	LLVolumeFaceFill::planarProjection(tc, normal, vec);
 }
 
 void sphericalProjection(LLVector2 &tc, const LLVector3& normal,
@@ -613,29 +581,7 @@ void LLFace::printDebugInfo() const
 // Transform the texture coordinates for this face.
 static void xform(LLVector2 &tex_coord, F32 cosAng, F32 sinAng, F32 offS, F32 offT, F32 magS, F32 magT)
 {
-	// New, good way
-	F32 s = tex_coord.mV[0];
-	F32 t = tex_coord.mV[1];
-
-	// Texture transforms are done about the center of the face.
-	s -= 0.5; 
-	t -= 0.5;
-
-	// Handle rotation
-	F32 temp = s;
-	s  = s     * cosAng + t * sinAng;
-	t  = -temp * sinAng + t * cosAng;
-
-	// Then scale
-	s *= magS;
-	t *= magT;
-
-	// Then offset
-	s += offS + 0.5f; 
-	t += offT + 0.5f;
-
-	tex_coord.mV[0] = s;
-	tex_coord.mV[1] = t;
+	LLVolumeFaceFill::transformTexCoord(tex_coord, cosAng, sinAng, offS, offT, magS, magT);
 }
 
 
@@ -900,6 +846,21 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 							   const S32 &f,
 								const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
 								const U16 &index_offset)
+{
+	LLVolumeFaceFill fill;
+	if (!prepareGeometryVolume(volume, f, mat_vert, mat_normal, index_offset, fill))
+	{
+		return FALSE;
+	}
+	fill.fill();
+	return TRUE;
+}
+
+BOOL LLFace::prepareGeometryVolume(const LLVolume& volume,
+								   const S32 &f,
+								   const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+								   const U16 &index_offset,
+								   LLVolumeFaceFill& fill)
 {
 	const LLVolumeFace &vf = volume.getVolumeFace(f);
 	S32 num_vertices = (S32)vf.mVertices.size();
@@ -920,13 +881,10 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		}
 	}
 
-	LLStrider<LLVector3> vertices;
-	LLStrider<LLVector2> tex_coords;
-	LLStrider<LLVector2> tex_coords2;
-	LLStrider<LLVector3> normals;
-	LLStrider<LLColor4U> colors;
-	LLStrider<LLVector3> binormals;
-	LLStrider<U16> indicesp;
+	fill.mFace = &vf;
+	fill.mVertexMatrix = mat_vert;
+	fill.mNormalMatrix = mat_normal;
+	fill.mIndexOffset = index_offset;
 
 	BOOL full_rebuild = mDrawablep->isState(LLDrawable::REBUILD_VOLUME);
 	
@@ -952,28 +910,28 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 
 	if (rebuild_pos)
 	{
-		mVertexBuffer->getVertexStrider(vertices, mGeomIndex);
+		mVertexBuffer->getVertexStrider(fill.mVertices, mGeomIndex);
 	}
 	if (rebuild_normal)
 	{
-		mVertexBuffer->getNormalStrider(normals, mGeomIndex);
+		mVertexBuffer->getNormalStrider(fill.mNormals, mGeomIndex);
 	}
 	if (rebuild_binormal)
 	{
-		mVertexBuffer->getBinormalStrider(binormals, mGeomIndex);
+		mVertexBuffer->getBinormalStrider(fill.mBinormals, mGeomIndex);
 	}
 
 	if (rebuild_tcoord)
 	{
-		mVertexBuffer->getTexCoord0Strider(tex_coords, mGeomIndex);
+		mVertexBuffer->getTexCoord0Strider(fill.mTexCoords, mGeomIndex);
 		if (bump_code && mVertexBuffer->hasDataType(LLVertexBuffer::TYPE_TEXCOORD1))
 		{
-			mVertexBuffer->getTexCoord1Strider(tex_coords2, mGeomIndex);
+			mVertexBuffer->getTexCoord1Strider(fill.mBumpTexCoords, mGeomIndex);
 		}
 	}
 	if (rebuild_color)
 	{	
-		mVertexBuffer->getColorStrider(colors, mGeomIndex);
+		mVertexBuffer->getColorStrider(fill.mColors, mGeomIndex);
 	}
 
 	F32 r = 0, os = 0, ot = 0, ms = 0, mt = 0, cos_ang = 0, sin_ang = 0;
@@ -981,8 +939,6 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 	BOOL is_static = mDrawablep->isStatic();
 	BOOL is_global = is_static;
 
-	LLVector3 center_sum(0.f, 0.f, 0.f);
-	
 	if (is_global)
 	{
 		setState(GLOBAL);
@@ -992,10 +948,6 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		clearState(GLOBAL);
 	}
 
-	LLVector2 tmin, tmax;
-	
-	
-
 	if (rebuild_tcoord)
 	{
 		if (tep)
@@ -1062,27 +1014,23 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			color.mV[3] = U8 (alpha[tep->getShiny()] * 255);
 		}
 	}
+	fill.mColor = color;
 
     // INDICES
 	if (full_rebuild)
 	{
-		mVertexBuffer->getIndexStrider(indicesp, mIndicesIndex);
-		for (U16 i = 0; i < num_indices; i++)
-		{
-			*indicesp++ = vf.mIndices[i] + index_offset;
-		}
+		mVertexBuffer->getIndexStrider(fill.mIndices, mIndicesIndex);
 	}
 	
-	
 	//bump setup
 	LLVector3 binormal_dir( -sin_ang, cos_ang, 0 );
 	LLVector3 bump_s_primary_light_ray;
 	LLVector3 bump_t_primary_light_ray;
 
-	LLQuaternion bump_quat;
 	if (mDrawablep->isActive())
 	{
-		bump_quat = LLQuaternion(mDrawablep->getRenderMatrix());
+		fill.mRotateBinormal = TRUE;
+		fill.mBinormalRotation = LLQuaternion(mDrawablep->getRenderMatrix());
 	}
 	
 	if (bump_code)
@@ -1132,6 +1080,9 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		bump_s_primary_light_ray = offset_multiple * s_scale * primary_light_ray;
 		bump_t_primary_light_ray = offset_multiple * t_scale * primary_light_ray;
 	}
+	fill.mBinormalDir = binormal_dir;
+	fill.mBumpS = bump_s_primary_light_ray;
+	fill.mBumpT = bump_t_primary_light_ray;
 		
 	U8 texgen = getTextureEntry()->getTexGen();
 	if (rebuild_tcoord && texgen != LLTextureEntry::TEX_GEN_DEFAULT)
@@ -1139,94 +1090,17 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		mVObjp->getVolume()->genBinormals(f);
 	}
 
-	for (S32 i = 0; i < num_vertices; i++)
-	{
-		if (rebuild_tcoord)
-		{
-			LLVector2 tc = vf.mVertices[i].mTexCoord;
-		
-			if (texgen != LLTextureEntry::TEX_GEN_DEFAULT)
-			{
-				LLVector3 vec = vf.mVertices[i].mPosition; 
-			
-				vec.scaleVec(scale);
-
-				switch (texgen)
-				{
-					case LLTextureEntry::TEX_GEN_PLANAR:
-						planarProjection(tc, vf.mVertices[i].mNormal, vf.mCenter, vec);
-						break;
-					case LLTextureEntry::TEX_GEN_SPHERICAL:
-						sphericalProjection(tc, vf.mVertices[i].mNormal, vf.mCenter, vec);
-						break;
-					case LLTextureEntry::TEX_GEN_CYLINDRICAL:
-						cylindricalProjection(tc, vf.mVertices[i].mNormal, vf.mCenter, vec);
-						break;
-					default:
-						break;
-				}		
-			}
-
-			if (tex_mode && mTextureMatrix)
-			{
-				LLVector3 tmp(tc.mV[0], tc.mV[1], 0.f);
-				tmp = tmp * *mTextureMatrix;
-				tc.mV[0] = tmp.mV[0];
-				tc.mV[1] = tmp.mV[1];
-			}
-			else
-			{
-				xform(tc, cos_ang, sin_ang, os, ot, ms, mt);
-			}
-
-			*tex_coords++ = tc;
-		
-			if (bump_code && mVertexBuffer->hasDataType(LLVertexBuffer::TYPE_TEXCOORD1))
-			{
-				LLVector3 tangent = vf.mVertices[i].mBinormal % vf.mVertices[i].mNormal;
-
-				LLMatrix3 tangent_to_object;
-				tangent_to_object.setRows(tangent, vf.mVertices[i].mBinormal, vf.mVertices[i].mNormal);
-				LLVector3 binormal = binormal_dir * tangent_to_object;
-				binormal = binormal * mat_normal;
-				
-				if (mDrawablep->isActive())
-				{
-					binormal *= bump_quat;
-				}
-
-				binormal.normVec();
-				tc += LLVector2( bump_s_primary_light_ray * tangent, bump_t_primary_light_ray * binormal );
-				
-				*tex_coords2++ = tc;
-			}	
-		}
-			
-		if (rebuild_pos)
-		{
-			*vertices++ = vf.mVertices[i].mPosition * mat_vert;
-		}
-		
-		if (rebuild_normal)
-		{
-			LLVector3 normal = vf.mVertices[i].mNormal * mat_normal;
-			normal.normVec();
-			
-			*normals++ = normal;
-		}
-		
-		if (rebuild_binormal)
-		{
-			LLVector3 binormal = vf.mVertices[i].mBinormal * mat_normal;
-			binormal.normVec();
-			*binormals++ = binormal;
-		}
-		
-		if (rebuild_color)
-		{
-			*colors++ = color;		
-		}
-	}
+	// spherical and cylindrical texgen are not implemented, and leave the
+	// texture coordinates as they are
+	fill.mPlanarTexGen = (texgen == LLTextureEntry::TEX_GEN_PLANAR);
+	fill.mTexGenScale = scale;
+	fill.mTextureMatrix = (tex_mode && mTextureMatrix) ? mTextureMatrix : NULL;
+	fill.mCosAng = cos_ang;
+	fill.mSinAng = sin_ang;
+	fill.mOffsetS = os;
+	fill.mOffsetT = ot;
+	fill.mScaleS = ms;
+	fill.mScaleT = mt;
 
 	if (rebuild_tcoord)
 	{
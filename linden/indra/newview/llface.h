@@ -51,6 +51,7 @@
 
 class LLFacePool;
 class LLVolume;
+class LLVolumeFaceFill;
 class LLViewerImage;
 class LLTextureEntry;
 class LLVertexProgram;
@@ -144,6 +145,15 @@ public:
 						const S32 &f,
 						const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
 						const U16 &index_offset);
+	// Does the part of getGeometryVolume() that needs the object, texture
+	// and vertex buffer: maps the buffer and sets up fill, which writes the
+	// geometry when fill.fill() is called.  fill.fill() may run on another
+	// thread, before the buffer is unmapped and the volume changes.
+	BOOL prepareGeometryVolume(const LLVolume& volume,
+						const S32 &f,
+						const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+						const U16 &index_offset,
+						LLVolumeFaceFill& fill);
 
 	// For avatar
 	U16			 getGeometryAvatar(
@@ -59,6 +59,8 @@
 #include "llviewercontrol.h"
 #include "llvoavatar.h"
 #include "llsdutil.h"
+#include "llsdserialize.h"
+#include "llbuffer.h"
 #include <deque>
 
 //#define DIFF_INVENTORY_FILES
@@ -1155,19 +1157,89 @@ bool LLInventoryModel::isBulkFetchProcessingComplete()
 			&& sBulkFetchCount<=0)  ?  TRUE : FALSE ) ;
 }
 
-class fetchDescendentsResponder: public LLHTTPClient::Responder
+class fetchDescendentsResponder: public LLHTTPClient::Responder,
+								  public LLSDXMLParser::StreamHandler
 {
 	public:
 		fetchDescendentsResponder(const LLSD& request_sd) : mRequestSD(request_sd) {};
 		//fetchDescendentsResponder() {};
+		void completedRaw(
+			U32 status,
+			const std::string& reason,
+			const LLChannelDescriptors& channels,
+			const LLIOPipe::buffer_ptr_t& buffer);
+		bool handleArrayElement(
+			const std::string& key,
+			const LLSD& container,
+			const LLSD& element);
 		void result(const LLSD& content);
 		void error(U32 status, const std::string& reason);
 	public:
 		typedef std::vector<LLViewerInventoryCategory*> folder_ref_t;
 	protected:
 		LLSD mRequestSD;
+		LLPointer<LLViewerInventoryItem> mStreamItem;
 };
 
+// Responses for large folders can run to several megabytes. Rather than
+// build the whole response and then walk it, parse it straight out of
+// the buffer and apply items as they complete. Whatever is not consumed
+// along the way is handled by result() as before.
+void fetchDescendentsResponder::completedRaw(
+	U32 status,
+	const std::string& reason,
+	const LLChannelDescriptors& channels,
+	const LLIOPipe::buffer_ptr_t& buffer)
+{
+	if (!isGoodStatus(status))
+	{
+		LLHTTPClient::Responder::completedRaw(status, reason, channels, buffer);
+		return;
+	}
+
+	LLPointer<LLSDXMLParser> parser = new LLSDXMLParser;
+	parser->setStreamHandler(this);
+	LLBufferArray::segment_iterator_t it = buffer->beginSegment();
+	LLBufferArray::segment_iterator_t end = buffer->endSegment();
+	for ( ; it != end; ++it)
+	{
+		if (it->isOnChannel(channels.in())
+			&& !parser->parseIncremental((const char*)it->data(), it->size()))
+		{
+			break;
+		}
+	}
+	LLSD content;
+	parser->finishIncremental(content);
+	mStreamItem = NULL;
+	completed(status, reason, content);
+}
+
+// Only items for folders we already have are applied early, since
+// that does not depend on anything else in the response.
+bool fetchDescendentsResponder::handleArrayElement(
+	const std::string& key,
+	const LLSD& container,
+	const LLSD& element)
+{
+	if (key != "items" || !container.has("folder_id"))
+	{
+		return false;
+	}
+	LLUUID parent_id = container["folder_id"];
+	if (parent_id.isNull() || !gInventory.getCategory(parent_id))
+	{
+		return false;
+	}
+	if (mStreamItem.isNull())
+	{
+		mStreamItem = new LLViewerInventoryItem;
+	}
+	mStreamItem->unpackMessage(element);
+	gInventory.updateItem(mStreamItem);
+	return true;
+}
+
 //If we get back a normal response, handle it here
 void  fetchDescendentsResponder::result(const LLSD& content)
 {
@@ -0,0 +1,153 @@
+/** 
+ * @file llregionimagelists.cpp
+ * @brief Textures resident in recently left regions
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llregionimagelists.h"
+
+#include "llregionhandle.h"
+#include "llsdserialize.h"
+#include <functional>
+#include <map>
+#include <set>
+
+const S32 MAX_REGION_IMAGES = 500; // per region
+const S32 MAX_REGION_IMAGE_LISTS = 64; // least recently left regions are dropped
+
+static std::string get_region_key(U64 region_handle)
+{
+	U32 x, y;
+	from_region_handle(region_handle, &x, &y);
+	return llformat("%u,%u", x, y);
+}
+
+LLRegionImageLists::LLRegionImageLists()
+	: mRegions(LLSD::emptyMap()),
+	  mNextSerial(0)
+{
+}
+
+void LLRegionImageLists::record(U64 region_handle, const image_list_t& images)
+{
+	// Only the images used in this region, each once, largest first
+	typedef std::multimap<S32, const Image*, std::greater<S32> > image_area_map_t;
+	image_area_map_t image_area_map;
+	std::set<LLUUID> ids;
+	for (image_list_t::const_iterator iter = images.begin(); iter != images.end(); ++iter)
+	{
+		if (iter->mRegionHandle == region_handle && iter->mDiscard >= 0 && ids.insert(iter->mID).second)
+		{
+			image_area_map.insert(std::make_pair(iter->mArea, &(*iter)));
+		}
+	}
+	if (image_area_map.empty())
+	{
+		return;
+	}
+
+	LLSD imagelist = LLSD::emptyArray();
+	S32 count = 0;
+	for (image_area_map_t::iterator iter = image_area_map.begin(); iter != image_area_map.end(); ++iter)
+	{
+		const Image* image = iter->second;
+		imagelist[count]["area"] = image->mArea;
+		imagelist[count]["discard"] = image->mDiscard;
+		imagelist[count]["uuid"] = image->mID;
+		if (++count >= MAX_REGION_IMAGES)
+			break;
+	}
+
+	LLSD& region = mRegions[get_region_key(region_handle)];
+	region["serial"] = mNextSerial++;
+	region["images"] = imagelist;
+
+	while (mRegions.size() > MAX_REGION_IMAGE_LISTS)
+	{
+		LLSD::map_iterator oldest = mRegions.endMap();
+		for (LLSD::map_iterator iter = mRegions.beginMap(); iter != mRegions.endMap(); ++iter)
+		{
+			if (oldest == mRegions.endMap() || iter->second["serial"].asInteger() < oldest->second["serial"].asInteger())
+			{
+				oldest = iter;
+			}
+		}
+		std::string oldest_key = oldest->first;
+		mRegions.erase(oldest_key);
+	}
+}
+
+bool LLRegionImageLists::get(U64 region_handle, image_list_t& images) const
+{
+	images.clear();
+	std::string key = get_region_key(region_handle);
+	if (!mRegions.has(key))
+	{
+		return false;
+	}
+	const LLSD& imagelist = mRegions[key]["images"];
+	for (LLSD::array_const_iterator iter = imagelist.beginArray();
+		 iter != imagelist.endArray(); ++iter)
+	{
+		const LLSD& imagesd = *iter;
+		images.push_back(Image(imagesd["uuid"].asUUID(), imagesd["discard"].asInteger(),
+							   imagesd["area"].asInteger(), region_handle));
+	}
+	return true;
+}
+
+void LLRegionImageLists::load(const std::string& filename)
+{
+	mRegions = LLSD::emptyMap();
+	mNextSerial = 0;
+	llifstream file;
+	file.open(filename);
+	if (file.is_open())
+	{
+		LLSD regions;
+		LLSDSerialize::fromXML(regions, file);
+		if (regions.isMap())
+		{
+			mRegions = regions;
+		}
+	}
+	for (LLSD::map_const_iterator iter = mRegions.beginMap(); iter != mRegions.endMap(); ++iter)
+	{
+		mNextSerial = llmax(mNextSerial, iter->second["serial"].asInteger() + 1);
+	}
+}
+
+void LLRegionImageLists::save(const std::string& filename) const
+{
+	llofstream file;
+	file.open(filename);
+	LLSDSerialize::toXML(mRegions, file);
+}
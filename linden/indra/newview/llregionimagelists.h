@@ -0,0 +1,73 @@
+/** 
+ * @file llregionimagelists.h
+ * @brief Textures resident in recently left regions
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLREGIONIMAGELISTS_H
+#define LL_LLREGIONIMAGELISTS_H
+
+#include "llsd.h"
+#include "lluuid.h"
+#include <vector>
+
+// Per region cache warmup lists: the largest textures used by objects in a
+// region when the agent left it, kept for the most recently left regions.
+class LLRegionImageLists
+{
+public:
+	struct Image
+	{
+		Image(const LLUUID& id, S32 discard, S32 area, U64 region_handle) :
+			mID(id), mDiscard(discard), mArea(area), mRegionHandle(region_handle) {}
+		LLUUID mID;
+		S32 mDiscard; // resident discard level
+		S32 mArea; // pixel area at mDiscard
+		U64 mRegionHandle; // region of an object using the image
+	};
+	typedef std::vector<Image> image_list_t;
+
+	LLRegionImageLists();
+
+	// Replaces the list of region_handle with the largest of images used in that region
+	void record(U64 region_handle, const image_list_t& images);
+	// Returns false if nothing was recorded for region_handle, images are largest first
+	bool get(U64 region_handle, image_list_t& images) const;
+
+	void load(const std::string& filename);
+	void save(const std::string& filename) const;
+
+	S32 getNumRegions() const { return mRegions.size(); }
+
+private:
+	LLSD mRegions; // region key -> serial and images
+	S32 mNextSerial; // orders the lists by when they were recorded
+};
+
+#endif // LL_LLREGIONIMAGELISTS_H
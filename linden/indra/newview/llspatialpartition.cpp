@@ -48,6 +48,8 @@
 #include "llrender.h"
 #include "lloctree.h"
 #include "llvoavatar.h"
+#include "llappviewer.h"
+#include "llbatchthread.h"
 
 const F32 SG_OCCLUSION_FUDGE = 0.25f;
 #define SG_DISCARD_TOLERANCE 0.01f
@@ -790,6 +792,7 @@ void LLSpatialGroup::shift(const LLVector3 &offset)
 	mOctreeNode->setCenter(mOctreeNode->getCenter()+offsetd);
 	mOctreeNode->updateMinMax();
 	mBounds[0] += offset;
+	mSpatialPartition->mPackedBounds.set(mBoundsSlot, mBounds[0], mBounds[1]);
 	mExtents[0] += offset;
 	mExtents[1] += offset;
 	mObjectBounds[0] += offset;
@@ -935,6 +938,26 @@ void LLSpatialGroup::clearState(U32 state, S32 mode)
 //		Octree Listener Implementation
 //======================================
 
+const S32 SG_GROUPS_PER_SLAB = 256;
+
+// Never destroyed, so groups may be released during static destruction.
+static LLFixedSizePool& get_group_pool()
+{
+	static LLFixedSizePool* pool = new LLFixedSizePool(sizeof(LLSpatialGroup), SG_GROUPS_PER_SLAB);
+	return *pool;
+}
+
+void* LLSpatialGroup::operator new(size_t size)
+{
+	llassert(size == sizeof(LLSpatialGroup));
+	return get_group_pool().allocate();
+}
+
+void LLSpatialGroup::operator delete(void* ptr, size_t size)
+{
+	get_group_pool().free(ptr);
+}
+
 LLSpatialGroup::LLSpatialGroup(OctreeNode* node, LLSpatialPartition* part) :
 	mState(0),
 	mBuilt(0.f),
@@ -959,6 +982,8 @@ LLSpatialGroup::LLSpatialGroup(OctreeNode* node, LLSpatialPartition* part) :
 
 	mBounds[0] = LLVector3(node->getCenter());
 	mBounds[1] = LLVector3(node->getSize());
+	mBoundsSlot = part->mPackedBounds.allocate();
+	part->mPackedBounds.set(mBoundsSlot, mBounds[0], mBounds[1]);
 
 	part->mLODSeed = (part->mLODSeed+1)%part->mLODPeriod;
 	mLODHash = part->mLODSeed;
@@ -1119,6 +1144,8 @@ void LLSpatialGroup::handleDestruction(const TreeNode* node)
 	mBufferMap.clear();
 	sZombieGroups++;
 	mOctreeNode = NULL;
+	mSpatialPartition->mPackedBounds.release(mBoundsSlot);
+	mBoundsSlot = -1;
 }
 
 void LLSpatialGroup::handleStateChange(const TreeNode* node)
@@ -1249,6 +1276,8 @@ BOOL LLSpatialGroup::rebound()
 		mBounds[1] = (newMax - newMin)*0.5f;
 	}
 	
+	mSpatialPartition->mPackedBounds.set(mBoundsSlot, mBounds[0], mBounds[1]);
+
 	setState(OCCLUSION_DIRTY);
 	
 	clearState(DIRTY);
@@ -1481,7 +1510,7 @@ class LLOctreeCull : public LLSpatialGroup::OctreeTraveler
 {
 public:
 	LLOctreeCull(LLCamera* camera)
-		: mCamera(camera), mRes(0) { }
+		: mCamera(camera), mRes(0), mResult(NULL), mPackedResults(NULL) { }
 
 	virtual bool earlyFail(LLSpatialGroup* group)
 	{
@@ -1525,9 +1554,27 @@ public:
 		}
 	}
 	
+	// TRUE if frustumCheck() tests group bounds against the far clip plane.
+	virtual BOOL usesFarClipPlane() const
+	{
+		return FALSE;
+	}
+
+	// Frustum test of group->mBounds, from the packed bounds results if the
+	// whole partition was tested up front.
+	S32 boundsInFrustum(const LLSpatialGroup* group)
+	{
+		if (mPackedResults)
+		{
+			return mPackedResults[group->mBoundsSlot];
+		}
+		return usesFarClipPlane() ? mCamera->AABBInFrustum(group->mBounds[0], group->mBounds[1]) :
+			mCamera->AABBInFrustumNoFarClip(group->mBounds[0], group->mBounds[1]);
+	}
+
 	virtual S32 frustumCheck(const LLSpatialGroup* group)
 	{
-		S32 res = mCamera->AABBInFrustumNoFarClip(group->mBounds[0], group->mBounds[1]);
+		S32 res = boundsInFrustum(group);
 		if (res != 0)
 		{
 			res = llmin(res, AABBSphereIntersect(group->mExtents[0], group->mExtents[1], mCamera->getOrigin(), mCamera->mFrustumCornerDist));
@@ -1575,7 +1622,14 @@ public:
 		{
 			group->doOcclusion(mCamera);
 		}
-		gPipeline.markNotCulled(group, *mCamera);
+		if (mResult)
+		{
+			gPipeline.markNotCulled(group, *mCamera, *mResult);
+		}
+		else
+		{
+			gPipeline.markNotCulled(group, *mCamera);
+		}
 	}
 	
 	virtual void visit(const LLSpatialGroup::OctreeNode* branch) 
@@ -1592,6 +1646,8 @@ public:
 
 	LLCamera *mCamera;
 	S32 mRes;
+	LLCullResult* mResult; // if set, visible groups go here instead of the pipeline's cull result
+	const S8* mPackedResults; // if set, frustum test results indexed by LLSpatialGroup::mBoundsSlot
 };
 
 class LLOctreeCullNoFarClip : public LLOctreeCull
@@ -1602,7 +1658,7 @@ public:
 
 	virtual S32 frustumCheck(const LLSpatialGroup* group)
 	{
-		return mCamera->AABBInFrustumNoFarClip(group->mBounds[0], group->mBounds[1]);
+		return boundsInFrustum(group);
 	}
 
 	virtual S32 frustumCheckObjects(const LLSpatialGroup* group)
@@ -1618,9 +1674,14 @@ public:
 	LLOctreeCullShadow(LLCamera* camera)
 		: LLOctreeCull(camera) { }
 
+	virtual BOOL usesFarClipPlane() const
+	{
+		return TRUE;
+	}
+
 	virtual S32 frustumCheck(const LLSpatialGroup* group)
 	{
-		return mCamera->AABBInFrustum(group->mBounds[0], group->mBounds[1]);
+		return boundsInFrustum(group);
 	}
 
 	virtual S32 frustumCheckObjects(const LLSpatialGroup* group)
@@ -1726,6 +1787,164 @@ public:
 	std::vector<LLDrawable*>* mResults;
 };
 
+// Parallel cull: the main thread culls the top of the tree down to the split
+// node (the first node with more than one child) and each child subtree of
+// the split node becomes an LLBatchThread job with its own LLCullResult.
+// Subtrees are disjoint, so the jobs only write to their own groups, and the
+// results are appended to the pipeline's in child order, which is the order
+// a serial traversal pushes them in.
+//
+// Occlusion queries are issued and read back while culling, which needs the
+// GL context, so this is only done when LLPipeline::sUseOcclusion <= 1.
+
+const S32 MAX_CULL_JOBS = 8; // children of an octree node
+static LLCullResult sCullJobResults[MAX_CULL_JOBS];
+
+template <class T>
+class LLOctreeCullJob : public LLBatchThread::Job
+{
+public:
+	LLOctreeCullJob(LLCamera* camera, S32 res, const S8* packed_results, const LLSpatialGroup::OctreeNode* node, LLCullResult* result)
+		: mCuller(camera), mNode(node)
+	{
+		mCuller.mRes = res;
+		mCuller.mResult = result;
+		mCuller.mPackedResults = packed_results;
+		result->clear();
+	}
+
+	/*virtual*/ void run()
+	{
+		mCuller.traverse(mNode);
+	}
+
+private:
+	T mCuller;
+	const LLSpatialGroup::OctreeNode* mNode;
+};
+
+template <class T>
+class LLOctreeCullSplit : public T
+{
+public:
+	LLOctreeCullSplit(LLCamera* camera, const LLSpatialGroup::OctreeNode* split)
+		: T(camera), mSplit(split) { }
+
+	virtual void traverse(const LLSpatialGroup::TreeNode* n)
+	{
+		const LLSpatialGroup::OctreeNode* node = (const LLSpatialGroup::OctreeNode*) n;
+		if (node->getParent() == mSplit)
+		{	//hand the subtree off with the frustum state its parent left us in
+			S32 index = (S32) mJobs.size();
+			if (index < MAX_CULL_JOBS)
+			{
+				mJobs.push_back(new LLOctreeCullJob<T>(T::mCamera, T::mRes, T::mPackedResults, node, &sCullJobResults[index]));
+			}
+			else
+			{	//get_cull_split() never picks a node with more children than we have results for
+				T::traverse(n);
+			}
+		}
+		else
+		{
+			T::traverse(n);
+		}
+	}
+
+	const LLSpatialGroup::OctreeNode* mSplit;
+	LLBatchThread::job_list_t mJobs;
+};
+
+// Returns the node whose children should be culled in parallel, or NULL to
+// cull serially.
+static const LLSpatialGroup::OctreeNode* get_cull_split(LLSpatialPartition* part)
+{
+	LLBatchThread* thread = LLAppViewer::getCullThread();
+	if (!LLPipeline::sParallelCull ||
+		LLPipeline::sUseOcclusion > 1 ||
+		part->isBridge() ||
+		!thread || !thread->getThreaded())
+	{
+		return NULL;
+	}
+
+	const LLSpatialGroup::OctreeNode* node = part->mOctree;
+	while (node->getChildCount() == 1)
+	{
+		node = node->getChild(0);
+	}
+
+	if (node->getChildCount() > (U32) MAX_CULL_JOBS)
+	{
+		return NULL;
+	}
+
+	for (U32 i = 0; i < node->getChildCount(); i++)
+	{
+		if (node->getChild(i)->getChildCount() > 0)
+		{
+			return node;
+		}
+	}
+	
+	return NULL; //nothing but leaves, not worth a thread
+}
+
+// Packed cull: before traversing, the bounds of every group in the partition
+// are tested against the frustum four at a time from the partition's packed
+// copy, and the culler looks the results up instead of testing groups one at
+// a time.  The results are the same as the culler's own tests would give.
+
+static std::vector<S8> sPackedCullResults;
+
+static const S8* cull_packed_bounds(LLSpatialPartition* part, LLCamera& camera, BOOL far_clip)
+{
+	LLPackedBounds& bounds = part->mPackedBounds;
+	if (bounds.getSlotCount() == 0)
+	{
+		return NULL;
+	}
+
+	sPackedCullResults.resize(bounds.getSlotCount());
+	if (far_clip)
+	{
+		camera.AABBInFrustumPacked(bounds, &sPackedCullResults[0]);
+	}
+	else
+	{
+		camera.AABBInFrustumNoFarClipPacked(bounds, &sPackedCullResults[0]);
+	}
+	return &sPackedCullResults[0];
+}
+
+template <class T>
+static void cull_octree(LLSpatialPartition* part, LLCamera& camera)
+{
+	const LLSpatialGroup::OctreeNode* split = get_cull_split(part);
+	if (!split)
+	{
+		T culler(&camera);
+		culler.mPackedResults = cull_packed_bounds(part, camera, culler.usesFarClipPlane());
+		culler.traverse(part->mOctree);
+		return;
+	}
+
+	LLOctreeCullSplit<T> culler(&camera, split);
+	culler.mPackedResults = cull_packed_bounds(part, camera, culler.usesFarClipPlane());
+	culler.traverse(part->mOctree);
+	if (culler.mJobs.empty())
+	{
+		return;
+	}
+
+	LLAppViewer::getCullThread()->runJobs(culler.mJobs);
+	for (U32 i = 0; i < culler.mJobs.size(); i++)
+	{
+		gPipeline.mergeCullResult(sCullJobResults[i]);
+		delete culler.mJobs[i];
+	}
+}
+
 void drawBox(const LLVector3& c, const LLVector3& r)
 {
 	gGL.begin(LLRender::TRIANGLE_STRIP);
@@ -1892,20 +2111,17 @@ S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* result
 	else if (LLPipeline::sShadowRender)
 	{
 		LLFastTimer ftm(LLFastTimer::FTM_FRUSTUM_CULL);
-		LLOctreeCullShadow culler(&camera);
-		culler.traverse(mOctree);
+		cull_octree<LLOctreeCullShadow>(this, camera);
 	}
 	else if (mInfiniteFarClip || !LLPipeline::sUseFarClip)
 	{
 		LLFastTimer ftm(LLFastTimer::FTM_FRUSTUM_CULL);		
-		LLOctreeCullNoFarClip culler(&camera);
-		culler.traverse(mOctree);
+		cull_octree<LLOctreeCullNoFarClip>(this, camera);
 	}
 	else
 	{
 		LLFastTimer ftm(LLFastTimer::FTM_FRUSTUM_CULL);		
-		LLOctreeCull culler(&camera);
-		culler.traverse(mOctree);
+		cull_octree<LLOctreeCull>(this, camera);
 	}
 	
 	return 0;
@@ -3042,6 +3258,41 @@ LLCullResult::drawinfo_list_t::iterator LLCullResult::endRenderMap(U32 type)
 	return mRenderMap[type].begin() + mRenderMapSize[type];
 }
 
+void LLCullResult::append(LLCullResult& other)
+{
+	for (U32 i = 0; i < other.mVisibleGroupsSize; i++)
+	{
+		pushVisibleGroup(other.mVisibleGroups[i]);
+	}
+	for (U32 i = 0; i < other.mAlphaGroupsSize; i++)
+	{
+		pushAlphaGroup(other.mAlphaGroups[i]);
+	}
+	for (U32 i = 0; i < other.mOcclusionGroupsSize; i++)
+	{
+		pushOcclusionGroup(other.mOcclusionGroups[i]);
+	}
+	for (U32 i = 0; i < other.mDrawableGroupsSize; i++)
+	{
+		pushDrawableGroup(other.mDrawableGroups[i]);
+	}
+	for (U32 i = 0; i < other.mVisibleListSize; i++)
+	{
+		pushDrawable(other.mVisibleList[i]);
+	}
+	for (U32 i = 0; i < other.mVisibleBridgeSize; i++)
+	{
+		pushBridge(other.mVisibleBridge[i]);
+	}
+	for (U32 i = 0; i < LLRenderPass::NUM_RENDER_TYPES; i++)
+	{
+		for (U32 j = 0; j < other.mRenderMapSize[i]; j++)
+		{
+			pushDrawInfo(i, other.mRenderMap[i][j]);
+		}
+	}
+}
+
 void LLCullResult::pushVisibleGroup(LLSpatialGroup* group)
 {
 	if (mVisibleGroupsSize < mVisibleGroups.size())
@@ -43,6 +43,7 @@
 #include "llcubemap.h"
 #include "lldrawpool.h"
 #include "llface.h"
+#include "llpackedbounds.h"
 
 #include <queue>
 
@@ -220,6 +221,11 @@ public:
 
 	LLSpatialGroup(OctreeNode* node, LLSpatialPartition* part);
 
+	// Groups are made and destroyed along with octree nodes, so they come
+	// from a pool too.
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
 	BOOL isDead()							{ return isState(DEAD); }
 	BOOL isState(U32 state) const			{ return mState & state ? TRUE : FALSE; }
 	U32 getState()							{ return mState; }
@@ -285,6 +291,7 @@ public:
 	LLSpatialPartition* mSpatialPartition;
 	LLVector3 mBounds[2];
 	LLVector3 mExtents[2];
+	S32 mBoundsSlot; //copy of mBounds in mSpatialPartition->mPackedBounds
 	
 	LLVector3 mObjectExtents[2];
 	LLVector3 mObjectBounds[2];
@@ -381,6 +388,7 @@ public:
 	BOOL mDepthMask; //if TRUE, objects in this partition will be written to depth during alpha rendering
 	U32 mDrawableType;
 	U32 mPartitionType;
+	LLPackedBounds mPackedBounds; //bounds of every group, for testing all of them against the frustum at once
 };
 
 // class for creating bridges between spatial partitions
@@ -424,6 +432,9 @@ public:
 	typedef std::vector<LLDrawInfo*> drawinfo_list_t;
 
 	void clear();
+
+	// Pushes everything in other after what is already here.
+	void append(LLCullResult& other);
 	
 	sg_list_t::iterator beginVisibleGroups();
 	sg_list_t::iterator endVisibleGroups();
@@ -550,6 +561,10 @@ public:
 	virtual void rebuildGeom(LLSpatialGroup* group);
 	virtual void rebuildMesh(LLSpatialGroup* group);
 	virtual void getGeometry(LLSpatialGroup* group);
+	// Rebuilds the meshes of several volume groups at once, writing their
+	// vertices on the geometry thread when RenderParallelGeometry is on.
+	// Mapping and unmapping the buffers stays on the calling thread.
+	static void rebuildMeshes(const std::vector<LLSpatialGroup*>& groups);
 	void genDrawInfo(LLSpatialGroup* group, U32 mask, std::vector<LLFace*>& faces, BOOL distance_sort = FALSE);
 	void registerFace(LLSpatialGroup* group, LLFace* facep, U32 type);
 
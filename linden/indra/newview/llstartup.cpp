@@ -610,6 +610,11 @@ bool idle_startup()
 				msg->mPacketRing.setUseOutThrottle(TRUE);
 				msg->mPacketRing.setOutBandwidth(outBandwidth);
 			}
+			if (gSavedSettings.getBOOL("PacketReceiveThread"))
+			{
+				LL_INFOS("AppInit") << "Receiving packets on a separate thread" << LL_ENDL;
+				msg->mPacketRing.startReceiveThread(msg->mSocket);
+			}
 		}
 
 		LL_INFOS("AppInit") << "Message System Initialized." << LL_ENDL;
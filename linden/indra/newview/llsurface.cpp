@@ -40,7 +40,6 @@
 #include "llpatchvertexarray.h"
 #include "patch_dct.h"
 #include "patch_code.h"
-#include "bitpack.h"
 #include "llviewerobjectlist.h"
 #include "llregionhandle.h"
 #include "llagent.h"
@@ -668,25 +667,16 @@ BOOL LLSurface::idleUpdate(F32 max_update_time)
 	return did_update;
 }
 
-void LLSurface::decompressDCTPatch(LLBitPack &bitpack, LLGroupHeader *gopp, BOOL b_large_patch) 
+void LLSurface::applyDecodedPatches(const LLGroupHeader &group_header, const std::vector<LLDecodedPatch> &patches)
 {
-
-	LLPatchHeader  ph;
-	S32 j, i;
-	S32 patch[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+	S32 j, i, row;
+	S32 size = group_header.patch_size;
 	LLSurfacePatch *patchp;
 
-	init_patch_decompressor(gopp->patch_size);
-	gopp->stride = mGridsPerEdge;
-	set_group_of_patch_header(gopp);
-
-	while (1)
+	for (std::vector<LLDecodedPatch>::const_iterator iter = patches.begin();
+		 iter != patches.end(); ++iter)
 	{
-		decode_patch_header(bitpack, &ph);
-		if (ph.quant_wbits == END_OF_PATCHES)
-		{
-			break;
-		}
+		const LLPatchHeader &ph = iter->mHeader;
 
 		i = ph.patchids >> 5;
 		j = ph.patchids & 0x1F;
@@ -708,9 +698,10 @@ void LLSurface::decompressDCTPatch(LLBitPack &bitpack, LLGroupHeader *gopp, BOOL
 
 		patchp = &mPatchList[j*mPatchesPerEdge + i];
 
-
-		decode_patch(bitpack, patch);
-		decompress_patch(patchp->getDataZ(), patch, &ph);
+		for (row = 0; row < size; row++)
+		{
+			memcpy(patchp->getDataZ() + row*mGridsPerEdge, iter->mData + row*size, size*sizeof(F32));
+		}
 
 		// Update edges for neighbors.  Need to guarantee that this gets done before we generate vertical stats.
 		patchp->updateNorthEdge();
@@ -67,7 +67,7 @@ const S32 ABOVE_WATERLINE_ALPHA = 32;  // The alpha of water when the land eleva
 
 class LLViewerRegion;
 class LLSurfacePatch;
-class LLBitPack;
+class LLDecodedPatch;
 class LLGroupHeader;
 
 class LLSurface 
@@ -91,7 +91,9 @@ public:
 	void disconnectNeighbor(LLSurface *neighborp);
 	void disconnectAllNeighbors();
 
-	virtual void decompressDCTPatch(LLBitPack &bitpack, LLGroupHeader *gopp, BOOL b_large_patch);
+	// Copies the patches of a land layer, decoded by decode_layer_patches(),
+	// into the surface in packet order.
+	void applyDecodedPatches(const LLGroupHeader &group_header, const std::vector<LLDecodedPatch> &patches);
 	virtual void updatePatchVisibilities(LLAgent &agent);
 
 	inline F32 getZ(const U32 k) const				{ return mSurfaceZ[k]; }
@@ -51,10 +51,41 @@
 //  Entry size same as header packet, so we're not 0-padding unless whole image is contained in header.
 // cache/textures/[0-F]/UUID.texture
 //  Actual texture body files
+// cache/texture.slabs (slab mode, replaces the body files)
+//  Index of the bodies packed into the slab files, rewritten periodically
+// cache/texture.slabs.[0-12]
+//  Slab files made of fixed size slots (4KB << N), one body per slot.
+//  Each slot starts with a SlabSlotHeader so a stale index is detected on read.
 
 const S32 TEXTURE_CACHE_ENTRY_SIZE = FIRST_PACKET_SIZE; 
 const F32 TEXTURE_CACHE_PURGE_AMOUNT = .20f; // % amount to reduce the cache by when it exceeds its limit
 const F32 TEXTURE_CACHE_LRU_SIZE = .10f; // % amount for LRU list (low overhead to regenerate)
+const S32 TEXTURE_SLAB_MIN_SLOT_SIZE = 4096;
+const S32 TEXTURE_SLAB_MAX_FILE_SIZE = 1024*1024*1024; // LLAPRFile offsets are S32
+const U32 TEXTURE_SLAB_INDEX_VERSION = 1;
+const F32 TEXTURE_SLAB_INDEX_FLUSH_SECONDS = 60.f;
+const U32 TEXTURE_ENTRIES_FLUSH_COUNT = 256; // dirty entries before a forced write
+const F32 TEXTURE_ENTRIES_FLUSH_SECONDS = 1.f;
+
+struct SlabSlotHeader
+{
+	LLUUID mID;
+	S32 mBodySize;
+};
+
+struct SlabIndexHeader
+{
+	U32 mVersion;
+	S32 mCount;
+};
+
+struct SlabIndexRecord
+{
+	LLUUID mID;
+	S32 mClass;
+	S32 mSlot;
+	S32 mSize;
+};
 
 class LLTextureCacheWorker : public LLWorkerClass
 {
@@ -452,8 +483,7 @@ bool LLTextureCacheRemoteWorker::doRead()
 	// Fourth state / stage : read the rest of the data from the UUID based cached file
 	if (!done && (mState == BODY))
 	{
-		std::string filename = mCache->getTextureFileName(mID);
-		S32 filesize = LLAPRFile::size(filename);
+		S32 filesize = mCache->getBodySize(mID);
 
 		if (filesize && (filesize + TEXTURE_CACHE_ENTRY_SIZE) > mOffset)
 		{
@@ -493,9 +523,8 @@ bool LLTextureCacheRemoteWorker::doRead()
 			mReadData = data;
 
 			// Read the data at last
-			S32 bytes_read = LLAPRFile::readEx(filename, 
-											 mReadData + data_offset,
-											 file_offset, file_size);
+			S32 bytes_read = mCache->readBody(mID, mReadData + data_offset,
+											  file_offset, file_size);
 			if (bytes_read != file_size)
 			{
 				llwarns << "LLTextureCacheWorker: "  << mID
@@ -511,7 +540,7 @@ bool LLTextureCacheRemoteWorker::doRead()
 		{
 			// No body, we're done.
 			mDataSize = llmax(TEXTURE_CACHE_ENTRY_SIZE - mOffset, 0);
-			lldebugs << "No body file for: " << filename << llendl;
+			lldebugs << "No body for: " << mID << llendl;
 		}	
 		// Nothing else to do at that point...
 		done = true;
@@ -630,12 +659,8 @@ bool LLTextureCacheRemoteWorker::doWrite()
 		S32 file_size = mDataSize - TEXTURE_CACHE_ENTRY_SIZE;
 		if ((file_size > 0) && mCache->updateTextureEntryList(mID, file_size))
 		{
-			// build the cache file name from the UUID
-			std::string filename = mCache->getTextureFileName(mID);			
-// 			llinfos << "Writing Body: " << filename << " Bytes: " << file_offset+file_size << llendl;
-			S32 bytes_written = LLAPRFile::writeEx(	filename, 
-													mWriteData + TEXTURE_CACHE_ENTRY_SIZE,
-													0, file_size);
+// 			llinfos << "Writing Body: " << mID << " Bytes: " << file_size << llendl;
+			S32 bytes_written = mCache->writeBody(mID, mWriteData + TEXTURE_CACHE_ENTRY_SIZE, file_size);
 			if (bytes_written <= 0)
 			{
 				llwarns << "LLTextureCacheWorker: "  << mID
@@ -733,20 +758,87 @@ void LLTextureCacheWorker::endWork(S32 param, bool aborted)
 
 //////////////////////////////////////////////////////////////////////////////
 
-LLTextureCache::LLTextureCache(bool threaded)
-	: LLWorkerThread("TextureCache", threaded),
+LLTextureCache::FlushRequest::FlushRequest(handle_t handle, LLTextureCache* cache)
+	: LLQueuedThread::QueuedRequest(handle, LLQueuedThread::PRIORITY_LOW, FLAG_AUTO_COMPLETE),
+	  mCache(cache)
+{
+}
+
+// virtual (WORKER THREAD)
+bool LLTextureCache::FlushRequest::processRequest()
+{
+	mCache->flushEntries();
+	return true;
+}
+
+// virtual (WORKER THREAD)
+void LLTextureCache::FlushRequest::finishRequest(bool completed)
+{
+	mCache->mFlushPending = FALSE;
+}
+
+// virtual
+void LLTextureCache::FlushRequest::deleteRequest()
+{
+	LLQueuedThread::QueuedRequest::deleteRequest();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+LLTextureCache::LLTextureCache(bool threaded, LLThreadPool* pool)
+	: LLWorkerThread("TextureCache", threaded, pool),
 	  mWorkersMutex(NULL),
 	  mHeaderMutex(NULL),
 	  mListMutex(NULL),
+	  mSlabMutex(NULL),
+	  mBodyStatsMutex(NULL),
 	  mHeaderAPRFile(NULL),
 	  mReadOnly(FALSE),
+	  mUseSlabs(FALSE),
 	  mTexturesSizeTotal(0),
-	  mDoPurge(FALSE)
+	  mDoPurge(FALSE),
+	  mSlabIndexDirty(FALSE),
+	  mFlushPending(FALSE),
+	  mBodyReads(0),
+	  mBodyWrites(0),
+	  mBodyReadBytes(0),
+	  mBodyWriteBytes(0),
+	  mBodyReadTime(0.0),
+	  mBodyWriteTime(0.0)
 {
+	for (S32 cls = 0; cls < TEXTURE_SLAB_CLASS_COUNT; cls++)
+	{
+		mSlabClasses[cls].mMutex = new LLMutex(NULL);
+	}
 }
 
 LLTextureCache::~LLTextureCache()
 {
+	if (mUseSlabs)
+	{
+		if (!mReadOnly)
+		{
+			LLMutexLock lock(&mHeaderMutex);
+			writeDirtyEntries();
+			writeSlabIndex();
+		}
+		LLMutexLock lock(&mSlabMutex);
+		closeSlabs();
+	}
+	for (S32 cls = 0; cls < TEXTURE_SLAB_CLASS_COUNT; cls++)
+	{
+		delete mSlabClasses[cls].mMutex;
+		mSlabClasses[cls].mMutex = NULL;
+	}
+	if (mBodyReads || mBodyWrites)
+	{
+		// Throughput of the body backend, compare runs with TextureCacheUseSlabs on and off
+		const F64 MB = 1024.0*1024.0;
+		LL_INFOS("TextureCache") << "TEXTURE CACHE: " << (mUseSlabs ? "slab" : "file") << " bodies:"
+				<< " READS: " << mBodyReads << " (" << (mBodyReadTime > 0.0 ? mBodyReadBytes / MB / mBodyReadTime : 0.0) << " MB/s)"
+				<< " WRITES: " << mBodyWrites << " (" << (mBodyWriteTime > 0.0 ? mBodyWriteBytes / MB / mBodyWriteTime : 0.0) << " MB/s)"
+				<< LL_ENDL;
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -757,6 +849,24 @@ S32 LLTextureCache::update(U32 max_time_ms)
 	S32 res;
 	res = LLWorkerThread::update(max_time_ms);
 
+	if (mUseSlabs && !mReadOnly && !mFlushPending && mHeaderMutex.tryLock())
+	{
+		// Don't stall the main thread on a worker holding the header lock, just try next frame.
+		// Only the check happens here, the writes are done by a FlushRequest on the cache thread.
+		bool flush = entriesFlushDue() || slabIndexFlushDue();
+		mHeaderMutex.unlock();
+		if (flush)
+		{
+			mFlushPending = TRUE;
+			FlushRequest* req = new FlushRequest(generateHandle(), this);
+			if (!addRequest(req))
+			{
+				req->deleteRequest();
+				mFlushPending = FALSE;
+			}
+		}
+	}
+
 	mListMutex.lock();
 	handle_list_t priorty_list = mPrioritizeWriteList; // copy list
 	mPrioritizeWriteList.clear();
@@ -827,6 +937,15 @@ bool LLTextureCache::updateTextureEntryList(const LLUUID& id, S32 bodysize)
 			{
 				oldbodysize = iter1->second;
 			}
+
+			if (mUseSlabs && !allocSlabBody(id, bodysize))
+			{
+				// No slot for a body this size, any older body is gone with it
+				llwarns << "No texture slab space for: " << id << " Size: " << bodysize << llendl;
+				mHeaderMutex.unlock();
+				removeFromCache(id);
+				return false;
+			}
 						
 			Entry entry;
 			S32 idx = openAndReadEntry(id, entry, false);
@@ -865,16 +984,134 @@ bool LLTextureCache::updateTextureEntryList(const LLUUID& id, S32 bodysize)
 	return res;
 }
 
+S32 LLTextureCache::getBodySize(const LLUUID& id)
+{
+	if (mUseSlabs)
+	{
+		LLMutexLock lock(&mSlabMutex);
+		slab_map_t::iterator iter = mSlabBodies.find(id);
+		return iter != mSlabBodies.end() ? iter->second.mSize : 0;
+	}
+	return LLAPRFile::size(getTextureFileName(id));
+}
+
+S32 LLTextureCache::readBody(const LLUUID& id, U8* data, S32 offset, S32 size)
+{
+	LLTimer timer;
+	S32 bytes_read = 0;
+	if (mUseSlabs)
+	{
+		SlabBody body;
+		{
+			LLMutexLock lock(&mSlabMutex);
+			slab_map_t::iterator iter = mSlabBodies.find(id);
+			if (iter != mSlabBodies.end())
+			{
+				body = iter->second;
+			}
+		}
+		// Only the slab class is locked for the I/O. If the slot is freed and
+		// reused meanwhile the slot header no longer matches.
+		if (body.mClass >= 0 && offset < body.mSize)
+		{
+			SlabClass& slab = mSlabClasses[body.mClass];
+			LLMutexLock lock(slab.mMutex);
+			LLAPRFile* file = slab.mFile;
+			S32 slot_offset = body.mSlot * (TEXTURE_SLAB_MIN_SLOT_SIZE << body.mClass);
+			size = llmin(size, body.mSize - offset);
+			SlabSlotHeader header;
+			if (file && file->seek(APR_SET, slot_offset) == slot_offset &&
+				file->read((void*)&header, (S32)sizeof(SlabSlotHeader)) == sizeof(SlabSlotHeader))
+			{
+				if (header.mID == id && header.mBodySize == body.mSize)
+				{
+					S32 data_offset = slot_offset + (S32)sizeof(SlabSlotHeader) + offset;
+					if (file->seek(APR_SET, data_offset) == data_offset)
+					{
+						bytes_read = file->read((void*)data, size);
+					}
+				}
+				else
+				{
+					llwarns << "Slab slot " << body.mClass << ":" << body.mSlot << " does not hold " << id << llendl;
+				}
+			}
+		}
+	}
+	else
+	{
+		bytes_read = LLAPRFile::readEx(getTextureFileName(id), data, offset, size);
+	}
+	{
+		// cache workers may run on several pool threads
+		LLMutexLock lock(&mBodyStatsMutex);
+		mBodyReads++;
+		mBodyReadBytes += llmax(bytes_read, 0);
+		mBodyReadTime += timer.getElapsedTimeF64();
+	}
+	return bytes_read;
+}
+
+S32 LLTextureCache::writeBody(const LLUUID& id, U8* data, S32 size)
+{
+	LLTimer timer;
+	S32 bytes_written = 0;
+	if (mUseSlabs)
+	{
+		SlabBody body;
+		{
+			LLMutexLock lock(&mSlabMutex);
+			slab_map_t::iterator iter = mSlabBodies.find(id);
+			if (iter != mSlabBodies.end())
+			{
+				body = iter->second;
+			}
+		}
+		// The slot was sized by allocSlabBody() in updateTextureEntryList().
+		// If it is reused before this lands, the new owner's reads fail
+		// the slot header check and fetch it again.
+		if (body.mClass >= 0 && body.mSize == size)
+		{
+			SlabClass& slab = mSlabClasses[body.mClass];
+			LLMutexLock lock(slab.mMutex);
+			LLAPRFile* file = slab.mFile;
+			S32 slot_offset = body.mSlot * (TEXTURE_SLAB_MIN_SLOT_SIZE << body.mClass);
+			SlabSlotHeader header;
+			header.mID = id;
+			header.mBodySize = size;
+			if (file && file->seek(APR_SET, slot_offset) == slot_offset &&
+				file->write((void*)&header, (S32)sizeof(SlabSlotHeader)) == sizeof(SlabSlotHeader))
+			{
+				bytes_written = file->write((void*)data, size);
+			}
+		}
+	}
+	else
+	{
+		bytes_written = LLAPRFile::writeEx(getTextureFileName(id), data, 0, size);
+	}
+	{
+		// cache workers may run on several pool threads
+		LLMutexLock lock(&mBodyStatsMutex);
+		mBodyWrites++;
+		mBodyWriteBytes += llmax(bytes_written, 0);
+		mBodyWriteTime += timer.getElapsedTimeF64();
+	}
+	return bytes_written;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 //static
 const S32 MAX_REASONABLE_FILE_SIZE = 512*1024*1024; // 512 MB
 F32 LLTextureCache::sHeaderCacheVersion = 1.2f;
+F32 LLTextureCache::sSlabCacheVersion = 2.2f; // differs so that switching backends purges the cache
 U32 LLTextureCache::sCacheMaxEntries = MAX_REASONABLE_FILE_SIZE / TEXTURE_CACHE_ENTRY_SIZE;
 S64 LLTextureCache::sCacheMaxTexturesSize = 0; // no limit
 const char* entries_filename = "texture.entries";
 const char* cache_filename = "texture.cache";
 const char* textures_dirname = "textures";
+const char* slabs_filename = "texture.slabs";
 
 void LLTextureCache::setDirNames(ELLPath location)
 {
@@ -882,6 +1119,7 @@ void LLTextureCache::setDirNames(ELLPath location)
 	mHeaderEntriesFileName = gDirUtilp->getExpandedFilename(location, entries_filename);
 	mHeaderDataFileName = gDirUtilp->getExpandedFilename(location, cache_filename);
 	mTexturesDirName = gDirUtilp->getExpandedFilename(location, textures_dirname);
+	mSlabIndexFileName = gDirUtilp->getExpandedFilename(location, slabs_filename);
 }
 
 void LLTextureCache::purgeCache(ELLPath location)
@@ -898,9 +1136,10 @@ void LLTextureCache::purgeCache(ELLPath location)
 	purgeAllTextures(true);
 }
 
-S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL read_only)
+S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL read_only, BOOL use_slabs)
 {
 	mReadOnly = read_only;
+	mUseSlabs = use_slabs;
 	
 	S64 header_size = (max_size * 2) / 10;
 	S64 max_entries = header_size / TEXTURE_CACHE_ENTRY_SIZE;
@@ -914,7 +1153,8 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL read_only)
 	max_size -= sCacheMaxTexturesSize;
 	
 	LL_INFOS("TextureCache") << "Headers: " << sCacheMaxEntries
-			<< " Textures size: " << sCacheMaxTexturesSize/(1024*1024) << " MB" << LL_ENDL;
+			<< " Textures size: " << sCacheMaxTexturesSize/(1024*1024) << " MB"
+			<< (mUseSlabs ? " (slabs)" : "") << LL_ENDL;
 
 	setDirNames(location);
 	
@@ -928,6 +1168,12 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL read_only)
 			LLFile::mkdir(dirname);
 		}
 	}
+	if (mUseSlabs)
+	{
+		LLMutexLock lock(&mSlabMutex);
+		openSlabs();
+		readSlabIndex();
+	}
 	readHeaderCache();
 	purgeTextures(true); // calc mTexturesSize and make some room in the texture cache if we need it
 
@@ -1015,6 +1261,10 @@ S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create
 						idx = iter3->second;
 						mHeaderIDMap.erase(oldid);
 						mTexturesSizeMap.erase(oldid);
+						if (mUseSlabs)
+						{
+							freeSlabBody(oldid);
+						}
 						break;
 					}
 				}
@@ -1029,6 +1279,17 @@ S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create
 				llassert_always(mTexturesSizeMap.erase(id) == 0);
 				// Initialize the entry (will get written later)
 				entry.init(id, time(NULL));
+				if (mUseSlabs)
+				{
+					// Handing an index to a new id is written through rather than batched:
+					// the header data for the new id goes to texture.cache right after this
+					if (idx >= (S32)mEntries.size())
+					{
+						mEntries.resize(idx + 1);
+					}
+					mEntries[idx] = entry;
+					mDirtyEntries.erase(idx);
+				}
 				// Update Header
 				writeEntriesHeader();
 				// Write Entry
@@ -1046,12 +1307,19 @@ S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create
 		// Remove this entry from the LRU if it exists
 		mLRU.erase(id);
 		// Read the entry
-		S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
-		LLAPRFile* aprfile = openHeaderEntriesFile(true, offset);
-		S32 bytes_read = aprfile->read((void*)&entry, (S32)sizeof(Entry));
-		llassert_always(bytes_read == sizeof(Entry));
+		if (mUseSlabs && idx < (S32)mEntries.size())
+		{
+			entry = mEntries[idx];
+		}
+		else
+		{
+			S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
+			LLAPRFile* aprfile = openHeaderEntriesFile(true, offset);
+			S32 bytes_read = aprfile->read((void*)&entry, (S32)sizeof(Entry));
+			llassert_always(bytes_read == sizeof(Entry));
+			closeHeaderEntriesFile();
+		}
 		llassert_always(entry.mImageSize == 0 || entry.mImageSize == -1 || entry.mImageSize > entry.mBodySize);
-		closeHeaderEntriesFile();
 	}
 	return idx;
 }
@@ -1068,6 +1336,13 @@ void LLTextureCache::writeEntryAndClose(S32 idx, Entry& entry)
 			{
 				mTexturesSizeMap[entry.mID] = entry.mBodySize;
 			}
+			if (mUseSlabs && idx < (S32)mEntries.size())
+			{
+				// Batched, see writeDirtyEntries()
+				mEntries[idx] = entry;
+				mDirtyEntries.insert(idx);
+				return;
+			}
 // 			llinfos << "Updating TE: " << idx << ": " << id << " Size: " << entry.mBodySize << " Time: " << entry.mTime << llendl;
 			S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
 			LLAPRFile* aprfile = openHeaderEntriesFile(false, offset);
@@ -1079,8 +1354,59 @@ void LLTextureCache::writeEntryAndClose(S32 idx, Entry& entry)
 	}
 }
 
+// Writes the entries touched since the last call with a single open of texture.entries
+void LLTextureCache::writeDirtyEntries()
+{
+	if (!mReadOnly && !mDirtyEntries.empty())
+	{
+		LLAPRFile* aprfile = openHeaderEntriesFile(false, 0);
+		for (std::set<S32>::iterator iter = mDirtyEntries.begin(); iter != mDirtyEntries.end(); ++iter)
+		{
+			S32 idx = *iter;
+			S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
+			aprfile->seek(APR_SET, offset);
+			S32 bytes_written = aprfile->write((void*)&mEntries[idx], (S32)sizeof(Entry));
+			llassert_always(bytes_written == sizeof(Entry));
+			mHeaderEntriesMaxWriteIdx = llmax(mHeaderEntriesMaxWriteIdx, idx);
+		}
+		closeHeaderEntriesFile();
+	}
+	mDirtyEntries.clear();
+	mEntriesFlushTimer.reset();
+}
+
+// Called with mHeaderMutex locked
+bool LLTextureCache::entriesFlushDue()
+{
+	return (mDirtyEntries.size() >= TEXTURE_ENTRIES_FLUSH_COUNT ||
+			(!mDirtyEntries.empty() && mEntriesFlushTimer.getElapsedTimeF32() > TEXTURE_ENTRIES_FLUSH_SECONDS));
+}
+
+// Called with mHeaderMutex locked
+bool LLTextureCache::slabIndexFlushDue()
+{
+	return mSlabIndexDirty && mSlabIndexFlushTimer.getElapsedTimeF32() > TEXTURE_SLAB_INDEX_FLUSH_SECONDS;
+}
+
+void LLTextureCache::flushEntries()
+{
+	LLMutexLock lock(&mHeaderMutex);
+	if (entriesFlushDue())
+	{
+		writeDirtyEntries();
+	}
+	if (slabIndexFlushDue())
+	{
+		writeSlabIndex();
+	}
+}
+
 U32 LLTextureCache::openAndReadEntries(std::vector<Entry>& entries)
 {
+	if (mUseSlabs)
+	{
+		writeDirtyEntries();
+	}
 	U32 num_entries = mHeaderEntriesInfo.mEntries;
 
 	mHeaderIDMap.clear();
@@ -1118,6 +1444,10 @@ U32 LLTextureCache::openAndReadEntries(std::vector<Entry>& entries)
 		}
 	}
 	closeHeaderEntriesFile();
+	if (mUseSlabs)
+	{
+		mEntries = entries;
+	}
 	return num_entries;
 }
 
@@ -1136,6 +1466,11 @@ void LLTextureCache::writeEntriesAndClose(const std::vector<Entry>& entries)
 		}
 		mHeaderEntriesMaxWriteIdx = llmax(mHeaderEntriesMaxWriteIdx, num_entries-1);
 		closeHeaderEntriesFile();
+		if (mUseSlabs)
+		{
+			mEntries = entries;
+			mDirtyEntries.clear();
+		}
 	}
 }
 
@@ -1150,7 +1485,7 @@ void LLTextureCache::readHeaderCache()
 
 	readEntriesHeader();
 	
-	if (mHeaderEntriesInfo.mVersion != sHeaderCacheVersion)
+	if (mHeaderEntriesInfo.mVersion != (mUseSlabs ? sSlabCacheVersion : sHeaderCacheVersion))
 	{
 		if (!mReadOnly)
 		{
@@ -1274,15 +1609,18 @@ void LLTextureCache::purgeAllTextures(bool purge_directories)
 		{
 			LLFile::rmdir(mTexturesDirName);
 		}
+		purgeSlabs();
 	}
 	mHeaderIDMap.clear();
 	mTexturesSizeMap.clear();
 	mTexturesSizeTotal = 0;
 	mFreeList.clear();
 	mTexturesSizeTotal = 0;
+	mEntries.clear();
+	mDirtyEntries.clear();
 
 	// Info with 0 entries
-	mHeaderEntriesInfo.mVersion = sHeaderCacheVersion;
+	mHeaderEntriesInfo.mVersion = mUseSlabs ? sSlabCacheVersion : sHeaderCacheVersion;
 	mHeaderEntriesInfo.mEntries = 0;
 	writeEntriesHeader();
 }
@@ -1354,6 +1692,15 @@ void LLTextureCache::purgeTextures(bool validate)
 		{
 			purge_entry = true;
 		}
+		else if (validate && mUseSlabs)
+		{
+			// The slab index is in memory, so check every body rather than 1/256th
+			if (!hasSlabBody(entries[idx].mID, entries[idx].mBodySize))
+			{
+				LL_DEBUGS("TextureCache") << "TEXTURE CACHE BODY NOT IN SLABS: " << entries[idx].mID << LL_ENDL;
+				purge_entry = true;
+			}
+		}
 		else if (validate)
 		{
 			// make sure file exists and is the correct size
@@ -1379,7 +1726,14 @@ void LLTextureCache::purgeTextures(bool validate)
 		{
 			purge_count++;
 	 		LL_DEBUGS("TextureCache") << "PURGING: " << filename << LL_ENDL;
-			LLAPRFile::remove(filename);
+			if (mUseSlabs)
+			{
+				freeSlabBody(entries[idx].mID);
+			}
+			else
+			{
+				LLAPRFile::remove(filename);
+			}
 			cache_size -= entries[idx].mBodySize;
 			mTexturesSizeTotal -= entries[idx].mBodySize;
 			entries[idx].mBodySize = 0;
@@ -1387,6 +1741,22 @@ void LLTextureCache::purgeTextures(bool validate)
 		}
 	}
 
+	if (validate && mUseSlabs)
+	{
+		// Release slots whose entry was lost or dropped since the index was written
+		LLMutexLock lock(&mSlabMutex);
+		for (slab_map_t::iterator iter = mSlabBodies.begin(); iter != mSlabBodies.end();)
+		{
+			slab_map_t::iterator curiter = iter++;
+			if (mTexturesSizeMap.find(curiter->first) == mTexturesSizeMap.end())
+			{
+				mSlabClasses[curiter->second.mClass].mFreeSlots.insert(curiter->second.mSlot);
+				mSlabBodies.erase(curiter);
+				mSlabIndexDirty = TRUE;
+			}
+		}
+	}
+
 	LL_DEBUGS("TextureCache") << "TEXTURE CACHE: Writing Entries: " << num_entries << LL_ENDL;
 
 	writeEntriesAndClose(entries);
@@ -1404,6 +1774,252 @@ void LLTextureCache::purgeTextures(bool validate)
 			<< llendl;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Slab backend
+
+//static
+S32 LLTextureCache::getSlabClass(S32 size)
+{
+	S32 slot_size = TEXTURE_SLAB_MIN_SLOT_SIZE;
+	for (S32 cls = 0; cls < TEXTURE_SLAB_CLASS_COUNT; cls++, slot_size <<= 1)
+	{
+		if (size <= slot_size)
+		{
+			return cls;
+		}
+	}
+	return -1;
+}
+
+std::string LLTextureCache::getSlabFileName(S32 cls)
+{
+	return mSlabIndexFileName + llformat(".%d", cls);
+}
+
+// mSlabMutex must be locked for openSlabs(), closeSlabs() and readSlabIndex()!
+// Take a slab class mutex after mSlabMutex, never before it.
+
+void LLTextureCache::openSlabs()
+{
+	apr_int32_t flags = mReadOnly ? APR_READ|APR_BINARY : APR_READ|APR_WRITE|APR_CREATE|APR_BINARY;
+	for (S32 cls = 0; cls < TEXTURE_SLAB_CLASS_COUNT; cls++)
+	{
+		SlabClass& slab = mSlabClasses[cls];
+		llassert_always(slab.mFile == NULL);
+		std::string filename = getSlabFileName(cls);
+		S32 slot_size = TEXTURE_SLAB_MIN_SLOT_SIZE << cls;
+		// Slabs stay open for the life of the cache, so use the long-lived pool
+		slab.mFile = new LLAPRFile(filename, flags, LLAPRFile::global);
+		if (!slab.mFile->getFileHandle())
+		{
+			if (!mReadOnly)
+			{
+				llwarns << "Unable to open texture slab: " << filename << llendl;
+			}
+			delete slab.mFile;
+			slab.mFile = NULL;
+		}
+		// The last slot may only be partially written
+		slab.mNumSlots = slab.mFile ? (LLAPRFile::size(filename) + slot_size - 1) / slot_size : 0;
+		slab.mFreeSlots.clear();
+		for (S32 slot = 0; slot < slab.mNumSlots; slot++)
+		{
+			slab.mFreeSlots.insert(slot);
+		}
+	}
+}
+
+void LLTextureCache::closeSlabs()
+{
+	for (S32 cls = 0; cls < TEXTURE_SLAB_CLASS_COUNT; cls++)
+	{
+		SlabClass& slab = mSlabClasses[cls];
+		LLMutexLock lock(slab.mMutex);
+		delete slab.mFile;
+		slab.mFile = NULL;
+		slab.mNumSlots = 0;
+		slab.mFreeSlots.clear();
+	}
+	mSlabBodies.clear();
+}
+
+void LLTextureCache::purgeSlabs()
+{
+	LLMutexLock lock(&mSlabMutex);
+	for (S32 cls = 0; cls < TEXTURE_SLAB_CLASS_COUNT; cls++)
+	{
+		SlabClass& slab = mSlabClasses[cls];
+		if (slab.mFile)
+		{
+			// Keep open slabs open, just empty them
+			LLMutexLock lock(slab.mMutex);
+			apr_file_trunc(slab.mFile->getFileHandle(), 0);
+		}
+		else
+		{
+			LLAPRFile::remove(getSlabFileName(cls));
+		}
+		slab.mNumSlots = 0;
+		slab.mFreeSlots.clear();
+	}
+	mSlabBodies.clear();
+	LLAPRFile::remove(mSlabIndexFileName);
+	mSlabIndexDirty = FALSE;
+}
+
+void LLTextureCache::readSlabIndex()
+{
+	mSlabBodies.clear();
+	S32 size = LLAPRFile::size(mSlabIndexFileName);
+	if (size < (S32)sizeof(SlabIndexHeader))
+	{
+		return;
+	}
+	std::vector<U8> buffer(size);
+	if (LLAPRFile::readEx(mSlabIndexFileName, &buffer[0], 0, size) != size)
+	{
+		llwarns << "Unable to read texture slab index" << llendl;
+		return;
+	}
+	SlabIndexHeader header;
+	memcpy(&header, &buffer[0], sizeof(SlabIndexHeader));
+	if (header.mVersion != TEXTURE_SLAB_INDEX_VERSION ||
+		header.mCount < 0 ||
+		(S32)sizeof(SlabIndexHeader) + header.mCount * (S32)sizeof(SlabIndexRecord) != size)
+	{
+		llwarns << "Discarding bad texture slab index" << llendl;
+		return;
+	}
+	S32 bad_records = 0;
+	for (S32 i = 0; i < header.mCount; i++)
+	{
+		SlabIndexRecord record;
+		memcpy(&record, &buffer[sizeof(SlabIndexHeader) + i * sizeof(SlabIndexRecord)], sizeof(SlabIndexRecord));
+		if (record.mClass < 0 || record.mClass >= TEXTURE_SLAB_CLASS_COUNT ||
+			record.mSize <= 0 ||
+			record.mSize + (S32)sizeof(SlabSlotHeader) > (TEXTURE_SLAB_MIN_SLOT_SIZE << record.mClass) ||
+			mSlabClasses[record.mClass].mFreeSlots.erase(record.mSlot) == 0 || // out of range or used twice
+			mSlabBodies.find(record.mID) != mSlabBodies.end())
+		{
+			++bad_records;
+			continue;
+		}
+		mSlabBodies[record.mID] = SlabBody(record.mClass, record.mSlot, record.mSize);
+	}
+	if (bad_records)
+	{
+		llwarns << "Ignored " << bad_records << " bad texture slab index records" << llendl;
+	}
+}
+
+// Snapshot of mSlabBodies. Slots reused after the last snapshot are caught by the
+// SlabSlotHeader check in readBody(), so it only needs writing now and then.
+void LLTextureCache::writeSlabIndex()
+{
+	if (mReadOnly)
+	{
+		return;
+	}
+	std::vector<U8> buffer;
+	{
+		LLMutexLock lock(&mSlabMutex);
+		SlabIndexHeader header;
+		header.mVersion = TEXTURE_SLAB_INDEX_VERSION;
+		header.mCount = (S32)mSlabBodies.size();
+		buffer.resize(sizeof(SlabIndexHeader) + header.mCount * sizeof(SlabIndexRecord));
+		memcpy(&buffer[0], &header, sizeof(SlabIndexHeader));
+		U8* dest = &buffer[sizeof(SlabIndexHeader)];
+		for (slab_map_t::iterator iter = mSlabBodies.begin(); iter != mSlabBodies.end(); ++iter)
+		{
+			SlabIndexRecord record;
+			record.mID = iter->first;
+			record.mClass = iter->second.mClass;
+			record.mSlot = iter->second.mSlot;
+			record.mSize = iter->second.mSize;
+			memcpy(dest, &record, sizeof(SlabIndexRecord));
+			dest += sizeof(SlabIndexRecord);
+		}
+		mSlabIndexDirty = FALSE;
+	}
+	mSlabIndexFlushTimer.reset();
+
+	std::string tmp_filename = mSlabIndexFileName + ".tmp";
+	LLAPRFile::remove(tmp_filename);
+	S32 size = (S32)buffer.size();
+	if (LLAPRFile::writeEx(tmp_filename, &buffer[0], 0, size) != size ||
+		!LLAPRFile::rename(tmp_filename, mSlabIndexFileName))
+	{
+		llwarns << "Unable to write texture slab index" << llendl;
+		LLAPRFile::remove(tmp_filename);
+		mSlabIndexDirty = TRUE;
+	}
+}
+
+// Finds (or keeps) a slot large enough for a body of size bytes
+bool LLTextureCache::allocSlabBody(const LLUUID& id, S32 size)
+{
+	S32 cls = getSlabClass(size + (S32)sizeof(SlabSlotHeader));
+	if (cls < 0)
+	{
+		return false;
+	}
+	LLMutexLock lock(&mSlabMutex);
+	slab_map_t::iterator iter = mSlabBodies.find(id);
+	if (iter != mSlabBodies.end())
+	{
+		if (iter->second.mClass == cls)
+		{
+			iter->second.mSize = size;
+			mSlabIndexDirty = TRUE;
+			return true;
+		}
+		mSlabClasses[iter->second.mClass].mFreeSlots.insert(iter->second.mSlot);
+		mSlabBodies.erase(iter);
+	}
+	SlabClass& slab = mSlabClasses[cls];
+	if (!slab.mFile)
+	{
+		return false;
+	}
+	S32 slot;
+	if (!slab.mFreeSlots.empty())
+	{
+		// Lowest free slot first to keep the slab dense
+		slot = *slab.mFreeSlots.begin();
+		slab.mFreeSlots.erase(slab.mFreeSlots.begin());
+	}
+	else if (slab.mNumSlots < TEXTURE_SLAB_MAX_FILE_SIZE / (TEXTURE_SLAB_MIN_SLOT_SIZE << cls))
+	{
+		slot = slab.mNumSlots++;
+	}
+	else
+	{
+		return false;
+	}
+	mSlabBodies[id] = SlabBody(cls, slot, size);
+	mSlabIndexDirty = TRUE;
+	return true;
+}
+
+void LLTextureCache::freeSlabBody(const LLUUID& id)
+{
+	LLMutexLock lock(&mSlabMutex);
+	slab_map_t::iterator iter = mSlabBodies.find(id);
+	if (iter != mSlabBodies.end())
+	{
+		mSlabClasses[iter->second.mClass].mFreeSlots.insert(iter->second.mSlot);
+		mSlabBodies.erase(iter);
+		mSlabIndexDirty = TRUE;
+	}
+}
+
+bool LLTextureCache::hasSlabBody(const LLUUID& id, S32 size)
+{
+	LLMutexLock lock(&mSlabMutex);
+	slab_map_t::iterator iter = mSlabBodies.find(id);
+	return iter != mSlabBodies.end() && iter->second.mSize == size;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 // call lockWorkers() first!
@@ -1629,8 +2245,15 @@ void LLTextureCache::removeFromCache(const LLUUID& id)
 	if (!mReadOnly)
 	{
 		removeHeaderCacheEntry(id);
-		LLMutexLock lock(&mHeaderMutex);
-		LLAPRFile::remove(getTextureFileName(id));
+		if (mUseSlabs)
+		{
+			freeSlabBody(id);
+		}
+		else
+		{
+			LLMutexLock lock(&mHeaderMutex);
+			LLAPRFile::remove(getTextureFileName(id));
+		}
 	}
 }
 
@@ -37,11 +37,15 @@
 #include "llstl.h"
 #include "llstring.h"
 #include "lluuid.h"
+#include "llframetimer.h"
 
 #include "llworkerthread.h"
 
+class LLAPRFile;
 class LLTextureCacheWorker;
 
+const S32 TEXTURE_SLAB_CLASS_COUNT = 13; // 4KB to 16MB slots
+
 class LLTextureCache : public LLWorkerThread
 {
 	friend class LLTextureCacheWorker;
@@ -67,6 +71,23 @@ private:
 		S32 mBodySize; // size of body file in body cache
 		U32 mTime; // seconds since 1/1/1970
 	};
+	// Slab backend: location of a body in one of the slab files
+	struct SlabBody
+	{
+		SlabBody() : mClass(-1), mSlot(-1), mSize(0) {}
+		SlabBody(S32 cls, S32 slot, S32 size) : mClass(cls), mSlot(slot), mSize(size) {}
+		S32 mClass; // slab file, slots are (TEXTURE_SLAB_MIN_SLOT_SIZE << mClass) bytes
+		S32 mSlot; // slot index within the slab file
+		S32 mSize; // size of the body stored in the slot
+	};
+	struct SlabClass
+	{
+		SlabClass() : mFile(NULL), mMutex(NULL), mNumSlots(0) {}
+		LLAPRFile* mFile;
+		LLMutex* mMutex; // held across each seek and read/write of mFile
+		S32 mNumSlots; // mNumSlots and mFreeSlots are protected by mSlabMutex
+		std::set<S32> mFreeSlots;
+	};
 
 	
 public:
@@ -97,13 +118,13 @@ public:
 		}
 	};
 	
-	LLTextureCache(bool threaded);
+	LLTextureCache(bool threaded, LLThreadPool* pool = NULL);
 	~LLTextureCache();
 
 	/*virtual*/ S32 update(U32 max_time_ms);	
 	
 	void purgeCache(ELLPath location);
-	S64 initCache(ELLPath location, S64 maxsize, BOOL read_only);
+	S64 initCache(ELLPath location, S64 maxsize, BOOL read_only, BOOL use_slabs = FALSE);
 
 	handle_t readFromCache(const std::string& local_filename, const LLUUID& id, U32 priority, S32 offset, S32 size,
 						   ReadResponder* responder);
@@ -131,6 +152,7 @@ public:
 	S64 getMaxUsage() { return sCacheMaxTexturesSize; }
 	U32 getEntries() { return mHeaderEntriesInfo.mEntries; }
 	U32 getMaxEntries() { return sCacheMaxEntries; };
+	BOOL usesSlabs() { return mUseSlabs; }
 
 protected:
 	// Accessed by LLTextureCacheWorker
@@ -138,6 +160,10 @@ protected:
 	std::string getLocalFileName(const LLUUID& id);
 	std::string getTextureFileName(const LLUUID& id);
 	void addCompleted(Responder* responder, bool success);
+	// Body storage, dispatches to the per-texture files or the slab files
+	S32 getBodySize(const LLUUID& id);
+	S32 readBody(const LLUUID& id, U8* data, S32 offset, S32 size);
+	S32 writeBody(const LLUUID& id, U8* data, S32 size);
 	
 protected:
 	//void setFileAPRPool(apr_pool_t* pool) { mFileAPRPool = pool ; }
@@ -158,12 +184,50 @@ private:
 	S32 getHeaderCacheEntry(const LLUUID& id, S32& imagesize);
 	S32 setHeaderCacheEntry(const LLUUID& id, S32 imagesize);
 	bool removeHeaderCacheEntry(const LLUUID& id);
+	void writeDirtyEntries();
+	bool entriesFlushDue();
+	bool slabIndexFlushDue();
+	void flushEntries(); // CACHE THREAD, see FlushRequest
+
+	// Slab backend
+	static S32 getSlabClass(S32 size);
+	std::string getSlabFileName(S32 cls);
+	void openSlabs();
+	void closeSlabs();
+	void purgeSlabs();
+	void readSlabIndex();
+	void writeSlabIndex();
+	bool allocSlabBody(const LLUUID& id, S32 size);
+	void freeSlabBody(const LLUUID& id);
+	bool hasSlabBody(const LLUUID& id, S32 size);
 	
+private:
+	// Writes out the batched slab mode entries and slab index, queued by update()
+	// so that the file writes never run on the main thread
+	class FlushRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		~FlushRequest() {}; // use deleteRequest()
+
+	public:
+		FlushRequest(handle_t handle, LLTextureCache* cache);
+
+		/*virtual*/ bool processRequest();
+		/*virtual*/ void finishRequest(bool completed);
+		/*virtual*/ void deleteRequest();
+
+	private:
+		LLTextureCache* mCache;
+	};
+	friend class FlushRequest;
+
 private:
 	// Internal
 	LLMutex mWorkersMutex;
 	LLMutex mHeaderMutex;
 	LLMutex mListMutex;
+	LLMutex mSlabMutex;
+	LLMutex mBodyStatsMutex;
 	LLAPRFile* mHeaderAPRFile;
 	
 	typedef std::map<handle_t, LLTextureCacheWorker*> handle_map_t;
@@ -177,6 +241,7 @@ private:
 	responder_list_t mCompletedList;
 	
 	BOOL mReadOnly;
+	BOOL mUseSlabs;
 	
 	// HEADERS (Include first mip)
 	std::string mHeaderEntriesFileName;
@@ -194,8 +259,31 @@ private:
 	S64 mTexturesSizeTotal;
 	LLAtomic32<BOOL> mDoPurge;
 
+	// SLABS (bodies packed into one file per slot size, slab mode only)
+	// mEntries mirrors texture.entries so lookups never touch the disk;
+	// touched entries are queued in mDirtyEntries and written out in batches.
+	std::string mSlabIndexFileName;
+	std::vector<Entry> mEntries;
+	std::set<S32> mDirtyEntries;
+	LLFrameTimer mEntriesFlushTimer;
+	typedef std::map<LLUUID,SlabBody> slab_map_t;
+	slab_map_t mSlabBodies; // protected by mSlabMutex
+	SlabClass mSlabClasses[TEXTURE_SLAB_CLASS_COUNT];
+	BOOL mSlabIndexDirty;
+	LLFrameTimer mSlabIndexFlushTimer;
+	LLAtomic32<BOOL> mFlushPending; // a FlushRequest is queued
+
+	// Body I/O totals, logged on shutdown (protected by mBodyStatsMutex)
+	U32 mBodyReads;
+	U32 mBodyWrites;
+	S64 mBodyReadBytes;
+	S64 mBodyWriteBytes;
+	F64 mBodyReadTime;
+	F64 mBodyWriteTime;
+
 	// Statics
 	static F32 sHeaderCacheVersion;
+	static F32 sSlabCacheVersion;
 	static U32 sCacheMaxEntries;
 	static S64 sCacheMaxTexturesSize;
 };
@@ -408,7 +408,7 @@ void LLGLTexMemBar::draw()
 					max_total_mem,
 					bound_mem,
 					max_bound_mem,
-					LLImageRaw::sGlobalRawMemory >> 20,					discard_bias,
+					(S32)LLImageRaw::sGlobalRawMemory >> 20,					discard_bias,
 					cache_usage, cache_max_usage);
 	//, cache_entries, cache_max_entries
 
@@ -485,7 +485,7 @@ void LLGLTexMemBar::draw()
 					LLAppViewer::getTextureCache()->getNumReads(), LLAppViewer::getTextureCache()->getNumWrites(),
 					LLLFSThread::sLocal->getPending(),
 					LLAppViewer::getImageDecodeThread()->getPending(), 
-					LLImageRaw::sRawImageCount,
+					(S32)LLImageRaw::sRawImageCount,
 					LLAppViewer::getTextureFetch()->getNumHTTPRequests());
 
 	LLFontGL::getFontMonospace()->renderUTF8(text, 0, 0, line_height*2,
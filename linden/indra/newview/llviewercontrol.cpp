@@ -66,6 +66,8 @@
 #include "llkeyboard.h"
 #include "llerrorcontrol.h"
 #include "llappviewer.h"
+#include "llprimitive.h"
+#include "llvolumemgr.h"
 #include "llvosurfacepatch.h"
 #include "llvowlsky.h"
 #include "llrender.h"
@@ -398,6 +400,30 @@ static bool handleRenderDynamicLODChanged(const LLSD& newvalue)
 	return true;
 }
 
+static bool handleRenderAsyncVolumeLODChanged(const LLSD& newvalue)
+{
+	LLPrimitive::getVolumeManager()->setGenerateThread(newvalue.asBoolean() ? LLAppViewer::getVolumeThread() : NULL);
+	return true;
+}
+
+static bool handleRenderVolumeCacheSizeChanged(const LLSD& newvalue)
+{
+	LLPrimitive::getVolumeManager()->setCacheSize(newvalue.asInteger() * 1024);
+	return true;
+}
+
+static bool handleRenderParallelCullChanged(const LLSD& newvalue)
+{
+	LLPipeline::sParallelCull = newvalue.asBoolean();
+	return true;
+}
+
+static bool handleRenderParallelGeometryChanged(const LLSD& newvalue)
+{
+	LLPipeline::sParallelGeometry = newvalue.asBoolean();
+	return true;
+}
+
 static bool handleRenderUseFBOChanged(const LLSD& newvalue)
 {
 	LLRenderTarget::sUseFBO = newvalue.asBoolean();
@@ -558,6 +584,10 @@ void settings_setup_listeners()
 	gSavedSettings.getControl("RenderFogRatio")->getSignal()->connect(boost::bind(&handleFogRatioChanged, _1));
 	gSavedSettings.getControl("RenderMaxPartCount")->getSignal()->connect(boost::bind(&handleMaxPartCountChanged, _1));
 	gSavedSettings.getControl("RenderDynamicLOD")->getSignal()->connect(boost::bind(&handleRenderDynamicLODChanged, _1));
+	gSavedSettings.getControl("RenderAsyncVolumeLOD")->getSignal()->connect(boost::bind(&handleRenderAsyncVolumeLODChanged, _1));
+	gSavedSettings.getControl("RenderVolumeCacheSize")->getSignal()->connect(boost::bind(&handleRenderVolumeCacheSizeChanged, _1));
+	gSavedSettings.getControl("RenderParallelCull")->getSignal()->connect(boost::bind(&handleRenderParallelCullChanged, _1));
+	gSavedSettings.getControl("RenderParallelGeometry")->getSignal()->connect(boost::bind(&handleRenderParallelGeometryChanged, _1));
 	gSavedSettings.getControl("RenderDebugTextureBind")->getSignal()->connect(boost::bind(&handleResetVertexBuffersChanged, _1));
 	gSavedSettings.getControl("RenderFastAlpha")->getSignal()->connect(boost::bind(&handleResetVertexBuffersChanged, _1));
 	gSavedSettings.getControl("RenderObjectBump")->getSignal()->connect(boost::bind(&handleResetVertexBuffersChanged, _1));
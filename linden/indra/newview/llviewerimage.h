@@ -311,8 +311,10 @@ public:
 
 	BOOL        isSameTexture(const LLViewerImage* tex) const ;
 
+	typedef std::list<LLFace*> ll_face_list_t ;
 	void        addFace(LLFace* facep) ;
 	void        removeFace(LLFace* facep) ;
+	const ll_face_list_t& getFaceList() const { return mFaceList ; }
 private:
 	/*virtual*/ void cleanup(); // Cleanup the LLViewerImage (so we can reinitialize it)
 
@@ -412,7 +414,6 @@ private:
 	BOOL   mForSculpt ; //a flag if the texture is used for a sculpt data.
 	mutable BOOL    mNeedsResetMaxVirtualSize ;
 
-	typedef std::list<LLFace*> ll_face_list_t ;
 	ll_face_list_t mFaceList ; //reverse pointer pointing to the faces using this image as texture
 
 public:
@@ -53,10 +53,12 @@
 #include "message.h"
 
 #include "llagent.h"
+#include "llface.h"
 #include "lltexturecache.h"
 #include "lltexturefetch.h"
 #include "llviewercontrol.h"
 #include "llviewerimage.h"
+#include "llviewerobject.h"
 #include "llviewermedia.h"
 #include "llviewerregion.h"
 #include "llviewerstats.h"
@@ -86,6 +88,7 @@ LLStat LLViewerImageList::sFormattedMemStat(32, TRUE);
 
 LLViewerImageList::LLViewerImageList() 
 	: mForceResetTextureStats(FALSE),
+	mRegionImagesLoaded(FALSE),
 	mUpdateStats(FALSE),
 	mMaxResidentTexMemInMegaBytes(0),
 	mMaxTotalTextureMemInMegaBytes(0)
@@ -171,6 +174,18 @@ void LLViewerImageList::doPreloadImages()
 	
 }
 
+// Textures worth remembering across sessions or regions
+static bool is_prefetch_candidate(LLViewerImage* image)
+{
+	if (!image->getUseDiscard() ||
+		image->needsAux() ||
+		image->getTargetHost() != LLHost::invalid)
+	{
+		return false; // avoid UI, baked, and other special images
+	}
+	return image->getBoundRecently();
+}
+
 static std::string get_texture_list_name()
 {
 	BOOL login_last = gSavedSettings.getBOOL("LoginLastLocation");
@@ -211,6 +226,104 @@ void LLViewerImageList::doPrefetchImages()
 	
 }
 
+const char* region_images_filename = "texture_regions.xml";
+
+void LLViewerImageList::recordRegionImages(U64 region_handle)
+{
+	if (!gSavedSettings.getBOOL("TexturePrefetchByRegion"))
+	{
+		return;
+	}
+	loadRegionImages();
+
+	// Record what is actually resident, with the regions of the objects using
+	// it: mImageList also holds the neighbouring regions' textures
+	LLRegionImageLists::image_list_t images;
+	for (image_priority_list_t::iterator iter = mImageList.begin();
+		 iter != mImageList.end(); ++iter)
+	{
+		LLViewerImage* image = *iter;
+		const LLViewerImage::ll_face_list_t& faces = image->getFaceList();
+		if (faces.empty() || !is_prefetch_candidate(image))
+		{
+			continue;
+		}
+		S32 discard = image->getDiscardLevel();
+		if (discard < 0 || discard >= MAX_DISCARD_LEVEL)
+		{
+			continue;
+		}
+		S32 pixel_area = image->getWidth(discard) * image->getHeight(discard);
+		std::set<U64> regions;
+		for (LLViewerImage::ll_face_list_t::const_iterator face_iter = faces.begin();
+			 face_iter != faces.end(); ++face_iter)
+		{
+			LLViewerObject* objectp = (*face_iter)->getViewerObject();
+			if (objectp && objectp->getRegion() && regions.insert(objectp->getRegion()->getHandle()).second)
+			{
+				images.push_back(LLRegionImageLists::Image(image->getID(), discard, pixel_area,
+														   objectp->getRegion()->getHandle()));
+			}
+		}
+	}
+	mRegionImages.record(region_handle, images);
+}
+
+void LLViewerImageList::prefetchRegionImages(U64 region_handle)
+{
+	if (!gSavedSettings.getBOOL("TexturePrefetchByRegion") ||
+		LLAppViewer::instance()->getPurgeCache())
+	{
+		return;
+	}
+	loadRegionImages();
+	LLRegionImageLists::image_list_t images;
+	if (!mRegionImages.get(region_handle, images))
+	{
+		return;
+	}
+
+	// The list is stored largest first, so requests go out in priority order.
+	// New images start in the texture cache (LLTextureCache readers) and get
+	// decoded from there, well before the objects using them are rezzed.
+	S32 requested = 0;
+	for (LLRegionImageLists::image_list_t::iterator iter = images.begin();
+		 iter != images.end(); ++iter)
+	{
+		LLViewerImage* image = hasImage(iter->mID);
+		if (image && image->getDiscardLevel() >= 0 && image->getDiscardLevel() <= iter->mDiscard)
+		{
+			continue; // already have it
+		}
+		image = getImage(iter->mID, MIPMAP_TRUE, FALSE);
+		if (image)
+		{
+			image->addTextureStats((F32)iter->mArea);
+			++requested;
+		}
+	}
+	LL_DEBUGS("ViewerImages") << "Prefetching " << requested << " textures for region " << region_handle << LL_ENDL;
+}
+
+void LLViewerImageList::loadRegionImages()
+{
+	if (mRegionImagesLoaded)
+	{
+		return;
+	}
+	mRegionImagesLoaded = TRUE;
+	mRegionImages.load(gDirUtilp->getExpandedFilename(LL_PATH_CACHE, region_images_filename));
+}
+
+void LLViewerImageList::saveRegionImages()
+{
+	if (!mRegionImagesLoaded || gDirUtilp->getExpandedFilename(LL_PATH_CACHE, "").empty())
+	{
+		return;
+	}
+	mRegionImages.save(gDirUtilp->getExpandedFilename(LL_PATH_CACHE, region_images_filename));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 LLViewerImageList::~LLViewerImageList()
@@ -229,15 +342,9 @@ void LLViewerImageList::shutdown()
 		 iter != mImageList.end(); ++iter)
 	{
 		LLViewerImage* image = *iter;
-		if (!image->getUseDiscard() ||
-			image->needsAux() ||
-			image->getTargetHost() != LLHost::invalid)
+		if (!is_prefetch_candidate(image))
 		{
-			continue; // avoid UI, baked, and other special images
-		}
-		if(!image->getBoundRecently())
-		{
-			continue ;
+			continue;
 		}
 		S32 desired = image->getDesiredDiscardLevel();
 		if (desired >= 0 && desired < MAX_DISCARD_LEVEL)
@@ -267,6 +374,8 @@ void LLViewerImageList::shutdown()
 		file.open(filename);
 		LLSDSerialize::toPrettyXML(imagelist, file);
 	}
+
+	saveRegionImages();
 	
 	//
 	// Clean up "loaded" callbacks.
@@ -36,9 +36,11 @@
 #include "lluuid.h"
 //#include "message.h"
 #include "llgl.h"
+#include "llsd.h"
 #include "llstat.h"
 #include "llviewerimage.h"
 #include "llui.h"
+#include "llregionimagelists.h"
 #include <list>
 #include <set>
 
@@ -147,6 +149,11 @@ public:
 	void doPreloadImages();
 	void doPrefetchImages();
 
+	// Per region cache warmup: remember the textures used by objects in a region
+	// and request them again, largest first, when the region is entered
+	void recordRegionImages(U64 region_handle);
+	void prefetchRegionImages(U64 region_handle);
+
 	static S32 getMinVideoRamSetting();
 	static S32 getMaxVideoRamSetting(bool get_recommended = false);
 	
@@ -155,6 +162,8 @@ private:
 	F32  updateImagesCreateTextures(F32 max_time);
 	F32  updateImagesFetchTextures(F32 max_time);
 	void updateImagesUpdateStats();
+	void loadRegionImages();
+	void saveRegionImages();
 	
 public:
 	typedef std::set<LLPointer<LLViewerImage> > image_list_t;	
@@ -179,6 +188,10 @@ private:
 	// simply holds on to LLViewerImage references to stop them from being purged too soon
 	std::set<LLPointer<LLViewerImage> > mImagePreloads;
 
+	// region handle -> textures resident when the agent left it
+	LLRegionImageLists mRegionImages;
+	BOOL mRegionImagesLoaded;
+
 	BOOL mUpdateStats;
 	S32	mMaxResidentTexMemInMegaBytes;
 	S32 mMaxTotalTextureMemInMegaBytes;
@@ -366,8 +366,8 @@ void output_statistics(void*)
 	llinfos << "Num images: " << gImageList.getNumImages() << llendl;
 	llinfos << "Texture usage: " << LLImageGL::sGlobalTextureMemoryInBytes << llendl;
 	llinfos << "Texture working set: " << LLImageGL::sBoundTextureMemoryInBytes << llendl;
-	llinfos << "Raw usage: " << LLImageRaw::sGlobalRawMemory << llendl;
-	llinfos << "Formatted usage: " << LLImageFormatted::sGlobalFormattedMemory << llendl;
+	llinfos << "Raw usage: " << (S32)LLImageRaw::sGlobalRawMemory << llendl;
+	llinfos << "Formatted usage: " << (S32)LLImageFormatted::sGlobalFormattedMemory << llendl;
 	llinfos << "Zombie Viewer Objects: " << LLViewerObject::getNumZombieObjects() << llendl;
 	llinfos << "Number of lights: " << gPipeline.getLightCount() << llendl;
 
@@ -760,6 +760,11 @@ void send_stats()
 	fail["off_circuit"] = (S32) gMessageSystem->mOffCircuitPackets;
 	fail["invalid"] = (S32) gMessageSystem->mInvalidOnCircuitPackets;
 
+	if (gVFS)
+	{
+		body["stats"]["vfs"] = gVFS->getStatistics();
+	}
+
 	// Misc stats, two strings and two ints
 	// These are not expecticed to persist across multiple releases
 	// Comment any changes with your name and the expected release revision
@@ -41,6 +41,8 @@
 #include "llviewerregion.h"
 #include "llframetimer.h"
 #include "llagent.h"
+#include "llappviewer.h"
+#include "lllayerdecodethread.h"
 #include "llsurface.h"
 
 LLVLManager gVLManager;
@@ -81,20 +83,27 @@ void LLVLManager::unpackData(const S32 num_packets)
 {
 	static LLFrameTimer decode_timer;
 	
+	LLLayerDecodeThread *decode_thread = LLAppViewer::getLayerDecodeThread();
+
 	S32 i;
 	for (i = 0; i < mPacketData.count(); i++)
 	{
 		LLVLData *datap = mPacketData[i];
 
+		if (LAND_LAYER_CODE == datap->mType)
+		{
+			// Land packets carry many patches, so decode each in one request
+			// on the layer decode thread.
+			LLQueuedThread::handle_t handle = decode_thread->decodeLayer(datap->mData, datap->mSize);
+			mPendingLayers.push_back(PendingLayer(handle, datap->mRegionp));
+			continue;
+		}
+
 		LLBitPack bit_pack(datap->mData, datap->mSize);
 		LLGroupHeader goph;
 
 		decode_patch_group_header(bit_pack, &goph);
-		if (LAND_LAYER_CODE == datap->mType)
-		{
-			datap->mRegionp->getLand().decompressDCTPatch(bit_pack, &goph, FALSE);
-		}
-		else if (WIND_LAYER_CODE == datap->mType)
+		if (WIND_LAYER_CODE == datap->mType)
 		{
 			datap->mRegionp->mWind.decompress(bit_pack, &goph);
 
@@ -111,6 +120,31 @@ void LLVLManager::unpackData(const S32 num_packets)
 	}
 	mPacketData.reset();
 
+	decode_thread->update(1); // unpauses the layer decode thread
+	applyDecodedLayers();
+}
+
+void LLVLManager::applyDecodedLayers()
+{
+	LLLayerDecodeThread *decode_thread = LLAppViewer::getLayerDecodeThread();
+
+	// Apply in arrival order, so a newer packet for a patch always wins
+	while (!mPendingLayers.empty())
+	{
+		PendingLayer &pending = mPendingLayers.front();
+		LLLayerDecodeThread::LayerRequest *req = decode_thread->getDecodedLayer(pending.mHandle);
+		if (!req)
+		{
+			break;
+		}
+		if (!req->isValid())
+		{
+			llwarns << "Received malformed terrain packet" << llendl;
+		}
+		pending.mRegionp->getLand().applyDecodedPatches(req->mGroupHeader, req->mPatches);
+		decode_thread->releaseLayer(pending.mHandle);
+		mPendingLayers.pop_front();
+	}
 }
 
 void LLVLManager::resetBitCounts()
@@ -153,6 +187,24 @@ void LLVLManager::cleanupData(LLViewerRegion *regionp)
 			cur++;
 		}
 	}
+
+	LLLayerDecodeThread *decode_thread = LLAppViewer::getLayerDecodeThread();
+	std::deque<PendingLayer>::iterator iter = mPendingLayers.begin();
+	while (iter != mPendingLayers.end())
+	{
+		if (iter->mRegionp == regionp)
+		{
+			if (decode_thread)
+			{
+				decode_thread->releaseLayer(iter->mHandle);
+			}
+			iter = mPendingLayers.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
 }
 
 LLVLData::LLVLData(LLViewerRegion *regionp, const S8 type, U8 *data, const S32 size)
@@ -35,8 +35,11 @@
 
 // This class manages the data coming in for viewer layers from the network.
 
+#include <deque>
+
 #include "stdtypes.h"
 #include "lldarray.h"
+#include "llqueuedthread.h"
 
 class LLVLData;
 class LLViewerRegion;
@@ -60,8 +63,20 @@ public:
 
 	void cleanupData(LLViewerRegion *regionp);
 protected:
+	void applyDecodedLayers();
 
 	LLDynamicArray<LLVLData *> mPacketData;
+
+	// Land layers queued on the layer decode thread, oldest first
+	struct PendingLayer
+	{
+		PendingLayer(LLQueuedThread::handle_t handle, LLViewerRegion *regionp)
+			: mHandle(handle), mRegionp(regionp) {}
+		LLQueuedThread::handle_t mHandle;
+		LLViewerRegion *mRegionp;
+	};
+	std::deque<PendingLayer> mPendingLayers;
+
 	U32 mLandBits;
 	U32 mWindBits;
 	U32 mCloudBits;
@@ -63,6 +63,8 @@
 #include "llworld.h"
 #include "llselectmgr.h"
 #include "pipeline.h"
+#include "llappviewer.h"
+#include "llvolumefacefill.h"
 
 const S32 MIN_QUIET_FRAMES_COALESCE = 30;
 const F32 FORCE_SIMPLE_RENDER_AREA = 512.f;
@@ -1085,6 +1087,12 @@ BOOL LLVOVolume::updateGeometry(LLDrawable *drawable)
 		updateFaceFlags();
 		return res;
 	}
+
+	if (mLODChanged && !mVolumeChanged && !mFaceMappingChanged && !mSculptChanged &&
+		!LLPrimitive::getVolumeManager()->requestVolume(getVolume()->getParams(), mLOD))
+	{	//keep drawing the current LOD until the new one has been generated
+		return FALSE;
+	}
 	
 	dirtySpatialGroup();
 
@@ -1758,6 +1766,7 @@ const LLMatrix4 LLVOVolume::getRenderMatrix() const
 void LLVOVolume::preUpdateGeom()
 {
 	sNumLODChanges = 0;
+	LLPrimitive::getVolumeManager()->update();
 }
 
 void LLVOVolume::parameterChanged(U16 param_type, bool local_origin)
@@ -2423,7 +2432,28 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 {
 	if (group->isState(LLSpatialGroup::MESH_DIRTY))
 	{
-		S32 num_mapped_veretx_buffer = LLVertexBuffer::sMappedCount ;
+		std::vector<LLSpatialGroup*> groups(1, group);
+		rebuildMeshes(groups);
+	}
+}
+
+//static
+void LLVolumeGeometryManager::rebuildMeshes(const std::vector<LLSpatialGroup*>& groups)
+{
+	S32 num_mapped_veretx_buffer = LLVertexBuffer::sMappedCount ;
+
+	//map the buffers and set up the fills, which write the geometry without
+	//touching GL or the objects
+	static LLVolumeFaceFill::fill_list_t fills;
+	fills.clear();
+
+	for (std::vector<LLSpatialGroup*>::const_iterator group_iter = groups.begin(); group_iter != groups.end(); ++group_iter)
+	{
+		LLSpatialGroup* group = *group_iter;
+		if (!group->isState(LLSpatialGroup::MESH_DIRTY))
+		{
+			continue;
+		}
 
 		group->mBuilt = 1.f;
 		
@@ -2446,15 +2476,32 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 					LLFace* face = drawablep->getFace(i);
 					if (face && face->mVertexBuffer.notNull())
 					{
-						face->getGeometryVolume(*volume, face->getTEOffset(), 
-							vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), face->getGeomIndex());
+						fills.push_back(LLVolumeFaceFill());
+						if (!face->prepareGeometryVolume(*volume, face->getTEOffset(), 
+							vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), face->getGeomIndex(), fills.back()))
+						{
+							fills.pop_back();
+						}
 					}
 				}
 
 				drawablep->clearState(LLDrawable::REBUILD_ALL);
 			}
 		}
-		
+	}
+
+	//write the geometry, on the geometry thread as well when there is enough
+	LLVolumeFaceFill::fillAll(fills, LLPipeline::sParallelGeometry ? LLAppViewer::getGeometryThread() : NULL);
+	fills.clear();
+
+	for (std::vector<LLSpatialGroup*>::const_iterator group_iter = groups.begin(); group_iter != groups.end(); ++group_iter)
+	{
+		LLSpatialGroup* group = *group_iter;
+		if (!group->isState(LLSpatialGroup::MESH_DIRTY))
+		{
+			continue;
+		}
+
 		//unmap all the buffers
 		for (LLSpatialGroup::buffer_map_t::iterator i = group->mBufferMap.begin(); i != group->mBufferMap.end(); ++i)
 		{
@@ -2474,17 +2521,25 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 		}
 		
 		// don't forget alpha
-		if(	group != NULL && 
-			!group->mVertexBuffer.isNull() && 
+		if(	!group->mVertexBuffer.isNull() && 
 			group->mVertexBuffer->isLocked())
 		{
 			group->mVertexBuffer->setBuffer(0);
 		}
+	}
 
-		//if not all buffers are unmapped
-		if(num_mapped_veretx_buffer != LLVertexBuffer::sMappedCount) 
+	//if not all buffers are unmapped
+	if(num_mapped_veretx_buffer != LLVertexBuffer::sMappedCount) 
+	{
+		llwarns << "Not all mapped vertex buffers are unmapped!" << llendl ; 
+		for (std::vector<LLSpatialGroup*>::const_iterator group_iter = groups.begin(); group_iter != groups.end(); ++group_iter)
 		{
-			llwarns << "Not all mapped vertex buffers are unmapped!" << llendl ; 
+			LLSpatialGroup* group = *group_iter;
+			if (!group->isState(LLSpatialGroup::MESH_DIRTY))
+			{
+				continue;
+			}
+
 			for (LLSpatialGroup::element_iter drawable_iter = group->getData().begin(); drawable_iter != group->getData().end(); ++drawable_iter)
 			{
 				LLDrawable* drawablep = *drawable_iter;
@@ -2498,8 +2553,11 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 				}
 			} 
 		}
+	}
 
-		group->clearState(LLSpatialGroup::MESH_DIRTY);
+	for (std::vector<LLSpatialGroup*>::const_iterator group_iter = groups.begin(); group_iter != groups.end(); ++group_iter)
+	{
+		(*group_iter)->clearState(LLSpatialGroup::MESH_DIRTY);
 	}
 }
 
@@ -239,6 +239,8 @@ BOOL	LLPipeline::sFastAlpha = TRUE;
 BOOL	LLPipeline::sDisableShaders = FALSE;
 BOOL	LLPipeline::sRenderBump = TRUE;
 BOOL	LLPipeline::sUseFarClip = TRUE;
+BOOL	LLPipeline::sParallelCull = FALSE;
+BOOL	LLPipeline::sParallelGeometry = FALSE;
 BOOL	LLPipeline::sShadowRender = FALSE;
 BOOL	LLPipeline::sSkipUpdate = FALSE;
 BOOL	LLPipeline::sWaterReflections = FALSE;
@@ -320,6 +322,8 @@ void LLPipeline::init()
 	LLMemType mt(LLMemType::MTYPE_PIPELINE);
 
 	sDynamicLOD = gSavedSettings.getBOOL("RenderDynamicLOD");
+	sParallelCull = gSavedSettings.getBOOL("RenderParallelCull");
+	sParallelGeometry = gSavedSettings.getBOOL("RenderParallelGeometry");
 	sRenderBump = gSavedSettings.getBOOL("RenderObjectBump");
 	sRenderAttachedLights = gSavedSettings.getBOOL("RenderAttachedLights");
 	sRenderAttachedParticles = gSavedSettings.getBOOL("RenderAttachedParticles");
@@ -1462,10 +1466,18 @@ void LLPipeline::updateCull(LLCamera& camera, LLCullResult& result, S32 water_cl
 }
 
 void LLPipeline::markNotCulled(LLSpatialGroup* group, LLCamera& camera)
+{
+	if (markNotCulled(group, camera, *sCull))
+	{
+		mNumVisibleNodes++;
+	}
+}
+
+BOOL LLPipeline::markNotCulled(LLSpatialGroup* group, LLCamera& camera, LLCullResult& result)
 {
 	if (group->getData().empty())
 	{ 
-		return;
+		return FALSE;
 	}
 	
 	group->setVisible();
@@ -1479,21 +1491,27 @@ void LLPipeline::markNotCulled(LLSpatialGroup* group, LLCamera& camera)
 
 	if (group->mPixelArea < MINIMUM_PIXEL_AREA)
 	{
-		return;
+		return FALSE;
 	}
 
 	assertInitialized();
 	
 	if (!group->mSpatialPartition->mRenderByGroup)
 	{ //render by drawable
-		sCull->pushDrawableGroup(group);
+		result.pushDrawableGroup(group);
 	}
 	else
 	{   //render by group
-		sCull->pushVisibleGroup(group);
+		result.pushVisibleGroup(group);
 	}
 
-	mNumVisibleNodes++;
+	return TRUE;
+}
+
+void LLPipeline::mergeCullResult(LLCullResult& result)
+{
+	sCull->append(result);
+	mNumVisibleNodes += result.getDrawableGroupsSize() + result.getVisibleGroupsSize();
 }
 
 void LLPipeline::markOccluder(LLSpatialGroup* group)
@@ -2220,6 +2238,34 @@ void LLPipeline::postSort(LLCamera& camera)
 	}
 	LLSpatialGroup::sNoDelete = TRUE;
 
+	if (sDelayVBUpdate && sParallelGeometry)
+	{	//rebuild the volume meshes the draw pools are about to ask for all at once,
+		//so their vertices can be written in parallel
+		LLFastTimer ftm(LLFastTimer::FTM_REBUILD_VBO);
+		LLFastTimer ftm2(LLFastTimer::FTM_REBUILD_VOLUME_VB);
+
+		static std::vector<LLSpatialGroup*> mesh_groups;
+		mesh_groups.clear();
+		for (U32 list = 0; list < 2; ++list)
+		{
+			LLCullResult::sg_list_t::iterator begin = list ? sCull->beginVisibleGroups() : sCull->beginDrawableGroups();
+			LLCullResult::sg_list_t::iterator end = list ? sCull->endVisibleGroups() : sCull->endDrawableGroups();
+			for (LLCullResult::sg_list_t::iterator i = begin; i != end; ++i)
+			{
+				LLSpatialGroup* group = *i;
+				if ((sUseOcclusion && group->isState(LLSpatialGroup::OCCLUDED)) ||
+					!group->isState(LLSpatialGroup::MESH_DIRTY) ||
+					group->isDead() ||
+					!dynamic_cast<LLVolumeGeometryManager*>(group->mSpatialPartition))
+				{
+					continue;
+				}
+				mesh_groups.push_back(group);
+			}
+		}
+		LLVolumeGeometryManager::rebuildMeshes(mesh_groups);
+	}
+
 
 	const S32 bin_count = 1024*8;
 		
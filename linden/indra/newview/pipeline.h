@@ -126,6 +126,11 @@ public:
 	void		markOccluder(LLSpatialGroup* group);
 	void		doOcclusion(LLCamera& camera);
 	void		markNotCulled(LLSpatialGroup* group, LLCamera &camera);
+	// Pushes into result instead of the current cull result. Only touches
+	// group and result, so parallel cull jobs may call it. Returns TRUE if
+	// the group was pushed.
+	BOOL		markNotCulled(LLSpatialGroup* group, LLCamera &camera, LLCullResult& result);
+	void		mergeCullResult(LLCullResult& result); // append a parallel cull job's result
 	void        markMoved(LLDrawable *drawablep, BOOL damped_motion = FALSE);
 	void        markShift(LLDrawable *drawablep);
 	void        markTextured(LLDrawable *drawablep);
@@ -402,6 +407,8 @@ public:
 	static BOOL				sRenderBump;
 	static BOOL				sUseFBO;
 	static BOOL				sUseFarClip;
+	static BOOL				sParallelCull;
+	static BOOL				sParallelGeometry;
 	static BOOL				sShadowRender;
 	static BOOL				sSkipUpdate; //skip lod updates
 	static BOOL				sWaterReflections;
@@ -146,6 +146,68 @@ namespace tut
 		ensure("segment is in buffer", mBuffer->containsSegment(seg1));
 		ensure("Create segment succeds", created);
 	}
+
+	template<> template<>
+	void heap_buffer_object::test<5>()
+	{
+		// reclaiming the most recent segment makes the memory
+		// available again right away.
+		const S32 BUF_SIZE = 10;
+		const S32 SEGMENT_SIZE = 4;
+		mBuffer = new LLHeapBuffer(BUF_SIZE);
+		LLSegment seg1;
+		mBuffer->createSegment(0, SEGMENT_SIZE, seg1);
+		LLSegment seg2;
+		mBuffer->createSegment(0, SEGMENT_SIZE, seg2);
+		ensure_equals("buffer used", mBuffer->bytesLeft(), 2);
+		mBuffer->reclaimSegment(seg2);
+		ensure_equals("last segment handed back", mBuffer->bytesLeft(), 6);
+		LLSegment seg3;
+		mBuffer->createSegment(0, SEGMENT_SIZE, seg3);
+		ensure("memory reused", (seg3.data() == seg2.data()));
+		mBuffer->reclaimSegment(seg1);
+		ensure_equals("first segment pending", mBuffer->bytesLeft(), 2);
+		mBuffer->reclaimSegment(seg3);
+		ensure_equals("buffer reclaimed", mBuffer->bytesLeft(), BUF_SIZE);
+	}
+
+	template<> template<>
+	void heap_buffer_object::test<6>()
+	{
+		// default sized buffers recycle memory through the pool.
+		LLHeapBuffer::initClass(1);
+		mBuffer = new LLHeapBuffer;
+		ensure_equals("default size", mBuffer->capacity(), (S32)LLHeapBuffer::DEFAULT_SIZE);
+		LLSegment segment;
+		mBuffer->createSegment(0, 1, segment);
+		U8* memory = segment.data();
+		delete mBuffer;
+		mBuffer = new LLHeapBuffer;
+		mBuffer->createSegment(0, 1, segment);
+		ensure("memory recycled", (segment.data() == memory));
+		LLHeapBuffer::PoolStats stats = LLHeapBuffer::getPoolStats();
+		ensure_equals("one slab", stats.mSlabs, 1);
+		ensure_equals("two hits", stats.mHits, (U32)2);
+
+		// once the slab of 16 is used up, buffers go to the heap.
+		std::vector<LLHeapBuffer*> buffers;
+		for(S32 i = 0; i < 16; ++i)
+		{
+			buffers.push_back(new LLHeapBuffer);
+		}
+		stats = LLHeapBuffer::getPoolStats();
+		ensure_equals("still one slab", stats.mSlabs, 1);
+		ensure_equals("heap allocation", stats.mMisses, (U32)1);
+		for(S32 i = 0; i < 16; ++i)
+		{
+			delete buffers[i];
+		}
+		delete mBuffer;
+		mBuffer = NULL;
+		stats = LLHeapBuffer::getPoolStats();
+		ensure_equals("all memory returned", stats.mFreeBlocks, 16);
+		LLHeapBuffer::cleanupClass();
+	}
 }
 
 namespace tut
@@ -359,6 +421,22 @@ namespace tut
 		delete[] temp;
 	}
 
+	template<> template<>
+	void buffer_object::test<10>()
+	{
+		// trimming a segment hands the unused end back to the buffer.
+		LLChannelDescriptors ch = mBuffer.nextChannel();
+		LLBufferArray::segment_iterator_t first = mBuffer.makeSegment(ch.out(), 100);
+		LLBufferArray::segment_iterator_t second = mBuffer.makeSegment(ch.out(), 100);
+		memcpy((*first).data(), "hello", 5);		/* Flawfinder: ignore */
+		ensure("trim empty", mBuffer.trimSegment(second, 0));
+		ensure("trim partial", mBuffer.trimSegment(first, 5));
+		ensure_equals("trimmed size", mBuffer.countAfter(ch.out(), NULL), 5);
+		LLBufferArray::segment_iterator_t next = mBuffer.makeSegment(ch.out(), 100);
+		ensure("memory handed out again", ((*next).data() == (*first).data() + 5));
+		ensure_equals("one buffer", mBuffer.capacity(), (S32)LLHeapBuffer::DEFAULT_SIZE);
+	}
+
 #if 0
 	template<> template<>
 	void buffer_object::test<9>()
@@ -1180,6 +1258,46 @@ namespace tut
 		ensure_equals("accepted socked close", count, 1);
 		lldebugs << "** Sleeper should have timed out.." << llendl;
 	}
+
+	template<> template<>
+	void fitness_test_object::test<6>()
+	{
+		lldebugs << "fitness_test_object::test<6>()" << llendl;
+
+		// Set up a server which never sends anything
+		LLPumpIO::chain_t chain;
+		typedef LLCloneIOFactory<LLIOSleeper> sleeper_t;
+		sleeper_t* sleeper = new sleeper_t(new LLIOSleeper);
+		boost::shared_ptr<LLChainIOFactory> factory(sleeper);
+		LLIOServerSocket* server = new LLIOServerSocket(
+			mPool,
+			mSocket,
+			factory);
+		chain.push_back(LLIOPipe::ptr_t(server));
+		mPump->addChain(chain, NEVER_CHAIN_EXPIRY_SECS);
+		pump_loop(mPump, 0.1f);
+
+		LLSocket::ptr_t client = LLSocket::create(mPool, LLSocket::STREAM_TCP);
+		LLHost server_host("127.0.0.1", SERVER_LISTEN_PORT);
+		bool connected = client->blockingConnect(server_host);
+		ensure("Connected to server", connected);
+		pump_loop(mPump, 0.1f);
+
+		// A socket reader on a socket with a timeout waits that long
+		// for data, as apr_socket_recv() does, then fails.
+		apr_socket_timeout_set(client->getSocket(), 200000);
+		LLIOPipe::ptr_t reader(new LLIOSocketReader(client));
+		LLIOPipe::buffer_ptr_t buffer(new LLBufferArray);
+		LLChannelDescriptors channels = buffer->nextChannel();
+		bool eos = false;
+		LLSD context;
+		LLTimer timer;
+		LLIOPipe::EStatus status = reader->process(channels, buffer, eos, context, NULL);
+		F32 elapsed = timer.getElapsedTimeF32();
+		ensure("waited for data", (elapsed > 0.15f));
+		ensure("read timed out", LLIOPipe::isError(status));
+		ensure_equals("nothing read", buffer->countAfter(channels.out(), NULL), 0);
+	}
 }
 
 namespace tut
@@ -0,0 +1,458 @@
+/**
+ * @file llbatchthread_tut.cpp
+ * @brief Tests for LLBatchThread and a parallel octree cull benchmark
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "lltut.h"
+#include "llapr.h"
+#include "llbatchthread.h"
+#include "llcamera.h"
+#include "llrand.h"
+#include "llthreadpool.h"
+#include "lltimer.h"
+#include "v3dmath.h"
+#include "lloctree.h" // needs v3dmath.h
+
+namespace tut
+{
+	class LLCountingJob : public LLBatchThread::Job
+	{
+	public:
+		LLCountingJob() : mRuns(0) {}
+		/*virtual*/ void run() { mRuns++; }
+		S32 mRuns;
+	};
+
+	// Holds a pool thread until released.
+	class LLBlockingRequest : public LLQueuedThread::QueuedRequest
+	{
+	public:
+		LLBlockingRequest(LLQueuedThread::handle_t handle, LLAtomicS32* started, LLAtomicS32* release)
+		:	LLQueuedThread::QueuedRequest(handle, LLQueuedThread::PRIORITY_NORMAL),
+			mStarted(started),
+			mRelease(release)
+		{
+		}
+
+		/*virtual*/ bool processRequest()
+		{
+			(*mStarted)++;
+			while (*mRelease == 0)
+			{
+				ms_sleep(1);
+			}
+			return true;
+		}
+
+	protected:
+		~LLBlockingRequest() {}
+
+		LLAtomicS32* mStarted;
+		LLAtomicS32* mRelease;
+	};
+
+	class LLBlockingQueue : public LLQueuedThread
+	{
+	public:
+		LLBlockingQueue(LLThreadPool* pool) : LLQueuedThread("blocking", true, pool) {}
+
+		handle_t add(LLAtomicS32* started, LLAtomicS32* release)
+		{
+			handle_t handle = generateHandle();
+			addRequest(new LLBlockingRequest(handle, started, release));
+			return handle;
+		}
+	};
+
+	//------------------------------------------------------------------------
+	// A synthetic partition: drawables are spheres in an octree, culled the
+	// way LLOctreeCull culls LLSpatialGroups in the viewer, except that node
+	// bounds come from the octree itself rather than from the group.
+
+	class LLCullTestDrawable : public LLRefCount
+	{
+	public:
+		LLCullTestDrawable(S32 id, const LLVector3d& position, F64 radius)
+			: mID(id), mPosition(position), mRadius(radius) {}
+
+		const LLVector3d& getPositionGroup() const { return mPosition; }
+		const F64& getBinRadius() const { return mRadius; }
+
+		S32 mID;
+		LLVector3d mPosition;
+		F64 mRadius;
+	};
+
+	typedef LLOctreeNode<LLCullTestDrawable> cull_node_t;
+	typedef LLOctreeRoot<LLCullTestDrawable> cull_root_t;
+	typedef std::vector<S32> cull_result_t;
+
+	class LLTestOctreeCull : public LLOctreeTraveler<LLCullTestDrawable>
+	{
+	public:
+		LLTestOctreeCull(LLCamera* camera, cull_result_t* result)
+			: mCamera(camera), mRes(0), mResult(result) {}
+
+		virtual void traverse(const LLTreeNode<LLCullTestDrawable>* n)
+		{
+			const cull_node_t* node = (const cull_node_t*) n;
+			if (mRes == 2)
+			{	//fully in, just add everything
+				LLOctreeTraveler<LLCullTestDrawable>::traverse(n);
+			}
+			else
+			{
+				// elements may stick out of their node by twice its size
+				mRes = mCamera->AABBInFrustum(LLVector3(node->getCenter()), LLVector3(node->getSize()) * 3.f);
+				if (mRes)
+				{
+					LLOctreeTraveler<LLCullTestDrawable>::traverse(n);
+				}
+				mRes = 0;
+			}
+		}
+
+		virtual void visit(const cull_node_t* branch)
+		{
+			for (cull_node_t::const_element_iter i = branch->getData().begin(); i != branch->getData().end(); ++i)
+			{
+				const LLCullTestDrawable* drawable = *i;
+				if (mRes == 2 ||
+					mCamera->sphereInFrustum(LLVector3(drawable->mPosition), (F32) drawable->mRadius))
+				{
+					mResult->push_back(drawable->mID);
+				}
+			}
+		}
+
+		LLCamera* mCamera;
+		S32 mRes;
+		cull_result_t* mResult;
+	};
+
+	class LLTestCullJob : public LLBatchThread::Job
+	{
+	public:
+		LLTestCullJob(LLCamera* camera, S32 res, const cull_node_t* node)
+			: mCuller(camera, &mResult), mNode(node)
+		{
+			mCuller.mRes = res;
+		}
+
+		/*virtual*/ void run() { mCuller.traverse(mNode); }
+
+		cull_result_t mResult;
+		LLTestOctreeCull mCuller;
+		const cull_node_t* mNode;
+	};
+
+	// Stops at the children of split, leaving a job for each.
+	class LLTestOctreeCullSplit : public LLTestOctreeCull
+	{
+	public:
+		LLTestOctreeCullSplit(LLCamera* camera, cull_result_t* result, const cull_node_t* split)
+			: LLTestOctreeCull(camera, result), mSplit(split) {}
+
+		~LLTestOctreeCullSplit()
+		{
+			for (U32 i = 0; i < mJobs.size(); i++)
+			{
+				delete mJobs[i];
+			}
+		}
+
+		virtual void traverse(const LLTreeNode<LLCullTestDrawable>* n)
+		{
+			const cull_node_t* node = (const cull_node_t*) n;
+			if (node->getParent() == mSplit)
+			{
+				mJobs.push_back(new LLTestCullJob(mCamera, mRes, node));
+			}
+			else
+			{
+				LLTestOctreeCull::traverse(n);
+			}
+		}
+
+		const cull_node_t* mSplit;
+		LLBatchThread::job_list_t mJobs;
+	};
+
+	struct batchthread_data
+	{
+		batchthread_data() : mOctree(NULL)
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+		}
+
+		~batchthread_data()
+		{
+			delete mOctree;
+		}
+
+		// Scatters count drawables over a 256m region, most of them small
+		// with the odd large one, like prims in a dense sim.
+		void buildOctree(S32 count)
+		{
+			mOctree = new cull_root_t(LLVector3d(128, 128, 128), LLVector3d(1, 1, 1), NULL);
+			for (S32 i = 0; i < count; i++)
+			{
+				LLVector3d position(ll_frand(256.f), ll_frand(256.f), 20.f + ll_frand(60.f));
+				F64 radius = (i % 50) ? 0.25f + ll_frand(2.f) : 4.f + ll_frand(12.f);
+				LLPointer<LLCullTestDrawable> drawable = new LLCullTestDrawable(i, position, radius);
+				mDrawables.push_back(drawable);
+				mOctree->insert(drawable);
+			}
+		}
+
+		// A viewer-like camera at eye looking at target.
+		void setCamera(LLCamera& camera, const LLVector3& eye, const LLVector3& target)
+		{
+			camera.lookAt(eye, target);
+			camera.setFar(128.f);
+
+			// the viewer gets these corners by unprojecting the viewport
+			F32 near_height = camera.getNear() * tanf(0.5f * camera.getView());
+			F32 far_height = camera.getFar() * tanf(0.5f * camera.getView());
+			LLVector3 frust[8];
+			for (S32 i = 0; i < 2; i++)
+			{
+				F32 dist = i ? camera.getFar() : camera.getNear();
+				F32 height = i ? far_height : near_height;
+				LLVector3 center = camera.getOrigin() + camera.getAtAxis() * dist;
+				LLVector3 left = camera.getLeftAxis() * height * camera.getAspect();
+				LLVector3 up = camera.getUpAxis() * height;
+				frust[i*4 + 0] = center + left - up;
+				frust[i*4 + 1] = center - left - up;
+				frust[i*4 + 2] = center - left + up;
+				frust[i*4 + 3] = center + left + up;
+			}
+			camera.calcAgentFrustumPlanes(frust);
+		}
+
+		// Same split as LLSpatialPartition::cull(): the first node with more
+		// than one child.
+		const cull_node_t* getSplit()
+		{
+			const cull_node_t* node = mOctree;
+			while (node->getChildCount() == 1)
+			{
+				node = node->getChild(0);
+			}
+			return node;
+		}
+
+		void cullSerial(LLCamera& camera, cull_result_t& result)
+		{
+			result.clear();
+			LLTestOctreeCull culler(&camera, &result);
+			culler.traverse(mOctree);
+		}
+
+		void cullParallel(LLBatchThread& thread, LLCamera& camera, cull_result_t& result)
+		{
+			result.clear();
+			LLTestOctreeCullSplit culler(&camera, &result, getSplit());
+			culler.traverse(mOctree);
+			thread.runJobs(culler.mJobs);
+			for (U32 i = 0; i < culler.mJobs.size(); i++)
+			{
+				const cull_result_t& job_result = ((LLTestCullJob*) culler.mJobs[i])->mResult;
+				result.insert(result.end(), job_result.begin(), job_result.end());
+			}
+		}
+
+		cull_root_t* mOctree;
+		std::vector<LLPointer<LLCullTestDrawable> > mDrawables;
+	};
+
+	typedef test_group<batchthread_data> batchthread_test;
+	typedef batchthread_test::object batchthread_object;
+	tut::batchthread_test batchthread_testcase("llbatchthread");
+
+	template<> template<>
+	void batchthread_object::test<1>()
+	{
+		// every job runs exactly once, on a pool, on our own thread and
+		// unthreaded
+		LLThreadPool pool("batch test", 3);
+		for (S32 mode = 0; mode < 3; mode++)
+		{
+			LLBatchThread thread("batch", mode < 2, mode == 0 ? &pool : NULL);
+			for (S32 batch = 0; batch < 20; batch++)
+			{
+				std::vector<LLCountingJob> jobs(1 + batch % 9);
+				LLBatchThread::job_list_t job_list;
+				for (U32 i = 0; i < jobs.size(); i++)
+				{
+					job_list.push_back(&jobs[i]);
+				}
+				thread.runJobs(job_list);
+				for (U32 i = 0; i < jobs.size(); i++)
+				{
+					ensure_equals("job ran once", jobs[i].mRuns, 1);
+				}
+			}
+			ensure_equals("nothing left", thread.getPending(), 0);
+			thread.shutdown();
+		}
+	}
+
+	template<> template<>
+	void batchthread_object::test<2>()
+	{
+		// a batch completes on the calling thread while the pool is busy
+		LLThreadPool pool("batch test", 1);
+		LLBlockingQueue blocking(&pool);
+		LLBatchThread thread("batch", true, &pool);
+		LLAtomicS32 started(0);
+		LLAtomicS32 release(0);
+		LLQueuedThread::handle_t handle = blocking.add(&started, &release);
+		LLTimer timer;
+		while (started == 0 && timer.getElapsedTimeF32() < 5.f)
+		{
+			blocking.update(0); // unpauses
+			ms_sleep(1);
+		}
+		if (started == 0)
+		{
+			release = 1;
+			fail("pool thread never started");
+		}
+
+		std::vector<LLCountingJob> jobs(4);
+		LLBatchThread::job_list_t job_list;
+		for (U32 i = 0; i < jobs.size(); i++)
+		{
+			job_list.push_back(&jobs[i]);
+		}
+		thread.runJobs(job_list);
+		for (U32 i = 0; i < jobs.size(); i++)
+		{
+			ensure_equals("job ran", jobs[i].mRuns, 1);
+		}
+
+		release = 1;
+		blocking.waitForResult(handle);
+		blocking.shutdown();
+		thread.shutdown();
+	}
+
+	template<> template<>
+	void batchthread_object::test<3>()
+	{
+		// a parallel cull finds the same drawables in the same order as a
+		// serial one
+		buildOctree(5000);
+		ensure("octree splits", getSplit()->getChildCount() > 1);
+		LLThreadPool pool("batch test", 3);
+		LLBatchThread thread("cull", true, &pool);
+		LLCamera camera;
+		cull_result_t serial;
+		cull_result_t parallel;
+		S32 visible = 0;
+		for (S32 i = 0; i < 16; i++)
+		{
+			F32 angle = F_TWO_PI * i / 16.f;
+			LLVector3 eye(128.f, 128.f, 40.f);
+			if (i & 1)
+			{	//from the edge of the region
+				eye.mV[VX] = 128.f - 120.f * cosf(angle);
+				eye.mV[VY] = 128.f - 120.f * sinf(angle);
+			}
+			setCamera(camera, eye, eye + LLVector3(cosf(angle), sinf(angle), -0.1f));
+			cullSerial(camera, serial);
+			cullParallel(thread, camera, parallel);
+			ensure("something culled", (S32)serial.size() < (S32)mDrawables.size());
+			ensure("same result", serial == parallel);
+			visible += (S32)serial.size();
+		}
+		ensure("something visible", visible > 0);
+		thread.shutdown();
+	}
+
+	struct batchthread_benchmark_data : public batchthread_data
+	{
+	};
+
+	typedef test_group<batchthread_benchmark_data> batchthread_benchmark_test;
+	typedef batchthread_benchmark_test::object batchthread_benchmark_object;
+	tut::batchthread_benchmark_test batchthread_benchmark_testcase("llbatchthread-benchmark");
+
+	template<> template<>
+	void batchthread_benchmark_object::test<1>()
+	{
+		// Benchmark culling 30k drawables, as in a dense sim, serially and
+		// split across the pool.
+		const S32 DRAWABLES = 30000;
+		const S32 CULLS = 200;
+		buildOctree(DRAWABLES);
+		LLThreadPool pool("batch test", llmax(LLThreadPool::getProcessorCount() - 1, 1));
+		LLBatchThread thread("cull", true, &pool);
+		LLCamera camera;
+		cull_result_t result;
+		for (S32 parallel = 0; parallel < 2; parallel++)
+		{
+			S32 visible = 0;
+			LLTimer timer;
+			for (S32 i = 0; i < CULLS; i++)
+			{
+				F32 angle = F_TWO_PI * i / (F32) CULLS;
+				LLVector3 eye(128.f, 128.f, 40.f);
+				setCamera(camera, eye, eye + LLVector3(cosf(angle), sinf(angle), -0.1f));
+				if (parallel)
+				{
+					cullParallel(thread, camera, result);
+				}
+				else
+				{
+					cullSerial(camera, result);
+				}
+				visible += (S32)result.size();
+			}
+			F64 elapsed = timer.getElapsedTimeF64();
+			llinfos << "Octree cull " << (parallel ? "parallel" : "serial") << ": " << DRAWABLES
+					<< " drawables, " << visible / CULLS << " visible, "
+					<< elapsed * 1000.0 / CULLS << " ms/cull with "
+					<< (parallel ? pool.getThreadCount() + 1 : 1) << " threads" << llendl;
+		}
+		thread.shutdown();
+	}
+}
@@ -0,0 +1,228 @@
+/**
+ * @file llcamera_tut.cpp
+ * @brief Tests for LLCamera frustum tests and LLPackedBounds
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "lltut.h"
+#include "llcamera.h"
+#include "llpackedbounds.h"
+#include "llrand.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	struct camera_data
+	{
+		// Points camera from eye at target, with the agent space frustum
+		// planes the culler uses.
+		void setCamera(LLCamera& camera, const LLVector3& eye, const LLVector3& target)
+		{
+			camera.lookAt(eye, target);
+			camera.setFar(128.f);
+
+			// the viewer gets these corners by unprojecting the viewport
+			F32 near_height = camera.getNear() * tanf(0.5f * camera.getView());
+			F32 far_height = camera.getFar() * tanf(0.5f * camera.getView());
+			LLVector3 frust[8];
+			for (S32 i = 0; i < 2; i++)
+			{
+				F32 dist = i ? camera.getFar() : camera.getNear();
+				F32 height = i ? far_height : near_height;
+				LLVector3 center = camera.getOrigin() + camera.getAtAxis() * dist;
+				LLVector3 left = camera.getLeftAxis() * height * camera.getAspect();
+				LLVector3 up = camera.getUpAxis() * height;
+				frust[i*4 + 0] = center + left - up;
+				frust[i*4 + 1] = center - left - up;
+				frust[i*4 + 2] = center - left + up;
+				frust[i*4 + 3] = center + left + up;
+			}
+			camera.calcAgentFrustumPlanes(frust);
+		}
+
+		LLVector3 randomVector(F32 scale)
+		{
+			return LLVector3(ll_frand(scale), ll_frand(scale), ll_frand(scale));
+		}
+
+		// Fills mBounds with count boxes over a 256m region, mostly small,
+		// with some empty ones and some bigger than the frustum.
+		void fillBounds(S32 count)
+		{
+			for (S32 i = 0; i < count; i++)
+			{
+				LLVector3 center = randomVector(256.f);
+				LLVector3 radius;
+				switch (i % 8)
+				{
+				case 0:
+					break;
+				case 1:
+					radius = randomVector(256.f);
+					break;
+				default:
+					radius = randomVector(16.f);
+					break;
+				}
+				S32 slot = mBounds.allocate();
+				ensure_equals("slots in order", slot, (S32)mCenters.size());
+				mBounds.set(slot, center, radius);
+				mCenters.push_back(center);
+				mRadii.push_back(radius);
+			}
+		}
+
+		// Checks the packed tests give the scalar tests' answer for every box.
+		void ensureSameResults(LLCamera& camera)
+		{
+			std::vector<S8> results(mBounds.getSlotCount());
+			camera.AABBInFrustumPacked(mBounds, &results[0]);
+			for (U32 i = 0; i < mCenters.size(); i++)
+			{
+				ensure_equals("far clip", (S32)results[i], camera.AABBInFrustum(mCenters[i], mRadii[i]));
+			}
+			camera.AABBInFrustumNoFarClipPacked(mBounds, &results[0]);
+			for (U32 i = 0; i < mCenters.size(); i++)
+			{
+				ensure_equals("no far clip", (S32)results[i], camera.AABBInFrustumNoFarClip(mCenters[i], mRadii[i]));
+			}
+		}
+
+		LLPackedBounds mBounds;
+		std::vector<LLVector3> mCenters;
+		std::vector<LLVector3> mRadii;
+	};
+	typedef test_group<camera_data> camera_test;
+	typedef camera_test::object camera_object;
+	tut::camera_test tcamera("camera");
+
+	template<> template<>
+	void camera_object::test<1>()
+	{
+		// slots come in fours and freed slots are reused, empty
+		LLPackedBounds bounds;
+		ensure_equals("empty", bounds.getSlotCount(), 0);
+		S32 first = bounds.allocate();
+		S32 second = bounds.allocate();
+		ensure_equals("first slot", first, 0);
+		ensure_equals("second slot", second, 1);
+		ensure_equals("padded", bounds.getSlotCount(), 4);
+		ensure_equals("free", bounds.getFreeCount(), 2);
+
+		bounds.set(first, LLVector3(1.f, 2.f, 3.f), LLVector3(4.f, 5.f, 6.f));
+		ensure_equals("center", bounds.getCenter(first), LLVector3(1.f, 2.f, 3.f));
+		ensure_equals("radius", bounds.getRadius(first), LLVector3(4.f, 5.f, 6.f));
+		ensure_equals("center array", bounds.getCenters(VY)[first], 2.f);
+		ensure_equals("radius array", bounds.getRadii(VZ)[first], 6.f);
+
+		bounds.release(first);
+		ensure_equals("released", bounds.getRadius(first), LLVector3::zero);
+		ensure_equals("reused", bounds.allocate(), first);
+
+		for (S32 i = 0; i < 3; i++)
+		{
+			bounds.allocate();
+		}
+		ensure_equals("grown", bounds.getSlotCount(), 8);
+	}
+
+	template<> template<>
+	void camera_object::test<2>()
+	{
+		// packed tests match the scalar ones
+		fillBounds(4093);
+		LLCamera camera;
+		for (S32 i = 0; i < 32; i++)
+		{
+			LLVector3 eye = randomVector(256.f);
+			setCamera(camera, eye, eye + randomVector(2.f) - LLVector3(1.f, 1.f, 1.f));
+			ensureSameResults(camera);
+		}
+
+		// and with a user clip plane, as for water reflections
+		LLVector3 eye(128.f, 128.f, 40.f);
+		setCamera(camera, eye, LLVector3(200.f, 160.f, 20.f));
+		camera.setUserClipPlane(LLPlane(LLVector3(0.f, 0.f, 20.f), LLVector3(0.f, 0.f, -1.f)));
+		ensureSameResults(camera);
+		camera.disableUserClipPlane();
+		ensureSameResults(camera);
+	}
+
+	struct camera_benchmark_data : public camera_data
+	{
+	};
+
+	typedef test_group<camera_benchmark_data> camera_benchmark_test;
+	typedef camera_benchmark_test::object camera_benchmark_object;
+	tut::camera_benchmark_test tcamera_benchmark("camera-benchmark");
+
+	template<> template<>
+	void camera_benchmark_object::test<1>()
+	{
+		// Benchmark testing 8k group bounds, one at a time and packed.
+		const S32 BOXES = 8192;
+		const S32 PASSES = 500;
+		fillBounds(BOXES);
+		LLCamera camera;
+		LLVector3 eye(128.f, 128.f, 30.f);
+		setCamera(camera, eye, LLVector3(200.f, 180.f, 20.f));
+		std::vector<S8> results(mBounds.getSlotCount());
+
+		S32 visible = 0;
+		LLTimer timer;
+		for (S32 pass = 0; pass < PASSES; pass++)
+		{
+			for (S32 i = 0; i < BOXES; i++)
+			{
+				results[i] = (S8) camera.AABBInFrustumNoFarClip(mCenters[i], mRadii[i]);
+			}
+			visible += results[pass % BOXES];
+		}
+		F64 scalar = timer.getElapsedTimeF64();
+
+		timer.reset();
+		for (S32 pass = 0; pass < PASSES; pass++)
+		{
+			camera.AABBInFrustumNoFarClipPacked(mBounds, &results[0]);
+			visible += results[pass % BOXES];
+		}
+		F64 packed = timer.getElapsedTimeF64();
+		ensureSameResults(camera);
+
+		llinfos << "LLCamera frustum test of " << BOXES << " boxes: scalar "
+				<< (S32)(BOXES * PASSES / scalar) << " boxes/sec, packed "
+				<< (S32)(BOXES * PASSES / packed) << " boxes/sec ("
+				<< visible << " visible)" << llendl;
+	}
+}
@@ -0,0 +1,344 @@
+/**
+ * @file llcircuit_tut.cpp
+ * @brief Tests for reliable packet tracking in LLCircuitData
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "llapr.h"
+#include "llcircuit.h"
+#include "llpacketidring.h"
+#include "llrand.h"
+#include "llversionserver.h"
+#include "message.h"
+#include "net.h"
+
+namespace tut
+{
+	// Exposes the reliable packet bookkeeping the message system drives.
+	class LLTestCircuitData : public LLCircuitData
+	{
+	public:
+		LLTestCircuitData(const LLHost& host) : LLCircuitData(host, 0, 5.f, 100.f)
+		{
+			// Only loss should hold back resends.
+			F32 bps[TC_EOF];
+			for (S32 i = 0; i < TC_EOF; ++i)
+			{
+				bps[i] = 100000000.f;
+			}
+			getThrottleGroup().setNominalBPS(bps);
+		}
+
+		// Adds a reliable packet as sendMessage() does and returns its id.
+		TPACKETID addPacket(S32 socket, const LLHost& host, S32 retries, F32 timeout,
+							void (*callback)(void**,S32), void** callback_data)
+		{
+			U8 buffer[64];	/* Flawfinder: ignore */
+			memset(buffer, 0, sizeof(buffer));
+			TPACKETID id = nextPacketOutID();
+			*((U32*)&buffer[PHL_PACKET_ID]) = htonl(id);
+			buffer[0] |= LL_RELIABLE_FLAG;
+
+			LLReliablePacketParams params;
+			params.set(host, retries, FALSE, timeout, callback, callback_data, NULL);
+			addReliablePacket(socket, buffer, sizeof(buffer), &params);
+			return id;
+		}
+
+		BOOL isDuplicate(TPACKETID id)					{ return isDuplicateResend(id); }
+		void addReceived(TPACKETID id)					{ mRecentlyReceivedReliablePackets.insert(id, 0); }
+		TPACKETID getOldestUnacked() const				{ return getOldestUnackedPacketID(); }
+	};
+
+	struct circuit_data
+	{
+		circuit_data() : mSendSocket(-1), mReceiveSocket(-1), mSendPort(0), mReceivePort(0), mAcked(0), mFailed(0)
+		{
+			static bool init = false;
+			if (!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+			// Circuits count resends on the message system.
+			start_messaging_system("notafile", 13040,
+								   LL_VERSION_MAJOR,
+								   LL_VERSION_MINOR,
+								   LL_VERSION_PATCH,
+								   FALSE,
+								   "notasharedsecret",
+								   NULL,
+								   false,
+								   5.f,
+								   100.f);
+			start_net(mSendSocket, mSendPort);
+			start_net(mReceiveSocket, mReceivePort);
+			mReceiveHost = LLHost(LOOPBACK_ADDRESS_STRING, mReceivePort);
+		}
+
+		~circuit_data()
+		{
+			end_net(mSendSocket);
+			end_net(mReceiveSocket);
+			delete gMessageSystem;
+			gMessageSystem = NULL;
+		}
+
+		static void reliableCallback(void** data, S32 result)
+		{
+			circuit_data* self = (circuit_data*)data;
+			if (result == LL_ERR_NOERR)
+			{
+				self->mAcked++;
+			}
+			else
+			{
+				self->mFailed++;
+			}
+		}
+
+		S32 mSendSocket;
+		S32 mReceiveSocket;
+		int mSendPort;
+		int mReceivePort;
+		LLHost mReceiveHost;
+		S32 mAcked;
+		S32 mFailed;
+	};
+	typedef test_group<circuit_data> circuit_test;
+	typedef circuit_test::object circuit_object;
+	tut::circuit_test tcircuit("circuit");
+
+	template<> template<>
+	void circuit_object::test<1>()
+	{
+		// the packet id ring finds, erases and grows across a wrap
+		LLPacketIDRing<S32> ring(4);
+		const TPACKETID FIRST = LL_MAX_OUT_PACKET_ID - 50;
+		for (S32 i = 0; i < 100; ++i)
+		{
+			ensure("inserted", ring.insert((FIRST + i) % LL_MAX_OUT_PACKET_ID, i));
+		}
+		ensure_equals("size", ring.size(), (U32)100);
+		ensure_equals("oldest", ring.getOldestID(), FIRST);
+		ensure_equals("newest wrapped", ring.getNewestID(), (TPACKETID)49);
+		ensure_equals("find before wrap", *ring.find(FIRST + 10), 10);
+		ensure_equals("find after wrap", *ring.find(10), 60);
+		ensure("not held", ring.find(50) == NULL);
+		ensure("not held far away", ring.find(FIRST - 1000) == NULL);
+
+		ensure("erase", ring.erase(FIRST));
+		ensure("erase twice", !ring.erase(FIRST));
+		ensure_equals("oldest moves on", ring.getOldestID(), FIRST + 1);
+		ensure("erase last", ring.erase(49));
+		ensure_equals("newest moves back", ring.getNewestID(), (TPACKETID)48);
+
+		// ids on either side of the wrap keep their order
+		ring.eraseBefore(5);
+		ensure_equals("erased before", ring.getOldestID(), (TPACKETID)5);
+		ensure_equals("size after erase", ring.size(), (U32)44);
+		TPACKETID id;
+		S32 value;
+		ensure("pop", ring.popOldest(id, value));
+		ensure_equals("popped id", id, (TPACKETID)5);
+		ensure_equals("popped value", value, 55);
+
+		// an id older than the window can go in front of it
+		ensure("insert older", ring.insert(2, 52));
+		ensure_equals("older is oldest", ring.getOldestID(), (TPACKETID)2);
+		ensure_equals("older found", *ring.find(2), 52);
+
+		ring.clear();
+		ensure("cleared", ring.empty());
+		ensure("reuse", ring.insert(1000, 1));
+		ensure_equals("reused oldest", ring.getOldestID(), (TPACKETID)1000);
+	}
+
+	template<> template<>
+	void circuit_object::test<2>()
+	{
+		// a limited window drops the oldest ids to make room
+		LLPacketIDRing<S32> ring(4, 16);
+		for (S32 i = 0; i < 10; ++i)
+		{
+			ring.insert(i, i);
+		}
+		ring.insert(20, 20);
+		ensure_equals("oldest dropped", ring.getOldestID(), (TPACKETID)5);
+		ensure("dropped", ring.find(4) == NULL);
+		ensure("kept", ring.find(5) != NULL);
+		ensure("too old", !ring.insert(2, 2));
+	}
+
+	template<> template<>
+	void circuit_object::test<3>()
+	{
+		// Stress a circuit losing 5% of packets and acks both ways.  Every
+		// reliable packet must be acked exactly once through resends, and
+		// the receiver must see each one once, discarding duplicates.
+		LLTestCircuitData sender(mReceiveHost);
+		LLTestCircuitData receiver(LLHost(LOOPBACK_ADDRESS_STRING, mSendPort));
+		const F32 LOSS = 5.f;
+		const S32 FRAMES = 200;
+		const S32 PER_FRAME = 25;
+		const S32 TOTAL = FRAMES * PER_FRAME;
+		const U32 start_resent = gMessageSystem->mResentPackets;
+
+		std::vector<TPACKETID> acks;
+		std::vector<TPACKETID> next_acks;
+		S32 unique = 0;
+		S32 duplicates = 0;
+		S32 frame = 0;
+		LLTimer timer;
+		while ((frame < FRAMES || sender.getUnackedPacketCount()) && timer.getElapsedTimeF32() < 20.f)
+		{
+			// Acks sent last frame arrive.
+			for (std::vector<TPACKETID>::iterator it = acks.begin(); it != acks.end(); ++it)
+			{
+				if (ll_frand(100.f) >= LOSS)
+				{
+					sender.ackReliablePacket(*it);
+				}
+			}
+			acks.swap(next_acks);
+			next_acks.clear();
+
+			// New packets, of which the first send is simulated here.
+			if (frame < FRAMES)
+			{
+				for (S32 i = 0; i < PER_FRAME; ++i)
+				{
+					TPACKETID id = sender.addPacket(mSendSocket, mReceiveHost, 10, 0.05f,
+													reliableCallback, (void**)static_cast<circuit_data*>(this));
+					if (ll_frand(100.f) >= LOSS)
+					{
+						receiver.addReceived(id);
+						unique++;
+						next_acks.push_back(id);
+					}
+				}
+			}
+
+			// Resends come over the wire.
+			U8 buffer[NET_BUFFER_SIZE];	/* Flawfinder: ignore */
+			S32 size;
+			while ((size = receive_packet(mReceiveSocket, (char*)buffer)) > 0)
+			{
+				if (ll_frand(100.f) < LOSS)
+				{
+					continue;
+				}
+				ensure("resent flag", (buffer[0] & LL_RESENT_FLAG) != 0);
+				TPACKETID id = ntohl(*((U32*)&buffer[PHL_PACKET_ID]));
+				if (receiver.isDuplicate(id))
+				{
+					duplicates++;
+				}
+				else
+				{
+					receiver.addReceived(id);
+					unique++;
+				}
+				// Duplicates are acked again to stop further resends.
+				next_acks.push_back(id);
+			}
+
+			// StartPingCheck tells the receiver what it can forget.
+			if (frame % 20 == 0)
+			{
+				receiver.clearDuplicateList(sender.getOldestUnacked());
+			}
+
+			sender.resendUnackedPackets(LLMessageSystem::getMessageTimeSeconds(TRUE));
+			ms_sleep(5);
+			frame++;
+		}
+
+		S32 resent = gMessageSystem->mResentPackets - start_resent;
+		llinfos << "Circuit with " << LOSS << "% loss: " << TOTAL << " reliable packets, "
+				<< resent << " resends, " << duplicates << " duplicates discarded in "
+				<< timer.getElapsedTimeF32() << " seconds" << llendl;
+
+		ensure_equals("all acked", mAcked, TOTAL);
+		ensure_equals("none failed", mFailed, 0);
+		ensure_equals("nothing unacked", sender.getUnackedPacketCount(), 0);
+		ensure_equals("no bytes unacked", sender.getUnackedPacketBytes(), 0);
+		ensure_equals("each received once", unique, TOTAL);
+		ensure("resent", resent > 0);
+		ensure("duplicates", duplicates > 0);
+	}
+
+	struct circuit_benchmark_data : public circuit_data
+	{
+	};
+
+	typedef test_group<circuit_benchmark_data> circuit_benchmark_test;
+	typedef circuit_benchmark_test::object circuit_benchmark_object;
+	tut::circuit_benchmark_test tcircuit_benchmark("circuit-benchmark");
+
+	template<> template<>
+	void circuit_benchmark_object::test<1>()
+	{
+		// Benchmark a busy circuit with many reliable packets in flight:
+		// each frame adds and acks a batch and checks for resends.
+		LLTestCircuitData sender(mReceiveHost);
+		const S32 IN_FLIGHT = 20000;
+		const S32 PER_FRAME = 50;
+		const S32 FRAMES = 1000;
+		std::vector<TPACKETID> ids;
+		for (S32 i = 0; i < IN_FLIGHT; ++i)
+		{
+			ids.push_back(sender.addPacket(mSendSocket, mReceiveHost, 3, 100.f, NULL, NULL));
+		}
+
+		size_t next_ack = 0;
+		LLTimer timer;
+		for (S32 frame = 0; frame < FRAMES; ++frame)
+		{
+			for (S32 i = 0; i < PER_FRAME; ++i)
+			{
+				ids.push_back(sender.addPacket(mSendSocket, mReceiveHost, 3, 100.f, NULL, NULL));
+				// Acks arrive a little out of order.
+				sender.ackReliablePacket(ids[next_ack + (i ^ 1)]);
+			}
+			next_ack += PER_FRAME;
+			sender.resendUnackedPackets(LLMessageSystem::getMessageTimeSeconds(TRUE));
+		}
+		F64 elapsed = timer.getElapsedTimeF64();
+		ensure_equals("in flight", sender.getUnackedPacketCount(), IN_FLIGHT);
+		ensure_equals("oldest", sender.getOldestUnacked(), ids[next_ack]);
+
+		llinfos << "Circuit with " << IN_FLIGHT << " reliable packets in flight: "
+				<< (S32)(FRAMES / elapsed) << " frames/sec, "
+				<< (S32)(FRAMES * PER_FRAME / elapsed) << " acks/sec" << llendl;
+	}
+}
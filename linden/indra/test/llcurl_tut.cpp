@@ -0,0 +1,426 @@
+/**
+ * @file llcurl_tut.cpp
+ * @brief Tests for connection reuse in LLCurlRequest
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+// Uses BSD sockets for the stand-in server. JC
+#if !LL_WINDOWS
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <vector>
+
+#include "lltut.h"
+#include "llapr.h"
+#include "llcurl.h"
+#include "llformat.h"
+#include "llthread.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	// Minimal HTTP/1.1 keep-alive server on the loopback interface that
+	// answers every GET with body_size bytes after latency_ms, standing in
+	// for a texture or capability host.  The first answer on a connection
+	// takes connect_ms longer, for the TCP and TLS handshakes a real host
+	// would cost.
+	class HTTPStandIn : public LLThread
+	{
+	public:
+		HTTPStandIn(S32 latency_ms, S32 connect_ms, S32 body_size)
+			: LLThread("HTTP stand-in"),
+			  mListenSocket(-1),
+			  mPort(0),
+			  mLatency(latency_ms * 1000),
+			  mConnectLatency(connect_ms * 1000),
+			  mBody(body_size, 'x')
+		{
+			mConnections = 0;
+			mMaxOpen = 0;
+			mListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+			int on = 1;
+			setsockopt(mListenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			sockaddr_in addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			bind(mListenSocket, (sockaddr*)&addr, sizeof(addr));
+			listen(mListenSocket, 128);
+			socklen_t len = sizeof(addr);
+			getsockname(mListenSocket, (sockaddr*)&addr, &len);
+			mPort = ntohs(addr.sin_port);
+			fcntl(mListenSocket, F_SETFL, O_NONBLOCK);
+		}
+
+		virtual ~HTTPStandIn()
+		{
+			setQuitting();
+			for (S32 timeout = 1000; timeout > 0 && !isStopped(); timeout--)
+			{
+				ms_sleep(1);
+			}
+			for (U32 i = 0; i < mClients.size(); ++i)
+			{
+				close(mClients[i].mSocket);
+			}
+			close(mListenSocket);
+		}
+
+		std::string getURL(S32 n) const
+		{
+			return llformat("http://127.0.0.1:%d/texture/%d", mPort, n);
+		}
+
+		// Connections accepted so far, and the most open at once.
+		LLAtomicU32 mConnections;
+		LLAtomicU32 mMaxOpen;
+
+	private:
+		struct Client
+		{
+			int mSocket;
+			bool mConnecting;
+			std::string mInput;
+			std::string mOutput;
+			std::vector<U64> mDue; // when each request read gets its response
+		};
+
+		/*virtual*/ void run()
+		{
+			while (!isQuitting())
+			{
+				std::vector<pollfd> fds(mClients.size() + 1);
+				fds[0].fd = mListenSocket;
+				fds[0].events = POLLIN;
+				for (U32 i = 0; i < mClients.size(); ++i)
+				{
+					fds[i + 1].fd = mClients[i].mSocket;
+					fds[i + 1].events = POLLIN | (mClients[i].mOutput.empty() ? 0 : POLLOUT);
+				}
+				poll(&fds[0], fds.size(), 1);
+
+				int socket;
+				while ((socket = accept(mListenSocket, NULL, NULL)) >= 0)
+				{
+					fcntl(socket, F_SETFL, O_NONBLOCK);
+					Client client;
+					client.mSocket = socket;
+					client.mConnecting = true;
+					mClients.push_back(client);
+					mConnections++;
+					mMaxOpen = llmax((U32)mMaxOpen, (U32)mClients.size());
+				}
+
+				U64 now = LLTimer::getTotalTime();
+				for (U32 i = 0; i < mClients.size(); )
+				{
+					if (!serve(mClients[i], now))
+					{
+						close(mClients[i].mSocket);
+						mClients.erase(mClients.begin() + i);
+						continue;
+					}
+					++i;
+				}
+			}
+		}
+
+		// Returns false once the client has hung up.
+		bool serve(Client& client, U64 now)
+		{
+			char buffer[4096];	/* Flawfinder: ignore */
+			S32 bytes;
+			while ((bytes = recv(client.mSocket, buffer, sizeof(buffer), 0)) > 0)
+			{
+				client.mInput.append(buffer, bytes);
+			}
+			if (bytes == 0)
+			{
+				return false;
+			}
+
+			std::string::size_type end;
+			while ((end = client.mInput.find("\r\n\r\n")) != std::string::npos)
+			{
+				client.mInput.erase(0, end + 4);
+				client.mDue.push_back(now + mLatency + (client.mConnecting ? mConnectLatency : 0));
+				client.mConnecting = false;
+			}
+			while (!client.mDue.empty() && client.mDue.front() <= now)
+			{
+				client.mDue.erase(client.mDue.begin());
+				client.mOutput += llformat("HTTP/1.1 200 OK\r\nContent-Type: image/x-j2c\r\nContent-Length: %d\r\n\r\n", (S32)mBody.size());
+				client.mOutput += mBody;
+			}
+			if (!client.mOutput.empty())
+			{
+				bytes = send(client.mSocket, client.mOutput.data(), client.mOutput.size(), 0);
+				if (bytes > 0)
+				{
+					client.mOutput.erase(0, bytes);
+				}
+			}
+			return true;
+		}
+
+		int mListenSocket;
+		S32 mPort;
+		U64 mLatency;
+		U64 mConnectLatency;
+		std::string mBody;
+		std::vector<Client> mClients;
+	};
+
+	class CountingResponder : public LLCurl::Responder
+	{
+	public:
+		CountingResponder(S32& done, S32& good) : mDone(done), mGood(good) {}
+
+		/*virtual*/ void completedRaw(U32 status, const std::string& reason,
+									  const LLChannelDescriptors& channels,
+									  const LLIOPipe::buffer_ptr_t& buffer)
+		{
+			++mDone;
+			if (isGoodStatus(status))
+			{
+				++mGood;
+			}
+		}
+
+		S32& mDone;
+		S32& mGood;
+	};
+
+	struct curl_data
+	{
+		curl_data() : mDone(0), mGood(0)
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				LLCurl::initClass();
+				init = true;
+			}
+		}
+
+		void get(LLCurlRequest& request, const std::string& url)
+		{
+			LLCurlRequest::headers_t headers;
+			headers.push_back("Accept: image/x-j2c");
+			request.getByteRange(url, headers, 0, 1000, new CountingResponder(mDone, mGood));
+		}
+
+		// Processes until expected requests are done or 10 seconds pass.
+		void wait(LLCurlRequest& request, S32 expected)
+		{
+			LLTimer timer;
+			while (mDone < expected && timer.getElapsedTimeF32() < 10.f)
+			{
+				request.process();
+				ms_sleep(1);
+			}
+		}
+
+		S32 mDone;
+		S32 mGood;
+	};
+	typedef test_group<curl_data> curl_test;
+	typedef curl_test::object curl_object;
+	tut::curl_test tcurl("curl");
+
+	template<> template<>
+	void curl_object::test<1>()
+	{
+		// requests beyond the per host cap wait, and connections are reused
+		HTTPStandIn server(5, 0, 1000);
+		server.start();
+
+		const S32 REQUESTS = 100;
+		const S32 MAX_PER_HOST = 4;
+		LLCurlRequest request(MAX_PER_HOST);
+		for (S32 i = 0; i < REQUESTS; ++i)
+		{
+			get(request, server.getURL(i));
+		}
+		ensure("waiting for a connection", request.getQueued() >= REQUESTS - MAX_PER_HOST);
+		wait(request, REQUESTS);
+
+		ensure_equals("done", mDone, REQUESTS);
+		ensure_equals("good", mGood, REQUESTS);
+		ensure("connections capped", server.mMaxOpen <= (U32)MAX_PER_HOST);
+		ensure("connections reused", server.mConnections <= (U32)MAX_PER_HOST);
+
+		LLCurl::Stats stats = request.getStats();
+		ensure_equals("requests", stats.mRequests, (U32)REQUESTS);
+		ensure_equals("completed", stats.mCompleted, (U32)REQUESTS);
+		ensure("reuse ratio", stats.getReuseRatio() >= 0.9f);
+		ensure("queue wait", stats.getAverageQueueWait() > 0.0);
+		ensure("first byte", stats.getAverageFirstByte() >= 0.004);
+		ensure_equals("nothing left", request.getQueued(), 0);
+	}
+
+	template<> template<>
+	void curl_object::test<2>()
+	{
+		// threaded requests complete on the owner thread within the budget
+		HTTPStandIn server(2, 0, 1000);
+		server.start();
+
+		const S32 REQUESTS = 50;
+		const S32 BUDGET = 5;
+		LLCurl::startThread(64, BUDGET);
+		ensure("threaded", LLCurl::isThreaded());
+		{
+			LLCurlRequest request;
+			for (S32 i = 0; i < REQUESTS; ++i)
+			{
+				get(request, server.getURL(i));
+			}
+			ensure_equals("queued", request.getQueued(), REQUESTS);
+
+			LLTimer timer;
+			S32 most = 0;
+			while (mDone < REQUESTS && timer.getElapsedTimeF32() < 10.f)
+			{
+				S32 processed = request.process();
+				most = llmax(most, processed);
+				ms_sleep(1);
+			}
+			ensure_equals("done", mDone, REQUESTS);
+			ensure_equals("good", mGood, REQUESTS);
+			ensure("budget", most <= BUDGET);
+			ensure_equals("nothing left", request.getQueued(), 0);
+		}
+		LLCurl::stopThread();
+		ensure("stopped", !LLCurl::isThreaded());
+	}
+
+	template<> template<>
+	void curl_object::test<3>()
+	{
+		// the curl thread stops starting transfers once the queue is full
+		HTTPStandIn server(1, 0, 1000);
+		server.start();
+
+		const S32 REQUESTS = 40;
+		const S32 QUEUE_SIZE = 8;
+		LLCurl::startThread(QUEUE_SIZE, 0);
+		{
+			LLCurlRequest request;
+			for (S32 i = 0; i < REQUESTS; ++i)
+			{
+				get(request, server.getURL(i));
+			}
+			// far longer than the transfers take
+			ms_sleep(300);
+			S32 processed = request.process();
+			ensure("something finished", processed > 0);
+			ensure("queue bounded", processed <= QUEUE_SIZE);
+
+			wait(request, REQUESTS);
+			ensure_equals("done", mDone, REQUESTS);
+			ensure_equals("good", mGood, REQUESTS);
+
+			// dropping the request with transfers in flight is safe
+			for (S32 i = 0; i < REQUESTS; ++i)
+			{
+				get(request, server.getURL(i));
+			}
+		}
+		LLCurl::stopThread();
+		ensure_equals("cancelled transfers not reported", mDone, REQUESTS);
+	}
+
+	struct curl_benchmark_data : public curl_data
+	{
+	};
+
+	typedef test_group<curl_benchmark_data> curl_benchmark_test;
+	typedef curl_benchmark_test::object curl_benchmark_object;
+	tut::curl_benchmark_test tcurl_benchmark("curl-benchmark");
+
+	template<> template<>
+	void curl_benchmark_object::test<1>()
+	{
+		// Benchmark against the old pattern of an uncapped multi handle
+		// replaced every hundred requests, with 30ms connection setup.
+		const S32 REQUESTS = 1000;
+		const S32 BATCH = 100;
+		const char* names[3] = { "per batch, uncapped", "pooled, 8 per host", "pooled, uncapped" };
+		for (S32 pass = 0; pass < 3; ++pass)
+		{
+			HTTPStandIn server(2, 30, 20000);
+			server.start();
+			mDone = 0;
+			mGood = 0;
+
+			LLTimer timer;
+			LLCurlRequest pooled(pass == 1 ? LLCurlRequest::DEFAULT_MAX_PER_HOST : 0);
+			for (S32 i = 0; i < REQUESTS; i += BATCH)
+			{
+				LLCurlRequest* request = pass ? &pooled : new LLCurlRequest(0);
+				for (S32 j = 0; j < BATCH; ++j)
+				{
+					get(*request, server.getURL(i + j));
+				}
+				wait(*request, i + BATCH);
+				if (!pass)
+				{
+					delete request;
+				}
+			}
+			F64 elapsed = timer.getElapsedTimeF64();
+			ensure_equals("good", mGood, REQUESTS);
+
+			llinfos << "LLCurlRequest " << names[pass] << ": "
+					<< (S32)(REQUESTS / elapsed) << " requests/sec, "
+					<< server.mConnections << " connections, "
+					<< server.mMaxOpen << " open at once" << llendl;
+			if (pass)
+			{
+				LLCurl::Stats stats = pooled.getStats();
+				llinfos << "LLCurlRequest " << names[pass] << ": "
+						<< "reuse " << stats.getReuseRatio() * 100.f << "%, "
+						<< "queue wait " << stats.getAverageQueueWait() * 1000.0 << "ms, "
+						<< "first byte " << stats.getAverageFirstByte() * 1000.0 << "ms" << llendl;
+			}
+		}
+	}
+}
+
+#endif // !LL_WINDOWS
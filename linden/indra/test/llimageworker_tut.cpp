@@ -0,0 +1,235 @@
+/**
+ * @file llimageworker_tut.cpp
+ * @brief Tests for parallel image decoding in LLImageDecodeThread
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+#include "llapr.h"
+#include "lldir.h"
+#include "llimagej2c.h"
+#include "llimageworker.h"
+#include "llthreadpool.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	class LLImageWorkerTestResponder : public LLImageDecodeThread::Responder
+	{
+	public:
+		LLImageWorkerTestResponder(LLAtomicS32* done, LLAtomicS32* failed)
+			: mDone(done), mFailed(failed)
+		{
+		}
+
+		/*virtual*/ void completed(bool success, LLImageRaw* raw, LLImageRaw* aux)
+		{
+			mRaw = raw;
+			if (!success)
+			{
+				(*mFailed)++;
+			}
+			(*mDone)++;
+		}
+
+		LLPointer<LLImageRaw> mRaw;
+		LLAtomicS32* mDone;
+		LLAtomicS32* mFailed;
+	};
+
+	struct imageworker_data
+	{
+		imageworker_data()
+		{
+			static bool init = false;
+			if (!init)
+			{
+				ll_init_apr();
+				LLImage::initClass(false);
+				init = true;
+			}
+		}
+
+		// Encodes a different synthetic image for each seed
+		LLPointer<LLImageJ2C> makeImage(S32 seed, S32 size)
+		{
+			LLPointer<LLImageRaw> raw = new LLImageRaw(size, size, 3);
+			U8* data = raw->getData();
+			for (S32 y = 0; y < size; y++)
+			{
+				for (S32 x = 0; x < size; x++)
+				{
+					U8* pixel = data + (y * size + x) * 3;
+					pixel[0] = (U8)(x * 255 / size);
+					pixel[1] = (U8)(y * 255 / size);
+					pixel[2] = (U8)((x ^ y) + seed * 17);
+				}
+			}
+			LLPointer<LLImageJ2C> j2c = new LLImageJ2C;
+			ensure("encode", j2c->encode(raw, 0.f));
+			return j2c;
+		}
+
+		// Decodes fresh copies of images on decoder, returns the responders in image order
+		std::vector<LLPointer<LLImageWorkerTestResponder> > decodeAll(LLImageDecodeThread& decoder,
+																	  const std::vector<LLPointer<LLImageJ2C> >& images,
+																	  S32 discard, S32& failed_count)
+		{
+			LLAtomicS32 done(0);
+			LLAtomicS32 failed(0);
+			std::vector<LLPointer<LLImageWorkerTestResponder> > responders;
+			std::vector<LLPointer<LLImageJ2C> > copies; // the decoder does not hold a reference
+			for (U32 i = 0; i < images.size(); i++)
+			{
+				LLPointer<LLImageJ2C> image = new LLImageJ2C;
+				memcpy(image->allocateData(images[i]->getDataSize()), images[i]->getData(), images[i]->getDataSize());
+				copies.push_back(image);
+				LLPointer<LLImageWorkerTestResponder> responder = new LLImageWorkerTestResponder(&done, &failed);
+				responders.push_back(responder);
+				decoder.decodeImage(image, LLQueuedThread::PRIORITY_NORMAL, discard, FALSE, responder);
+			}
+			LLTimer timeout;
+			while (done < (S32)images.size() && timeout.getElapsedTimeF32() < 60.f)
+			{
+				decoder.update(0);
+				if (decoder.getThreaded())
+				{
+					ms_sleep(1);
+				}
+			}
+			ensure_equals("all decoded", (S32)done, (S32)images.size());
+			failed_count = failed;
+			return responders;
+		}
+	};
+
+	typedef test_group<imageworker_data> imageworker_test;
+	typedef imageworker_test::object imageworker_object;
+	tut::imageworker_test imageworker_testcase("llimageworker");
+
+	template<> template<>
+	void imageworker_object::test<1>()
+	{
+		// parallel decodes on a pool match decodes on the calling thread
+		const S32 COUNT = 16;
+		std::vector<LLPointer<LLImageJ2C> > images;
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			images.push_back(makeImage(i, 128));
+		}
+
+		S32 failed = 0;
+		LLImageDecodeThread serial(false);
+		std::vector<LLPointer<LLImageWorkerTestResponder> > expected = decodeAll(serial, images, 0, failed);
+		ensure_equals("serial failures", failed, 0);
+
+		LLThreadPool pool("imagedecode test pool", 4);
+		LLImageDecodeThread parallel(true, &pool);
+		std::vector<LLPointer<LLImageWorkerTestResponder> > actual = decodeAll(parallel, images, 0, failed);
+		ensure_equals("parallel failures", failed, 0);
+
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			LLImageRaw* a = actual[i]->mRaw;
+			LLImageRaw* e = expected[i]->mRaw;
+			ensure("decoded", a && e);
+			ensure_equals("width", a->getWidth(), e->getWidth());
+			ensure_equals("height", a->getHeight(), e->getHeight());
+			ensure_memory_matches("pixels", a->getData(), a->getDataSize(), e->getData(), e->getDataSize());
+		}
+		parallel.shutdown();
+	}
+
+	struct imageworker_benchmark_data : public imageworker_data
+	{
+	};
+
+	typedef test_group<imageworker_benchmark_data> imageworker_benchmark_test;
+	typedef imageworker_benchmark_test::object imageworker_benchmark_object;
+	tut::imageworker_benchmark_test imageworker_benchmark_testcase("llimageworker-benchmark");
+
+	template<> template<>
+	void imageworker_benchmark_object::test<1>()
+	{
+		// Decode throughput per thread count and discard level. Decodes the .j2c files in
+		// $LL_J2C_BENCHMARK_DIR if set, otherwise a small set of synthetic images.
+		std::vector<LLPointer<LLImageJ2C> > images;
+		const char* dir = getenv("LL_J2C_BENCHMARK_DIR");
+		if (dir && *dir)
+		{
+			std::string dirname(dir);
+			std::string filename;
+			while (gDirUtilp->getNextFileInDir(dirname, "*.j2c", filename, FALSE))
+			{
+				LLPointer<LLImageJ2C> image = new LLImageJ2C;
+				if (image->loadAndValidate(dirname + gDirUtilp->getDirDelimiter() + filename))
+				{
+					images.push_back(image);
+				}
+			}
+		}
+		else
+		{
+			for (S32 i = 0; i < 32; i++)
+			{
+				images.push_back(makeImage(i, 256));
+			}
+		}
+		ensure("have images", !images.empty());
+		S64 total_bytes = 0;
+		for (U32 i = 0; i < images.size(); i++)
+		{
+			total_bytes += images[i]->getDataSize();
+		}
+
+		S32 max_threads = LLThreadPool::getProcessorCount();
+		for (S32 threads = 1; ; threads = llmin(threads * 2, max_threads))
+		{
+			LLThreadPool pool("imagedecode benchmark pool", threads);
+			LLImageDecodeThread decoder(true, &pool);
+			for (S32 discard = 0; discard <= 4; discard++)
+			{
+				S32 failed = 0;
+				LLTimer timer;
+				decodeAll(decoder, images, discard, failed);
+				F64 elapsed = llmax(timer.getElapsedTimeF64(), 0.000001);
+				llinfos << "J2C decode: " << threads << " threads, discard " << discard << ": "
+						<< (images.size() / elapsed) << " images/sec, "
+						<< (total_bytes / elapsed / (1024.0 * 1024.0)) << " MB/s of J2C data ("
+						<< images.size() << " images, " << failed << " failed)" << llendl;
+			}
+			decoder.shutdown();
+			if (threads == max_threads)
+			{
+				break;
+			}
+		}
+	}
+}
@@ -34,7 +34,9 @@
 #include "linden_common.h"
 #include "lltut.h"
 #include "llbufferstream.h"
+#include "llhost.h"
 #include "lliohttpserver.h"
+#include "lliosocket.h"
 #include "llsdhttpserver.h"
 #include "llsdserialize.h"
 
@@ -79,6 +81,26 @@ namespace tut
 			}
 		};
 
+		class WireBulk : public LLIOPipe
+		{
+		public:
+			enum { BULK_SIZE = 1024 * 1024 };
+
+		protected:
+			virtual EStatus process_impl(
+				const LLChannelDescriptors& channels,
+				buffer_ptr_t& buffer,
+				bool& eos,
+				LLSD& context,
+				LLPumpIO* pump)
+			{
+				if(!eos) return STATUS_BREAK;
+				std::vector<U8> body(BULK_SIZE, 'x');
+				buffer->append(channels.out(), &body[0], BULK_SIZE);
+				return STATUS_DONE;
+			}
+		};
+
 		HTTPServiceTestData()
 			: mResponse(NULL)
 		{
@@ -345,6 +367,79 @@ namespace tut
 	}
 
 
+	struct HTTPServiceBenchmarkData : public HTTPServiceTestData
+	{
+	};
+
+	typedef test_group<HTTPServiceBenchmarkData>	HTTPServiceBenchmarkGroup;
+	typedef HTTPServiceBenchmarkGroup::object		HTTPServiceBenchmarkObject;
+	HTTPServiceBenchmarkGroup httpServiceBenchmarkGroup("http service-benchmark");
+
+	template<> template<>
+	void HTTPServiceBenchmarkObject::test<1>()
+	{
+		// serve 1 MB bodies over sockets, with and without the heap
+		// buffer pool, and report the throughput.
+		const U16 SERVER_LISTEN_PORT = 13051;
+		const S32 REQUESTS = 32;
+		const char* names[2] = { "heap", "pooled" };
+		for(S32 pooled = 0; pooled < 2; ++pooled)
+		{
+			if(pooled) LLHeapBuffer::initClass();
+			apr_pool_t* pool;
+			apr_pool_create(&pool, NULL);
+			LLPumpIO* pump = new LLPumpIO(pool);
+			LLHTTPNode& root = LLIOHTTPServer::create(
+				pool,
+				*pump,
+				SERVER_LISTEN_PORT + pooled);
+			root.addNode("/wire/bulk", new LLHTTPNodeForPipe<WireBulk>);
+			pump_loop(pump, 0.1f);
+
+			LLHost server_host("127.0.0.1", SERVER_LISTEN_PORT + pooled);
+			F64 elapsed = 0.0;
+			for(S32 i = 0; i < REQUESTS; ++i)
+			{
+				LLSocket::ptr_t client = LLSocket::create(pool, LLSocket::STREAM_TCP);
+				ensure("connected to server", client->blockingConnect(server_host));
+				LLPipeStringExtractor* extractor = new LLPipeStringExtractor;
+				LLIOPipe::ptr_t extractor_ptr(extractor);
+				LLPumpIO::chain_t chain;
+				chain.push_back(LLIOPipe::ptr_t(
+					new LLPipeStringInjector("GET /wire/bulk HTTP/1.0\r\n\r\n")));
+				chain.push_back(LLIOPipe::ptr_t(new LLIOSocketWriter(client)));
+				chain.push_back(LLIOPipe::ptr_t(new LLIONull));
+				pump->addChain(chain, DEFAULT_CHAIN_EXPIRY_SECS);
+				chain.clear();
+				chain.push_back(LLIOPipe::ptr_t(new LLIOSocketReader(client)));
+				chain.push_back(extractor_ptr);
+				pump->addChain(chain, DEFAULT_CHAIN_EXPIRY_SECS);
+				client.reset();
+
+				LLTimer timer;
+				while(!extractor->done() && (timer.getElapsedTimeF64() < 10.0))
+				{
+					LLFrameTimer::updateFrameTime();
+					pump->pump();
+					pump->callback();
+				}
+				elapsed += timer.getElapsedTimeF64();
+				std::string result = extractor->string();
+				ensure_starts_with("bulk status", result, "HTTP/1.0 200 OK\r\n");
+				ensure_contains("bulk content length", result,
+					"Content-Length: 1048576\r\n");
+				ensure("bulk body", (result.size() > WireBulk::BULK_SIZE));
+			}
+
+			llinfos << "LLIOHTTPServer " << names[pooled] << " buffers: "
+					<< REQUESTS << " 1 MB bodies at "
+					<< (S32)(REQUESTS / elapsed) << " MB/sec" << llendl;
+			delete pump;
+			apr_pool_destroy(pool);
+			if(pooled) LLHeapBuffer::cleanupClass();
+		}
+	}
+
 	/* TO DO:
 		test generation of not found and method not allowed errors
 	*/
@@ -0,0 +1,476 @@
+/**
+ * @file lllayerdecodethread_tut.cpp
+ * @brief Tests for terrain patch decompression and LLLayerDecodeThread
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include <vector>
+
+#include "linden_common.h"
+#include "lltut.h"
+#include "llapr.h"
+#include "bitpack.h"
+#include "indra_constants.h"
+#include "lllayerdecodethread.h"
+#include "llthreadpool.h"
+#include "lltimer.h"
+#include "patch_code.h"
+#include "patch_dct.h"
+
+namespace tut
+{
+	struct layerdecode_data
+	{
+		layerdecode_data() : mSeed(12345)
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+		}
+
+		// Own generator so failures reproduce.
+		U32 random(U32 max)
+		{
+			mSeed = mSeed * 1103515245 + 12345;
+			return (mSeed >> 8) % max;
+		}
+
+		// Coefficients that fall off with frequency, as the DCT of terrain does.
+		void makeCoefficients(S32* cpatch, S32 size)
+		{
+			for (S32 i = 0; i < size*size; i++)
+			{
+				S32 scale = 2048 >> llmin(i / 8, 11);
+				cpatch[i] = (S32)random(2 * scale + 1) - scale;
+			}
+		}
+
+		// Rolling hills with a ridge, edge patches x edge patches of size.
+		void makeTerrain(std::vector<F32>& heights, S32 edge, S32 size)
+		{
+			S32 grids = edge * size;
+			heights.resize(grids * grids);
+			F32 phase = (F32)random(1000) / 100.f;
+			for (S32 y = 0; y < grids; y++)
+			{
+				for (S32 x = 0; x < grids; x++)
+				{
+					heights[y * grids + x] = 20.f + 12.f * sinf(x * 0.05f + phase) * cosf(y * 0.07f)
+						+ 4.f * sinf((x + y) * 0.21f) + (F32)random(100) / 200.f;
+				}
+			}
+		}
+
+		// Compresses the terrain into LayerData packets of patches_per_packet
+		// patches, the way the simulator sends it.
+		void makePackets(std::vector<std::vector<U8> >& packets, std::vector<F32>& heights,
+						 S32 edge, S32 size, S32 patches_per_packet)
+		{
+			const S32 MAX_PACKET = 65536;
+			S32 grids = edge * size;
+			U8 buffer[MAX_PACKET];
+			S32 cpatch[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+			S32 patch_count = edge * edge;
+			packets.clear();
+			for (S32 first = 0; first < patch_count; first += patches_per_packet)
+			{
+				LLBitPack bitpack(buffer, MAX_PACKET);
+				init_patch_coding(bitpack);
+				init_patch_compressor(size, grids, LAND_LAYER_CODE);
+				LLGroupHeader group_header;
+				get_patch_group_header(&group_header);
+				code_patch_group_header(bitpack, &group_header);
+				for (S32 p = first; p < llmin(first + patches_per_packet, patch_count); p++)
+				{
+					S32 i = p % edge;
+					S32 j = p / edge;
+					F32* patch = &heights[j * size * grids + i * size];
+					LLPatchHeader ph;
+					F32 zmax, zmin;
+					prescan_patch(patch, &ph, zmax, zmin);
+					compress_patch(patch, cpatch, &ph, 10);
+					ph.patchids = (i << 5) | j;
+					code_patch_header(bitpack, &ph, cpatch);
+					code_patch(bitpack, cpatch, 0);
+				}
+				code_end_of_data(bitpack);
+				end_patch_coding(bitpack);
+				packets.push_back(std::vector<U8>(buffer, buffer + bitpack.mBufferSize));
+			}
+		}
+
+		// The per patch decode LLSurface used before decode_layer_patches().
+		void decodeScalar(const std::vector<U8>& packet, std::vector<LLDecodedPatch>& patches)
+		{
+			LLBitPack bitpack((U8*)&packet[0], packet.size());
+			LLGroupHeader group_header;
+			LLPatchHeader ph;
+			S32 cpatch[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+			decode_patch_group_header(bitpack, &group_header);
+			S32 size = group_header.patch_size;
+			init_patch_decompressor(size);
+			group_header.stride = size;
+			set_group_of_patch_header(&group_header);
+			while (1)
+			{
+				decode_patch_header(bitpack, &ph);
+				if (ph.quant_wbits == END_OF_PATCHES)
+				{
+					break;
+				}
+				decode_patch(bitpack, cpatch);
+				patches.resize(patches.size() + 1);
+				patches.back().mHeader = ph;
+				decompress_patch_scalar(patches.back().mData, cpatch, &ph);
+			}
+		}
+
+		void ensurePatchesMatch(const char* msg, const std::vector<LLDecodedPatch>& actual,
+								const std::vector<LLDecodedPatch>& expected, S32 size)
+		{
+			ensure_equals(msg, actual.size(), expected.size());
+			for (U32 i = 0; i < actual.size(); i++)
+			{
+				ensure_equals(msg, actual[i].mHeader.patchids, expected[i].mHeader.patchids);
+				ensure_memory_matches(msg, actual[i].mData, size*size*sizeof(F32),
+									  expected[i].mData, size*size*sizeof(F32));
+			}
+		}
+
+		U32 mSeed;
+	};
+
+	typedef test_group<layerdecode_data> layerdecode_test;
+	typedef layerdecode_test::object layerdecode_object;
+	tut::layerdecode_test layerdecode_testcase("lllayerdecodethread");
+
+	template<> template<>
+	void layerdecode_object::test<1>()
+	{
+		// decompress_patch() matches decompress_patch_scalar() bit for bit
+		const S32 STRIDE = 70;
+		S32 cpatch[LARGE_PATCH_SIZE*LARGE_PATCH_SIZE];
+		std::vector<F32> expected(STRIDE * LARGE_PATCH_SIZE);
+		std::vector<F32> actual(STRIDE * LARGE_PATCH_SIZE);
+		for (S32 size = NORMAL_PATCH_SIZE; size <= LARGE_PATCH_SIZE; size *= 2)
+		{
+			init_patch_decompressor(size);
+			LLGroupHeader group_header;
+			group_header.stride = STRIDE;
+			group_header.patch_size = size;
+			group_header.layer_type = LAND_LAYER_CODE;
+			set_group_of_patch_header(&group_header);
+			for (S32 n = 0; n < 500; n++)
+			{
+				makeCoefficients(cpatch, size);
+				LLPatchHeader ph;
+				ph.dc_offset = (F32)random(20000) / 100.f - 50.f;
+				ph.range = 1 + random(300);
+				ph.quant_wbits = (U8)((random(9) << 4) | random(16));
+				ph.patchids = 0;
+				std::fill(expected.begin(), expected.end(), -1.f);
+				std::fill(actual.begin(), actual.end(), -1.f);
+				decompress_patch_scalar(&expected[0], cpatch, &ph);
+				decompress_patch(&actual[0], cpatch, &ph);
+				ensure_memory_matches("patch", &actual[0], actual.size() * sizeof(F32),
+									  &expected[0], expected.size() * sizeof(F32));
+			}
+		}
+	}
+
+	template<> template<>
+	void layerdecode_object::test<2>()
+	{
+		// decode_layer_patches() matches decoding a packet patch by patch
+		for (S32 size = NORMAL_PATCH_SIZE; size <= LARGE_PATCH_SIZE; size *= 2)
+		{
+			S32 edge = 256 / size;
+			std::vector<F32> heights;
+			std::vector<std::vector<U8> > packets;
+			makeTerrain(heights, edge, size);
+			makePackets(packets, heights, edge, size, 4);
+			init_patch_decompressor_tables();
+			S32 patch_count = 0;
+			F32 max_error = 0.f;
+			for (U32 p = 0; p < packets.size(); p++)
+			{
+				std::vector<LLDecodedPatch> expected;
+				decodeScalar(packets[p], expected);
+				LLGroupHeader group_header;
+				std::vector<LLDecodedPatch> actual;
+				ensure("decoded", decode_layer_patches(&packets[p][0], packets[p].size(), &group_header, actual));
+				ensure_equals("patch size", (S32)group_header.patch_size, size);
+				ensurePatchesMatch("patches", actual, expected, size);
+
+				// and is close to the terrain it came from
+				for (U32 i = 0; i < actual.size(); i++)
+				{
+					S32 px = actual[i].mHeader.patchids >> 5;
+					S32 py = actual[i].mHeader.patchids & 0x1F;
+					for (S32 y = 0; y < size; y++)
+					{
+						for (S32 x = 0; x < size; x++)
+						{
+							F32 height = heights[(py * size + y) * edge * size + px * size + x];
+							max_error = llmax(max_error, fabsf(actual[i].mData[y * size + x] - height));
+						}
+					}
+				}
+				patch_count += actual.size();
+			}
+			ensure_equals("all patches", patch_count, edge * edge);
+			ensure("heights", max_error < 1.f);
+		}
+	}
+
+	template<> template<>
+	void layerdecode_object::test<3>()
+	{
+		// malformed packets are rejected without reading past their end
+		std::vector<F32> heights;
+		std::vector<std::vector<U8> > packets;
+		makeTerrain(heights, 4, NORMAL_PATCH_SIZE);
+		makePackets(packets, heights, 4, NORMAL_PATCH_SIZE, 16);
+		init_patch_decompressor_tables();
+		std::vector<U8>& packet = packets[0];
+
+		LLGroupHeader group_header;
+		std::vector<LLDecodedPatch> patches;
+		for (S32 size = 0; size < (S32)packet.size(); size += 7)
+		{
+			patches.clear();
+			std::vector<U8> truncated(packet.begin(), packet.begin() + size);
+			ensure("truncated", !decode_layer_patches(truncated.empty() ? NULL : &truncated[0],
+													  size, &group_header, patches));
+			ensure("partial", patches.size() <= 16);
+		}
+
+		std::vector<U8> bad_size(packet);
+		bad_size[2] = 64; // patch_size follows the 16 bit stride
+		patches.clear();
+		ensure("patch size", !decode_layer_patches(&bad_size[0], bad_size.size(), &group_header, patches));
+		ensure("no patches", patches.empty());
+
+		// a packet of random bytes
+		std::vector<U8> noise(600);
+		for (U32 i = 0; i < noise.size(); i++)
+		{
+			noise[i] = (U8)random(256);
+		}
+		noise[2] = NORMAL_PATCH_SIZE;
+		patches.clear();
+		decode_layer_patches(&noise[0], noise.size(), &group_header, patches);
+	}
+
+	template<> template<>
+	void layerdecode_object::test<4>()
+	{
+		// LLLayerDecodeThread decodes the same patches, threaded or not
+		std::vector<F32> heights;
+		std::vector<std::vector<U8> > packets;
+		makeTerrain(heights, 16, NORMAL_PATCH_SIZE);
+		makePackets(packets, heights, 16, NORMAL_PATCH_SIZE, 4);
+
+		LLThreadPool pool("layerdecode test pool", 4);
+		for (S32 threaded = 0; threaded < 2; threaded++)
+		{
+			LLLayerDecodeThread decoder(threaded != 0, threaded ? &pool : NULL);
+			std::vector<LLQueuedThread::handle_t> handles;
+			for (U32 p = 0; p < packets.size(); p++)
+			{
+				handles.push_back(decoder.decodeLayer(&packets[p][0], packets[p].size()));
+			}
+			// abandoned before it is decoded, or after
+			decoder.releaseLayer(decoder.decodeLayer(&packets[0][0], packets[0].size()));
+
+			LLTimer timeout;
+			U32 next = 0;
+			while (next < handles.size() && timeout.getElapsedTimeF32() < 30.f)
+			{
+				decoder.update(1);
+				LLLayerDecodeThread::LayerRequest* req = decoder.getDecodedLayer(handles[next]);
+				if (!req)
+				{
+					ms_sleep(1);
+					continue;
+				}
+				std::vector<LLDecodedPatch> expected;
+				decodeScalar(packets[next], expected);
+				ensure("valid", req->isValid());
+				ensurePatchesMatch("patches", req->mPatches, expected, NORMAL_PATCH_SIZE);
+				decoder.releaseLayer(handles[next]);
+				next++;
+			}
+			ensure_equals("all decoded", next, (U32)handles.size());
+			decoder.shutdown();
+		}
+	}
+
+	struct layerdecode_benchmark_data : public layerdecode_data
+	{
+	};
+
+	typedef test_group<layerdecode_benchmark_data> layerdecode_benchmark_test;
+	typedef layerdecode_benchmark_test::object layerdecode_benchmark_object;
+	tut::layerdecode_benchmark_test layerdecode_benchmark_testcase("lllayerdecodethread-benchmark");
+
+	template<> template<>
+	void layerdecode_benchmark_object::test<1>()
+	{
+		// Benchmark decompress_patch() against decompress_patch_scalar(),
+		// then a region's worth of land packets decoded patch by patch, with
+		// decode_layer_patches() and on pools of decode threads.
+		for (S32 size = NORMAL_PATCH_SIZE; size <= LARGE_PATCH_SIZE; size *= 2)
+		{
+			const S32 IDCT_PATCHES = 64;
+			const S32 IDCT_PASSES = 100;
+			std::vector<S32> cpatches(IDCT_PATCHES * size * size);
+			for (S32 i = 0; i < IDCT_PATCHES; i++)
+			{
+				makeCoefficients(&cpatches[i * size * size], size);
+			}
+			init_patch_decompressor(size);
+			LLGroupHeader idct_header;
+			idct_header.stride = size;
+			idct_header.patch_size = size;
+			idct_header.layer_type = LAND_LAYER_CODE;
+			set_group_of_patch_header(&idct_header);
+			LLPatchHeader ph;
+			ph.dc_offset = 20.f;
+			ph.range = 40;
+			ph.quant_wbits = 0x88;
+			ph.patchids = 0;
+			std::vector<F32> expected_heights(IDCT_PATCHES * size * size);
+			std::vector<F32> actual_heights(IDCT_PATCHES * size * size);
+
+			LLTimer timer;
+			for (S32 pass = 0; pass < IDCT_PASSES; pass++)
+			{
+				for (S32 i = 0; i < IDCT_PATCHES; i++)
+				{
+					decompress_patch_scalar(&expected_heights[i * size * size], &cpatches[i * size * size], &ph);
+				}
+			}
+			F64 scalar = IDCT_PASSES * IDCT_PATCHES / llmax(timer.getElapsedTimeF64(), 0.000001);
+			timer.reset();
+			for (S32 pass = 0; pass < IDCT_PASSES; pass++)
+			{
+				for (S32 i = 0; i < IDCT_PATCHES; i++)
+				{
+					decompress_patch(&actual_heights[i * size * size], &cpatches[i * size * size], &ph);
+				}
+			}
+			F64 vector = IDCT_PASSES * IDCT_PATCHES / llmax(timer.getElapsedTimeF64(), 0.000001);
+			ensure_memory_matches("heights", &actual_heights[0], actual_heights.size() * sizeof(F32),
+								  &expected_heights[0], expected_heights.size() * sizeof(F32));
+			llinfos << "Terrain " << size << "x" << size << " decompress_patch: scalar " << (S32)scalar
+					<< " patches/sec, current " << (S32)vector << " patches/sec" << llendl;
+
+			S32 edge = 256 / size;
+			std::vector<F32> heights;
+			std::vector<std::vector<U8> > packets;
+			makeTerrain(heights, edge, size);
+			makePackets(packets, heights, edge, size, size == NORMAL_PATCH_SIZE ? 4 : 1);
+			const S32 PASSES = 20;
+			S32 patches_per_pass = edge * edge;
+
+			timer.reset();
+			std::vector<std::vector<LLDecodedPatch> > expected(packets.size());
+			for (S32 pass = 0; pass < PASSES; pass++)
+			{
+				for (U32 p = 0; p < packets.size(); p++)
+				{
+					expected[p].clear();
+					decodeScalar(packets[p], expected[p]);
+				}
+			}
+			scalar = PASSES * patches_per_pass / llmax(timer.getElapsedTimeF64(), 0.000001);
+
+			timer.reset();
+			std::vector<std::vector<LLDecodedPatch> > actual(packets.size());
+			LLGroupHeader group_header;
+			for (S32 pass = 0; pass < PASSES; pass++)
+			{
+				for (U32 p = 0; p < packets.size(); p++)
+				{
+					actual[p].clear();
+					decode_layer_patches(&packets[p][0], packets[p].size(), &group_header, actual[p]);
+				}
+			}
+			F64 batched = PASSES * patches_per_pass / llmax(timer.getElapsedTimeF64(), 0.000001);
+			for (U32 p = 0; p < packets.size(); p++)
+			{
+				ensurePatchesMatch("patches", actual[p], expected[p], size);
+			}
+			llinfos << "Terrain " << size << "x" << size << " packets: patch by patch " << (S32)scalar
+					<< " patches/sec, decode_layer_patches " << (S32)batched << " patches/sec" << llendl;
+
+			S32 max_threads = LLThreadPool::getProcessorCount();
+			for (S32 threads = 1; ; threads = llmin(threads * 2, max_threads))
+			{
+				LLThreadPool pool("layerdecode benchmark pool", threads);
+				LLLayerDecodeThread decoder(true, &pool);
+				std::vector<LLQueuedThread::handle_t> handles;
+				timer.reset();
+				for (S32 pass = 0; pass < PASSES; pass++)
+				{
+					for (U32 p = 0; p < packets.size(); p++)
+					{
+						handles.push_back(decoder.decodeLayer(&packets[p][0], packets[p].size()));
+					}
+					decoder.update(0);
+				}
+				for (U32 h = 0; h < handles.size(); h++)
+				{
+					while (!decoder.getDecodedLayer(handles[h]))
+					{
+						LLThread::yield();
+					}
+				}
+				F64 pooled = PASSES * patches_per_pass / llmax(timer.getElapsedTimeF64(), 0.000001);
+				for (U32 h = 0; h < handles.size(); h++)
+				{
+					ensurePatchesMatch("patches", decoder.getDecodedLayer(handles[h])->mPatches,
+									   expected[h % packets.size()], size);
+					decoder.releaseLayer(handles[h]);
+				}
+				llinfos << "Terrain " << size << "x" << size << " packets: " << threads
+						<< " decode threads " << (S32)pooled << " patches/sec" << llendl;
+				decoder.shutdown();
+				if (threads == max_threads)
+				{
+					break;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,300 @@
+/**
+ * @file lloctree_tut.cpp
+ * @brief Tests for LLOctreeNode
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "lltut.h"
+#include "llmemory.h"
+#include "llrand.h"
+#include "lltimer.h"
+#include "v3dmath.h"
+#include "lloctree.h" // needs v3dmath.h
+
+namespace tut
+{
+	class LLOctreeTestElement;
+	typedef LLOctreeNode<LLOctreeTestElement> test_node_t;
+	typedef LLOctreeRoot<LLOctreeTestElement> test_root_t;
+
+	class LLOctreeTestElement : public LLRefCount
+	{
+	public:
+		LLOctreeTestElement(const LLVector3d& position, F64 radius)
+			: mPosition(position), mRadius(radius), mNode(NULL) {}
+
+		const LLVector3d& getPositionGroup() const { return mPosition; }
+		const F64& getBinRadius() const { return mRadius; }
+
+		LLVector3d mPosition;
+		F64 mRadius;
+		test_node_t* mNode;
+	};
+
+	// Keeps track of the node each element is in, the way LLSpatialGroup
+	// does for drawables.
+	class LLOctreeTestListener : public LLOctreeListener<LLOctreeTestElement>
+	{
+	public:
+		/*virtual*/ void handleInsertion(const LLTreeNode<LLOctreeTestElement>* node, LLOctreeTestElement* data)
+		{
+			data->mNode = (test_node_t*) node;
+		}
+		/*virtual*/ void handleRemoval(const LLTreeNode<LLOctreeTestElement>* node, LLOctreeTestElement* data)
+		{
+			data->mNode = NULL;
+		}
+		/*virtual*/ void handleDestruction(const LLTreeNode<LLOctreeTestElement>* node) { }
+		/*virtual*/ void handleStateChange(const LLTreeNode<LLOctreeTestElement>* node) { }
+		/*virtual*/ void handleChildAddition(const test_node_t* parent, test_node_t* child)
+		{
+			child->addListener(new LLOctreeTestListener());
+		}
+		/*virtual*/ void handleChildRemoval(const test_node_t* parent, const test_node_t* child) { }
+	};
+
+	struct octree_data
+	{
+		octree_data() : mRoot(NULL)
+		{
+		}
+
+		~octree_data()
+		{
+			delete mRoot;
+		}
+
+		test_root_t* makeRoot()
+		{
+			test_root_t* root = new test_root_t(LLVector3d(128, 128, 128), LLVector3d(1, 1, 1), NULL);
+			root->addListener(new LLOctreeTestListener());
+			return root;
+		}
+
+		// Somewhere in a 256m region, mostly small with the odd large one,
+		// like prims in a dense sim.
+		LLVector3d randomPosition()
+		{
+			return LLVector3d(ll_frand(256.f), ll_frand(256.f), 20.f + ll_frand(60.f));
+		}
+
+		F64 randomRadius(S32 i)
+		{
+			return (i % 50) ? 0.25f + ll_frand(2.f) : 4.f + ll_frand(12.f);
+		}
+
+		void build(S32 count)
+		{
+			mRoot = makeRoot();
+			for (S32 i = 0; i < count; i++)
+			{
+				LLPointer<LLOctreeTestElement> element = new LLOctreeTestElement(randomPosition(), randomRadius(i));
+				mElements.push_back(element);
+				mRoot->insert(element);
+			}
+		}
+
+		// Moves an element the way LLSpatialPartition::move() does when it
+		// leaves its group: out of its node and back in from the root.
+		void move(LLOctreeTestElement* element, const LLVector3d& position)
+		{
+			element->mNode->remove(element);
+			element->mPosition = position;
+			mRoot->insert(element);
+		}
+
+		// Checks the structure of the tree under node and returns the number
+		// of elements in it.
+		S32 validate(const test_node_t* node)
+		{
+			ensure("child count", node->getChildCount() <= LL_OCTREE_MAX_CHILDREN);
+			ensure("leaf", node->isLeaf() == (node->getChildCount() == 0));
+			S32 count = node->getElementCount();
+			for (test_node_t::const_element_iter i = node->getData().begin(); i != node->getData().end(); ++i)
+			{
+				ensure("element knows its node", (*i)->mNode == node);
+				ensure("element inside its node", node->isInside((*i)->getPositionGroup()));
+			}
+			for (U32 i = 0; i < node->getChildCount(); i++)
+			{
+				const test_node_t* child = node->getChild(i);
+				ensure("child's parent", child->getParent() == node);
+				ensure("child not empty", child->getChildCount() > 0 || child->getElementCount() > 0);
+				count += validate(child);
+			}
+			return count;
+		}
+
+		test_root_t* mRoot;
+		std::vector<LLPointer<LLOctreeTestElement> > mElements;
+	};
+	typedef test_group<octree_data> octree_test;
+	typedef octree_test::object octree_object;
+	tut::octree_test toctree("octree");
+
+	template<> template<>
+	void octree_object::test<1>()
+	{
+		// the tree stays sound as elements come, move and go
+		const S32 ELEMENTS = 5000;
+		build(ELEMENTS);
+		ensure_equals("all inserted", validate(mRoot), ELEMENTS);
+
+		for (S32 i = 0; i < ELEMENTS; i++)
+		{
+			move(mElements[i], randomPosition());
+		}
+		ensure_equals("all moved", validate(mRoot), ELEMENTS);
+
+		for (S32 i = 0; i < ELEMENTS; i += 2)
+		{
+			mElements[i]->mNode->remove(mElements[i]);
+		}
+		ensure_equals("half removed", validate(mRoot), ELEMENTS / 2);
+
+		for (S32 i = 1; i < ELEMENTS; i += 2)
+		{
+			mElements[i]->mNode->remove(mElements[i]);
+		}
+		ensure_equals("all removed", validate(mRoot), 0);
+		ensure("empty", mRoot->isLeaf());
+	}
+
+	template<> template<>
+	void octree_object::test<2>()
+	{
+		// an element handed to a node it is not in ends up where inserting
+		// it at the root puts it
+		const S32 ELEMENTS = 2000;
+		build(ELEMENTS);
+		test_root_t* other = makeRoot();
+		std::vector<LLPointer<LLOctreeTestElement> > others;
+		for (S32 i = 0; i < ELEMENTS; i++)
+		{
+			LLPointer<LLOctreeTestElement> element = new LLOctreeTestElement(mElements[i]->mPosition, mElements[i]->mRadius);
+			others.push_back(element);
+			other->insert(element);
+		}
+
+		for (S32 i = 0; i < 100; i++)
+		{
+			LLPointer<LLOctreeTestElement> element = new LLOctreeTestElement(randomPosition(), randomRadius(i + 1));
+			LLPointer<LLOctreeTestElement> other_element = new LLOctreeTestElement(element->mPosition, element->mRadius);
+
+			test_node_t* start = mElements[i]->mNode;
+			if (start->isInside(element->mPosition))
+			{
+				continue;
+			}
+			start->insert(element);
+			other->insert(other_element);
+			ensure("inserted", element->mNode && other_element->mNode);
+			ensure_equals("same node center", element->mNode->getCenter(), other_element->mNode->getCenter());
+			ensure_equals("same node size", element->mNode->getSize(), other_element->mNode->getSize());
+			mElements.push_back(element);
+			others.push_back(other_element);
+		}
+		validate(mRoot);
+		delete other;
+	}
+
+	template<> template<>
+	void octree_object::test<3>()
+	{
+		// nodes go back to the pool and are reused
+		LLFixedSizePool& pool = test_node_t::getNodePool();
+		S32 in_use = pool.getStats().mBlocksInUse;
+		build(5000);
+		LLFixedSizePool::Stats built = pool.getStats();
+		ensure("nodes from the pool", built.mBlocksInUse > in_use + 100);
+
+		delete mRoot;
+		mRoot = NULL;
+		mElements.clear();
+		ensure_equals("nodes returned", pool.getStats().mBlocksInUse, in_use);
+
+		build(5000);
+		ensure_equals("no new slabs", pool.getStats().mSlabs, built.mSlabs);
+	}
+
+	struct octree_benchmark_data : public octree_data
+	{
+	};
+
+	typedef test_group<octree_benchmark_data> octree_benchmark_test;
+	typedef octree_benchmark_test::object octree_benchmark_object;
+	tut::octree_benchmark_test toctree_benchmark("octree-benchmark");
+
+	template<> template<>
+	void octree_benchmark_object::test<1>()
+	{
+		// Benchmark churn of 100k elements: insert them all, move them all,
+		// then remove them all.
+		const S32 ELEMENTS = 100000;
+		LLFixedSizePool& pool = test_node_t::getNodePool();
+		LLFixedSizePool::Stats start = pool.getStats();
+		std::vector<LLVector3d> moves;
+		for (S32 i = 0; i < ELEMENTS; i++)
+		{
+			LLVector3d offset(ll_frand(8.f) - 4.f, ll_frand(8.f) - 4.f, ll_frand(2.f) - 1.f);
+			moves.push_back(offset);
+		}
+
+		LLTimer timer;
+		build(ELEMENTS);
+		F64 insert_time = timer.getElapsedTimeF64();
+
+		timer.reset();
+		for (S32 i = 0; i < ELEMENTS; i++)
+		{
+			move(mElements[i], mElements[i]->mPosition + moves[i]);
+		}
+		F64 move_time = timer.getElapsedTimeF64();
+
+		timer.reset();
+		for (S32 i = 0; i < ELEMENTS; i++)
+		{
+			mElements[i]->mNode->remove(mElements[i]);
+		}
+		F64 remove_time = timer.getElapsedTimeF64();
+		ensure_equals("all removed", validate(mRoot), 0);
+
+		LLFixedSizePool::Stats end = pool.getStats();
+		llinfos << "LLOctreeNode churn of " << ELEMENTS << " elements: insert "
+				<< (S32)(insert_time * 1000.0) << " ms, move " << (S32)(move_time * 1000.0)
+				<< " ms, remove " << (S32)(remove_time * 1000.0) << " ms, "
+				<< (end.mAllocations - start.mAllocations) << " nodes made with "
+				<< (end.mSlabs - start.mSlabs) << " heap allocations" << llendl;
+	}
+}
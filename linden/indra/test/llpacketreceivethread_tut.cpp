@@ -0,0 +1,223 @@
+/**
+ * @file llpacketreceivethread_tut.cpp
+ * @brief Tests for receiving message system packets on a separate thread
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+#include "llapr.h"
+#include "llpacketreceivethread.h"
+#include "llpacketring.h"
+#include "net.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	struct packetreceivethread_data
+	{
+		packetreceivethread_data() : mReceiveSocket(-1), mSendSocket(-1), mReceivePort(0), mSendPort(0)
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+			start_net(mReceiveSocket, mReceivePort);
+			start_net(mSendSocket, mSendPort);
+			mLoopback = ip_string_to_u32(LOOPBACK_ADDRESS_STRING);
+		}
+
+		~packetreceivethread_data()
+		{
+			end_net(mReceiveSocket);
+			end_net(mSendSocket);
+		}
+
+		void sendPacket(U32 sequence, S32 size)
+		{
+			char buffer[MTUBYTES];	/* Flawfinder: ignore */
+			memset(buffer, 0, size);
+			memcpy(buffer, &sequence, sizeof(sequence));	/* Flawfinder: ignore */
+			send_packet(mSendSocket, buffer, size, mLoopback, mReceivePort);
+		}
+
+		// Reads everything currently available, the way checkMessages() does.
+		// Returns the number of packets read and checks they arrived in order.
+		S32 drain(LLPacketRing& ring, U32& next_sequence)
+		{
+			char buffer[NET_BUFFER_SIZE];	/* Flawfinder: ignore */
+			S32 count = 0;
+			S32 size;
+			while ((size = ring.receivePacket(mReceiveSocket, buffer)) > 0)
+			{
+				U32 sequence;
+				memcpy(&sequence, buffer, sizeof(sequence));	/* Flawfinder: ignore */
+				ensure("sequence order", sequence >= next_sequence);
+				ensure_equals("sender", ring.getLastSender().getPort(), (U32)mSendPort);
+				next_sequence = sequence + 1;
+				count++;
+			}
+			return count;
+		}
+
+		// Simulates a main loop that is busy for frame_ms between calls
+		// to drain() while the network delivers burst packets per frame.
+		// Returns packets received.
+		S32 runLoad(LLPacketRing& ring, S32 frames, S32 burst, S32 frame_ms, F64& elapsed)
+		{
+			U32 sequence = 0;
+			U32 next_sequence = 0;
+			S32 received = 0;
+			LLTimer timer;
+			for (S32 frame = 0; frame < frames; frame++)
+			{
+				for (S32 i = 0; i < burst; i++)
+				{
+					sendPacket(sequence++, 100);
+				}
+				ms_sleep(frame_ms);
+				received += drain(ring, next_sequence);
+			}
+			// Let the last packets land.
+			ms_sleep(50);
+			received += drain(ring, next_sequence);
+			elapsed = timer.getElapsedTimeF64();
+			return received;
+		}
+
+		S32 mReceiveSocket;
+		S32 mSendSocket;
+		int mReceivePort;
+		int mSendPort;
+		U32 mLoopback;
+	};
+
+	typedef test_group<packetreceivethread_data> packetreceivethread_test;
+	typedef packetreceivethread_test::object packetreceivethread_object;
+	tut::packetreceivethread_test packetreceivethread_testcase("llpacketreceivethread");
+
+	template<> template<>
+	void packetreceivethread_object::test<1>()
+	{
+		// batched receive fills in sender and size for each packet
+		const S32 COUNT = 100;
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			sendPacket(i, 20 + i);
+		}
+		ensure("waiting", wait_for_packet(mReceiveSocket, 1000));
+
+		std::vector<LLPacketBuffer> packets(COUNT);
+		S32 received = receive_packets(mReceiveSocket, &packets[0], COUNT);
+		ensure_equals("received", received, COUNT);
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			U32 sequence;
+			memcpy(&sequence, packets[i].getData(), sizeof(sequence));	/* Flawfinder: ignore */
+			ensure_equals("sequence", sequence, (U32)i);
+			ensure_equals("size", packets[i].getSize(), 20 + i);
+			ensure_equals("sender", packets[i].getHost().getPort(), (U32)mSendPort);
+		}
+		ensure_equals("drained", receive_packets(mReceiveSocket, &packets[0], COUNT), 0);
+		ensure("idle", !wait_for_packet(mReceiveSocket, 0));
+	}
+
+	template<> template<>
+	void packetreceivethread_object::test<2>()
+	{
+		// packets from the thread come out of the ring in order,
+		// including across the wrap of a small ring
+		LLPacketRing ring;
+		ring.startReceiveThread(mReceiveSocket, 16);
+
+		const U32 COUNT = 1000;
+		const U32 BATCH = 10;
+		U32 next_sequence = 0;
+		S32 received = 0;
+		for (U32 i = 0; i < COUNT; i += BATCH)
+		{
+			for (U32 j = i; j < i + BATCH; j++)
+			{
+				sendPacket(j, 64);
+			}
+			// Keep the kernel buffer from overflowing while the ring is small.
+			LLTimer timer;
+			while (received < (S32)(i + BATCH) && timer.getElapsedTimeF32() < 5.f)
+			{
+				received += drain(ring, next_sequence);
+				ms_sleep(1);
+			}
+			ensure_equals("received", received, (S32)(i + BATCH));
+		}
+		ensure_equals("last", next_sequence, COUNT);
+		ensure_equals("thread count", ring.getReceiveThread()->getPacketsReceived(), COUNT);
+		ring.stopReceiveThread();
+		ensure("stopped", ring.getReceiveThread() == NULL);
+	}
+
+	struct packetreceivethread_benchmark_data : public packetreceivethread_data
+	{
+	};
+
+	typedef test_group<packetreceivethread_benchmark_data> packetreceivethread_benchmark_test;
+	typedef packetreceivethread_benchmark_test::object packetreceivethread_benchmark_object;
+	tut::packetreceivethread_benchmark_test packetreceivethread_benchmark_testcase("llpacketreceivethread-benchmark");
+
+	template<> template<>
+	void packetreceivethread_benchmark_object::test<1>()
+	{
+		// Loopback load: bursts of packets arriving while the main loop is
+		// busy, read directly on the main thread versus via the receive thread.
+		const S32 FRAMES = 50;
+		const S32 BURST = 2000;
+		const S32 FRAME_MS = 20;
+		const S32 SENT = FRAMES * BURST;
+
+		F64 direct_time;
+		LLPacketRing direct_ring;
+		S32 direct_received = runLoad(direct_ring, FRAMES, BURST, FRAME_MS, direct_time);
+
+		F64 thread_time;
+		LLPacketRing thread_ring;
+		thread_ring.startReceiveThread(mReceiveSocket, 4096);
+		S32 thread_received = runLoad(thread_ring, FRAMES, BURST, FRAME_MS, thread_time);
+		U32 ring_full = thread_ring.getReceiveThread()->getRingFullCount();
+		thread_ring.stopReceiveThread();
+
+		llinfos << "Packet receive direct: " << (S32)(direct_received / direct_time) << " packets/sec, "
+				<< (100.0 * (SENT - direct_received) / SENT) << "% dropped" << llendl;
+		llinfos << "Packet receive thread: " << (S32)(thread_received / thread_time) << " packets/sec, "
+				<< (100.0 * (SENT - thread_received) / SENT) << "% dropped, ring full " << ring_full << " times" << llendl;
+
+		ensure("direct received", direct_received > 0);
+		ensure("thread received", thread_received > 0);
+	}
+}
@@ -0,0 +1,379 @@
+/**
+ * @file llpacketscheduler_tut.cpp
+ * @brief Tests and trace replay for the outbound packet scheduler
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#include "lltut.h"
+#include "llpacketscheduler.h"
+#include "llhost.h"
+
+namespace tut
+{
+	// One outbound packet in a trace.
+	struct packet_trace_entry
+	{
+		F64 mTime;
+		LLPacketScheduler::EPacketCategory mCategory;
+		S32 mSize;
+	};
+	typedef std::vector<packet_trace_entry> packet_trace_t;
+
+	// Latency seen by one category over a replay.
+	struct replay_stats
+	{
+		replay_stats() : mQueued(0), mSent(0), mTotalDelay(0.0), mMaxDelay(0.0) {}
+
+		S32 mQueued;
+		S32 mSent;
+		F64 mTotalDelay;
+		F64 mMaxDelay;
+	};
+
+	struct packetscheduler_data
+	{
+		packetscheduler_data() : mHost(LOOPBACK_ADDRESS_STRING, 13000) {}
+
+		// Queues a packet carrying tag so it can be told apart later.
+		BOOL queue(LLPacketScheduler& scheduler, LLPacketScheduler::EPacketCategory category,
+				   U32 tag, S32 size, F64 now)
+		{
+			char buffer[NET_BUFFER_SIZE];	/* Flawfinder: ignore */
+			memset(buffer, 0, size);
+			memcpy(buffer, &tag, sizeof(tag));	/* Flawfinder: ignore */
+			return scheduler.queuePacket(category, mHost, buffer, size, now);
+		}
+
+		// Pops everything the scheduler allows at now.  Returns the
+		// tags in send order.
+		std::vector<U32> drain(LLPacketScheduler& scheduler, F64 now)
+		{
+			std::vector<U32> tags;
+			LLPacketBuffer* packetp;
+			while ((packetp = scheduler.popPacket(now)) != NULL)
+			{
+				U32 tag;
+				memcpy(&tag, packetp->getData(), sizeof(tag));	/* Flawfinder: ignore */
+				tags.push_back(tag);
+				delete packetp;
+			}
+			return tags;
+		}
+
+		// Replays trace through a link of bps, pumping the scheduler
+		// every frame_secs the way the message system does.  With fifo
+		// set every packet shares one queue with no deadline, which is
+		// how LLPacketRing throttled before the scheduler.
+		void replay(const packet_trace_t& trace, F32 bps, F64 frame_secs, bool fifo,
+					replay_stats stats[LLPacketScheduler::PC_EOF])
+		{
+			LLPacketScheduler scheduler(bps);
+			if (fifo)
+			{
+				for (S32 i = 0; i < LLPacketScheduler::PC_EOF; ++i)
+				{
+					scheduler.setShare((LLPacketScheduler::EPacketCategory)i, 0.f);
+					scheduler.setDeadline((LLPacketScheduler::EPacketCategory)i, 0.f);
+				}
+			}
+
+			size_t next = 0;
+			F64 end = trace.empty() ? 0.0 : trace.back().mTime;
+			for (F64 now = 0.0; next < trace.size() || scheduler.getQueuedBytes(); now += frame_secs)
+			{
+				// Sends during the frame happen as they are made...
+				while (next < trace.size() && trace[next].mTime <= now)
+				{
+					const packet_trace_entry& entry = trace[next];
+					LLPacketScheduler::EPacketCategory category =
+						fifo ? LLPacketScheduler::PC_UNRELIABLE : entry.mCategory;
+					if (queue(scheduler, category, (U32)next, entry.mSize, entry.mTime))
+					{
+						stats[entry.mCategory].mQueued++;
+					}
+					record(drain(scheduler, entry.mTime), trace, entry.mTime, stats);
+					++next;
+				}
+				// ...and the rest go out from processAcks() once a frame.
+				record(drain(scheduler, now), trace, now, stats);
+				ensure("replay finishes", now < end + 60.0);
+			}
+		}
+
+		void record(const std::vector<U32>& tags, const packet_trace_t& trace, F64 now,
+					replay_stats stats[LLPacketScheduler::PC_EOF])
+		{
+			for (std::vector<U32>::const_iterator it = tags.begin(); it != tags.end(); ++it)
+			{
+				const packet_trace_entry& entry = trace[*it];
+				replay_stats& category = stats[entry.mCategory];
+				F64 delay = now - entry.mTime;
+				category.mSent++;
+				category.mTotalDelay += delay;
+				category.mMaxDelay = llmax(category.mMaxDelay, delay);
+			}
+		}
+
+		// A viewer walking around while an inventory fetch and the odd
+		// resend compete for the uplink: AgentUpdate ten times a second,
+		// a steady trickle of small unreliable messages, a resend every
+		// second and a burst of reliable packets every two seconds.
+		packet_trace_t makeTrace(F64 seconds)
+		{
+			packet_trace_t trace;
+			for (S32 tick = 0; tick < (S32)(seconds * 100.0); ++tick)
+			{
+				F64 time = tick * 0.01;
+				if (tick % 10 == 0)
+				{
+					addEntry(trace, time, LLPacketScheduler::PC_AGENT_UPDATE, 120);
+				}
+				if (tick % 20 == 5)
+				{
+					addEntry(trace, time, LLPacketScheduler::PC_UNRELIABLE, 200);
+				}
+				if (tick % 100 == 50)
+				{
+					addEntry(trace, time, LLPacketScheduler::PC_RESEND, 1000);
+				}
+				if (tick % 200 == 0)
+				{
+					for (S32 i = 0; i < 20; ++i)
+					{
+						addEntry(trace, time, LLPacketScheduler::PC_RELIABLE, 1000);
+					}
+				}
+			}
+			return trace;
+		}
+
+		void addEntry(packet_trace_t& trace, F64 time, LLPacketScheduler::EPacketCategory category, S32 size)
+		{
+			packet_trace_entry entry;
+			entry.mTime = time;
+			entry.mCategory = category;
+			entry.mSize = size;
+			trace.push_back(entry);
+		}
+
+		// Reads a trace of "seconds category bytes" lines, with category
+		// an EPacketCategory value, in time order.
+		bool loadTrace(const char* filename, packet_trace_t& trace)
+		{
+			std::ifstream file(filename);
+			if (!file.is_open())
+			{
+				return false;
+			}
+			F64 time;
+			S32 category;
+			S32 size;
+			while (file >> time >> category >> size)
+			{
+				if (category >= 0 && category < LLPacketScheduler::PC_EOF && size > 0 && size <= MTUBYTES)
+				{
+					addEntry(trace, time, (LLPacketScheduler::EPacketCategory)category, size);
+				}
+			}
+			return true;
+		}
+
+		void report(const char* name, F32 bps, replay_stats stats[LLPacketScheduler::PC_EOF])
+		{
+			for (S32 i = 0; i < LLPacketScheduler::PC_EOF; ++i)
+			{
+				const replay_stats& category = stats[i];
+				llinfos << "Packet replay " << name << " at " << (S32)bps << " bps, "
+						<< LLPacketScheduler::getCategoryName((LLPacketScheduler::EPacketCategory)i)
+						<< ": " << category.mSent << " sent, "
+						<< (category.mQueued - category.mSent) << " expired, average "
+						<< (S32)(category.mSent ? 1000.0 * category.mTotalDelay / category.mSent : 0.0)
+						<< " ms, max " << (S32)(1000.0 * category.mMaxDelay) << " ms" << llendl;
+			}
+		}
+
+		LLHost mHost;
+	};
+	typedef test_group<packetscheduler_data> packetscheduler_test;
+	typedef packetscheduler_test::object packetscheduler_object;
+	tut::packetscheduler_test tpacketscheduler("packetscheduler");
+
+	template<> template<>
+	void packetscheduler_object::test<1>()
+	{
+		// packets go out immediately while the link has room, in
+		// priority order and first in first out within a category
+		LLPacketScheduler scheduler(1000000.f);
+		queue(scheduler, LLPacketScheduler::PC_UNRELIABLE, 1, 100, 1.0);
+		queue(scheduler, LLPacketScheduler::PC_RELIABLE, 2, 100, 1.0);
+		queue(scheduler, LLPacketScheduler::PC_RELIABLE, 3, 100, 1.0);
+		queue(scheduler, LLPacketScheduler::PC_RESEND, 4, 100, 1.0);
+		queue(scheduler, LLPacketScheduler::PC_AGENT_UPDATE, 5, 100, 1.0);
+		ensure_equals("queued", scheduler.getQueuedBytes(), 500);
+
+		std::vector<U32> tags = drain(scheduler, 1.0);
+		ensure_equals("all sent", tags.size(), (size_t)5);
+		ensure_equals("resend first", tags[0], (U32)4);
+		ensure_equals("agent update", tags[1], (U32)5);
+		ensure_equals("reliable", tags[2], (U32)2);
+		ensure_equals("reliable in order", tags[3], (U32)3);
+		ensure_equals("unreliable last", tags[4], (U32)1);
+		ensure_equals("empty", scheduler.getQueuedBytes(), 0);
+
+		const LLPacketScheduler::CategoryStats& stats = scheduler.getStats(LLPacketScheduler::PC_RELIABLE);
+		ensure_equals("sent", stats.mSent, (U32)2);
+		ensure_equals("bytes", stats.mBytesSent, (U32)200);
+		ensure_equals("no delay", stats.mMaxDelay, 0.0);
+	}
+
+	template<> template<>
+	void packetscheduler_object::test<2>()
+	{
+		// a backlog drains at the link rate
+		const F32 BPS = 80000.f;
+		LLPacketScheduler scheduler(BPS);
+		for (U32 i = 0; i < 100; ++i)
+		{
+			queue(scheduler, LLPacketScheduler::PC_RELIABLE, i, 1000, 10.0);
+		}
+		S32 burst = (S32)drain(scheduler, 10.0).size();
+		ensure("burst limited", burst > 0 && burst < 10);
+		S32 sent = 0;
+		for (S32 frame = 1; frame <= 250; ++frame)
+		{
+			sent += (S32)drain(scheduler, 10.0 + frame * 0.02).size();
+		}
+		// 5 seconds at 10000 bytes a second.
+		ensure("rate", sent >= 49 && sent <= 51);
+
+		const LLPacketScheduler::CategoryStats& stats = scheduler.getStats(LLPacketScheduler::PC_RELIABLE);
+		ensure_equals("stats", stats.mSent, (U32)(burst + sent));
+		ensure("delay", stats.mMaxDelay > 4.8 && stats.mMaxDelay <= 5.0);
+	}
+
+	template<> template<>
+	void packetscheduler_object::test<3>()
+	{
+		// a reliable backlog does not hold up agent updates, and stale
+		// agent updates are dropped instead of sent
+		LLPacketScheduler scheduler(80000.f);
+		for (U32 i = 0; i < 60; ++i)
+		{
+			queue(scheduler, LLPacketScheduler::PC_RELIABLE, i, 1000, 0.0);
+		}
+		U32 tag = 1000;
+		for (S32 frame = 0; frame < 150; ++frame)
+		{
+			F64 now = frame * 0.02;
+			if (frame % 5 == 0)
+			{
+				queue(scheduler, LLPacketScheduler::PC_AGENT_UPDATE, tag++, 120, now);
+			}
+			drain(scheduler, now);
+		}
+		const LLPacketScheduler::CategoryStats& stats = scheduler.getStats(LLPacketScheduler::PC_AGENT_UPDATE);
+		ensure_equals("agent updates sent", stats.mSent, (U32)30);
+		// At most one reliable packet's worth of link debt plus a frame.
+		ensure("agent updates prompt", stats.mMaxDelay < 0.15);
+		ensure_equals("none expired", stats.mDeadlineDropped, (U32)0);
+		ensure("reliable still queued", scheduler.getQueuedPackets(LLPacketScheduler::PC_RELIABLE) > 0);
+
+		// Starve the link so agent updates wait past their deadline.
+		scheduler.setRate(1000.f, 3.0);
+		for (U32 i = 0; i < 10; ++i)
+		{
+			queue(scheduler, LLPacketScheduler::PC_RESEND, i, 1000, 3.0);
+			queue(scheduler, LLPacketScheduler::PC_AGENT_UPDATE, tag++, 120, 3.0);
+		}
+		drain(scheduler, 3.0);
+		drain(scheduler, 3.5);
+		ensure("expired", stats.mDeadlineDropped > 0);
+		ensure_equals("nothing else expires",
+					  scheduler.getStats(LLPacketScheduler::PC_RESEND).mDeadlineDropped, (U32)0);
+	}
+
+	template<> template<>
+	void packetscheduler_object::test<4>()
+	{
+		// a full queue drops new packets and counts them
+		LLPacketScheduler scheduler(1000.f);
+		scheduler.setMaxQueuedBytes(5000);
+		for (U32 i = 0; i < 5; ++i)
+		{
+			ensure("fits", queue(scheduler, LLPacketScheduler::PC_RELIABLE, i, 1000, 10.0));
+		}
+		ensure("full", !queue(scheduler, LLPacketScheduler::PC_UNRELIABLE, 6, 100, 10.0));
+		ensure_equals("counted", scheduler.getStats(LLPacketScheduler::PC_UNRELIABLE).mOverflowDropped, (U32)1);
+		scheduler.clear();
+		ensure_equals("cleared", scheduler.getQueuedBytes(), 0);
+	}
+
+	template<> template<>
+	void packetscheduler_object::test<5>()
+	{
+		// Replays a packet trace over a constrained uplink through a
+		// single first in first out queue and through the scheduler,
+		// and reports latency per category.  Set LL_PACKET_TRACE to a
+		// file of "seconds category bytes" lines to replay a real trace.
+		const F32 BPS = 128000.f;
+		const F64 FRAME_SECS = 1.0 / 45.0;
+		packet_trace_t trace;
+		const char* filename = getenv("LL_PACKET_TRACE");	/* Flawfinder: ignore */
+		if (!filename || !loadTrace(filename, trace) || trace.empty())
+		{
+			trace = makeTrace(20.0);
+		}
+
+		replay_stats fifo[LLPacketScheduler::PC_EOF];
+		replay(trace, BPS, FRAME_SECS, true, fifo);
+		report("fifo", BPS, fifo);
+
+		replay_stats scheduled[LLPacketScheduler::PC_EOF];
+		replay(trace, BPS, FRAME_SECS, false, scheduled);
+		report("scheduled", BPS, scheduled);
+
+		if (!filename)
+		{
+			const S32 AGENT_UPDATE = LLPacketScheduler::PC_AGENT_UPDATE;
+			ensure_equals("fifo sends everything", fifo[AGENT_UPDATE].mSent, fifo[AGENT_UPDATE].mQueued);
+			ensure("agent updates faster",
+				   scheduled[AGENT_UPDATE].mMaxDelay < fifo[AGENT_UPDATE].mMaxDelay / 2.0);
+			ensure("resends faster",
+				   scheduled[LLPacketScheduler::PC_RESEND].mMaxDelay < fifo[LLPacketScheduler::PC_RESEND].mMaxDelay);
+			ensure_equals("reliable all sent", scheduled[LLPacketScheduler::PC_RELIABLE].mSent,
+						  scheduled[LLPacketScheduler::PC_RELIABLE].mQueued);
+		}
+	}
+}
@@ -0,0 +1,396 @@
+/**
+ * @file llpumpio_tut.cpp
+ * @brief Tests for LLPumpIO chain scheduling
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+// Polls pipes, which APR can not do on windows.
+#if !LL_WINDOWS
+
+#include <sys/resource.h>
+#include <vector>
+
+#include "lltut.h"
+#include "apr_file_io.h"
+#include "apr_network_io.h"
+#include "apr_pools.h"
+#include "apr_portable.h"
+#include "llpipeutil.h"
+#include "llpumpio.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	// Waits on a descriptor the first time it is processed, then
+	// finishes the chain when it is processed again, or keeps waiting
+	// if keep_going is set.
+	class LLPollingPipe : public LLIOPipe
+	{
+	public:
+		LLPollingPipe(const apr_pollfd_t& poll, bool keep_going, S32& processed) :
+			mPoll(poll),
+			mKeepGoing(keep_going),
+			mPolling(false),
+			mSleep(0.0),
+			mProcessed(processed)
+		{
+		}
+
+		// Sleep the chain for seconds before waiting on the descriptor.
+		void setSleep(F64 seconds) { mSleep = seconds; }
+
+	protected:
+		/*virtual*/ EStatus process_impl(
+			const LLChannelDescriptors& channels,
+			buffer_ptr_t& buffer,
+			bool& eos,
+			LLSD& context,
+			LLPumpIO* pump)
+		{
+			++mProcessed;
+			if(mSleep > 0.0)
+			{
+				pump->sleepChain(mSleep);
+				mSleep = 0.0;
+				return STATUS_BREAK;
+			}
+			if(!mPolling)
+			{
+				pump->setConditional(this, &mPoll);
+				mPolling = true;
+				return STATUS_BREAK;
+			}
+			if(mKeepGoing)
+			{
+				return STATUS_BREAK;
+			}
+			pump->setConditional(this, NULL);
+			return STATUS_STOP;
+		}
+
+		apr_pollfd_t mPoll;
+		bool mKeepGoing;
+		bool mPolling;
+		F64 mSleep;
+		S32& mProcessed;
+	};
+
+	struct pumpio_data
+	{
+		pumpio_data() : mPool(NULL), mPump(NULL), mIdleProcessed(0), mPipeProcessed(0)
+		{
+			apr_pool_create(&mPool, NULL);
+		}
+
+		~pumpio_data()
+		{
+			reset(false);
+			apr_pool_destroy(mPool);
+		}
+
+		// Starts again with a fresh pump.
+		bool reset(bool use_epoll)
+		{
+			delete mPump;
+			mPump = NULL;
+			for(std::vector<apr_socket_t*>::iterator it = mSockets.begin(); it != mSockets.end(); ++it)
+			{
+				apr_socket_close(*it);
+			}
+			mSockets.clear();
+			for(std::vector<apr_file_t*>::iterator it = mFiles.begin(); it != mFiles.end(); ++it)
+			{
+				apr_file_close(*it);
+			}
+			mFiles.clear();
+			mWriters.clear();
+			mIdleProcessed = 0;
+			mPipeProcessed = 0;
+			mPump = new LLPumpIO(mPool);
+			return (mPump->setUseEpoll(use_epoll) == use_epoll);
+		}
+
+		// Adds a chain waiting on an unbound udp socket, which is never
+		// signalled.
+		void addIdleChain(F32 timeout)
+		{
+			apr_socket_t* socket = NULL;
+			apr_socket_create(&socket, APR_INET, SOCK_DGRAM, APR_PROTO_UDP, mPool);
+			mSockets.push_back(socket);
+			apr_pollfd_t poll;
+			memset(&poll, 0, sizeof(poll));
+			poll.desc_type = APR_POLL_SOCKET;
+			poll.desc.s = socket;
+			poll.reqevents = APR_POLLIN;
+			LLPumpIO::chain_t chain;
+			chain.push_back(LLIOPipe::ptr_t(new LLPollingPipe(poll, false, mIdleProcessed)));
+			mPump->addChain(chain, timeout);
+		}
+
+		// Adds a chain waiting to read a pipe, which write() signals.
+		LLPollingPipe* addPipeChain(bool keep_going)
+		{
+			apr_file_t* reader = NULL;
+			apr_file_t* writer = NULL;
+			apr_file_pipe_create(&reader, &writer, mPool);
+			mFiles.push_back(reader);
+			mFiles.push_back(writer);
+			mWriters.push_back(writer);
+			apr_pollfd_t poll;
+			memset(&poll, 0, sizeof(poll));
+			poll.desc_type = APR_POLL_FILE;
+			poll.desc.f = reader;
+			poll.reqevents = APR_POLLIN;
+			LLPollingPipe* pipe = new LLPollingPipe(poll, keep_going, mPipeProcessed);
+			LLPumpIO::chain_t chain;
+			chain.push_back(LLIOPipe::ptr_t(pipe));
+			mPump->addChain(chain, NEVER_CHAIN_EXPIRY_SECS);
+			return pipe;
+		}
+
+		void write(S32 index)
+		{
+			char byte = 0;
+			apr_size_t size = 1;
+			apr_file_write(mWriters[index], &byte, &size);
+		}
+
+		void pump(S32 times)
+		{
+			for(S32 i = 0; i < times; ++i)
+			{
+				LLFrameTimer::updateFrameTime();
+				mPump->pump();
+			}
+		}
+
+		apr_pool_t* mPool;
+		LLPumpIO* mPump;
+		std::vector<apr_socket_t*> mSockets;
+		std::vector<apr_file_t*> mFiles;
+		std::vector<apr_file_t*> mWriters;
+		S32 mIdleProcessed;
+		S32 mPipeProcessed;
+	};
+	typedef test_group<pumpio_data> pumpio_test;
+	typedef pumpio_test::object pumpio_object;
+	tut::pumpio_test tpumpio("pumpio");
+
+	template<> template<>
+	void pumpio_object::test<1>()
+	{
+		// only signalled chains are processed
+		for(S32 use_epoll = 1; use_epoll >= 0; --use_epoll)
+		{
+			if(!reset(use_epoll)) continue;
+			const S32 IDLE = 50;
+			for(S32 i = 0; i < IDLE; ++i)
+			{
+				addIdleChain(NEVER_CHAIN_EXPIRY_SECS);
+			}
+			addPipeChain(false);
+			addPipeChain(false);
+			pump(5);
+			ensure_equals("idle chains waiting", mIdleProcessed, IDLE);
+			ensure_equals("pipe chains waiting", mPipeProcessed, 2);
+			ensure_equals("all running", (S32)mPump->runningChains(), IDLE + 2);
+
+			write(1);
+			pump(5);
+			ensure_equals("idle chains still waiting", mIdleProcessed, IDLE);
+			ensure_equals("signalled chain ran", mPipeProcessed, 3);
+			ensure_equals("signalled chain done", (S32)mPump->runningChains(), IDLE + 1);
+
+			write(0);
+			pump(1);
+			ensure_equals("other chain done", (S32)mPump->runningChains(), IDLE);
+		}
+	}
+
+	template<> template<>
+	void pumpio_object::test<2>()
+	{
+		// chains waiting on descriptors still time out
+		for(S32 use_epoll = 1; use_epoll >= 0; --use_epoll)
+		{
+			if(!reset(use_epoll)) continue;
+			addIdleChain(NEVER_CHAIN_EXPIRY_SECS);
+			addIdleChain(0.2f);
+			addIdleChain(0.2f);
+			pump_loop(mPump, 0.1f);
+			ensure_equals("not expired", (S32)mPump->runningChains(), 3);
+			pump_loop(mPump, 0.3f);
+			ensure_equals("expired", (S32)mPump->runningChains(), 1);
+		}
+	}
+
+	template<> template<>
+	void pumpio_object::test<3>()
+	{
+		// sleeping chains are skipped until they wake
+		for(S32 use_epoll = 1; use_epoll >= 0; --use_epoll)
+		{
+			if(!reset(use_epoll)) continue;
+			addPipeChain(false)->setSleep(0.2);
+			write(0);
+			pump_loop(mPump, 0.1f);
+			ensure_equals("asleep", mPipeProcessed, 1);
+			pump_loop(mPump, 0.3f);
+			ensure_equals("done", (S32)mPump->runningChains(), 0);
+		}
+	}
+
+	template<> template<>
+	void pumpio_object::test<4>()
+	{
+		// chains waiting on the same descriptor all wait, and all run
+		// when it is signalled
+		for(S32 use_epoll = 1; use_epoll >= 0; --use_epoll)
+		{
+			if(!reset(use_epoll)) continue;
+			apr_file_t* reader = NULL;
+			apr_file_t* writer = NULL;
+			apr_file_pipe_create(&reader, &writer, mPool);
+			mFiles.push_back(reader);
+			mFiles.push_back(writer);
+			mWriters.push_back(writer);
+			apr_pollfd_t poll;
+			memset(&poll, 0, sizeof(poll));
+			poll.desc_type = APR_POLL_FILE;
+			poll.desc.f = reader;
+			poll.reqevents = APR_POLLIN;
+			const S32 SHARING = 3;
+			for(S32 i = 0; i < SHARING; ++i)
+			{
+				LLPumpIO::chain_t chain;
+				chain.push_back(LLIOPipe::ptr_t(new LLPollingPipe(poll, false, mPipeProcessed)));
+				mPump->addChain(chain, NEVER_CHAIN_EXPIRY_SECS);
+			}
+			pump(5);
+			ensure_equals("chains waiting", mPipeProcessed, SHARING);
+
+			write(0);
+			pump(2);
+			ensure_equals("chains ran", mPipeProcessed, SHARING * 2);
+			ensure_equals("chains done", (S32)mPump->runningChains(), 0);
+		}
+	}
+
+	template<> template<>
+	void pumpio_object::test<5>()
+	{
+		// a chain waiting on a descriptor whose number was closed and
+		// reused while another chain still waits on the old one is
+		// signalled for the new descriptor.
+		if(!reset(true)) return;
+		apr_file_t* reader = NULL;
+		apr_file_t* writer = NULL;
+		apr_file_pipe_create(&reader, &writer, mPool);
+		apr_pollfd_t poll;
+		memset(&poll, 0, sizeof(poll));
+		poll.desc_type = APR_POLL_FILE;
+		poll.desc.f = reader;
+		poll.reqevents = APR_POLLIN;
+		LLPumpIO::chain_t chain;
+		chain.push_back(LLIOPipe::ptr_t(new LLPollingPipe(poll, true, mIdleProcessed)));
+		mPump->addChain(chain, NEVER_CHAIN_EXPIRY_SECS);
+		pump(2);
+		ensure_equals("stale chain waiting", mIdleProcessed, 1);
+		apr_os_file_t old_fd = -1;
+		apr_os_file_get(&old_fd, reader);
+		apr_file_close(reader);
+		apr_file_close(writer);
+
+		addPipeChain(false);
+		apr_os_file_t new_fd = -1;
+		apr_os_file_get(&new_fd, mFiles[0]);
+		ensure_equals("descriptor reused", new_fd, old_fd);
+		pump(2);
+		ensure_equals("chain waiting", mPipeProcessed, 1);
+
+		write(0);
+		pump(2);
+		ensure_equals("chain ran", mPipeProcessed, 2);
+	}
+
+	struct pumpio_benchmark_data : public pumpio_data
+	{
+	};
+
+	typedef test_group<pumpio_benchmark_data> pumpio_benchmark_test;
+	typedef pumpio_benchmark_test::object pumpio_benchmark_object;
+	tut::pumpio_benchmark_test tpumpio_benchmark("pumpio-benchmark");
+
+	template<> template<>
+	void pumpio_benchmark_object::test<1>()
+	{
+		// Benchmark 10k idle chains, as with many quiet http connections,
+		// alongside 100 busy ones.
+		S32 idle = 10000;
+		const S32 ACTIVE = 100;
+		const S32 PUMPS = 1000;
+		struct rlimit limit;
+		if(0 == getrlimit(RLIMIT_NOFILE, &limit))
+		{
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+			idle = llmin(idle, (S32)limit.rlim_cur - ACTIVE * 2 - 100);
+		}
+		const char* names[2] = { "pollset", "epoll" };
+		for(S32 use_epoll = 1; use_epoll >= 0; --use_epoll)
+		{
+			if(!reset(use_epoll)) continue;
+			for(S32 i = 0; i < idle; ++i)
+			{
+				addIdleChain(NEVER_CHAIN_EXPIRY_SECS);
+			}
+			for(S32 i = 0; i < ACTIVE; ++i)
+			{
+				addPipeChain(true);
+				write(i);
+			}
+			pump(2);
+
+			mPipeProcessed = 0;
+			LLTimer timer;
+			pump(PUMPS);
+			F64 elapsed = timer.getElapsedTimeF64();
+			ensure_equals("idle chains waiting", mIdleProcessed, idle);
+			ensure_equals("active chains processed", mPipeProcessed, ACTIVE * PUMPS);
+
+			llinfos << "LLPumpIO " << names[use_epoll] << ": " << idle << " idle and "
+					<< ACTIVE << " active chains, " << (S32)(PUMPS / elapsed)
+					<< " pumps/sec" << llendl;
+		}
+	}
+}
+
+#endif // !LL_WINDOWS
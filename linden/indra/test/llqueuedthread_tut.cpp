@@ -0,0 +1,257 @@
+/**
+ * @file llqueuedthread_tut.cpp
+ * @brief Tests for LLQueuedThread request handling
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+#include "llapr.h"
+#include "llqueuedthread.h"
+#include "llthreadpool.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	class LLQueuedThreadTestRequest : public LLQueuedThread::QueuedRequest
+	{
+	public:
+		LLQueuedThreadTestRequest(LLQueuedThread::handle_t handle, U32 priority, U32 flags,
+								  S32 id, S32 steps, std::vector<S32>* order, LLAtomicS32* done)
+		:	LLQueuedThread::QueuedRequest(handle, priority, flags),
+			mID(id),
+			mSteps(steps),
+			mOrder(order),
+			mDone(done)
+		{
+		}
+
+		/*virtual*/ bool processRequest()
+		{
+			if (mOrder)
+			{
+				mOrder->push_back(mID);
+			}
+			if (--mSteps > 0)
+			{
+				return false;
+			}
+			if (mDone)
+			{
+				(*mDone)++;
+			}
+			return true;
+		}
+
+	protected:
+		~LLQueuedThreadTestRequest() {}
+
+		S32 mID;
+		S32 mSteps; // calls to processRequest() before completing
+		std::vector<S32>* mOrder;
+		LLAtomicS32* mDone;
+	};
+
+	class LLQueuedThreadTest : public LLQueuedThread
+	{
+	public:
+		LLQueuedThreadTest(bool threaded, LLThreadPool* pool = NULL) : LLQueuedThread("QueuedThread test", threaded, pool) {}
+
+		handle_t add(U32 priority, U32 flags, S32 id, S32 steps, std::vector<S32>* order = NULL, LLAtomicS32* done = NULL)
+		{
+			handle_t handle = generateHandle();
+			addRequest(new LLQueuedThreadTestRequest(handle, priority, flags, id, steps, order, done));
+			return handle;
+		}
+
+		// Keep every request in one hash shard, as before the hash was sharded.
+		// Must be called before any requests are added.
+		void unshard() { mHashShardMask = 0; }
+
+		bool waitForIdle(F32 timeout)
+		{
+			LLTimer timer;
+			while (getPending() > 0 && timer.getElapsedTimeF32() < timeout)
+			{
+				update(0);
+				ms_sleep(1);
+			}
+			return getPending() == 0;
+		}
+	};
+
+	struct queuedthread_data
+	{
+		queuedthread_data()
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+		}
+	};
+
+	typedef test_group<queuedthread_data> queuedthread_test;
+	typedef queuedthread_test::object queuedthread_object;
+	tut::queuedthread_test queuedthread_testcase("llqueuedthread");
+
+	template<> template<>
+	void queuedthread_object::test<1>()
+	{
+		// requests run in priority order, including changes made after queuing
+		LLQueuedThreadTest thread(false);
+		std::vector<S32> order;
+		LLQueuedThread::handle_t low = thread.add(LLQueuedThread::PRIORITY_LOW, LLQueuedThread::FLAG_AUTO_COMPLETE, 1, 1, &order);
+		thread.add(LLQueuedThread::PRIORITY_HIGH, LLQueuedThread::FLAG_AUTO_COMPLETE, 2, 1, &order);
+		thread.add(LLQueuedThread::PRIORITY_NORMAL, LLQueuedThread::FLAG_AUTO_COMPLETE, 3, 1, &order);
+		thread.setPriority(low, LLQueuedThread::PRIORITY_URGENT);
+		ensure_equals("pending", thread.getPending(), 3);
+
+		thread.update(0);
+		ensure_equals("processed", order.size(), (size_t)3);
+		ensure_equals("first", order[0], 1);
+		ensure_equals("second", order[1], 2);
+		ensure_equals("third", order[2], 3);
+		ensure_equals("idle", thread.getPending(), 0);
+		ensure("auto completed", thread.getRequestStatus(low) == LLQueuedThread::STATUS_EXPIRED);
+	}
+
+	template<> template<>
+	void queuedthread_object::test<2>()
+	{
+		// threaded requests that need several passes, completed by the caller
+		const S32 COUNT = 2000;
+		LLQueuedThreadTest thread(true);
+		std::vector<LLQueuedThread::handle_t> handles;
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			handles.push_back(thread.add(LLQueuedThread::PRIORITY_NORMAL | i, 0, i, 3));
+		}
+		ensure("processed", thread.waitForIdle(10.f));
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			ensure("complete", thread.getRequestStatus(handles[i]) == LLQueuedThread::STATUS_COMPLETE);
+			ensure("completeRequest", thread.completeRequest(handles[i]));
+		}
+		ensure("deleted", thread.waitForIdle(10.f));
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			ensure("expired", thread.getRequestStatus(handles[i]) == LLQueuedThread::STATUS_EXPIRED);
+		}
+	}
+
+	template<> template<>
+	void queuedthread_object::test<3>()
+	{
+		// two queues sharing a pool, including requests that need several passes
+		const S32 COUNT = 2000;
+		LLThreadPool pool("QueuedThread test pool", 4);
+		ensure_equals("threads", pool.getThreadCount(), 4);
+		LLAtomicS32 done(0);
+		{
+			LLQueuedThreadTest first(true, &pool);
+			LLQueuedThreadTest second(true, &pool);
+			std::vector<LLQueuedThread::handle_t> handles;
+			for (S32 i = 0; i < COUNT; i++)
+			{
+				first.add(LLQueuedThread::PRIORITY_NORMAL | i, LLQueuedThread::FLAG_AUTO_COMPLETE, i, 1 + (i % 3), NULL, &done);
+				handles.push_back(second.add(LLQueuedThread::PRIORITY_NORMAL | i, 0, i, 1 + (i % 3), NULL, &done));
+			}
+			ensure("first processed", first.waitForIdle(10.f));
+			ensure("second processed", second.waitForIdle(10.f));
+			ensure_equals("completed", (S32)done, 2 * COUNT);
+			for (S32 i = 0; i < COUNT; i++)
+			{
+				ensure("complete", second.getRequestStatus(handles[i]) == LLQueuedThread::STATUS_COMPLETE);
+				second.completeRequest(handles[i]);
+			}
+			ensure("deleted", second.waitForIdle(10.f));
+		}
+	}
+
+	struct queuedthread_benchmark_data : public queuedthread_data
+	{
+		// Main thread cost of feeding a busy worker the way LLTextureFetch does:
+		// new requests and priority changes every frame, then update()
+		void feedWorker(bool sharded)
+		{
+			const S32 FRAMES = 2000;
+			const S32 REQUESTS_PER_FRAME = 20;
+			LLQueuedThreadTest thread(true);
+			if (!sharded)
+			{
+				thread.unshard();
+			}
+			std::vector<LLQueuedThread::handle_t> handles;
+			F64 main_time = 0.0;
+			F64 max_frame_time = 0.0;
+			for (S32 frame = 0; frame < FRAMES; frame++)
+			{
+				LLTimer frame_timer;
+				for (S32 r = 0; r < REQUESTS_PER_FRAME; r++)
+				{
+					handles.push_back(thread.add(LLQueuedThread::PRIORITY_NORMAL | r, LLQueuedThread::FLAG_AUTO_COMPLETE, r, 4));
+				}
+				S32 count = (S32)handles.size();
+				for (S32 n = 0; n < REQUESTS_PER_FRAME && n < count; n++)
+				{
+					thread.setPriority(handles[count - 1 - n], LLQueuedThread::PRIORITY_HIGH | n);
+				}
+				thread.update(1);
+				F64 frame_time = frame_timer.getElapsedTimeF64();
+				main_time += frame_time;
+				max_frame_time = llmax(max_frame_time, frame_time);
+			}
+			ensure("processed", thread.waitForIdle(30.f));
+
+			llinfos << "LLQueuedThread main thread (" << (sharded ? "sharded" : "unsharded") << "): "
+					<< (main_time * 1000000.0 / FRAMES) << " us/frame average, "
+					<< (max_frame_time * 1000000.0) << " us worst, " << FRAMES * REQUESTS_PER_FRAME << " requests" << llendl;
+		}
+	};
+
+	typedef test_group<queuedthread_benchmark_data> queuedthread_benchmark_test;
+	typedef queuedthread_benchmark_test::object queuedthread_benchmark_object;
+	tut::queuedthread_benchmark_test queuedthread_benchmark_testcase("llqueuedthread-benchmark");
+
+	template<> template<>
+	void queuedthread_benchmark_object::test<1>()
+	{
+		// baseline: a single hash shard, so every lookup takes the same mutex
+		feedWorker(false);
+	}
+
+	template<> template<>
+	void queuedthread_benchmark_object::test<2>()
+	{
+		feedWorker(true);
+	}
+}
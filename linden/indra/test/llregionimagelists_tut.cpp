@@ -0,0 +1,143 @@
+/**
+ * @file llregionimagelists_tut.cpp
+ * @brief Tests for newview/llregionimagelists.cpp
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "../newview/llregionimagelists.cpp"
+
+namespace tut
+{
+	struct regionimagelists_data
+	{
+		static LLUUID imageID(S32 index)
+		{
+			LLUUID id;
+			memcpy(id.mData, &index, sizeof(index));
+			return id;
+		}
+
+		static U64 regionHandle(S32 index)
+		{
+			return to_region_handle(256 * 1000 + 256 * index, 256 * 1000);
+		}
+	};
+
+	typedef test_group<regionimagelists_data> regionimagelists_test;
+	typedef regionimagelists_test::object regionimagelists_object;
+	tut::regionimagelists_test regionimagelists_testcase("llregionimagelists");
+
+	template<> template<>
+	void regionimagelists_object::test<1>()
+	{
+		// only the images used in the recorded region, once each, largest first
+		LLRegionImageLists lists;
+		LLRegionImageLists::image_list_t images;
+		images.push_back(LLRegionImageLists::Image(imageID(1), 2, 64 * 64, regionHandle(0)));
+		images.push_back(LLRegionImageLists::Image(imageID(2), 0, 512 * 512, regionHandle(1)));
+		images.push_back(LLRegionImageLists::Image(imageID(3), 1, 256 * 256, regionHandle(0)));
+		images.push_back(LLRegionImageLists::Image(imageID(3), 1, 256 * 256, regionHandle(1)));
+		images.push_back(LLRegionImageLists::Image(imageID(3), 1, 256 * 256, regionHandle(0)));
+		lists.record(regionHandle(0), images);
+
+		LLRegionImageLists::image_list_t result;
+		ensure("recorded", lists.get(regionHandle(0), result));
+		ensure_equals("count", (S32)result.size(), 2);
+		ensure_equals("largest first", result[0].mID, imageID(3));
+		ensure_equals("discard", result[0].mDiscard, 1);
+		ensure_equals("area", result[0].mArea, 256 * 256);
+		ensure_equals("smallest last", result[1].mID, imageID(1));
+		ensure("neighbour not recorded", !lists.get(regionHandle(1), result));
+	}
+
+	template<> template<>
+	void regionimagelists_object::test<2>()
+	{
+		// a region keeps its MAX_REGION_IMAGES largest images
+		LLRegionImageLists lists;
+		LLRegionImageLists::image_list_t images;
+		for (S32 i = 0; i < MAX_REGION_IMAGES * 2; i++)
+		{
+			images.push_back(LLRegionImageLists::Image(imageID(i), 0, i + 1, regionHandle(0)));
+		}
+		lists.record(regionHandle(0), images);
+
+		LLRegionImageLists::image_list_t result;
+		lists.get(regionHandle(0), result);
+		ensure_equals("capped", (S32)result.size(), MAX_REGION_IMAGES);
+		ensure_equals("largest", result.front().mID, imageID(MAX_REGION_IMAGES * 2 - 1));
+		ensure_equals("smallest kept", result.back().mID, imageID(MAX_REGION_IMAGES));
+	}
+
+	template<> template<>
+	void regionimagelists_object::test<3>()
+	{
+		// the least recently recorded regions are dropped, also across a save and load
+		LLRegionImageLists lists;
+		for (S32 i = 0; i < MAX_REGION_IMAGE_LISTS; i++)
+		{
+			LLRegionImageLists::image_list_t images;
+			images.push_back(LLRegionImageLists::Image(imageID(i), 0, 1024, regionHandle(i)));
+			lists.record(regionHandle(i), images);
+		}
+		ensure_equals("full", lists.getNumRegions(), MAX_REGION_IMAGE_LISTS);
+
+		// region 0 recorded again is now the most recent
+		LLRegionImageLists::image_list_t images;
+		images.push_back(LLRegionImageLists::Image(imageID(0), 0, 1024, regionHandle(0)));
+		lists.record(regionHandle(0), images);
+
+		LLUUID random;
+		random.generate();
+		std::ostringstream filename;
+#if LL_WINDOWS
+		filename << "llregionimagelists-test-" << random << ".xml";
+#else
+		filename << "/tmp/llregionimagelists-test-" << random << ".xml";
+#endif
+		lists.save(filename.str());
+		LLRegionImageLists loaded;
+		loaded.load(filename.str());
+		LLFile::remove(filename.str());
+		ensure_equals("loaded", loaded.getNumRegions(), MAX_REGION_IMAGE_LISTS);
+
+		images.clear();
+		images.push_back(LLRegionImageLists::Image(imageID(1000), 0, 1024, regionHandle(1000)));
+		loaded.record(regionHandle(1000), images);
+		LLRegionImageLists::image_list_t result;
+		ensure_equals("still full", loaded.getNumRegions(), MAX_REGION_IMAGE_LISTS);
+		ensure("oldest dropped", !loaded.get(regionHandle(1), result));
+		ensure("refreshed kept", loaded.get(regionHandle(0), result));
+		ensure("newest kept", loaded.get(regionHandle(1000), result));
+		ensure_equals("image after load", result[0].mID, imageID(1000));
+	}
+}
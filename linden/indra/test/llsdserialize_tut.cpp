@@ -42,6 +42,7 @@
 #include "llsdserialize.h"
 #include "lltut.h"
 #include "llformat.h"
+#include "lltimer.h"
 
 // These tests take too long to run on Windows. JC
 // Yeah, who cares if windows works or not, right? Phoenix
@@ -219,12 +220,18 @@ namespace tut
 
 		void doRoundTripTests(const std::string&);
 		void checkRoundTrip(const std::string&, const LLSD& v);
+		void checkBufferRoundTrip(
+			const std::string&,
+			const LLSD& v,
+			const std::string& expected);
 		
 		LLPointer<LLSDFormatter> mFormatter;
 		LLPointer<LLSDParser> mParser;
+		bool mCheckBinaryBuffer;
 	};
 
-	TestLLSDSerializeData::TestLLSDSerializeData()
+	TestLLSDSerializeData::TestLLSDSerializeData() :
+		mCheckBinaryBuffer(false)
 	{
 	}
 
@@ -251,6 +258,37 @@ namespace tut
 			std::cerr << stream.str() << std::endl;
 			throw;
 		}
+
+		if(mCheckBinaryBuffer)
+		{
+			checkBufferRoundTrip(msg, v, stream.str());
+		}
+	}
+
+	void TestLLSDSerializeData::checkBufferRoundTrip(
+		const std::string& msg,
+		const LLSD& v,
+		const std::string& expected)
+	{
+		// the buffer formatter has to produce exactly the stream bytes
+		LLPointer<LLSDBinaryFormatter> formatter = new LLSDBinaryFormatter;
+		std::string buffer;
+		formatter->formatBuffer(v, buffer);
+		ensure((msg + " (buffer format)").c_str(), buffer == expected);
+
+		LLPointer<LLSDBinaryParser> parser = new LLSDBinaryParser;
+		LLSD w;
+		S32 bytes_read = 0;
+		parser->parseBuffer(
+			(const U8*)buffer.data(),
+			buffer.size(),
+			w,
+			&bytes_read);
+		ensure_equals((msg + " (buffer parse)").c_str(), w, v);
+		ensure_equals(
+			(msg + " (buffer bytes read)").c_str(),
+			bytes_read,
+			(S32)buffer.size());
 	}
 
 	static void fillmap(LLSD& root, U32 width, U32 depth)
@@ -269,6 +307,38 @@ namespace tut
 		}
 	}
 	
+	// Roughly the shape of an inventory fetch response.
+	static LLSD make_inventory_llsd(S32 item_count)
+	{
+		LLSD items = LLSD::emptyArray();
+		for(S32 i = 0; i < item_count; ++i)
+		{
+			LLSD item;
+			LLUUID id;
+			id.generate();
+			item["item_id"] = id;
+			item["parent_id"] = LLUUID::null;
+			item["name"] = llformat("Inventory item number %d", i);
+			item["desc"] = "(No Description)";
+			item["type"] = i % 20;
+			item["flags"] = 0x7fff0000 | i;
+			item["created_at"] = LLDate(1234567890.0 + i);
+			item["sale_price"] = 10.5 * i;
+			LLSD perms;
+			perms["owner_mask"] = (S32)0x7fffffff;
+			perms["group_mask"] = 0;
+			perms["is_owner_group"] = false;
+			item["permissions"] = perms;
+			std::vector<U8> blob(16, (U8)i);
+			item["extra"] = blob;
+			items.append(item);
+		}
+		LLSD root;
+		root["folder_id"] = LLUUID::null;
+		root["items"] = items;
+		return root;
+	}
+
 	void TestLLSDSerializeData::doRoundTripTests(const std::string& msg)
 	{
 		LLSD v;
@@ -465,6 +535,15 @@ namespace tut
 		doRoundTripTests("binary serialization");
 	}
 
+	template<> template<> 
+	void TestLLSDSerializeObject::test<4>()
+	{
+		mFormatter = new LLSDBinaryFormatter();
+		mParser = new LLSDBinaryParser();
+		mCheckBinaryBuffer = true;
+		doRoundTripTests("binary buffer serialization");
+	}
+
 
 	/**
 	 * @class TestLLSDParsing
@@ -648,6 +727,160 @@ namespace tut
 			v.size() + 1);
 	}
 
+	class TestXMLStreamHandler : public LLSDXMLParser::StreamHandler
+	{
+	public:
+		TestXMLStreamHandler() : mConsume(true), mPeakOutstanding(0) {}
+
+		virtual bool handleArrayElement(
+			const std::string& key,
+			const LLSD& container,
+			const LLSD& element)
+		{
+			if(mItemIDs.empty())
+			{
+				mFirstElementTime = mTimer.getElapsedTimeF64();
+			}
+			mPeakOutstanding = llmax(mPeakOutstanding, LLSD::outstandingCount());
+			if(key != "items") return false;
+			mContainerIDs.push_back(container["folder_id"]);
+			mItemIDs.push_back(element["item_id"]);
+			return mConsume;
+		}
+
+		bool mConsume;
+		LLTimer mTimer;
+		F64 mFirstElementTime;
+		U32 mPeakOutstanding;
+		std::vector<LLUUID> mItemIDs;
+		std::vector<LLUUID> mContainerIDs;
+	};
+
+	static std::string make_inventory_xml(S32 folder_count, S32 items_per_folder)
+	{
+		LLSD folders = LLSD::emptyArray();
+		for(S32 i = 0; i < folder_count; ++i)
+		{
+			LLSD folder = make_inventory_llsd(items_per_folder);
+			LLUUID folder_id;
+			folder_id.generate();
+			folder["folder_id"] = folder_id;
+			folder["version"] = i;
+			folders.append(folder);
+		}
+		LLSD response;
+		response["folders"] = folders;
+		std::ostringstream ostr;
+		LLSDSerialize::toXML(response, ostr);
+		return ostr.str();
+	}
+
+	template<> template<> 
+	void TestLLSDXMLParsingObject::test<4>()
+	{
+		// stream handler with the document fed in small pieces
+		std::string xml = make_inventory_xml(3, 4);
+		LLSD expected;
+		std::istringstream istr(xml);
+		S32 expected_count = LLSDSerialize::fromXML(expected, istr);
+
+		TestXMLStreamHandler handler;
+		mParser->reset();
+		mParser->setStreamHandler(&handler);
+		const S32 PIECE = 7;
+		for(S32 i = 0; i < (S32)xml.size(); i += PIECE)
+		{
+			S32 len = llmin(PIECE, (S32)xml.size() - i);
+			ensure("incremental parse", mParser->parseIncremental(xml.data() + i, len));
+		}
+		LLSD result;
+		S32 count = mParser->finishIncremental(result);
+		mParser->setStreamHandler(NULL);
+		ensure_equals("incremental count", count, expected_count);
+		ensure_equals("streamed items", handler.mItemIDs.size(), (size_t)12);
+
+		// everything not consumed is still in the result
+		S32 n = 0;
+		for(S32 f = 0; f < 3; ++f)
+		{
+			LLSD& folder = expected["folders"][f];
+			LLSD& items = folder["items"];
+			for(S32 i = 0; i < items.size(); ++i, ++n)
+			{
+				ensure_equals("streamed item", handler.mItemIDs[n], items[i]["item_id"].asUUID());
+				ensure_equals("streamed container", handler.mContainerIDs[n], folder["folder_id"].asUUID());
+			}
+			folder["items"] = LLSD::emptyArray();
+		}
+		ensure_equals("streamed remainder", result, expected);
+
+		// a handler which declines leaves the result untouched
+		handler.mConsume = false;
+		handler.mItemIDs.clear();
+		mParser->reset();
+		mParser->setStreamHandler(&handler);
+		ensure("whole parse", mParser->parseIncremental(xml.data(), xml.size()));
+		count = mParser->finishIncremental(result);
+		mParser->setStreamHandler(NULL);
+		ensure_equals("declined count", count, expected_count);
+		istr.clear();
+		istr.str(xml);
+		LLSDSerialize::fromXML(expected, istr);
+		ensure_equals("declined result", result, expected);
+
+		// malformed input fails the same way as a stream parse
+		mParser->reset();
+		std::string bad("<llsd><array><integer>1</integer></map></llsd>");
+		ensure("bad incremental", !mParser->parseIncremental(bad.data(), bad.size()));
+		ensure_equals(
+			"bad incremental count",
+			mParser->finishIncremental(result),
+			(S32)LLSDParser::PARSE_FAILURE);
+	}
+
+	template<> template<> 
+	void TestLLSDXMLParsingObject::test<5>()
+	{
+		// Memory and latency of a ~10MB inventory fetch response, built
+		// in full versus streamed with every item consumed. Memory is
+		// measured in live LLSD nodes. This only reports.
+		std::string xml = make_inventory_xml(20, 800);
+		const S32 PIECE = 16 * 1024;
+
+		U32 baseline = LLSD::outstandingCount();
+		LLTimer timer;
+		LLSD tree;
+		std::istringstream istr(xml);
+		LLSDSerialize::fromXML(tree, istr);
+		F64 tree_time = timer.getElapsedTimeF64();
+		U32 tree_nodes = LLSD::outstandingCount() - baseline;
+		tree.clear();
+
+		TestXMLStreamHandler handler;
+		mParser->reset();
+		mParser->setStreamHandler(&handler);
+		baseline = LLSD::outstandingCount();
+		handler.mTimer.reset();
+		for(S32 i = 0; i < (S32)xml.size(); i += PIECE)
+		{
+			S32 len = llmin(PIECE, (S32)xml.size() - i);
+			mParser->parseIncremental(xml.data() + i, len);
+		}
+		LLSD result;
+		mParser->finishIncremental(result);
+		F64 stream_time = handler.mTimer.getElapsedTimeF64();
+		mParser->setStreamHandler(NULL);
+		ensure_equals("streamed items", handler.mItemIDs.size(), (size_t)(20 * 800));
+		U32 stream_nodes = handler.mPeakOutstanding - baseline;
+
+		llinfos << "LLSD XML " << xml.size() << " bytes: tree "
+			<< tree_time << "s, " << tree_nodes << " LLSD nodes; streamed "
+			<< stream_time << "s, first item after "
+			<< handler.mFirstElementTime << "s, peak "
+			<< stream_nodes << " LLSD nodes" << llendl;
+		ensure("streaming bounds memory", stream_nodes < tree_nodes / 10);
+	}
+
 	/*
 	TODO:
 		test XML parsing
@@ -917,6 +1150,32 @@ namespace tut
 	{
 	public:
 		TestLLSDBinaryParsing() {}
+
+		// Every binary parse test also runs against the buffer parser,
+		// which has to agree with the stream parser on all input.
+		void ensureParse(
+			const std::string& msg,
+			const std::string& in,
+			const LLSD& expected_value,
+			S32 expected_count)
+		{
+			TestLLSDParsing<LLSDBinaryParser>::ensureParse(
+				msg,
+				in,
+				expected_value,
+				expected_count);
+
+			LLSD parsed_result;
+			S32 parsed_count = mParser->parseBuffer(
+				(const U8*)in.data(),
+				in.size(),
+				parsed_result);
+			std::string buffer_msg(msg);
+			buffer_msg += " (buffer)";
+			ensure_equals(buffer_msg.c_str(), parsed_result, expected_value);
+			buffer_msg += " (count)";
+			ensure_equals(buffer_msg, parsed_count, expected_count);
+		}
 	};
 
 	typedef tut::test_group<TestLLSDBinaryParsing> TestLLSDBinaryParsingGroup;
@@ -1241,6 +1500,114 @@ namespace tut
 	}
 */
 
+	template<> template<> 
+	void TestLLSDBinaryParsingObject::test<12>()
+	{
+		LLSD input = make_inventory_llsd(20);
+		std::string buffer;
+		LLSDSerialize::toBinary(input, buffer);
+		buffer.append("trailing");
+		const U8* buf = (const U8*)buffer.data();
+		S32 len = buffer.size();
+
+		// a single object is read and trailing bytes are left alone
+		LLSD output;
+		S32 bytes_read = 0;
+		S32 count = mParser->parseBuffer(buf, len, output, &bytes_read);
+		ensure("buffer parse count", count > 0);
+		ensure_equals("buffer parse", output, input);
+		ensure_equals("buffer bytes read", bytes_read, len - 8);
+
+		// every truncation of the object has to fail cleanly
+		for(S32 i = 0; i < len - 8; ++i)
+		{
+			count = mParser->parseBuffer(buf, i, output, &bytes_read);
+			ensure_equals("truncated buffer count", count, (S32)LLSDParser::PARSE_FAILURE);
+			ensure("truncated buffer undefined", output.isUndefined());
+			ensure("truncated buffer read past end", bytes_read <= i);
+		}
+
+		// a huge array size must not be trusted
+		std::vector<U8> vec;
+		vec.push_back('[');
+		vec.resize(vec.size() + 4);
+		uint32_t size = htonl(0x7fffffff);
+		memcpy(&vec[1], &size, sizeof(uint32_t));
+		vec.push_back('!');
+		vec.push_back(']');
+		std::string str_bad((char*)&vec[0], vec.size());
+		ensureParse("huge array size", str_bad, LLSD(), LLSDParser::PARSE_FAILURE);
+	}
+
+	class TestLLSDBinaryBenchmark : public TestLLSDBinaryParsing
+	{
+	};
+
+	typedef tut::test_group<TestLLSDBinaryBenchmark> TestLLSDBinaryBenchmarkGroup;
+	typedef TestLLSDBinaryBenchmarkGroup::object TestLLSDBinaryBenchmarkObject;
+	TestLLSDBinaryBenchmarkGroup gTestLLSDBinaryBenchmarkGroup(
+		"llsd binary parsing-benchmark");
+
+	template<> template<> 
+	void TestLLSDBinaryBenchmarkObject::test<1>()
+	{
+		// Compare the stream and buffer code paths on an inventory
+		// sized payload. This only reports; the timings are too noisy
+		// to assert on.
+		const S32 ITERATIONS = 20;
+		LLSD input = make_inventory_llsd(1000);
+		std::ostringstream ostr;
+		LLSDSerialize::toBinary(input, ostr);
+		const std::string serialized = ostr.str();
+		const F64 megabytes = (F64)serialized.size() * ITERATIONS / (1024.0 * 1024.0);
+
+		LLTimer timer;
+		for(S32 i = 0; i < ITERATIONS; ++i)
+		{
+			std::ostringstream out;
+			LLSDSerialize::toBinary(input, out);
+		}
+		F64 stream_format = timer.getElapsedTimeF64();
+
+		timer.reset();
+		std::string buffer;
+		for(S32 i = 0; i < ITERATIONS; ++i)
+		{
+			buffer.clear();
+			LLSDSerialize::toBinary(input, buffer);
+		}
+		F64 buffer_format = timer.getElapsedTimeF64();
+		ensure("buffer format matches", buffer == serialized);
+
+		LLSD output;
+		timer.reset();
+		for(S32 i = 0; i < ITERATIONS; ++i)
+		{
+			std::istringstream istr(serialized);
+			LLSDSerialize::fromBinary(output, istr, serialized.size());
+		}
+		F64 stream_parse = timer.getElapsedTimeF64();
+		ensure_equals("stream parse", output, input);
+
+		timer.reset();
+		for(S32 i = 0; i < ITERATIONS; ++i)
+		{
+			LLSDSerialize::fromBinary(
+				output,
+				(const U8*)serialized.data(),
+				serialized.size());
+		}
+		F64 buffer_parse = timer.getElapsedTimeF64();
+		ensure_equals("buffer parse", output, input);
+
+		llinfos << "LLSD binary " << serialized.size() << " bytes x "
+			<< ITERATIONS << ": format stream "
+			<< megabytes / llmax(stream_format, 0.000001) << " MB/s, buffer "
+			<< megabytes / llmax(buffer_format, 0.000001) << " MB/s; parse stream "
+			<< megabytes / llmax(stream_parse, 0.000001) << " MB/s, buffer "
+			<< megabytes / llmax(buffer_parse, 0.000001) << " MB/s" << llendl;
+	}
+
    /**
 	 * @class TestLLSDCrossCompatible
 	 * @brief Miscellaneous serialization and parsing tests
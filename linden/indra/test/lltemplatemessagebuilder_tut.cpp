@@ -972,5 +972,345 @@ namespace tut
 		ensure_equals("Ensure unchanged buffer ", strlen(outBuffer), 0);
 		delete reader;
 	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<46>()
+		// several blocks with fixed and variable layouts
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		LLMessageBlock* variable_block = createBlock(_PREHASH_Test0, MVT_U32, 4);
+		variable_block->addVariable(_PREHASH_Test1, MVT_VARIABLE, 1);
+		messageTemplate.addBlock(variable_block);
+		LLMessageBlock* multiple_block = new LLMessageBlock(_PREHASH_Test1, MBT_MULTIPLE, 2);
+		multiple_block->addVariable(_PREHASH_Test0, MVT_U16, 2);
+		multiple_block->addVariable(_PREHASH_Test1, MVT_LLVector3, 12);
+		messageTemplate.addBlock(multiple_block);
+		messageTemplate.addBlock(createBlock(_PREHASH_Test2, MVT_LLUUID, 16, MBT_SINGLE));
+
+		LLUUID id;
+		id.generate();
+		std::string names[3] = { "one", "", "three" };
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		for (U32 i = 0; i < 3; i++)
+		{
+			if (i)
+			{
+				builder->nextBlock(_PREHASH_Test0);
+			}
+			builder->addU32(_PREHASH_Test0, i * 100);
+			builder->addString(_PREHASH_Test1, names[i]);
+		}
+		for (U16 i = 0; i < 2; i++)
+		{
+			builder->nextBlock(_PREHASH_Test1);
+			builder->addU16(_PREHASH_Test0, i + 7);
+			builder->addVector3(_PREHASH_Test1, LLVector3(i, 2.f, 3.f));
+		}
+		builder->nextBlock(_PREHASH_Test2);
+		builder->addUUID(_PREHASH_Test0, id);
+		LLTemplateMessageReader* reader = setReader(messageTemplate, builder, 3);
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			ensure_equals("Test0 blocks", reader->getNumberOfBlocks(_PREHASH_Test0), 3);
+			ensure_equals("Test1 blocks", reader->getNumberOfBlocks(_PREHASH_Test1), 2);
+			ensure_equals("Test2 blocks", reader->getNumberOfBlocks(_PREHASH_Test2), 1);
+			ensure_equals("missing blocks", reader->getNumberOfBlocks(_PREHASH_Data), 0);
+			for (S32 i = 0; i < 3; i++)
+			{
+				U32 value;
+				std::string name;
+				reader->getU32(_PREHASH_Test0, _PREHASH_Test0, value, i);
+				reader->getString(_PREHASH_Test0, _PREHASH_Test1, name, i);
+				ensure_equals("U32", value, (U32)i * 100);
+				ensure_equals("string", name, names[i]);
+				// empty strings are sent without the terminator
+				S32 string_size = names[i].empty() ? 0 : (S32)names[i].size() + 1;
+				ensure_equals("string size", reader->getSize(_PREHASH_Test0, i, _PREHASH_Test1), string_size);
+			}
+			for (S32 i = 0; i < 2; i++)
+			{
+				U16 value;
+				LLVector3 vec;
+				reader->getU16(_PREHASH_Test1, _PREHASH_Test0, value, i);
+				reader->getVector3(_PREHASH_Test1, _PREHASH_Test1, vec, i);
+				ensure_equals("U16", value, i + 7);
+				ensure_equals("Vector3", vec, LLVector3(i, 2.f, 3.f));
+			}
+			LLUUID out_id;
+			reader->getUUID(_PREHASH_Test2, _PREHASH_Test0, out_id);
+			ensure_equals("UUID", out_id, id);
+			ensure_equals("UUID size", reader->getSize(_PREHASH_Test2, _PREHASH_Test0), 16);
+			ensure_equals("missing block", reader->getSize(_PREHASH_Test0, 3, _PREHASH_Test0), LL_BLOCK_NOT_IN_MESSAGE);
+			ensure_equals("missing variable", reader->getSize(_PREHASH_Test2, _PREHASH_Test1), LL_VARIABLE_NOT_IN_BLOCK);
+
+			// the same message again after a round trip through a builder
+			LLTemplateMessageBuilder* copy = new LLTemplateMessageBuilder(nameMap);
+			copy->newMessage(_PREHASH_TestMessage);
+			reader->copyToBuilder(*copy);
+			delete reader;
+			reader = setReader(messageTemplate, copy);
+		}
+		delete reader;
+	}
+
+	static void decodeBenchmarkHandler(LLMessageSystem*, void**)
+	{
+	}
+
+	// A template and a packet shaped like one of the busiest viewer bound
+	// messages, with the block counts a crowded region produces.
+	struct LLTemplateMessageFixture
+	{
+		LLTemplateMessageFixture(char* name, U32 number) : mTemplate(name, number, MFT_HIGH)
+		{
+			mTemplate.setHandlerFunc(decodeBenchmarkHandler, NULL);
+			nameMap[name] = &mTemplate;
+			numberMap[number] = &mTemplate;
+		}
+
+		~LLTemplateMessageFixture()
+		{
+			nameMap.erase(mTemplate.mName);
+			numberMap.erase(mTemplate.mMessageNumber);
+		}
+
+		void build(LLTemplateMessageBuilder& builder)
+		{
+			U8 buffer[MAX_BUFFER_SIZE];
+			memset(buffer, 0, LL_PACKET_ID_SIZE);
+			U32 size = builder.buildMessage(buffer, MAX_BUFFER_SIZE, 0);
+			mPacket.assign(buffer, buffer + size);
+		}
+
+		LLMessageTemplate mTemplate;
+		std::vector<U8> mPacket;
+	};
+
+	struct LLTemplateMessageBuilderBenchmarkData : public LLTemplateMessageBuilderTestData
+	{
+	};
+
+	typedef test_group<LLTemplateMessageBuilderBenchmarkData>	LLTemplateMessageBuilderBenchmarkGroup;
+	typedef LLTemplateMessageBuilderBenchmarkGroup::object		LLTemplateMessageBuilderBenchmarkObject;
+	LLTemplateMessageBuilderBenchmarkGroup templateMessageBuilderBenchmarkGroup("LLTemplateMessageBuilder-benchmark");
+
+	template<> template<>
+	void LLTemplateMessageBuilderBenchmarkObject::test<1>()
+		// decode throughput for high frequency messages
+	{
+		defaultTemplate();
+
+		LLUUID id;
+		id.generate();
+		std::vector<U8> data(60, 0x5a);
+		std::vector<U8> texture_entry(200, 0x21);
+
+		// ObjectUpdate, abridged to the fields the viewer reads on every update
+		LLTemplateMessageFixture object_update(_PREHASH_ObjectUpdate, 12);
+		{
+			LLMessageBlock* region = new LLMessageBlock(_PREHASH_RegionData, MBT_SINGLE);
+			region->addVariable(_PREHASH_RegionHandle, MVT_U64, 8);
+			region->addVariable(_PREHASH_TimeDilation, MVT_U16, 2);
+			object_update.mTemplate.addBlock(region);
+			LLMessageBlock* object = new LLMessageBlock(_PREHASH_ObjectData, MBT_VARIABLE);
+			object->addVariable(_PREHASH_ID, MVT_U32, 4);
+			object->addVariable(_PREHASH_State, MVT_U8, 1);
+			object->addVariable(_PREHASH_FullID, MVT_LLUUID, 16);
+			object->addVariable(_PREHASH_CRC, MVT_U32, 4);
+			object->addVariable(_PREHASH_PCode, MVT_U8, 1);
+			object->addVariable(_PREHASH_Material, MVT_U8, 1);
+			object->addVariable(_PREHASH_ClickAction, MVT_U8, 1);
+			object->addVariable(_PREHASH_Scale, MVT_LLVector3, 12);
+			object->addVariable(_PREHASH_ObjectData, MVT_VARIABLE, 1);
+			object->addVariable(_PREHASH_ParentID, MVT_U32, 4);
+			object->addVariable(_PREHASH_UpdateFlags, MVT_U32, 4);
+			object->addVariable(_PREHASH_PathCurve, MVT_U8, 1);
+			object->addVariable(_PREHASH_ProfileCurve, MVT_U8, 1);
+			object->addVariable(_PREHASH_TextureEntry, MVT_VARIABLE, 2);
+			object->addVariable(_PREHASH_Text, MVT_VARIABLE, 1);
+			object->addVariable(_PREHASH_TextColor, MVT_FIXED, 4);
+			object->addVariable(_PREHASH_NameValue, MVT_VARIABLE, 2);
+			object->addVariable(_PREHASH_ExtraParams, MVT_VARIABLE, 1);
+			object->addVariable(_PREHASH_OwnerID, MVT_LLUUID, 16);
+			object->addVariable(_PREHASH_Sound, MVT_LLUUID, 16);
+			object->addVariable(_PREHASH_Gain, MVT_F32, 4);
+			object->addVariable(_PREHASH_Flags, MVT_U8, 1);
+			object->addVariable(_PREHASH_Radius, MVT_F32, 4);
+			object_update.mTemplate.addBlock(object);
+
+			LLTemplateMessageBuilder builder(nameMap);
+			builder.newMessage(_PREHASH_ObjectUpdate);
+			builder.nextBlock(_PREHASH_RegionData);
+			builder.addU64(_PREHASH_RegionHandle, 1099511628032000ULL);
+			builder.addU16(_PREHASH_TimeDilation, 65535);
+			for (U32 i = 0; i < 4; i++)
+			{
+				U8 color[4] = { 255, 255, 255, 255 };
+				builder.nextBlock(_PREHASH_ObjectData);
+				builder.addU32(_PREHASH_ID, i);
+				builder.addU8(_PREHASH_State, 0);
+				builder.addUUID(_PREHASH_FullID, id);
+				builder.addU32(_PREHASH_CRC, i * 3);
+				builder.addU8(_PREHASH_PCode, 9);
+				builder.addU8(_PREHASH_Material, 3);
+				builder.addU8(_PREHASH_ClickAction, 0);
+				builder.addVector3(_PREHASH_Scale, LLVector3(0.5f, 0.5f, 0.5f));
+				builder.addBinaryData(_PREHASH_ObjectData, &data[0], data.size());
+				builder.addU32(_PREHASH_ParentID, 0);
+				builder.addU32(_PREHASH_UpdateFlags, 0x10000);
+				builder.addU8(_PREHASH_PathCurve, 16);
+				builder.addU8(_PREHASH_ProfileCurve, 1);
+				builder.addBinaryData(_PREHASH_TextureEntry, &texture_entry[0], texture_entry.size());
+				builder.addString(_PREHASH_Text, "");
+				builder.addBinaryData(_PREHASH_TextColor, color, 4);
+				builder.addString(_PREHASH_NameValue, "");
+				builder.addBinaryData(_PREHASH_ExtraParams, &data[0], 1);
+				builder.addUUID(_PREHASH_OwnerID, id);
+				builder.addUUID(_PREHASH_Sound, LLUUID::null);
+				builder.addF32(_PREHASH_Gain, 0.f);
+				builder.addU8(_PREHASH_Flags, 0);
+				builder.addF32(_PREHASH_Radius, 0.f);
+			}
+			object_update.build(builder);
+		}
+
+		LLTemplateMessageFixture terse_update(_PREHASH_ImprovedTerseObjectUpdate, 13);
+		{
+			LLMessageBlock* region = new LLMessageBlock(_PREHASH_RegionData, MBT_SINGLE);
+			region->addVariable(_PREHASH_RegionHandle, MVT_U64, 8);
+			region->addVariable(_PREHASH_TimeDilation, MVT_U16, 2);
+			terse_update.mTemplate.addBlock(region);
+			LLMessageBlock* object = new LLMessageBlock(_PREHASH_ObjectData, MBT_VARIABLE);
+			object->addVariable(_PREHASH_Data, MVT_VARIABLE, 1);
+			object->addVariable(_PREHASH_TextureEntry, MVT_VARIABLE, 2);
+			terse_update.mTemplate.addBlock(object);
+
+			LLTemplateMessageBuilder builder(nameMap);
+			builder.newMessage(_PREHASH_ImprovedTerseObjectUpdate);
+			builder.nextBlock(_PREHASH_RegionData);
+			builder.addU64(_PREHASH_RegionHandle, 1099511628032000ULL);
+			builder.addU16(_PREHASH_TimeDilation, 65535);
+			for (U32 i = 0; i < 15; i++)
+			{
+				builder.nextBlock(_PREHASH_ObjectData);
+				builder.addBinaryData(_PREHASH_Data, &data[0], data.size());
+				builder.addBinaryData(_PREHASH_TextureEntry, &texture_entry[0], 0);
+			}
+			terse_update.build(builder);
+		}
+
+		LLTemplateMessageFixture agent_update(_PREHASH_AgentUpdate, 14);
+		{
+			LLMessageBlock* agent = new LLMessageBlock(_PREHASH_AgentData, MBT_SINGLE);
+			agent->addVariable(_PREHASH_AgentID, MVT_LLUUID, 16);
+			agent->addVariable(_PREHASH_SessionID, MVT_LLUUID, 16);
+			agent->addVariable(_PREHASH_BodyRotation, MVT_LLQuaternion, 12);
+			agent->addVariable(_PREHASH_HeadRotation, MVT_LLQuaternion, 12);
+			agent->addVariable(_PREHASH_State, MVT_U8, 1);
+			agent->addVariable(_PREHASH_CameraCenter, MVT_LLVector3, 12);
+			agent->addVariable(_PREHASH_CameraAtAxis, MVT_LLVector3, 12);
+			agent->addVariable(_PREHASH_CameraLeftAxis, MVT_LLVector3, 12);
+			agent->addVariable(_PREHASH_CameraUpAxis, MVT_LLVector3, 12);
+			agent->addVariable(_PREHASH_Far, MVT_F32, 4);
+			agent->addVariable(_PREHASH_ControlFlags, MVT_U32, 4);
+			agent->addVariable(_PREHASH_Flags, MVT_U8, 1);
+			agent_update.mTemplate.addBlock(agent);
+
+			LLTemplateMessageBuilder builder(nameMap);
+			builder.newMessage(_PREHASH_AgentUpdate);
+			builder.nextBlock(_PREHASH_AgentData);
+			builder.addUUID(_PREHASH_AgentID, id);
+			builder.addUUID(_PREHASH_SessionID, id);
+			builder.addQuat(_PREHASH_BodyRotation, LLQuaternion());
+			builder.addQuat(_PREHASH_HeadRotation, LLQuaternion());
+			builder.addU8(_PREHASH_State, 0);
+			builder.addVector3(_PREHASH_CameraCenter, LLVector3(128.f, 128.f, 30.f));
+			builder.addVector3(_PREHASH_CameraAtAxis, LLVector3(1.f, 0.f, 0.f));
+			builder.addVector3(_PREHASH_CameraLeftAxis, LLVector3(0.f, 1.f, 0.f));
+			builder.addVector3(_PREHASH_CameraUpAxis, LLVector3(0.f, 0.f, 1.f));
+			builder.addF32(_PREHASH_Far, 128.f);
+			builder.addU32(_PREHASH_ControlFlags, 0);
+			builder.addU8(_PREHASH_Flags, 0);
+			agent_update.build(builder);
+		}
+
+		LLTemplateMessageFixture coarse_update(_PREHASH_CoarseLocationUpdate, 15);
+		{
+			LLMessageBlock* location = new LLMessageBlock(_PREHASH_Location, MBT_VARIABLE);
+			location->addVariable(_PREHASH_X, MVT_U8, 1);
+			location->addVariable(_PREHASH_Y, MVT_U8, 1);
+			location->addVariable(_PREHASH_Z, MVT_U8, 1);
+			coarse_update.mTemplate.addBlock(location);
+			LLMessageBlock* index = new LLMessageBlock(_PREHASH_Index, MBT_SINGLE);
+			index->addVariable(_PREHASH_You, MVT_S16, 2);
+			index->addVariable(_PREHASH_Prey, MVT_S16, 2);
+			coarse_update.mTemplate.addBlock(index);
+			LLMessageBlock* agent = new LLMessageBlock(_PREHASH_AgentData, MBT_VARIABLE);
+			agent->addVariable(_PREHASH_AgentID, MVT_LLUUID, 16);
+			coarse_update.mTemplate.addBlock(agent);
+
+			LLTemplateMessageBuilder builder(nameMap);
+			builder.newMessage(_PREHASH_CoarseLocationUpdate);
+			for (U8 i = 0; i < 40; i++)
+			{
+				builder.nextBlock(_PREHASH_Location);
+				builder.addU8(_PREHASH_X, i);
+				builder.addU8(_PREHASH_Y, i);
+				builder.addU8(_PREHASH_Z, i);
+			}
+			builder.nextBlock(_PREHASH_Index);
+			builder.addS16(_PREHASH_You, 0);
+			builder.addS16(_PREHASH_Prey, -1);
+			for (U8 i = 0; i < 40; i++)
+			{
+				builder.nextBlock(_PREHASH_AgentData);
+				builder.addUUID(_PREHASH_AgentID, id);
+			}
+			coarse_update.build(builder);
+		}
+
+		// Decode each packet and read every field, the way the handlers do.
+		const S32 ITERATIONS = 20000;
+		LLTemplateMessageReader reader(numberMap);
+		LLTemplateMessageFixture* fixtures[4] = { &object_update, &terse_update, &agent_update, &coarse_update };
+		for (S32 f = 0; f < 4; f++)
+		{
+			LLTemplateMessageFixture* fixture = fixtures[f];
+			const LLMessageTemplate& msg_template = fixture->mTemplate;
+			U8 scratch[MAX_BUFFER_SIZE];
+			S32 fields = 0;
+			LLTimer timer;
+			for (S32 n = 0; n < ITERATIONS; n++)
+			{
+				reader.clearMessage();
+				ensure("valid", reader.validateMessage(&fixture->mPacket[0], fixture->mPacket.size(), LLHost()));
+				ensure("read", reader.readMessage(&fixture->mPacket[0], LLHost()));
+				fields = 0;
+				for (LLMessageTemplate::message_block_map_t::const_iterator block_iter = msg_template.mMemberBlocks.begin();
+					 block_iter != msg_template.mMemberBlocks.end(); ++block_iter)
+				{
+					const LLMessageBlock* block = *block_iter;
+					S32 count = reader.getNumberOfBlocks(block->mName);
+					for (S32 i = 0; i < count; i++)
+					{
+						for (LLMessageBlock::message_variable_map_t::const_iterator var_iter = block->mMemberVariables.begin();
+							 var_iter != block->mMemberVariables.end(); ++var_iter)
+						{
+							const LLMessageVariable* var = *var_iter;
+							S32 size = reader.getSize(block->mName, i, var->getName());
+							reader.getBinaryData(block->mName, var->getName(), scratch, 0, i, MAX_BUFFER_SIZE);
+							fields += (size >= 0);
+						}
+					}
+				}
+			}
+			F64 elapsed = timer.getElapsedTimeF64();
+			llinfos << "LLTemplateMessageReader " << msg_template.mName << ": "
+					<< fixture->mPacket.size() << " bytes, " << fields << " fields, "
+					<< (S32)(ITERATIONS / elapsed) << " messages/sec" << llendl;
+		}
+		reader.clearMessage();
+	}
 }
 
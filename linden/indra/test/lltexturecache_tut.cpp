@@ -0,0 +1,389 @@
+/**
+ * @file lltexturecache_tut.cpp
+ * @brief Tests for newview/lltexturecache.cpp
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "../newview/lltexturecache.cpp"
+
+// Mock implementation.
+LLControlGroup gSavedSettings;
+
+LLAppViewer* LLAppViewer::sInstance = NULL;
+
+void LLAppViewer::pauseMainloopTimeout()
+{
+}
+
+void LLAppViewer::resumeMainloopTimeout(const std::string& state, F32 secs)
+{
+}
+
+namespace tut
+{
+	const S64 TEXTURE_CACHE_TEST_SIZE = 256 * 1024 * 1024;
+
+	// Keeps whatever the cache hands back for one read.
+	class LLTestReadResponder : public LLTextureCache::ReadResponder
+	{
+	public:
+		LLTestReadResponder() : mDone(false), mSuccess(false) {}
+
+		void setData(U8* data, S32 datasize, S32 imagesize, S32 imageformat, BOOL imagelocal)
+		{
+			// the responder owns the data, like LLImageFormatted::setData()
+			mData.assign(data, data + datasize);
+			delete[] data;
+		}
+		void completed(bool success)
+		{
+			mSuccess = success;
+			mDone = true;
+		}
+
+		std::vector<U8> mData;
+		bool mDone;
+		bool mSuccess;
+	};
+
+	class LLTestWriteResponder : public LLTextureCache::WriteResponder
+	{
+	public:
+		LLTestWriteResponder() : mDone(false), mSuccess(false) {}
+
+		void completed(bool success)
+		{
+			mSuccess = success;
+			mDone = true;
+		}
+
+		bool mDone;
+		bool mSuccess;
+	};
+
+	struct texturecache_data
+	{
+		std::string mCacheDir;
+
+		texturecache_data()
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				gSavedSettings.declareU32("CacheValidateCounter", 0, "Used to distribute cache validation", FALSE);
+				init = true;
+			}
+			LLUUID random;
+			random.generate();
+			std::ostringstream dir;
+#if LL_WINDOWS
+			dir << "lltexturecache-test-" << random;
+#else
+			dir << "/tmp/lltexturecache-test-" << random;
+#endif
+			mCacheDir = dir.str();
+			gDirUtilp->setCacheDir(mCacheDir);
+		}
+
+		~texturecache_data()
+		{
+			std::string delem = gDirUtilp->getDirDelimiter();
+			std::string mask = delem + "*";
+			std::string textures = mCacheDir + delem + "textures";
+			const char* subdirs = "0123456789abcdef";
+			for (S32 i = 0; i < 16; i++)
+			{
+				std::string dirname = textures + delem + subdirs[i];
+				gDirUtilp->deleteFilesInDir(dirname, mask);
+				LLFile::rmdir(dirname);
+			}
+			LLFile::rmdir(textures);
+			gDirUtilp->deleteFilesInDir(mCacheDir, mask);
+			LLFile::rmdir(mCacheDir);
+			gDirUtilp->setCacheDir("");
+		}
+
+		LLTextureCache* create(BOOL use_slabs)
+		{
+			LLTextureCache* cache = new LLTextureCache(true);
+			cache->initCache(LL_PATH_CACHE, TEXTURE_CACHE_TEST_SIZE, FALSE, use_slabs);
+			return cache;
+		}
+
+		void destroy(LLTextureCache* cache)
+		{
+			cache->shutdown();
+			delete cache;
+		}
+
+		static LLUUID textureID(S32 index)
+		{
+			LLUUID id;
+			memcpy(id.mData, &index, sizeof(index));
+			id.mData[15] = 0x7e;
+			return id;
+		}
+
+		static void fillTexture(std::vector<U8>& data, S32 index, S32 size)
+		{
+			data.resize(size);
+			for (S32 i = 0; i < size; i++)
+			{
+				data[i] = (U8)(i * 7 + index);
+			}
+		}
+
+		bool write(LLTextureCache* cache, const LLUUID& id, std::vector<U8>& data)
+		{
+			LLPointer<LLTestWriteResponder> responder = new LLTestWriteResponder;
+			LLTextureCache::handle_t handle = cache->writeToCache(id, LLWorkerThread::PRIORITY_NORMAL,
+																  &data[0], data.size(), data.size(),
+																  responder);
+			while (!cache->writeComplete(handle))
+			{
+				cache->update(1);
+				ms_sleep(1);
+			}
+			while (!responder->mDone)
+			{
+				cache->update(1);
+			}
+			return responder->mSuccess;
+		}
+
+		bool read(LLTextureCache* cache, const LLUUID& id, S32 size, std::vector<U8>& data)
+		{
+			LLPointer<LLTestReadResponder> responder = new LLTestReadResponder;
+			LLTextureCache::handle_t handle = cache->readFromCache(id, LLWorkerThread::PRIORITY_NORMAL,
+																   0, size, responder);
+			while (!cache->readComplete(handle, false))
+			{
+				cache->update(1);
+				ms_sleep(1);
+			}
+			while (!responder->mDone)
+			{
+				cache->update(1);
+			}
+			data = responder->mData;
+			return responder->mSuccess;
+		}
+
+		// Writes a header only, a small body and a large body texture,
+		// then reads all three back.
+		void writeAndRead(LLTextureCache* cache)
+		{
+			const S32 sizes[] = { TEXTURE_CACHE_ENTRY_SIZE / 2, 5000, 300000 };
+			for (S32 i = 0; i < 3; i++)
+			{
+				std::vector<U8> data;
+				fillTexture(data, i, sizes[i]);
+				ensure("write", write(cache, textureID(i), data));
+			}
+			for (S32 i = 0; i < 3; i++)
+			{
+				std::vector<U8> expected;
+				fillTexture(expected, i, sizes[i]);
+				std::vector<U8> data;
+				ensure("read", read(cache, textureID(i), sizes[i], data));
+				ensure("same data", data == expected);
+			}
+		}
+
+		std::string readEntriesFile()
+		{
+			std::string filename = gDirUtilp->getExpandedFilename(LL_PATH_CACHE, entries_filename);
+			S32 size = LLAPRFile::size(filename);
+			std::string contents(llmax(size, 0), '\0');
+			if (size > 0)
+			{
+				LLAPRFile::readEx(filename, &contents[0], 0, size);
+			}
+			return contents;
+		}
+	};
+
+	typedef test_group<texturecache_data> texturecache_test;
+	typedef texturecache_test::object texturecache_object;
+	tut::texturecache_test texturecache_testcase("lltexturecache");
+
+	template<> template<>
+	void texturecache_object::test<1>()
+	{
+		// bodies in one file per texture
+		LLTextureCache* cache = create(FALSE);
+		ensure("files", !cache->usesSlabs());
+		writeAndRead(cache);
+		destroy(cache);
+	}
+
+	template<> template<>
+	void texturecache_object::test<2>()
+	{
+		// bodies packed into the slab files
+		LLTextureCache* cache = create(TRUE);
+		ensure("slabs", cache->usesSlabs());
+		writeAndRead(cache);
+		destroy(cache);
+	}
+
+	template<> template<>
+	void texturecache_object::test<3>()
+	{
+		// slab bodies and the batched entries survive a restart
+		LLTextureCache* cache = create(TRUE);
+		std::vector<U8> data;
+		fillTexture(data, 1, 70000);
+		ensure("write", write(cache, textureID(1), data));
+		destroy(cache);
+
+		cache = create(TRUE);
+		std::vector<U8> result;
+		ensure("read after restart", read(cache, textureID(1), data.size(), result));
+		ensure("same data after restart", result == data);
+
+		// a removed body stays removed
+		cache->removeFromCache(textureID(1));
+		destroy(cache);
+		cache = create(TRUE);
+		ensure("removed", !read(cache, textureID(1), data.size(), result));
+		destroy(cache);
+	}
+
+	template<> template<>
+	void texturecache_object::test<4>()
+	{
+		// the batched entries reach texture.entries while the cache is
+		// running, written from the cache thread once update() sees them due
+		LLTextureCache* cache = create(TRUE);
+		std::vector<U8> data;
+		fillTexture(data, 2, 5000);
+		ensure("write", write(cache, textureID(2), data));
+		std::string written = readEntriesFile();
+
+		LLTimer timer;
+		while (readEntriesFile() == written && timer.getElapsedTimeF32() < TEXTURE_ENTRIES_FLUSH_SECONDS * 10.f)
+		{
+			// the flush timers are frame timers, tick them like the viewer's main loop
+			LLFrameTimer::updateFrameTime();
+			cache->update(1);
+			ms_sleep(10);
+		}
+		ensure("entries flushed", readEntriesFile() != written);
+		destroy(cache);
+	}
+
+	struct texturecache_benchmark_data : public texturecache_data
+	{
+		// Writes then reads back textures through one backend with every
+		// request in flight at once, logs the throughput.
+		void run(BOOL use_slabs)
+		{
+			const S32 TEXTURES = 1000;
+			const S32 TEXTURE_SIZE = 64 * 1024;
+			const F64 MB = 1024.0 * 1024.0;
+			LLTextureCache* cache = create(use_slabs);
+
+			std::vector<std::vector<U8> > textures(TEXTURES);
+			for (S32 i = 0; i < TEXTURES; i++)
+			{
+				fillTexture(textures[i], i, TEXTURE_SIZE);
+			}
+
+			LLTimer timer;
+			std::vector<LLTextureCache::handle_t> handles;
+			for (S32 i = 0; i < TEXTURES; i++)
+			{
+				handles.push_back(cache->writeToCache(textureID(i), LLWorkerThread::PRIORITY_NORMAL,
+													  &textures[i][0], TEXTURE_SIZE, TEXTURE_SIZE,
+													  new LLTestWriteResponder));
+			}
+			for (S32 i = 0; i < TEXTURES; i++)
+			{
+				while (!cache->writeComplete(handles[i]))
+				{
+					cache->update(1);
+				}
+			}
+			F64 write_time = timer.getElapsedTimeF64();
+
+			std::vector<LLPointer<LLTestReadResponder> > responders;
+			handles.clear();
+			timer.reset();
+			for (S32 i = 0; i < TEXTURES; i++)
+			{
+				responders.push_back(new LLTestReadResponder);
+				handles.push_back(cache->readFromCache(textureID(i), LLWorkerThread::PRIORITY_NORMAL,
+													   0, TEXTURE_SIZE, responders[i]));
+			}
+			for (S32 i = 0; i < TEXTURES; i++)
+			{
+				while (!cache->readComplete(handles[i], false))
+				{
+					cache->update(1);
+				}
+			}
+			F64 read_time = timer.getElapsedTimeF64();
+			cache->update(1);
+
+			llinfos << "TEXTURE CACHE: " << (use_slabs ? "slab" : "file") << " bodies, "
+					<< TEXTURES << " x " << TEXTURE_SIZE << " bytes, WRITES: "
+					<< (write_time > 0.0 ? TEXTURES * TEXTURE_SIZE / MB / write_time : 0.0) << " MB/s READS: "
+					<< (read_time > 0.0 ? TEXTURES * TEXTURE_SIZE / MB / read_time : 0.0) << " MB/s" << llendl;
+
+			for (S32 i = 0; i < TEXTURES; i++)
+			{
+				ensure("read", responders[i]->mData == textures[i]);
+			}
+			destroy(cache);
+		}
+	};
+
+	typedef test_group<texturecache_benchmark_data> texturecache_benchmark_test;
+	typedef texturecache_benchmark_test::object texturecache_benchmark_object;
+	tut::texturecache_benchmark_test texturecache_benchmark_testcase("lltexturecache-benchmark");
+
+	template<> template<>
+	void texturecache_benchmark_object::test<1>()
+	{
+		// one file per texture body
+		run(FALSE);
+	}
+
+	template<> template<>
+	void texturecache_benchmark_object::test<2>()
+	{
+		// slab files, compare with test<1>
+		run(TRUE);
+	}
+}
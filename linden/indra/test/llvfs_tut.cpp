@@ -0,0 +1,490 @@
+/**
+ * @file llvfs_tut.cpp
+ * @brief Tests for the virtual file system
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+#include "llapr.h"
+#include "llvfs.h"
+#include "llfile.h"
+#include "llthread.h"
+#include "lltimer.h"
+
+#include <algorithm>
+
+namespace tut
+{
+	const S32 VFS_TEST_PRESIZE = 4 * 1024 * 1024;
+
+	// Hammers one VFS with reads and writes to its own set of files.
+	class LLVFSTestThread : public LLThread
+	{
+	public:
+		LLVFSTestThread(LLVFS* vfs, S32 id, S32 files, S32 ops)
+		:	LLThread("VFS test"),
+			mVFS(vfs),
+			mID(id),
+			mFiles(files),
+			mOps(ops),
+			mErrors(0)
+		{
+		}
+
+		/*virtual*/ void run()
+		{
+			U8 out[512];
+			U8 in[512];
+			for (S32 i = 0; i < mOps; i++)
+			{
+				LLUUID file_id;
+				file_id.mData[0] = (U8)mID;
+				file_id.mData[1] = (U8)(i % mFiles);
+				file_id.mData[15] = 1;
+				memset(out, (mID + i) & 0xff, sizeof(out));
+
+				U64 start = LLTimer::getTotalTime();
+				mVFS->setMaxSize(file_id, LLAssetType::AT_NOTECARD, sizeof(out));
+				mVFS->storeData(file_id, LLAssetType::AT_NOTECARD, out, 0, sizeof(out));
+				S32 bytes = mVFS->getData(file_id, LLAssetType::AT_NOTECARD, in, 0, sizeof(in));
+				mLatencies.push_back(LLTimer::getTotalTime() - start);
+
+				if (bytes != sizeof(in) || memcmp(in, out, sizeof(in)))
+				{
+					mErrors++;
+				}
+			}
+		}
+
+		LLVFS* mVFS;
+		S32 mID;
+		S32 mFiles;
+		S32 mOps;
+		S32 mErrors;
+		std::vector<U64> mLatencies;
+	};
+
+	struct vfs_data
+	{
+		std::string mIndexFile;
+		std::string mDataFile;
+
+		vfs_data()
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+			LLUUID random;
+			random.generate();
+			std::ostringstream base;
+#if LL_WINDOWS
+			base << "llvfs-test-" << random;
+#else
+			base << "/tmp/llvfs-test-" << random;
+#endif
+			mIndexFile = base.str() + ".index";
+			mDataFile = base.str() + ".data";
+		}
+
+		~vfs_data()
+		{
+			LLFile::remove(mIndexFile);
+			LLFile::remove(mIndexFile + ".journal");
+			LLFile::remove(mIndexFile + ".journal.old");
+			LLFile::remove(mIndexFile + ".tmp");
+			LLFile::remove(mDataFile);
+			LLFile::remove(mDataFile + ".open");
+		}
+
+		LLVFS* create(BOOL mapped, U32 presize = VFS_TEST_PRESIZE, BOOL remove_after_crash = FALSE)
+		{
+			return new LLVFS(mIndexFile, mDataFile, FALSE, presize, remove_after_crash, mapped);
+		}
+
+		// Runs a thread per set of files to completion, returns the
+		// number of corrupt reads.
+		S32 runThreads(LLVFS* vfs, S32 thread_count, S32 ops, std::vector<U64>& latencies)
+		{
+			std::vector<LLVFSTestThread*> threads;
+			for (S32 i = 0; i < thread_count; i++)
+			{
+				threads.push_back(new LLVFSTestThread(vfs, i, 16, ops));
+				threads.back()->start();
+			}
+
+			S32 errors = 0;
+			for (S32 i = 0; i < thread_count; i++)
+			{
+				while (!threads[i]->isStopped())
+				{
+					ms_sleep(1);
+				}
+				errors += threads[i]->mErrors;
+				latencies.insert(latencies.end(), threads[i]->mLatencies.begin(), threads[i]->mLatencies.end());
+				delete threads[i];
+			}
+			return errors;
+		}
+
+		static LLUUID fileID(S32 index)
+		{
+			LLUUID id;
+			memcpy(id.mData, &index, sizeof(index));
+			return id;
+		}
+
+		// Fills a new VFS with 16 byte textures and closes it.
+		void fillIndex(S32 files, U32 presize = VFS_TEST_PRESIZE)
+		{
+			LLVFS* vfs = create(FALSE, presize);
+			U8 data[16];
+			memset(data, 0x5a, sizeof(data));
+			for (S32 i = 0; i < files; i++)
+			{
+				vfs->setMaxSize(fileID(i), LLAssetType::AT_TEXTURE, sizeof(data));
+				vfs->storeData(fileID(i), LLAssetType::AT_TEXTURE, data, 0, sizeof(data));
+			}
+			delete vfs;
+		}
+	};
+
+	typedef test_group<vfs_data> vfs_test;
+	typedef vfs_test::object vfs_object;
+	tut::vfs_test vfs_testcase("llvfs");
+
+	template<> template<>
+	void vfs_object::test<1>()
+	{
+		// store and read back through a mapped data file
+		LLVFS* vfs = create(TRUE);
+		ensure("valid", vfs->isValid());
+#if !LL_WINDOWS
+		ensure("mapped", vfs->isDataMapped());
+#endif
+
+		LLUUID id;
+		id.generate();
+		const char data[] = "The quick brown fox jumps over the lazy dog";
+		S32 len = sizeof(data);
+		ensure("setMaxSize", vfs->setMaxSize(id, LLAssetType::AT_NOTECARD, len));
+		ensure_equals("storeData", vfs->storeData(id, LLAssetType::AT_NOTECARD, (const U8*)data, 0, len), len);
+		ensure_equals("getSize", vfs->getSize(id, LLAssetType::AT_NOTECARD), len);
+
+		char buffer[sizeof(data)];
+		ensure_equals("getData", vfs->getData(id, LLAssetType::AT_NOTECARD, (U8*)buffer, 0, len), len);
+		ensure_memory_matches("data", buffer, len, data, len);
+		delete vfs;
+
+		// reopen with buffered access, the data must still be there
+		vfs = create(FALSE);
+		ensure("reopen valid", vfs->isValid());
+		ensure("reopen not mapped", !vfs->isDataMapped());
+		memset(buffer, 0, len);
+		ensure_equals("reopen getData", vfs->getData(id, LLAssetType::AT_NOTECARD, (U8*)buffer, 0, len), len);
+		ensure_memory_matches("reopen data", buffer, len, data, len);
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_object::test<2>()
+	{
+		// growing a file that can't extend in place moves its contents
+		LLVFS* vfs = create(TRUE);
+		LLUUID first;
+		LLUUID second;
+		first.generate();
+		second.generate();
+
+		U8 data[1024];
+		for (S32 i = 0; i < 1024; i++)
+		{
+			data[i] = (U8)i;
+		}
+		vfs->setMaxSize(first, LLAssetType::AT_NOTECARD, 1024);
+		vfs->storeData(first, LLAssetType::AT_NOTECARD, data, 0, 1024);
+		vfs->setMaxSize(second, LLAssetType::AT_NOTECARD, 1024);
+
+		ensure("grow", vfs->setMaxSize(first, LLAssetType::AT_NOTECARD, 4096));
+		U8 buffer[1024];
+		ensure_equals("getData", vfs->getData(first, LLAssetType::AT_NOTECARD, buffer, 0, 1024), 1024);
+		ensure_memory_matches("moved data", buffer, 1024, data, 1024);
+
+		// and renaming keeps it readable under the new ID
+		LLUUID renamed;
+		renamed.generate();
+		vfs->renameFile(first, LLAssetType::AT_NOTECARD, renamed, LLAssetType::AT_NOTECARD);
+		ensure("old name gone", !vfs->getExists(first, LLAssetType::AT_NOTECARD));
+		ensure_equals("renamed getData", vfs->getData(renamed, LLAssetType::AT_NOTECARD, buffer, 0, 1024), 1024);
+		ensure_memory_matches("renamed data", buffer, 1024, data, 1024);
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_object::test<3>()
+	{
+		// concurrent readers and writers on separate files
+		LLVFS* vfs = create(TRUE);
+		std::vector<U64> latencies;
+		ensure_equals("no corrupt reads", runThreads(vfs, 4, 500, latencies), 0);
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_object::test<4>()
+	{
+		// a torn record at the end of the index journal is ignored
+		LLVFS* vfs = create(FALSE);
+		LLUUID id;
+		id.generate();
+		const char data[] = "journal";
+		S32 len = sizeof(data);
+		vfs->setMaxSize(id, LLAssetType::AT_NOTECARD, len);
+		vfs->storeData(id, LLAssetType::AT_NOTECARD, (const U8*)data, 0, len);
+		delete vfs;
+
+		LLFILE* journal = LLFile::fopen(mIndexFile + ".journal", "ab");
+		ensure("journal exists", journal != NULL);
+		const char torn[] = "not a whole journal record";
+		fwrite(torn, 1, sizeof(torn), journal);
+		fclose(journal);
+
+		vfs = create(FALSE);
+		ensure("valid after torn journal", vfs->isValid());
+		char buffer[sizeof(data)];
+		ensure_equals("getData", vfs->getData(id, LLAssetType::AT_NOTECARD, (U8*)buffer, 0, len), len);
+		ensure_memory_matches("data", buffer, len, data, len);
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_object::test<5>()
+	{
+		// files survive reopening a larger index
+		const S32 FILES = 1000;
+		fillIndex(FILES);
+		LLVFS* vfs = create(FALSE);
+		ensure("valid", vfs->isValid());
+		ensure_equals("last file", vfs->getSize(fileID(FILES - 1), LLAssetType::AT_TEXTURE), 16);
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_object::test<6>()
+	{
+		// idle defragmentation closes the holes left by removed files
+		LLVFS* vfs = create(FALSE);
+		// fill the data file exactly, so the holes are all the free space
+		const S32 FILES = 64;
+		const S32 FILE_SIZE = VFS_TEST_PRESIZE / FILES;
+		std::vector<U8> data(FILE_SIZE);
+		for (S32 i = 0; i < FILES; i++)
+		{
+			LLUUID id;
+			id.mData[0] = (U8)i;
+			id.mData[15] = 1;
+			std::fill(data.begin(), data.end(), (U8)i);
+			vfs->setMaxSize(id, LLAssetType::AT_NOTECARD, FILE_SIZE);
+			vfs->storeData(id, LLAssetType::AT_NOTECARD, &data[0], 0, FILE_SIZE);
+		}
+		for (S32 i = 0; i < FILES; i += 2)
+		{
+			LLUUID id;
+			id.mData[0] = (U8)i;
+			id.mData[15] = 1;
+			vfs->removeFile(id, LLAssetType::AT_NOTECARD);
+		}
+
+		LLSD before = vfs->getStatistics();
+		ensure_equals("files", before["files"].asInteger(), FILES / 2);
+		ensure("fragmented", before["fragmentation"].asReal() > 0.0);
+
+		// never more than the budget, even for one file
+		ensure_equals("file over budget", vfs->defragment(FILE_SIZE - 1), 0);
+		S32 budget = FILE_SIZE * 5 / 2;
+		ensure_equals("within budget", vfs->defragment(budget), FILE_SIZE * 2);
+
+		ensure("moved", vfs->defragment(VFS_TEST_PRESIZE) > 0);
+		LLSD after = vfs->getStatistics();
+		ensure("less fragmented", after["fragmentation"].asReal() < before["fragmentation"].asReal());
+		ensure("fewer free blocks", after["free_blocks"].asInteger() < before["free_blocks"].asInteger());
+		ensure_equals("free space kept", after["free_bytes"].asInteger(), before["free_bytes"].asInteger());
+
+		for (S32 i = 1; i < FILES; i += 2)
+		{
+			LLUUID id;
+			id.mData[0] = (U8)i;
+			id.mData[15] = 1;
+			std::vector<U8> buffer(FILE_SIZE);
+			std::fill(data.begin(), data.end(), (U8)i);
+			ensure_equals("getData", vfs->getData(id, LLAssetType::AT_NOTECARD, &buffer[0], 0, FILE_SIZE), FILE_SIZE);
+			ensure_memory_matches("data after move", &buffer[0], FILE_SIZE, &data[0], FILE_SIZE);
+		}
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_object::test<7>()
+	{
+		// a crash still wipes a VFS that asks for it, journal or not
+		LLVFS* vfs = create(FALSE, VFS_TEST_PRESIZE, TRUE);
+		LLUUID id;
+		id.generate();
+		const char data[] = "wiped";
+		vfs->setMaxSize(id, LLAssetType::AT_NOTECARD, sizeof(data));
+		vfs->storeData(id, LLAssetType::AT_NOTECARD, (const U8*)data, 0, sizeof(data));
+		delete vfs;
+
+		vfs = create(FALSE, VFS_TEST_PRESIZE, TRUE);
+		ensure("kept after clean shutdown", vfs->getExists(id, LLAssetType::AT_NOTECARD));
+		delete vfs;
+
+		// what the marker looks like when the last run didn't shut down
+		LLFILE* marker = LLFile::fopen(mDataFile + ".open", "w");
+		ensure("marker", marker != NULL);
+		fclose(marker);
+
+		vfs = create(FALSE, VFS_TEST_PRESIZE, TRUE);
+		ensure("valid", vfs->isValid());
+		ensure("wiped after crash", !vfs->getExists(id, LLAssetType::AT_NOTECARD));
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_object::test<8>()
+	{
+		// files changed while the index is compacted a chunk at a time
+		const S32 FILES = 3000;
+		const S32 ROUNDS = 4;
+		fillIndex(FILES);
+		LLVFS* vfs = create(FALSE);
+		U8 data[16];
+		for (S32 round = 0; round < ROUNDS; round++)
+		{
+			// rename every file back and forth, two records each
+			for (S32 i = 0; i < FILES; i++)
+			{
+				vfs->renameFile(fileID(i), LLAssetType::AT_TEXTURE, fileID(i), LLAssetType::AT_NOTECARD);
+				vfs->renameFile(fileID(i), LLAssetType::AT_NOTECARD, fileID(i), LLAssetType::AT_TEXTURE);
+			}
+			// and drop a few, which frees space mid-compaction
+			vfs->removeFile(fileID(round), LLAssetType::AT_TEXTURE);
+		}
+		delete vfs;
+
+		llstat info;
+		ensure("compaction finished", LLFile::stat(mIndexFile + ".journal.old", &info) != 0);
+
+		vfs = create(FALSE);
+		ensure("valid", vfs->isValid());
+		for (S32 i = 0; i < FILES; i++)
+		{
+			if (i < ROUNDS)
+			{
+				ensure("removed", !vfs->getExists(fileID(i), LLAssetType::AT_TEXTURE));
+				continue;
+			}
+			ensure_equals("getData", vfs->getData(fileID(i), LLAssetType::AT_TEXTURE, data, 0, sizeof(data)), (S32)sizeof(data));
+			ensure_equals("data", data[15], (U8)0x5a);
+		}
+		delete vfs;
+	}
+
+	struct vfs_benchmark_data : public vfs_data
+	{
+	};
+
+	typedef test_group<vfs_benchmark_data> vfs_benchmark_test;
+	typedef vfs_benchmark_test::object vfs_benchmark_object;
+	tut::vfs_benchmark_test vfs_benchmark_testcase("llvfs-benchmark");
+
+	template<> template<>
+	void vfs_benchmark_object::test<1>()
+	{
+		// throughput and latency of concurrent readers and writers
+		const S32 THREADS = 4;
+		const S32 OPS = 2000;
+		LLVFS* vfs = create(TRUE);
+
+		std::vector<U64> latencies;
+		LLTimer timer;
+		S32 errors = runThreads(vfs, THREADS, OPS, latencies);
+		F32 elapsed = timer.getElapsedTimeF32();
+
+		std::sort(latencies.begin(), latencies.end());
+		U64 p99 = latencies.empty() ? 0 : latencies[(latencies.size() * 99) / 100];
+		llinfos << "VFS: " << THREADS << " threads, "
+				<< (elapsed > 0.f ? (F32)(THREADS * OPS) / elapsed : 0.f) << " ops/sec, p99 "
+				<< p99 << " usec" << llendl;
+
+		ensure_equals("no corrupt reads", errors, 0);
+		delete vfs;
+	}
+
+	template<> template<>
+	void vfs_benchmark_object::test<2>()
+	{
+		// Startup time with a large index, first with nothing in the journal,
+		// then replaying a journal record for every file on top of it.
+		const S32 FILES = 200000;
+		const U32 PRESIZE = FILES * 1024;	// one data block per file
+		fillIndex(FILES, PRESIZE);
+
+		// fold the fill's journal into the index
+		delete create(FALSE, PRESIZE);
+
+		LLTimer timer;
+		LLVFS* vfs = create(FALSE, PRESIZE);
+		F32 index_only = timer.getElapsedTimeF32();
+		ensure("valid", vfs->isValid());
+		ensure_equals("first file", vfs->getSize(fileID(0), LLAssetType::AT_TEXTURE), 16);
+
+		// retype half the files, two journal records each, which stops just
+		// short of a compaction
+		for (S32 i = 0; i < FILES; i += 2)
+		{
+			vfs->renameFile(fileID(i), LLAssetType::AT_TEXTURE, fileID(i), LLAssetType::AT_NOTECARD);
+		}
+		delete vfs;
+
+		timer.reset();
+		vfs = create(FALSE, PRESIZE);
+		F32 replayed = timer.getElapsedTimeF32();
+		llinfos << "VFS: opened " << FILES << " file index in " << index_only << " seconds, "
+				<< replayed << " seconds replaying " << FILES << " journal records" << llendl;
+
+		ensure("valid after replay", vfs->isValid());
+		ensure_equals("renamed file", vfs->getSize(fileID(FILES - 2), LLAssetType::AT_NOTECARD), 16);
+		ensure_equals("last file", vfs->getSize(fileID(FILES - 1), LLAssetType::AT_TEXTURE), 16);
+		delete vfs;
+	}
+}
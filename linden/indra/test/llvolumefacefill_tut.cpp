@@ -0,0 +1,407 @@
+/**
+ * @file llvolumefacefill_tut.cpp
+ * @brief Tests for LLVolumeFaceFill and a threaded geometry rebuild benchmark
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "lltut.h"
+#include "llapr.h"
+#include "llbatchthread.h"
+#include "llmemory.h"
+#include "llthreadpool.h"
+#include "lltimer.h"
+#include "llvolume.h"
+#include "llvolumefacefill.h"
+
+namespace tut
+{
+	// One vertex of an interleaved test buffer.
+	struct LLTestVertex
+	{
+		LLVector3 mPosition;
+		LLVector3 mNormal;
+		LLVector3 mBinormal;
+		LLVector2 mTexCoord;
+		LLVector2 mBumpTexCoord;
+		LLColor4U mColor;
+	};
+
+	// A spatial group's worth of prims, with the buffer they are written to.
+	struct LLTestGroup
+	{
+		std::vector<LLTestVertex> mVertices;
+		std::vector<U16> mIndices;
+	};
+
+	struct volumefacefill_data
+	{
+		volumefacefill_data() : mSeed(1)
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+
+			LLVolumeParams params;
+			params.setCube();
+			addVolume(params);
+			params.setType(LL_PCODE_PROFILE_CIRCLE_HALF, LL_PCODE_PATH_CIRCLE);
+			params.setRevolutions(1.f);
+			addVolume(params);
+			params.setType(LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_CIRCLE);
+			params.setRatio(1.f, 0.25f);
+			addVolume(params);
+			params.setType(LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_LINE);
+			params.setRatio(1.f, 1.f);
+			params.setHollow(0.5f);
+			addVolume(params);
+		}
+
+		void addVolume(const LLVolumeParams& params)
+		{
+			LLPointer<LLVolume> volume = new LLVolume(params, 4.f);
+			for (S32 i = 0; i < volume->getNumVolumeFaces(); i++)
+			{
+				volume->genBinormals(i);
+			}
+			mVolumes.push_back(volume);
+		}
+
+		// Sets up fills for count random prims in group, as the viewer does
+		// for a group with every attribute to rebuild.
+		void prepareGroup(LLTestGroup& group, S32 count, LLVolumeFaceFill::fill_list_t& fills)
+		{
+			S32 num_vertices = 0;
+			S32 num_indices = 0;
+			std::vector<const LLVolume*> prims;
+			for (S32 i = 0; i < count; i++)
+			{
+				const LLVolume* volume = mVolumes[rand((S32)mVolumes.size())];
+				prims.push_back(volume);
+				for (S32 f = 0; f < volume->getNumVolumeFaces(); f++)
+				{
+					num_vertices += (S32)volume->getVolumeFace(f).mVertices.size();
+					num_indices += (S32)volume->getVolumeFace(f).mIndices.size();
+				}
+			}
+			group.mVertices.resize(num_vertices);
+			group.mIndices.resize(num_indices);
+
+			S32 vertex = 0;
+			S32 index = 0;
+			for (S32 i = 0; i < count; i++)
+			{
+				const LLVolume* volume = prims[i];
+				LLQuaternion rotation(frand(F_TWO_PI), LLVector3(frand(1.f), frand(1.f), 1.f));
+				LLVector3 scale(0.5f + frand(10.f), 0.5f + frand(10.f), 0.5f + frand(10.f));
+				LLVector3 position(frand(256.f), frand(256.f), frand(64.f));
+				LLMatrix4 mat_vert;
+				mat_vert.initAll(scale, rotation, position);
+				LLMatrix3 mat_normal(rotation);
+
+				for (S32 f = 0; f < volume->getNumVolumeFaces(); f++)
+				{
+					const LLVolumeFace& face = volume->getVolumeFace(f);
+					fills.push_back(LLVolumeFaceFill());
+					LLVolumeFaceFill& fill = fills.back();
+					fill.mFace = &face;
+					fill.mVertexMatrix = mat_vert;
+					fill.mNormalMatrix = mat_normal;
+					fill.mIndexOffset = (U16)(vertex & 0x3fff);
+
+					LLTestVertex* v = &group.mVertices[vertex];
+					setStrider(fill.mVertices, &v->mPosition);
+					setStrider(fill.mNormals, &v->mNormal);
+					setStrider(fill.mBinormals, &v->mBinormal);
+					setStrider(fill.mTexCoords, &v->mTexCoord);
+					setStrider(fill.mColors, &v->mColor);
+					fill.mIndices = &group.mIndices[index];
+
+					F32 rot = frand(F_TWO_PI);
+					fill.mCosAng = cosf(rot);
+					fill.mSinAng = sinf(rot);
+					fill.mOffsetS = frand(1.f);
+					fill.mOffsetT = frand(1.f);
+					fill.mScaleS = 0.5f + frand(4.f);
+					fill.mScaleT = 0.5f + frand(4.f);
+					fill.mPlanarTexGen = (f % 2);
+					fill.mTexGenScale = scale;
+					fill.mColor = LLColor4U(rand(256), rand(256), rand(256), 255);
+					if (f % 3 == 0)
+					{
+						setStrider(fill.mBumpTexCoords, &v->mBumpTexCoord);
+						fill.mBinormalDir.setVec(-fill.mSinAng, fill.mCosAng, 0.f);
+						fill.mBumpS.setVec(0.f, 0.f, 1.f / 256.f);
+						fill.mBumpT.setVec(0.f, 1.f / 512.f, 1.f / 512.f);
+					}
+
+					vertex += (S32)face.mVertices.size();
+					index += (S32)face.mIndices.size();
+				}
+			}
+		}
+
+		// The prims are made from a seed, so that groups can be built again
+		// the same.
+		S32 rand(S32 val)
+		{
+			mSeed = mSeed * 1664525 + 1013904223;
+			return (S32)((mSeed >> 8) % (U32)val);
+		}
+
+		F32 frand(F32 val)
+		{
+			return val * (F32)rand(1 << 20) / (F32)(1 << 20);
+		}
+
+		template<class T> void setStrider(LLStrider<T>& strider, T* first)
+		{
+			strider = first;
+			strider.setStride(sizeof(LLTestVertex));
+		}
+
+		// Builds groups of prims_per_group prims, filling them through
+		// thread, or on this thread if it is NULL.
+		void buildGroups(std::vector<LLTestGroup>& groups, S32 prims_per_group, LLBatchThread* thread, U32 seed)
+		{
+			LLVolumeFaceFill::fill_list_t fills;
+			mSeed = seed;
+			for (U32 i = 0; i < groups.size(); i++)
+			{
+				prepareGroup(groups[i], prims_per_group, fills);
+			}
+			LLVolumeFaceFill::fillAll(fills, thread);
+		}
+
+		static bool equal(const std::vector<LLTestGroup>& a, const std::vector<LLTestGroup>& b)
+		{
+			if (a.size() != b.size())
+			{
+				return false;
+			}
+			for (U32 i = 0; i < a.size(); i++)
+			{
+				if (a[i].mVertices.size() != b[i].mVertices.size() ||
+					a[i].mIndices != b[i].mIndices)
+				{
+					return false;
+				}
+				for (U32 j = 0; j < a[i].mVertices.size(); j++)
+				{
+					if (!equal(a[i].mVertices[j], b[i].mVertices[j]))
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		// Exactly equal, field by field.  LLColor4U has padding, so no memcmp().
+		static bool equal(const LLTestVertex& a, const LLTestVertex& b)
+		{
+			return a.mPosition == b.mPosition &&
+				a.mNormal == b.mNormal &&
+				a.mBinormal == b.mBinormal &&
+				a.mTexCoord == b.mTexCoord &&
+				a.mBumpTexCoord == b.mBumpTexCoord &&
+				a.mColor == b.mColor;
+		}
+
+		std::vector<LLPointer<LLVolume> > mVolumes;
+		U32 mSeed;
+	};
+	typedef test_group<volumefacefill_data> volumefacefill_test;
+	typedef volumefacefill_test::object volumefacefill_object;
+	tut::volumefacefill_test tvolumefacefill("volumefacefill");
+
+	template<> template<>
+	void volumefacefill_object::test<1>()
+	{
+		// positions, normals, indices and color
+		const LLVolumeFace& face = mVolumes[0]->getVolumeFace(0);
+		S32 count = (S32)face.mVertices.size();
+		LLQuaternion rotation(F_PI_BY_TWO, LLVector3(0.f, 0.f, 1.f));
+		LLMatrix4 mat_vert;
+		mat_vert.initAll(LLVector3(1.f, 1.f, 1.f), rotation, LLVector3(10.f, 20.f, 30.f));
+
+		std::vector<LLVector3> positions(count);
+		std::vector<LLVector3> normals(count);
+		std::vector<U16> indices(face.mIndices.size());
+		std::vector<LLColor4U> colors(count);
+
+		LLVolumeFaceFill fill;
+		fill.mFace = &face;
+		fill.mVertexMatrix = mat_vert;
+		fill.mNormalMatrix = LLMatrix3(rotation);
+		fill.mIndexOffset = 100;
+		fill.mVertices = &positions[0];
+		fill.mNormals = &normals[0];
+		fill.mIndices = &indices[0];
+		fill.mColors = &colors[0];
+		fill.mColor = LLColor4U(1, 2, 3, 4);
+		ensure_equals("vertex count", fill.getNumVertices(), count);
+		fill.fill();
+
+		for (S32 i = 0; i < count; i++)
+		{
+			LLVector3 expected = face.mVertices[i].mPosition * mat_vert;
+			ensure("position", dist_vec(positions[i], expected) < 1.e-4f);
+			LLVector3 normal = face.mVertices[i].mNormal * rotation;
+			normal.normVec();
+			ensure("normal", dist_vec(normals[i], normal) < 1.e-5f);
+			ensure("color", colors[i] == LLColor4U(1, 2, 3, 4));
+		}
+		for (U32 i = 0; i < indices.size(); i++)
+		{
+			ensure_equals("index", (S32)indices[i], face.mIndices[i] + 100);
+		}
+	}
+
+	template<> template<>
+	void volumefacefill_object::test<2>()
+	{
+		// texture coordinates, and attributes without a strider are left alone
+		const LLVolumeFace& face = mVolumes[3]->getVolumeFace(0);
+		S32 count = (S32)face.mVertices.size();
+		std::vector<LLTestVertex> vertices(count);
+		memset(&vertices[0], 0, count * sizeof(LLTestVertex));
+
+		LLVolumeFaceFill fill;
+		fill.mFace = &face;
+		setStrider(fill.mTexCoords, &vertices[0].mTexCoord);
+		fill.mCosAng = cosf(0.5f);
+		fill.mSinAng = sinf(0.5f);
+		fill.mOffsetS = 0.25f;
+		fill.mScaleT = 2.f;
+		fill.fill();
+
+		for (S32 i = 0; i < count; i++)
+		{
+			LLVector2 tc = face.mVertices[i].mTexCoord;
+			LLVolumeFaceFill::transformTexCoord(tc, cosf(0.5f), sinf(0.5f), 0.25f, 0.f, 1.f, 2.f);
+			ensure("tex coord", vertices[i].mTexCoord == tc);
+			ensure("position untouched", vertices[i].mPosition.isExactlyZero());
+			ensure("bump untouched", vertices[i].mBumpTexCoord.isExactlyZero());
+		}
+
+		// a texture matrix replaces the texture entry transform
+		LLMatrix4 tex_mat;
+		tex_mat.initAll(LLVector3(2.f, 4.f, 1.f), LLQuaternion(), LLVector3(0.f, 0.f, 0.f));
+		setStrider(fill.mTexCoords, &vertices[0].mTexCoord);
+		fill.mTextureMatrix = &tex_mat;
+		fill.mPlanarTexGen = TRUE;
+		fill.mTexGenScale.setVec(2.f, 2.f, 2.f);
+		fill.fill();
+		for (S32 i = 0; i < count; i++)
+		{
+			LLVector2 tc;
+			LLVector3 vec = face.mVertices[i].mPosition;
+			vec.scaleVec(fill.mTexGenScale);
+			LLVolumeFaceFill::planarProjection(tc, face.mVertices[i].mNormal, vec);
+			ensure("planar s", fabsf(vertices[i].mTexCoord.mV[VX] - tc.mV[VX] * 2.f) < 1.e-4f);
+			ensure("planar t", fabsf(vertices[i].mTexCoord.mV[VY] - tc.mV[VY] * 4.f) < 1.e-4f);
+		}
+	}
+
+	template<> template<>
+	void volumefacefill_object::test<3>()
+	{
+		// filling on the pool gives exactly the serial result
+		const S32 GROUPS = 40;
+		const S32 PRIMS = 12;
+		LLThreadPool pool("fill test", 3);
+		LLBatchThread thread("geometry", true, &pool);
+		std::vector<LLTestGroup> serial(GROUPS);
+		std::vector<LLTestGroup> parallel(GROUPS);
+		buildGroups(serial, PRIMS, NULL, 7);
+		buildGroups(parallel, PRIMS, &thread, 7);
+		ensure("parallel fill matches serial fill", equal(serial, parallel));
+		thread.shutdown();
+	}
+
+	struct volumefacefill_benchmark_data : public volumefacefill_data
+	{
+	};
+
+	typedef test_group<volumefacefill_benchmark_data> volumefacefill_benchmark_test;
+	typedef volumefacefill_benchmark_test::object volumefacefill_benchmark_object;
+	tut::volumefacefill_benchmark_test tvolumefacefill_benchmark("volumefacefill-benchmark");
+
+	template<> template<>
+	void volumefacefill_benchmark_object::test<1>()
+	{
+		// Benchmark rebuilding a frame's worth of dirty groups, as after
+		// moving through a busy sim, with and without the worker threads.
+		const S32 GROUPS = 100;
+		const S32 PRIMS = 16;
+		const S32 FRAMES = 10;
+		LLThreadPool pool("fill test", llmax(LLThreadPool::getProcessorCount() - 1, 1));
+		LLBatchThread thread("geometry", true, &pool);
+		std::vector<LLTestGroup> groups[2];
+		for (S32 parallel = 0; parallel < 2; parallel++)
+		{
+			groups[parallel].resize(GROUPS);
+			LLBatchThread* fill_thread = parallel ? &thread : NULL;
+			buildGroups(groups[parallel], PRIMS, fill_thread, 11);
+
+			S32 vertices = 0;
+			for (S32 i = 0; i < GROUPS; i++)
+			{
+				vertices += (S32)groups[parallel][i].mVertices.size();
+			}
+
+			F64 elapsed = 0.0;
+			for (S32 frame = 0; frame < FRAMES; frame++)
+			{
+				LLVolumeFaceFill::fill_list_t fills;
+				mSeed = 11;
+				for (S32 i = 0; i < GROUPS; i++)
+				{
+					prepareGroup(groups[parallel][i], PRIMS, fills);
+				}
+				LLTimer timer;
+				LLVolumeFaceFill::fillAll(fills, fill_thread);
+				elapsed += timer.getElapsedTimeF64();
+			}
+			llinfos << "Volume geometry rebuild " << (parallel ? "parallel" : "serial") << ": "
+					<< GROUPS << " groups, " << vertices << " vertices, "
+					<< elapsed * 1000.0 / FRAMES << " ms/frame with "
+					<< (parallel ? pool.getThreadCount() + 1 : 1) << " threads" << llendl;
+		}
+		ensure("parallel rebuild matches serial rebuild", equal(groups[0], groups[1]));
+		thread.shutdown();
+	}
+}
@@ -0,0 +1,351 @@
+/**
+ * @file llvolumemgr_tut.cpp
+ * @brief Tests for LLVolumeMgr sharing, caching and generating volumes
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "lltut.h"
+#include "llapr.h"
+#include "llmemory.h"
+#include "llthreadpool.h"
+#include "lltimer.h"
+#include "llvolume.h"
+#include "llvolumegeneratethread.h"
+#include "llvolumemgr.h"
+
+namespace tut
+{
+	struct volumemgr_data
+	{
+		volumemgr_data()
+		{
+			static bool init = false;
+			if(!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+		}
+
+		// A distinct hollow cylinder for each index.
+		LLVolumeParams getParams(S32 index)
+		{
+			LLVolumeParams params;
+			params.setType(LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_LINE);
+			params.setRatio(1.f, 1.f);
+			params.setHollow(0.05f + 0.9f * (F32)(index % 100) / 100.f);
+			params.setTwistEnd(0.5f * (F32)(index / 100) / 10.f);
+			return params;
+		}
+
+		void ensureVolumesMatch(const char* msg, const LLVolume* volume, const LLVolume* expected)
+		{
+			ensure_equals(msg, volume->getNumVolumeFaces(), expected->getNumVolumeFaces());
+			for (S32 f = 0; f < volume->getNumVolumeFaces(); f++)
+			{
+				const LLVolumeFace& face = volume->getVolumeFace(f);
+				const LLVolumeFace& expected_face = expected->getVolumeFace(f);
+				ensure_equals(msg, face.mVertices.size(), expected_face.mVertices.size());
+				ensure(msg, face.mIndices == expected_face.mIndices);
+				for (U32 v = 0; v < face.mVertices.size(); v++)
+				{
+					ensure(msg, face.mVertices[v].mPosition == expected_face.mVertices[v].mPosition);
+					ensure(msg, face.mVertices[v].mNormal == expected_face.mVertices[v].mNormal);
+					ensure(msg, face.mVertices[v].mTexCoord == expected_face.mVertices[v].mTexCoord);
+				}
+			}
+		}
+
+		// Refs the volume the manager has for params once requestVolume()
+		// says it is ready, updating as a frame would.
+		LLVolume* refWhenReady(LLVolumeMgr& mgr, const LLVolumeParams& params, S32 detail)
+		{
+			LLTimer timeout;
+			while (!mgr.requestVolume(params, detail) && timeout.getElapsedTimeF32() < 30.f)
+			{
+				ms_sleep(1);
+				mgr.update();
+			}
+			return mgr.refVolume(params, detail);
+		}
+	};
+	typedef test_group<volumemgr_data> volumemgr_test;
+	typedef volumemgr_test::object volumemgr_object;
+	tut::volumemgr_test tvolumemgr("volumemgr");
+
+	template<> template<>
+	void volumemgr_object::test<1>()
+	{
+		// volumes are shared, and without a cache dropped with their last ref
+		LLVolumeMgr mgr;
+		LLVolumeParams params = getParams(0);
+		LLPointer<LLVolume> first = mgr.refVolume(params, 2);
+		LLPointer<LLVolume> second = mgr.refVolume(params, 2);
+		ensure("shared", first == second);
+		ensure_equals("detail", first->getDetail(), LLVolumeLODGroup::getVolumeScaleFromDetail(2));
+		ensure_equals("shared hits", mgr.getStats().mSharedHits, 1);
+		ensure_equals("generated", mgr.getStats().mGenerated, 1);
+		ensure("bytes saved", mgr.getStats().mBytesSaved == first->getDataSize());
+
+		LLPointer<LLVolume> other = mgr.refVolume(params, 3);
+		ensure("other LOD", other != first);
+		mgr.unrefVolume(first);
+		mgr.unrefVolume(second);
+		ensure("LOD still referenced", mgr.getGroup(params)->hasLOD(3));
+		ensure("LOD dropped", !mgr.getGroup(params)->hasLOD(2));
+		mgr.unrefVolume(other);
+		ensure("group dropped", mgr.getGroup(params) == NULL);
+		ensure_equals("nothing cached", mgr.getStats().mCachedVolumes, 0);
+		ensure("cleanup", mgr.cleanup());
+	}
+
+	template<> template<>
+	void volumemgr_object::test<2>()
+	{
+		// released volumes are cached, least recently used first out
+		LLVolumeMgr mgr;
+		LLPointer<LLVolume> volume = mgr.refVolume(getParams(0), 3);
+		S32 size = volume->getDataSize();
+		mgr.unrefVolume(volume);
+		volume = NULL;
+		mgr.setCacheSize(size * 5 / 2);
+
+		for (S32 i = 0; i < 3; i++)
+		{
+			LLVolume* volumep = mgr.refVolume(getParams(i), 3);
+			mgr.unrefVolume(volumep);
+		}
+		ensure("first evicted", mgr.getGroup(getParams(0)) == NULL);
+		ensure("second cached", mgr.getGroup(getParams(1)) != NULL);
+		ensure("third cached", mgr.getGroup(getParams(2)) != NULL);
+		ensure_equals("cached", mgr.getStats().mCachedVolumes, 2);
+		ensure_equals("evicted", mgr.getStats().mEvictions, 1);
+		ensure("within budget", mgr.getStats().mCachedBytes <= mgr.getCacheSize());
+
+		LLVolume* cached = mgr.getGroup(getParams(1))->refLOD(3);
+		mgr.getGroup(getParams(1))->derefLOD(cached);
+		S32 generated = mgr.getStats().mGenerated;
+		S64 saved = mgr.getStats().mBytesSaved;
+		volume = mgr.refVolume(getParams(1), 3);
+		ensure("cache hit", volume == cached);
+		ensure_equals("cache hits", mgr.getStats().mCacheHits, 1);
+		ensure_equals("not generated", mgr.getStats().mGenerated, generated);
+		ensure("bytes saved", mgr.getStats().mBytesSaved == saved + volume->getDataSize());
+		ensure_equals("taken from the cache", mgr.getStats().mCachedVolumes, 1);
+
+		// the second is now the most recently used
+		mgr.unrefVolume(volume);
+		mgr.unrefVolume(mgr.refVolume(getParams(3), 3));
+		ensure("third evicted", mgr.getGroup(getParams(2)) == NULL);
+		ensure("second kept", mgr.getGroup(getParams(1)) != NULL);
+
+		mgr.setCacheSize(0);
+		ensure_equals("cache emptied", mgr.getStats().mCachedVolumes, 0);
+		ensure("groups dropped", mgr.getGroup(getParams(1)) == NULL && mgr.getGroup(getParams(3)) == NULL);
+		ensure("cleanup", mgr.cleanup());
+	}
+
+	template<> template<>
+	void volumemgr_object::test<3>()
+	{
+		// the generate thread makes the same volumes, threaded or not
+		LLThreadPool pool("volumemgr test pool", 3);
+		for (S32 threaded = 0; threaded < 2; threaded++)
+		{
+			LLVolumeGenerateThread thread(threaded != 0, threaded ? &pool : NULL);
+			LLVolumeMgr mgr;
+			mgr.useMutex();
+			mgr.setGenerateThread(&thread);
+
+			LLUUID sculpt_id;
+			sculpt_id.mData[0] = 1;
+			LLVolumeParams sculpt_params = getParams(0);
+			sculpt_params.setSculptID(sculpt_id, LL_SCULPT_TYPE_SPHERE);
+			ensure("sculpties are not requested", mgr.requestVolume(sculpt_params, 2));
+
+			const S32 COUNT = 8;
+			for (S32 i = 0; i < COUNT; i++)
+			{
+				ensure("not ready", !mgr.requestVolume(getParams(i), 2));
+			}
+			for (S32 i = 0; i < COUNT; i++)
+			{
+				LLPointer<LLVolume> volume = refWhenReady(mgr, getParams(i), 2);
+				LLPointer<LLVolume> expected = new LLVolume(getParams(i), LLVolumeLODGroup::getVolumeScaleFromDetail(2));
+				ensure_equals("detail", volume->getDetail(), expected->getDetail());
+				ensureVolumesMatch("generated", volume, expected);
+				mgr.unrefVolume(volume);
+			}
+			ensure_equals("generated", mgr.getStats().mGenerated, COUNT);
+			ensure_equals("no cache hits", mgr.getStats().mCacheHits, 0);
+			ensure("nothing cached", mgr.getGroup(getParams(0)) == NULL);
+
+			// generated ahead but never taken, then dropped
+			ensure("requested", !mgr.requestVolume(getParams(0), 1));
+			LLTimer timeout;
+			while (mgr.getStats().mCachedVolumes == 0 && timeout.getElapsedTimeF32() < 30.f)
+			{
+				ms_sleep(1);
+				mgr.update();
+			}
+			ensure_equals("kept for one update", mgr.getStats().mCachedVolumes, 1);
+			mgr.update();
+			ensure_equals("then dropped", mgr.getStats().mCachedVolumes, 0);
+			ensure("group dropped", mgr.getGroup(getParams(0)) == NULL);
+
+			// abandoned by refVolume() or cleanup() before it is generated
+			mgr.requestVolume(getParams(1), 1);
+			LLPointer<LLVolume> volume = mgr.refVolume(getParams(1), 1);
+			ensure_equals("generated anyway", volume->getDetail(), LLVolumeLODGroup::getVolumeScaleFromDetail(1));
+			mgr.unrefVolume(volume);
+			mgr.requestVolume(getParams(2), 1);
+			ensure("cleanup", mgr.cleanup());
+			timeout.reset();
+			while (thread.update(1) > 0 && timeout.getElapsedTimeF32() < 30.f)
+			{
+				ms_sleep(1); // the abandoned requests delete themselves
+			}
+			ensure_equals("requests deleted", thread.getPending(), 0);
+			thread.shutdown();
+		}
+	}
+
+	template<> template<>
+	void volumemgr_object::test<4>()
+	{
+		// volumes are collected and referenced while the pool is still
+		// generating others, and the requests keep no references to them
+		LLThreadPool pool("volumemgr test pool", 3);
+		LLVolumeGenerateThread thread(true, &pool);
+		LLVolumeMgr mgr;
+		mgr.useMutex();
+		mgr.setGenerateThread(&thread);
+
+		const S32 COUNT = 200;
+		std::vector<LLPointer<LLVolume> > volumes(COUNT);
+		S32 requested = 0;
+		S32 referenced = 0;
+		LLTimer timeout;
+		while (referenced < COUNT && timeout.getElapsedTimeF32() < 60.f)
+		{
+			// a few more each frame, so the pool is never idle
+			for (S32 i = 0; i < 4 && requested < COUNT; i++, requested++)
+			{
+				mgr.requestVolume(getParams(requested), 3);
+			}
+			mgr.update();
+			for (S32 i = 0; i < requested; i++)
+			{
+				if (volumes[i].isNull() && mgr.requestVolume(getParams(i), 3))
+				{
+					volumes[i] = mgr.refVolume(getParams(i), 3);
+					ensure_equals("held by the group and the test", volumes[i]->getNumRefs(), 2);
+					referenced++;
+				}
+			}
+		}
+		ensure_equals("all referenced", referenced, COUNT);
+		ensure_equals("all generated", mgr.getStats().mGenerated, COUNT);
+
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			mgr.unrefVolume(volumes[i]);
+			ensure_equals("held by the test alone", volumes[i]->getNumRefs(), 1);
+		}
+		ensure("cleanup", mgr.cleanup());
+		thread.shutdown();
+	}
+
+	struct volumemgr_benchmark_data : public volumemgr_data
+	{
+	};
+
+	typedef test_group<volumemgr_benchmark_data> volumemgr_benchmark_test;
+	typedef volumemgr_benchmark_test::object volumemgr_benchmark_object;
+	tut::volumemgr_benchmark_test tvolumemgr_benchmark("volumemgr-benchmark");
+
+	template<> template<>
+	void volumemgr_benchmark_object::test<1>()
+	{
+		// Benchmark prims switching LOD back and forth as the camera moves,
+		// with and without the cache.
+		const S32 PRIMS = 200;
+		const S32 FRAMES = 20;
+		for (S32 cache = 0; cache < 2; cache++)
+		{
+			LLVolumeMgr mgr;
+			mgr.setCacheSize(cache ? 64 * 1024 * 1024 : 0);
+			std::vector<LLPointer<LLVolume> > volumes(PRIMS);
+			for (S32 i = 0; i < PRIMS; i++)
+			{
+				volumes[i] = mgr.refVolume(getParams(i), 3);
+			}
+
+			LLTimer timer;
+			for (S32 frame = 0; frame < FRAMES; frame++)
+			{
+				S32 detail = (frame & 1) ? 3 : 2;
+				for (S32 i = 0; i < PRIMS; i++)
+				{
+					LLPointer<LLVolume> old_volume = volumes[i];
+					volumes[i] = mgr.refVolume(getParams(i), detail);
+					mgr.unrefVolume(old_volume);
+				}
+			}
+			F64 elapsed = timer.getElapsedTimeF64();
+
+			const LLVolumeMgr::Stats& stats = mgr.getStats();
+			ensure_equals("requests", stats.mRequests, PRIMS * (FRAMES + 1));
+			if (cache)
+			{
+				ensure_equals("generated each LOD once", stats.mGenerated, PRIMS * 2);
+			}
+			else
+			{
+				ensure_equals("generated every time", stats.mGenerated, stats.mRequests);
+			}
+
+			llinfos << "Volume LOD changes " << (cache ? "cached" : "uncached") << ": "
+					<< PRIMS << " prims, " << elapsed * 1000.0 / FRAMES << " ms/frame, hit rate "
+					<< stats.getHitRate() << ", " << stats.mBytesSaved / 1024 << " KB not generated again, "
+					<< stats.mCachedBytes / 1024 << " KB cached" << llendl;
+
+			for (S32 i = 0; i < PRIMS; i++)
+			{
+				mgr.unrefVolume(volumes[i]);
+			}
+			volumes.clear();
+			ensure("cleanup", mgr.cleanup());
+		}
+	}
+}
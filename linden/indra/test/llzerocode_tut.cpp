@@ -0,0 +1,239 @@
+/**
+ * @file llzerocode_tut.cpp
+ * @brief Tests for message system zero coding
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ *
+ * Copyright (c) 2009, Linden Research, Inc.
+ *
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ *
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ *
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ *
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include <vector>
+
+#include "linden_common.h"
+#include "lltut.h"
+#include "llzerocode.h"
+#include "lltimer.h"
+#include "net.h"
+
+namespace tut
+{
+	struct zerocode_data
+	{
+		zerocode_data() : mSeed(12345)
+		{
+		}
+
+		// Own generator so failures reproduce.
+		U32 random(U32 max)
+		{
+			mSeed = mSeed * 1103515245 + 12345;
+			return (mSeed >> 8) % max;
+		}
+
+		// Bytes where roughly zero_percent of them are zero, in runs.
+		void makeRandom(std::vector<U8>& data, S32 size, U32 zero_percent)
+		{
+			data.resize(size);
+			S32 i = 0;
+			while (i < size)
+			{
+				S32 run = 1 + random(random(8) ? 8 : 600);
+				U8 zero = random(100) < zero_percent;
+				for ( ; run > 0 && i < size; --run, ++i)
+				{
+					data[i] = zero ? 0 : (U8)(1 + random(255));
+				}
+			}
+		}
+
+		// A body laid out like ObjectUpdate: ids, float vectors, small
+		// integers and zero filled texture entries and extra params.
+		void makeObjectUpdate(std::vector<U8>& data)
+		{
+			data.clear();
+			S32 size = 200 + random(1000);
+			while ((S32)data.size() < size)
+			{
+				switch (random(4))
+				{
+				case 0:
+					for (S32 i = 0; i < 16; ++i)
+					{
+						data.push_back((U8)random(256));
+					}
+					break;
+				case 1:
+					for (S32 i = 0; i < 3; ++i)
+					{
+						F32 value = random(4) ? (F32)random(256) + 0.5f : 0.f;
+						U8 bytes[4];
+						memcpy(bytes, &value, 4);	/* Flawfinder: ignore */
+						data.insert(data.end(), bytes, bytes + 4);
+					}
+					break;
+				case 2:
+					data.push_back((U8)random(16));
+					data.push_back(0);
+					data.push_back(0);
+					data.push_back(0);
+					break;
+				default:
+					data.insert(data.end(), 4 + random(60), 0);
+					break;
+				}
+			}
+		}
+
+		U32 mSeed;
+	};
+	typedef test_group<zerocode_data> zerocode_test;
+	typedef zerocode_test::object zerocode_object;
+	tut::zerocode_test tzc("zerocode");
+
+	template<> template<>
+	void zerocode_object::test<1>()
+	{
+		// known encodings
+		const U8 in[] = { 1, 0, 0, 2, 0 };
+		const U8 expected[] = { 1, 0, 2, 2, 0, 1 };
+		U8 out[16];
+		ensure_equals("encoded size", zero_code_encode(in, sizeof(in), out), (S32)sizeof(expected));
+		ensure("encoded", !memcmp(out, expected, sizeof(expected)));
+
+		std::vector<U8> zeroes(511, 0);
+		std::vector<U8> coded(zero_code_max_encoded_size(zeroes.size()));
+		const U8 expected_run[] = { 0, 255, 0, 255, 0, 1 };
+		ensure_equals("run size", zero_code_encode(&zeroes[0], zeroes.size(), &coded[0]), (S32)sizeof(expected_run));
+		ensure("run", !memcmp(&coded[0], expected_run, sizeof(expected_run)));
+
+		// a 0 in the count position is 256 more zeroes
+		const U8 wrapped[] = { 7, 0, 0, 2, 7 };
+		std::vector<U8> expanded(512, 0xff);
+		ensure_equals("wrap size", zero_code_expand(wrapped, sizeof(wrapped), &expanded[0], expanded.size()), 1 + 1 + 256 + 1 + 1);
+		ensure_equals("wrap head", expanded[0], 7);
+		ensure_equals("wrap zero", expanded[200], 0);
+		ensure_equals("wrap tail", expanded[259], 7);
+
+		ensure_equals("overflow", zero_code_expand(wrapped, sizeof(wrapped), &expanded[0], 200), -1);
+		ensure_equals("empty", zero_code_encode(in, 0, out), 0);
+	}
+
+	template<> template<>
+	void zerocode_object::test<2>()
+	{
+		// fuzz the vectorized versions against the scalar ones
+		std::vector<U8> data;
+		std::vector<U8> coded;
+		std::vector<U8> coded_scalar;
+		std::vector<U8> expanded(NET_BUFFER_SIZE);
+		std::vector<U8> expanded_scalar(NET_BUFFER_SIZE);
+		for (S32 n = 0; n < 20000; ++n)
+		{
+			makeRandom(data, random(2000), random(101));
+			S32 size = data.size();
+			coded.resize(zero_code_max_encoded_size(size) + 1);
+			coded_scalar.resize(coded.size());
+			U8* datap = size ? &data[0] : NULL;
+
+			S32 coded_size = zero_code_encode(datap, size, &coded[0]);
+			S32 coded_size_scalar = zero_code_encode_scalar(datap, size, &coded_scalar[0]);
+			ensure_equals("encode size", coded_size, coded_size_scalar);
+			ensure("encode", !memcmp(&coded[0], &coded_scalar[0], coded_size));
+			ensure("encode bound", coded_size <= zero_code_max_encoded_size(size));
+
+			S32 expanded_size = zero_code_expand(&coded[0], coded_size, &expanded[0], expanded.size());
+			ensure_equals("round trip size", expanded_size, size);
+			ensure("round trip", !memcmp(&expanded[0], datap, size));
+
+			// arbitrary input, including wraps and short output buffers
+			S32 out_size = random(4) ? expanded.size() : random(expanded.size());
+			expanded_size = zero_code_expand(datap, size, &expanded[0], out_size);
+			S32 expanded_size_scalar = zero_code_expand_scalar(datap, size, &expanded_scalar[0], out_size);
+			ensure_equals("expand size", expanded_size, expanded_size_scalar);
+			if (expanded_size > 0)
+			{
+				ensure("expand", !memcmp(&expanded[0], &expanded_scalar[0], expanded_size));
+			}
+		}
+	}
+
+	struct zerocode_benchmark_data : public zerocode_data
+	{
+	};
+
+	typedef test_group<zerocode_benchmark_data> zerocode_benchmark_test;
+	typedef zerocode_benchmark_test::object zerocode_benchmark_object;
+	tut::zerocode_benchmark_test tzc_benchmark("zerocode-benchmark");
+
+	template<> template<>
+	void zerocode_benchmark_object::test<1>()
+	{
+		// throughput on ObjectUpdate shaped packets
+		const S32 PACKETS = 256;
+		std::vector< std::vector<U8> > packets(PACKETS);
+		std::vector< std::vector<U8> > coded(PACKETS);
+		S32 total = 0;
+		S32 coded_total = 0;
+		for (S32 i = 0; i < PACKETS; ++i)
+		{
+			makeObjectUpdate(packets[i]);
+			coded[i].resize(zero_code_max_encoded_size(packets[i].size()));
+			coded[i].resize(zero_code_encode_scalar(&packets[i][0], packets[i].size(), &coded[i][0]));
+			total += packets[i].size();
+			coded_total += coded[i].size();
+		}
+
+		U8 out[NET_BUFFER_SIZE * 2];
+		const S32 ITERATIONS = 200;
+		F64 elapsed[4];
+		for (S32 pass = 0; pass < 4; ++pass)
+		{
+			S32 check = 0;
+			LLTimer timer;
+			for (S32 n = 0; n < ITERATIONS; ++n)
+			{
+				for (S32 i = 0; i < PACKETS; ++i)
+				{
+					switch (pass)
+					{
+					case 0: check += zero_code_encode_scalar(&packets[i][0], packets[i].size(), out); break;
+					case 1: check += zero_code_encode(&packets[i][0], packets[i].size(), out); break;
+					case 2: check += zero_code_expand_scalar(&coded[i][0], coded[i].size(), out, sizeof(out)); break;
+					default: check += zero_code_expand(&coded[i][0], coded[i].size(), out, sizeof(out)); break;
+					}
+				}
+			}
+			elapsed[pass] = timer.getElapsedTimeF64();
+			ensure_equals("bytes", check, ITERATIONS * (pass < 2 ? coded_total : total));
+		}
+
+		// rates are in terms of the uncompressed bytes
+		F64 bytes = (F64)ITERATIONS * total / (1024.0 * 1024.0 * 1024.0);
+		llinfos << "Zero coding " << PACKETS << " packets, " << total << " bytes, " << coded_total << " coded" << llendl;
+		llinfos << "Zero code encode: scalar " << bytes / elapsed[0] << " GB/s, vectorized " << bytes / elapsed[1] << " GB/s" << llendl;
+		llinfos << "Zero code expand: scalar " << bytes / elapsed[2] << " GB/s, vectorized " << bytes / elapsed[3] << " GB/s" << llendl;
+	}
+}
@@ -43,6 +43,7 @@
 #include "linden_common.h"
 #include "llerrorcontrol.h"
 #include "lltut.h"
+#include "test.h"
 
 #include "apr_pools.h"
 #include "apr_getopt.h"
@@ -57,10 +58,18 @@
 namespace tut
 {
 	std::string sSourceDir;
+	const char* const BENCHMARK_GROUP_SUFFIX = "-benchmark";
 
     test_runner_singleton runner;
 }
 
+static bool is_benchmark_group(const std::string& name)
+{
+	const std::string suffix(tut::BENCHMARK_GROUP_SUFFIX);
+	return name.size() > suffix.size()
+		&& 0 == name.compare(name.size() - suffix.size(), suffix.size(), suffix);
+}
+
 class LLTestCallback : public tut::callback
 {
 public:
@@ -130,6 +139,11 @@ public:
 	}
 
 	void run_completed()
+	{
+		// main() reports once every group it runs is done.
+	}
+
+	void report()
 	{
 		if (mStream)
 		{
@@ -184,6 +198,7 @@ static const apr_getopt_option_t TEST_CL_OPTIONS[] =
 	{"list", 'l', 0, "List available test groups."},
 	{"verbose", 'v', 0, "Verbose output."},
 	{"group", 'g', 1, "Run test group specified by option argument."},
+	{"benchmark", 'b', 0, "Also run the *-benchmark test groups."},
 	{"output", 'o', 1, "Write output to the named file."},
 	{"sourcedir", 's', 1, "Project source file directory from CMake."},
 	{"touch", 't', 1, "Touch the given file if all tests succeed"},
@@ -217,6 +232,8 @@ void stream_usage(std::ostream& s, const char* app)
 	s << "\tList all available test groups." << std::endl;
 	s << "  " << app << " --group=uuid" << std::endl;
 	s << "\tRun the test group 'uuid'." << std::endl;
+	s << "  " << app << " --benchmark" << std::endl;
+	s << "\tRun all the tests, including the timing benchmarks." << std::endl;
 }
 
 void stream_groups(std::ostream& s, const char* app)
@@ -265,6 +282,7 @@ int main(int argc, char **argv)
 	// values used for controlling application
 	bool verbose_mode = false;
 	bool wait_at_exit = false;
+	bool run_benchmarks = false;
 	std::string test_group;
 
 	// values use for options parsing
@@ -290,6 +308,9 @@ int main(int argc, char **argv)
 		case 'g':
 			test_group.assign(opt_arg);
 			break;
+		case 'b':
+			run_benchmarks = true;
+			break;
 		case 'h':
 			stream_usage(std::cout, argv[0]);
 			return 0;
@@ -333,12 +354,22 @@ int main(int argc, char **argv)
 	
 	if(test_group.empty())
 	{
-		tut::runner.get().run_tests();
+		tut::groupnames gl = tut::runner.get().list_groups();
+		tut::groupnames::const_iterator it = gl.begin();
+		tut::groupnames::const_iterator end = gl.end();
+		for(; it != end; ++it)
+		{
+			if(run_benchmarks || !is_benchmark_group(*it))
+			{
+				tut::runner.get().run_tests(*it);
+			}
+		}
 	}
 	else
 	{
 		tut::runner.get().run_tests(test_group);
 	}
+	callback.report();
 
 	if (wait_at_exit)
 	{
@@ -45,6 +45,11 @@ namespace tut
 	// Use sparingly, as hitting the file system slows down test execution
 	// and hence every compile. JC
 	extern std::string sSourceDir;
+
+	// Timing tests go in test groups whose names end in this suffix.
+	// They only run with --benchmark, or when named with --group, so
+	// every build just runs the behaviour tests.
+	extern const char* const BENCHMARK_GROUP_SUFFIX;
 }
 
 #endif